@@ -0,0 +1,54 @@
+/**
+ * @file backoff_dither.c
+ * @brief Implementation of the per-device connection dither.
+ */
+
+#include "backoff_dither.h"
+
+/* Standard includes. */
+#include <stddef.h>
+
+/**
+ * @brief Fraction (as a divisor) of the window used for the random component.
+ */
+#define backoffditherRANDOM_FRACTION    ( 8U )
+
+/*-----------------------------------------------------------*/
+
+/**
+ * @brief 32 bit FNV-1a hash of a null terminated string.
+ */
+static uint32_t prvHashDeviceId( const char * pcDeviceId )
+{
+    uint32_t ulHash = 2166136261U;
+
+    while( ( pcDeviceId != NULL ) && ( *pcDeviceId != '\0' ) )
+    {
+        ulHash ^= ( uint8_t ) *pcDeviceId++;
+        ulHash *= 16777619U;
+    }
+
+    return ulHash;
+}
+/*-----------------------------------------------------------*/
+
+uint32_t BackoffDither_GetStartupDelay( const char * pcDeviceId,
+                                        uint32_t ulWindowMs,
+                                        uint32_t ulRandomValue )
+{
+    uint32_t ulSlot;
+    uint32_t ulJitter;
+    uint32_t ulJitterMax;
+
+    if( ulWindowMs == 0U )
+    {
+        return 0U;
+    }
+
+    ulSlot = prvHashDeviceId( pcDeviceId ) % ulWindowMs;
+    ulJitterMax = ulWindowMs / backoffditherRANDOM_FRACTION;
+    ulJitter = ( ulJitterMax > 0U ) ? ( ulRandomValue % ulJitterMax ) : 0U;
+
+    return ( ulSlot + ulJitter ) % ulWindowMs;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,39 @@
+/**
+ * @file backoff_dither.h
+ * @brief Per-device connection dither, used to spread a fleet of devices that
+ * lose their network at the same time (e.g. an access point reboot) over a
+ * window instead of reconnecting in lockstep.
+ */
+
+#ifndef BACKOFF_DITHER_H_
+#define BACKOFF_DITHER_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Standard include. */
+#include <stdint.h>
+
+/**
+ * @brief Compute the delay to wait before the first connection attempt.
+ *
+ * The delay is made of a deterministic slot, derived from a hash of the device
+ * ID so devices are spread evenly over @p ulWindowMs even when their random
+ * number generators are not yet well seeded, plus a small random component so
+ * that two devices whose IDs hash to the same slot do not collide.
+ *
+ * @param[in] pcDeviceId Null terminated device ID.
+ * @param[in] ulWindowMs Width of the window (in milliseconds) to spread over.
+ * @param[in] ulRandomValue A random value, e.g. from configRAND32().
+ *
+ * @return The dither in milliseconds, in the range [0, ulWindowMs).
+ */
+uint32_t BackoffDither_GetStartupDelay( const char * pcDeviceId,
+                                        uint32_t ulWindowMs,
+                                        uint32_t ulRandomValue );
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* ifndef BACKOFF_DITHER_H_ */
@@ -0,0 +1,216 @@
+/**
+ * @file dns_cache.c
+ * @brief Resolver cache with TTL and last known good fallback.
+ */
+
+#include "dns_cache.h"
+
+/* Standard includes. */
+#include <stdbool.h>
+#include <string.h>
+
+/* Lwip includes. */
+#include "lwip/netdb.h"
+
+/* FreeRTOS includes. */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_log.h"
+
+static const char * TAG = "dns_cache";
+
+typedef struct DnsCacheEntry
+{
+    char cHostName[ dnscacheMAX_HOST_NAME_LENGTH + 1 ];
+    int lFamily;
+    DnsCacheAddress_t xAddress;
+    TickType_t xResolvedAt;
+    TickType_t xLastUsed;
+    bool xValid;
+    bool xStale;
+} DnsCacheEntry_t;
+
+static DnsCacheEntry_t xEntries[ dnscacheMAX_ENTRIES ];
+
+/* Only guards the table; DNS queries run outside of it so a slow resolution
+ * never blocks another task. */
+static portMUX_TYPE xEntriesLock = portMUX_INITIALIZER_UNLOCKED;
+
+/*-----------------------------------------------------------*/
+
+static DnsCacheEntry_t * prvFindEntry( const char * pcHostName,
+                                       int lFamily )
+{
+    for( int i = 0; i < dnscacheMAX_ENTRIES; i++ )
+    {
+        if( xEntries[ i ].xValid &&
+            ( xEntries[ i ].lFamily == lFamily ) &&
+            ( strcmp( xEntries[ i ].cHostName, pcHostName ) == 0 ) )
+        {
+            return &xEntries[ i ];
+        }
+    }
+
+    return NULL;
+}
+/*-----------------------------------------------------------*/
+
+static DnsCacheEntry_t * prvFindSlot( void )
+{
+    DnsCacheEntry_t * pxOldest = &xEntries[ 0 ];
+
+    for( int i = 0; i < dnscacheMAX_ENTRIES; i++ )
+    {
+        if( !xEntries[ i ].xValid )
+        {
+            return &xEntries[ i ];
+        }
+
+        if( ( TickType_t ) ( xEntries[ i ].xLastUsed - pxOldest->xLastUsed ) > ( portMAX_DELAY / 2 ) )
+        {
+            pxOldest = &xEntries[ i ];
+        }
+    }
+
+    return pxOldest;
+}
+/*-----------------------------------------------------------*/
+
+static bool prvQueryDns( const char * pcHostName,
+                         int lFamily,
+                         DnsCacheAddress_t * pxAddress )
+{
+    struct addrinfo xHints = { 0 };
+    struct addrinfo * pxResult = NULL;
+    const void * pvRawAddress;
+    int lError;
+
+    xHints.ai_family = lFamily;
+    xHints.ai_socktype = SOCK_STREAM;
+
+    /* getaddrinfo is reentrant in lwip: every caller gets its own request
+     * and result, no task handle is shared between resolutions. */
+    lError = getaddrinfo( pcHostName, NULL, &xHints, &pxResult );
+
+    if( ( lError != 0 ) || ( pxResult == NULL ) )
+    {
+        ESP_LOGW( TAG, "Unable to resolve %s (%d)", pcHostName, lError );
+        return false;
+    }
+
+    memset( pxAddress, 0, sizeof( *pxAddress ) );
+    memcpy( &pxAddress->xAddress, pxResult->ai_addr, pxResult->ai_addrlen );
+    pxAddress->xAddressLength = pxResult->ai_addrlen;
+
+    if( pxResult->ai_family == AF_INET6 )
+    {
+        pvRawAddress = &( ( struct sockaddr_in6 * ) pxResult->ai_addr )->sin6_addr;
+    }
+    else
+    {
+        pvRawAddress = &( ( struct sockaddr_in * ) pxResult->ai_addr )->sin_addr;
+    }
+
+    inet_ntop( pxResult->ai_family, pvRawAddress, pxAddress->cAddress, sizeof( pxAddress->cAddress ) );
+    freeaddrinfo( pxResult );
+
+    return true;
+}
+/*-----------------------------------------------------------*/
+
+DnsCacheStatus_t DnsCache_Resolve( const char * pcHostName,
+                                   int lFamily,
+                                   DnsCacheAddress_t * pxAddress )
+{
+    DnsCacheEntry_t * pxEntry;
+    DnsCacheAddress_t xResolved;
+    TickType_t xNow = xTaskGetTickCount();
+    DnsCacheStatus_t xStatus = eDnsCacheFailure;
+
+    if( ( pcHostName == NULL ) || ( pxAddress == NULL ) ||
+        ( strlen( pcHostName ) > dnscacheMAX_HOST_NAME_LENGTH ) )
+    {
+        ESP_LOGE( TAG, "Invalid host name" );
+        return eDnsCacheFailure;
+    }
+
+    portENTER_CRITICAL( &xEntriesLock );
+    pxEntry = prvFindEntry( pcHostName, lFamily );
+
+    if( ( pxEntry != NULL ) && !pxEntry->xStale &&
+        ( ( xNow - pxEntry->xResolvedAt ) < pdMS_TO_TICKS( dnscacheTTL_MS ) ) )
+    {
+        *pxAddress = pxEntry->xAddress;
+        pxEntry->xLastUsed = xNow;
+        xStatus = eDnsCacheHit;
+    }
+
+    portEXIT_CRITICAL( &xEntriesLock );
+
+    if( xStatus == eDnsCacheHit )
+    {
+        return xStatus;
+    }
+
+    if( prvQueryDns( pcHostName, lFamily, &xResolved ) )
+    {
+        portENTER_CRITICAL( &xEntriesLock );
+        pxEntry = prvFindEntry( pcHostName, lFamily );
+
+        if( pxEntry == NULL )
+        {
+            pxEntry = prvFindSlot();
+            strcpy( pxEntry->cHostName, pcHostName );
+            pxEntry->lFamily = lFamily;
+            pxEntry->xValid = true;
+        }
+
+        pxEntry->xAddress = xResolved;
+        pxEntry->xResolvedAt = xNow;
+        pxEntry->xLastUsed = xNow;
+        pxEntry->xStale = false;
+        portEXIT_CRITICAL( &xEntriesLock );
+
+        *pxAddress = xResolved;
+        ESP_LOGI( TAG, "Resolved %s to %s", pcHostName, pxAddress->cAddress );
+        return eDnsCacheResolved;
+    }
+
+    portENTER_CRITICAL( &xEntriesLock );
+    pxEntry = prvFindEntry( pcHostName, lFamily );
+
+    if( pxEntry != NULL )
+    {
+        *pxAddress = pxEntry->xAddress;
+        pxEntry->xLastUsed = xNow;
+        xStatus = eDnsCacheStale;
+    }
+
+    portEXIT_CRITICAL( &xEntriesLock );
+
+    if( xStatus == eDnsCacheStale )
+    {
+        ESP_LOGW( TAG, "DNS unreachable, using last known address %s for %s",
+                  pxAddress->cAddress, pcHostName );
+    }
+
+    return xStatus;
+}
+/*-----------------------------------------------------------*/
+
+void DnsCache_MarkStale( const char * pcHostName )
+{
+    portENTER_CRITICAL( &xEntriesLock );
+
+    for( int i = 0; i < dnscacheMAX_ENTRIES; i++ )
+    {
+        if( xEntries[ i ].xValid && ( strcmp( xEntries[ i ].cHostName, pcHostName ) == 0 ) )
+        {
+            xEntries[ i ].xStale = true;
+        }
+    }
+
+    portEXIT_CRITICAL( &xEntriesLock );
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,85 @@
+/**
+ * @file dns_cache.h
+ * @brief Small resolver cache for the IoT Hub host name.
+ *
+ * Resolutions are kept for dnscacheTTL_MS so a reconnect does not pay for a
+ * DNS round trip, and the last known good address is kept after it expires so
+ * the device can still reach the hub while the local DNS server is down.
+ * All functions are safe to call from several tasks at the same time.
+ */
+
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "lwip/sockets.h"
+
+/**
+ * @brief Time (in milliseconds) a resolved address is used without asking DNS again.
+ */
+#ifndef dnscacheTTL_MS
+    #define dnscacheTTL_MS             ( 10 * 60 * 1000U )
+#endif
+
+/**
+ * @brief Number of host names kept in the cache.
+ */
+#ifndef dnscacheMAX_ENTRIES
+    #define dnscacheMAX_ENTRIES        ( 4 )
+#endif
+
+/**
+ * @brief Longest host name that can be cached.
+ */
+#ifndef dnscacheMAX_HOST_NAME_LENGTH
+    #define dnscacheMAX_HOST_NAME_LENGTH    ( 128 )
+#endif
+
+typedef enum DnsCacheStatus
+{
+    eDnsCacheHit = 0,     /**< Fresh entry found in the cache. */
+    eDnsCacheResolved,    /**< Resolved by DNS and stored in the cache. */
+    eDnsCacheStale,       /**< DNS failed, the last known good address was returned. */
+    eDnsCacheFailure      /**< DNS failed and nothing was cached for the host. */
+} DnsCacheStatus_t;
+
+typedef struct DnsCacheAddress
+{
+    struct sockaddr_storage xAddress;  /**< Resolved address, port left as 0. */
+    socklen_t xAddressLength;          /**< Length of xAddress for the family. */
+    char cAddress[ INET6_ADDRSTRLEN ]; /**< Numeric string form of xAddress. */
+} DnsCacheAddress_t;
+
+/**
+ * @brief Resolve a host name, using the cache when possible.
+ *
+ * @param[in] pcHostName Null terminated host name.
+ * @param[in] lFamily AF_INET, AF_INET6 or AF_UNSPEC for either.
+ * @param[out] pxAddress Resolved address.
+ *
+ * @return eDnsCacheHit, eDnsCacheResolved or eDnsCacheStale when @p pxAddress
+ * was filled, eDnsCacheFailure otherwise.
+ */
+DnsCacheStatus_t DnsCache_Resolve( const char * pcHostName,
+                                   int lFamily,
+                                   DnsCacheAddress_t * pxAddress );
+
+/**
+ * @brief Mark the cached address of a host as stale after a failed connection.
+ *
+ * The next DnsCache_Resolve() asks DNS again, but still falls back to the
+ * stale address if DNS does not answer.
+ *
+ * @param[in] pcHostName Null terminated host name.
+ */
+void DnsCache_MarkStale( const char * pcHostName );
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* DNS_CACHE_H */
@@ -7,6 +7,7 @@
  */
 
 #include "sockets_wrapper.h"
+#include "dns_cache.h"
 
 /* Standard includes. */
 #include <stdbool.h>
@@ -14,8 +15,6 @@
 
 /* Lwip includes. */
 #include "lwip/sockets.h"
-#include "lwip/netdb.h"
-#include "lwip/dns.h"
 #include "lwip/err.h"
 #include "lwip/ip.h"
 
@@ -24,13 +23,6 @@
 #include "task.h"
 /*-----------------------------------------------------------*/
 
-/*
- * DNS timeouts.
- */
-#ifndef lwipdnsresolverMAX_WAIT_SECONDS
-    #define lwipdnsresolverMAX_WAIT_SECONDS    ( 20 )
-#endif
-
 /*
  * convert from system ticks to seconds.
  */
@@ -42,92 +34,19 @@
 #define TICK_TO_US( _t_ )    ( ( _t_ ) * 1000 / configTICK_RATE_HZ * 1000 )
 /*-----------------------------------------------------------*/
 
-/*
- * Task handle to use for DNS resolution.
- */
-static TaskHandle_t xDNSResolutionTaskHandle = NULL;
-
-/*-----------------------------------------------------------*/
-
-/*
- * Lwip DNS Found callback, compatible with type "dns_found_callback"
- * declared in lwip/dns.h.
- *
- * NOTE: this resolves only ipv4 addresses; calls to dns_gethostbyname_addrtype()
- * must specify dns_addrtype == LWIP_DNS_ADDRTYPE_IPV4.
- */
-static void lwip_dns_found_callback( const char * ucName,
-                                     const ip_addr_t * xIPAddr,
-                                     void * pvCallbackArg )
-{
-    if( xDNSResolutionTaskHandle != NULL )
-    {
-        uint32_t * ulAddr = ( uint32_t * ) pvCallbackArg;
-
-        if( xIPAddr != NULL )
-        {
-            *ulAddr = *( ( uint32_t * ) xIPAddr ); /* NOTE: IPv4 addresses only */
-        }
-        else
-        {
-            *ulAddr = 0;
-        }
-
-        xTaskNotifyGive( xDNSResolutionTaskHandle );
-    }
-}
-/*-----------------------------------------------------------*/
-
 uint32_t prvGetHostByName( const char * pcHostName )
 {
     uint32_t ulAddr = 0;
-    err_t xLwipError = ERR_OK;
-    ip_addr_t xLwipIpv4Address;
-    uint32_t ulDNSNotificationValue = 0;
-
-    xDNSResolutionTaskHandle = xTaskGetCurrentTaskHandle();
+    DnsCacheAddress_t xAddress;
 
-    if( strlen( pcHostName ) <= ( size_t ) SOCKETS_MAX_HOST_NAME_LENGTH )
+    /* Sockets_Open() creates IPv4 sockets, so only ask for IPv4 addresses. */
+    if( DnsCache_Resolve( pcHostName, AF_INET, &xAddress ) != eDnsCacheFailure )
     {
-        xLwipError = dns_gethostbyname_addrtype( pcHostName, &xLwipIpv4Address,
-                                                 lwip_dns_found_callback, ( void * ) &ulAddr,
-                                                 LWIP_DNS_ADDRTYPE_IPV4 );
-
-        switch( xLwipError )
-        {
-            case ERR_OK:
-                ulAddr = *( ( uint32_t * ) &xLwipIpv4Address ); /* NOTE: IPv4 addresses only */
-                break;
-
-            case ERR_INPROGRESS:
-
-                /*
-                 * The DNS resolver is working the request.  Wait for it to complete
-                 * or time out; print a timeout error message if configured for debug
-                 * printing.
-                 */
-                ulDNSNotificationValue = ulTaskNotifyTake( pdTRUE, ( lwipdnsresolverMAX_WAIT_SECONDS * 1000 ) / portTICK_PERIOD_MS );
-                xDNSResolutionTaskHandle = NULL;
-
-                if( ( ulDNSNotificationValue != 1 ) || ( ulAddr == 0 ) )
-                {
-                    /* DNS resolution timed out */
-                    configPRINTF( ( "Unable to resolve (%s) within (%lu) seconds",
-                                    pcHostName, lwipdnsresolverMAX_WAIT_SECONDS ) );
-                }
-
-                break;
-
-            default:
-                configPRINTF( ( "Unexpected error (%lu) from dns_gethostbyname_addrtype() while resolving (%s)!",
-                                ( uint32_t ) xLwipError, pcHostName ) );
-                break;
-        }
+        ulAddr = ( ( struct sockaddr_in * ) &xAddress.xAddress )->sin_addr.s_addr;
     }
     else
     {
-        ulAddr = 0;
-        configPRINTF( ( "Host name (%s) too long!", pcHostName ) );
+        configPRINTF( ( "Unable to resolve (%s)", pcHostName ) );
     }
 
     return ulAddr;
@@ -191,6 +110,8 @@ BaseType_t Sockets_Connect( SocketHandle xSocket,
 
         if( lwip_connect( ulSocketNumber, ( struct sockaddr * ) &xSockAddr, sizeof( xSockAddr ) ) < 0 )
         {
+            /* The host may have moved: ask DNS again on the next attempt. */
+            DnsCache_MarkStale( pcHostName );
             lRetVal = SOCKETS_SOCKET_ERROR;
         }
     }
@@ -41,6 +41,9 @@
 
 #include "demo_config.h"
 
+/* Resolver cache include. */
+#include "dns_cache.h"
+
 static const char *TAG = "tls_freertos";
 
 /**
@@ -74,6 +77,7 @@ TlsTransportStatus_t TLS_Socket_Connect( NetworkContext_t * pNetworkContext,
                                          uint32_t ulSendTimeoutMs )
 {
     TlsTransportStatus_t xReturnStatus = eTLSTransportSuccess;
+    DnsCacheAddress_t xAddress;
 
     TlsTransportParams_t * pxTlsParams = (TlsTransportParams_t*)pNetworkContext->pParams;
 
@@ -118,14 +122,23 @@ TlsTransportStatus_t TLS_Socket_Connect( NetworkContext_t * pNetworkContext,
         esp_transport_ssl_set_client_key_data_der( pxEspTlsTransport->xTransport, (const char *) pNetworkCredentials->pucPrivateKey, pNetworkCredentials->xPrivateKeySize );
     }
 
-    if ( esp_transport_connect( pxEspTlsTransport->xTransport, pHostName, usPort, ulReceiveTimeoutMs ) < 0 )
+    /* Resolve through the cache and connect to the numeric address; the host
+     * name is still used for SNI and for the server certificate check. */
+    if ( DnsCache_Resolve( pHostName, AF_UNSPEC, &xAddress ) == eDnsCacheFailure )
     {
-        ESP_LOGE( TAG, "Failed establishing TLS connection (esp_transport_connect failed)" );
+        ESP_LOGE( TAG, "Failed establishing TLS connection (unable to resolve %s)", pHostName );
         xReturnStatus = eTLSTransportConnectFailure;
     }
     else
     {
-        xReturnStatus = eTLSTransportSuccess;
+        esp_transport_ssl_set_common_name( pxEspTlsTransport->xTransport, pHostName );
+
+        if ( esp_transport_connect( pxEspTlsTransport->xTransport, xAddress.cAddress, usPort, ulReceiveTimeoutMs ) < 0 )
+        {
+            ESP_LOGE( TAG, "Failed establishing TLS connection (esp_transport_connect failed)" );
+            DnsCache_MarkStale( pHostName );
+            xReturnStatus = eTLSTransportConnectFailure;
+        }
     }
 
     /* Clean up on failure. */
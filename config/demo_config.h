@@ -6,6 +6,8 @@
 
 #include <stdlib.h>
 
+#include "esp_random.h"
+
 /*
  * This Model ID is tightly tied to the code implementation in `sample_azure_iot_pnp_simulated_device.c`
  * If you intend to test a different Model ID, please provide the implementation of the model on your application.
@@ -151,7 +153,11 @@
 
 /**
  * @brief Defines configRAND32, used by the common sample modules.
+ *
+ * Uses the hardware RNG, which is fed by RF noise once Wi-Fi or BLE is
+ * running. A full 32 bit value is required: the backoff algorithm takes it
+ * modulo the jitter window.
  */
-#define configRAND32()    ( rand() / RAND_MAX )
+#define configRAND32()    esp_random()
 
 #endif /* DEMO_CONFIG_H */
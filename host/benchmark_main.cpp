@@ -0,0 +1,11 @@
+/*
+ * Host build of the DSP benchmark, prints the same table as the firmware
+ * built with RUN_DSP_BENCHMARK, in nanoseconds instead of CPU cycles.
+ */
+
+#include "dsp_benchmark.h"
+
+int main()
+{
+    return run_dsp_benchmark() == ESP_OK ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+/*
+ * Runs the fault classifier of main/fault_classifier.cpp over the feature
+ * vectors of a golden CSV, as tools/fault_model/fault_model.py writes it:
+ * the features, the int8 logits and the probabilities of each vector, and
+ * reports the latency per inference.
+ *
+ *   classifier_check tools/fault_model/demo_model.bin tools/fault_model/demo_golden.csv
+ *
+ * Exits with 1 if the model does not load, if a logit differs from the golden
+ * one or a probability by more than PROBABILITY_TOLERANCE, so it can gate CI.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "esp_timer.h"
+
+#include "fault_classifier.h"
+
+/* The golden probabilities are computed in double */
+#define PROBABILITY_TOLERANCE 1e-5f
+#define LINE_LENGTH 4096
+
+static bool read_file(const char *path, std::vector<uint8_t> *data)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        return false;
+    }
+    uint8_t buffer[4096];
+    size_t read;
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        data->insert(data->end(), buffer, buffer + read);
+    }
+    fclose(file);
+    return true;
+}
+
+/* Comma separated values of a golden line, false if there are not @p count of them */
+static bool parse_line(char *line, float *values, int count)
+{
+    char *text = line;
+
+    for (int i = 0; i < count; i++)
+    {
+        char *end;
+        values[i] = strtof(text, &end);
+        if (end == text || (*end != ',' && i < count - 1))
+        {
+            return false;
+        }
+        text = end + 1;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    static FaultClassifier classifier;
+    std::vector<uint8_t> model;
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s MODEL.bin GOLDEN.csv\n", argv[0]);
+        return 2;
+    }
+    if (!read_file(argv[1], &model) || !classifier.load(model.data(), model.size()))
+    {
+        printf("%s is not a valid fault model\n", argv[1]);
+        return 1;
+    }
+    FILE *golden = fopen(argv[2], "r");
+    if (golden == NULL)
+    {
+        printf("cannot open %s\n", argv[2]);
+        return 1;
+    }
+
+    const int inputs = classifier.inputs();
+    const int classes = classifier.classes();
+    printf("model %u, %d inputs, %d classes:", (unsigned)classifier.modelId(), inputs, classes);
+    for (int c = 0; c < classes; c++)
+    {
+        printf(" %s", classifier.label(c));
+    }
+    printf("\n");
+
+    std::vector<float> values(inputs + 2 * classes);
+    float probabilities[FAULT_CLASSES_MAX];
+    int8_t logits[FAULT_CLASSES_MAX];
+    char line[LINE_LENGTH];
+    int vectors = 0;
+    int failures = 0;
+    int64_t elapsedUs = 0;
+
+    while (fgets(line, sizeof(line), golden) != NULL)
+    {
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+        if (!parse_line(line, values.data(), values.size()))
+        {
+            printf("line %d: expected %d values\n", vectors + 1, (int)values.size());
+            failures++;
+            break;
+        }
+
+        const int64_t startedAt = esp_timer_get_time();
+        classifier.classify(values.data(), probabilities, logits);
+        elapsedUs += esp_timer_get_time() - startedAt;
+
+        const float *expectedLogits = &values[inputs];
+        const float *expectedProbabilities = &values[inputs + classes];
+        for (int c = 0; c < classes; c++)
+        {
+            if (logits[c] != (int)expectedLogits[c] ||
+                fabsf(probabilities[c] - expectedProbabilities[c]) > PROBABILITY_TOLERANCE)
+            {
+                printf("vector %d class %s: logit %d probability %.7f, expected %d and %.7f\n", vectors,
+                       classifier.label(c), logits[c], probabilities[c], (int)expectedLogits[c],
+                       expectedProbabilities[c]);
+                failures++;
+            }
+        }
+        vectors++;
+    }
+    fclose(golden);
+
+    printf("%d vectors, %d mismatches, %.2f us per inference\n", vectors, failures,
+           vectors > 0 ? (double)elapsedUs / vectors : 0.0);
+    return failures == 0 && vectors > 0 ? 0 : 1;
+}
@@ -0,0 +1,1269 @@
+/*
+ * Runs the acquisition and FFT pipeline of main/QMI8658_setup.cpp on the host,
+ * fed by SimulatedImu, and prints the strongest peaks of each spectrum frame.
+ *
+ * Exits with 1 when a frame fails a check, so it can gate CI:
+ *   - --tone: the strongest simulated tone inside the published band is not the strongest peak
+ *   - SPECTRAL_PEAKS: a tone is missing from the peak list or is in the wrong harmonic family
+ *   - FEATURE_PERIOD_MS: the z RMS of the time domain features is off the simulated signal
+ *   - SPECTRUM_QUANTITY: the velocity RMS is off the simulated signal
+ *   - ENABLE_GYRO: the strongest rocking tone is not the gyroscope x peak
+ *   - ENVELOPE_ANALYSIS, --impulse: impacts ringing inside the band are not the strongest envelope peak
+ *   - ORDER_TRACKING, --speed: the strongest tone is off its order; with a speed variation the tones move,
+ *     so the strongest peak and the gyroscope are not checked against them
+ *   - --impulse-onset: the anomaly score is above ANOMALY_THRESHOLD before the impacts start, or below it
+ *     once they started after the baseline was learned
+ *   - ALARM_BANDS: a band is not at the level its RMS held for ALARM_PERSISTENCE windows
+ *   - RAW_SNAPSHOT: an alarm brought no snapshot, or one off the simulated z RMS
+ *   - --capture: the waveform is not the samples granted, or is off the simulated z RMS
+ *   - --model: the fault model did not give the class probabilities of a window
+ *   - OCTAVE_ANALYSIS: the octave band of a tone is off its RMS
+ *   - CEPSTRUM_ANALYSIS, --gear: the strongest cepstral peak is not at the shaft rate of the gear
+ *   - SPECTRUM_CODEC: the bins do not decode within the dead band, do not resync after a lost message,
+ *     or shrink less than CODEC_MIN_RATIO times
+ *   - --lateral: the range does not rise above the tone on x, or does not come back down after it
+ *     despite the gravity on z
+ */
+
+#include <algorithm>
+#include <map>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "QMI8658_setup.h"
+#include "file_setup.h"
+#include "simulated_imu.h"
+#include "spectrum_codec.h"
+#include "system_events.h"
+
+#define TAG "PIPELINE_SIM"
+
+#define PEAKS_PRINTED 3
+#define FRAME_TIMEOUT_MS 10000
+/* Tolerance of the z RMS against the tones and noise of the simulator */
+#define RMS_TOLERANCE 0.05f
+/* Tolerance of the interpolated peak frequencies, in bins */
+#define PEAK_HZ_TOLERANCE_BINS 0.1f
+/* Tones this close to an octave band edge leak into the next band */
+#define OCTAVE_EDGE_MARGIN_BINS 3.0f
+/* Frame whose coded spectrum is dropped as if its message was lost, and the
+ * least the bins may shrink by once coded, JSON against base64 */
+#define CODEC_LOST_FRAME 4
+#define CODEC_MIN_RATIO 5.0
+#define GRAVITY 9.81f
+
+static SimulatedImuConfig s_config;
+static SimulatedImu *s_imu = NULL;
+/* Alerts received, and whether a healthy window was scored */
+static int s_alerts = 0;
+static bool s_scoredHealthy = false;
+/* Frame the first band entered the alarm level in, -1 before, and snapshots received */
+static int s_alarmFrame = -1;
+static int s_snapshots = 0;
+/* Waveform to capture once the pipeline runs, and its samples per axis once granted */
+static uint32_t s_captureMs = 0;
+static uint8_t s_captureAxes = 0;
+static float s_captureHz = 0;
+static uint32_t s_captureSamples = 0;
+static const char *const s_axisNames[] = {"ax", "ay", "az", "gx", "gy", "gz"};
+/* Contents of the model partition, empty without --model */
+static std::vector<uint8_t> s_faultModel;
+/* Bytes of the delta coded spectra in base64, and of their bins as JSON arrays */
+static size_t s_codedBytes = 0;
+static size_t s_jsonBytes = 0;
+/* The NVS of the pipeline, key and value of the stored blobs */
+static std::map<std::string, std::vector<uint8_t>> s_nvs;
+
+ImuSensor *create_imu_sensor()
+{
+    static SimulatedImu imu(s_config);
+    s_imu = &imu;
+    return &imu;
+}
+
+esp_err_t read_nvs_blob(const char *key, void *value, size_t len)
+{
+    auto blob = s_nvs.find(key);
+    if (blob == s_nvs.end())
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (blob->second.size() != len)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(value, blob->second.data(), len);
+    return ESP_OK;
+}
+
+const uint8_t *map_fault_model(size_t *size)
+{
+    *size = s_faultModel.size();
+    return s_faultModel.empty() ? NULL : s_faultModel.data();
+}
+
+esp_err_t write_nvs_blob(const char *key, const void *value, size_t len)
+{
+    s_nvs[key].assign((const uint8_t *)value, (const uint8_t *)value + len);
+    return ESP_OK;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --tone HZ:G[:RAD]           add a tone on z (up to %d, replaces the defaults)\n"
+            "  --noise G                   white noise RMS on every axis\n"
+            "  --gyro-tone HZ:DPS[:RAD]    add rocking about x (up to %d, replaces the default)\n"
+            "  --gyro-noise DPS            white noise RMS on every gyroscope axis\n"
+            "  --impulse HZ:G:RES_HZ:DECAY_S[:MOD_HZ:DEPTH]\n"
+            "                              periodic impacts ringing at a resonance (BPFO), modulated\n"
+            "                              at MOD_HZ like an inner race defect (BPFI)\n"
+            "  --impulse-onset S           impacts start after S seconds, like a developing defect\n"
+            "  --gear MESH_HZ:G:SHAFT_HZ:DEPTH\n"
+            "                              gear mesh tone bumped by 1 + DEPTH once a shaft turn\n"
+            "                              (cracked tooth), sidebands spaced by SHAFT_HZ\n"
+            "  --lateral HZ:G[:END_S]      tone on x until END_S, past the full scale it moves the range up\n"
+            "  --baseline G:PERIOD_S       slow baseline wander on z\n"
+            "  --speed FRACTION:PERIOD_S   machine speed varying by +-FRACTION, every tone follows it\n"
+            "  --odr-error PPM             sensor oscillator error\n"
+            "  --capture MS:AXES:HZ        record a waveform of the axes (like ax,az) once running\n"
+            "  --model FILE                fault model blob in the model partition\n"
+            "  --seed N                    noise seed\n"
+            "  --fast                      do not pace the samples in real time\n"
+            "  --frames N                  spectrum frames to analyse (default 3)\n"
+            "  --verbose                   keep the pipeline info logs\n",
+            name, SIMULATED_IMU_MAX_TONES, SIMULATED_IMU_MAX_TONES);
+}
+
+static bool parse_floats(const char *text, float *values, int min, int max)
+{
+    int count = 0;
+    char *end;
+
+    while (count < max)
+    {
+        values[count++] = strtof(text, &end);
+        if (end == text)
+        {
+            return false;
+        }
+        if (*end != ':')
+        {
+            break;
+        }
+        text = end + 1;
+    }
+    return *end == '\0' && count >= min;
+}
+
+/* MS:AXES:HZ of --capture, the axes named and separated by commas */
+static bool parse_capture(const char *text)
+{
+    char *end;
+
+    s_captureMs = (uint32_t)strtoul(text, &end, 10);
+    if (end == text || *end != ':')
+    {
+        return false;
+    }
+    s_captureAxes = 0;
+    do
+    {
+        text = end + 1;
+        int axis = 0;
+        while (axis < ImuSensor::AXES && strncmp(text, s_axisNames[axis], 2) != 0)
+        {
+            axis++;
+        }
+        if (axis == ImuSensor::AXES)
+        {
+            return false;
+        }
+        s_captureAxes |= 1 << axis;
+        end = (char *)text + 2;
+    } while (*end == ',');
+    if (*end != ':')
+    {
+        return false;
+    }
+    text = end + 1;
+    s_captureHz = strtof(text, &end);
+    return end != text && *end == '\0';
+}
+
+static bool parse_args(int argc, char **argv, int *frames, bool *verbose)
+{
+    bool defaultTones = true;
+    bool defaultGyroTones = true;
+    float values[6];
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *option = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(option, "--fast") == 0)
+        {
+            s_config.realTime = false;
+            continue;
+        }
+        if (strcmp(option, "--verbose") == 0)
+        {
+            *verbose = true;
+            continue;
+        }
+        if (value == NULL)
+        {
+            return false;
+        }
+        i++;
+
+        if (strcmp(option, "--tone") == 0)
+        {
+            if (defaultTones)
+            {
+                s_config.toneCount = 0;
+                defaultTones = false;
+            }
+            values[2] = 0.0f;
+            if (s_config.toneCount >= SIMULATED_IMU_MAX_TONES || !parse_floats(value, values, 2, 3))
+            {
+                return false;
+            }
+            s_config.tones[s_config.toneCount++] = {values[0], values[1], values[2]};
+        }
+        else if (strcmp(option, "--noise") == 0 && parse_floats(value, values, 1, 1))
+        {
+            s_config.noiseRmsG = values[0];
+        }
+        else if (strcmp(option, "--gyro-tone") == 0)
+        {
+            if (defaultGyroTones)
+            {
+                s_config.gyroToneCount = 0;
+                defaultGyroTones = false;
+            }
+            values[2] = 0.0f;
+            if (s_config.gyroToneCount >= SIMULATED_IMU_MAX_TONES || !parse_floats(value, values, 2, 3))
+            {
+                return false;
+            }
+            s_config.gyroTones[s_config.gyroToneCount++] = {values[0], values[1], values[2]};
+        }
+        else if (strcmp(option, "--gyro-noise") == 0 && parse_floats(value, values, 1, 1))
+        {
+            s_config.gyroNoiseRmsDps = values[0];
+        }
+        else if (strcmp(option, "--impulse") == 0)
+        {
+            values[4] = values[5] = 0.0f;
+            if (!parse_floats(value, values, 4, 6))
+            {
+                return false;
+            }
+            s_config.impulseRateHz = values[0];
+            s_config.impulseAmplitudeG = values[1];
+            s_config.impulseResonanceHz = values[2];
+            s_config.impulseDecayS = values[3];
+            s_config.impulseModulationHz = values[4];
+            s_config.impulseModulationDepth = values[5];
+        }
+        else if (strcmp(option, "--impulse-onset") == 0 && parse_floats(value, values, 1, 1))
+        {
+            s_config.impulseOnsetS = values[0];
+        }
+        else if (strcmp(option, "--gear") == 0 && parse_floats(value, values, 4, 4))
+        {
+            s_config.gearMeshHz = values[0];
+            s_config.gearAmplitudeG = values[1];
+            s_config.gearShaftHz = values[2];
+            s_config.gearModulationDepth = values[3];
+        }
+        else if (strcmp(option, "--lateral") == 0)
+        {
+            values[2] = 0.0f;
+            if (!parse_floats(value, values, 2, 3))
+            {
+                return false;
+            }
+            s_config.lateralTone = {values[0], values[1], 0.0f};
+            s_config.lateralEndS = values[2];
+        }
+        else if (strcmp(option, "--baseline") == 0 && parse_floats(value, values, 2, 2))
+        {
+            s_config.baselineDriftG = values[0];
+            s_config.baselineDriftPeriodS = values[1];
+        }
+        else if (strcmp(option, "--speed") == 0 && parse_floats(value, values, 2, 2))
+        {
+            s_config.speedVariation = values[0];
+            s_config.speedPeriodS = values[1];
+        }
+        else if (strcmp(option, "--odr-error") == 0 && parse_floats(value, values, 1, 1))
+        {
+            s_config.odrErrorPpm = values[0];
+        }
+        else if (strcmp(option, "--capture") == 0)
+        {
+            if (!parse_capture(value))
+            {
+                return false;
+            }
+        }
+        else if (strcmp(option, "--model") == 0)
+        {
+            FILE *file = fopen(value, "rb");
+            if (file == NULL)
+            {
+                return false;
+            }
+            int c;
+            while ((c = fgetc(file)) != EOF)
+            {
+                s_faultModel.push_back((uint8_t)c);
+            }
+            fclose(file);
+        }
+        else if (strcmp(option, "--seed") == 0)
+        {
+            s_config.noiseSeed = (uint32_t)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(option, "--frames") == 0)
+        {
+            *frames = atoi(value);
+        }
+        else
+        {
+            return false;
+        }
+    }
+    return *frames > 0;
+}
+
+/* Strongest local maxima of a spectrum, highest first */
+static int find_peaks(const float *m, int size, int *bins, int count)
+{
+    int found = 0;
+
+    for (int i = 1; i < size - 1; i++)
+    {
+        if (m[i] <= m[i - 1] || m[i] < m[i + 1])
+        {
+            continue;
+        }
+        int position = found;
+        if (found < count)
+        {
+            found++;
+        }
+        else if (m[i] > m[bins[count - 1]])
+        {
+            position = count - 1;
+        }
+        else
+        {
+            continue;
+        }
+        while (position > 0 && m[bins[position - 1]] < m[i])
+        {
+            bins[position] = bins[position - 1];
+            position--;
+        }
+        bins[position] = i;
+    }
+    return found;
+}
+
+/* Strongest configured tone that falls inside the published bins, -1 if none */
+static int expected_peak(const SpectrumFrame &frame)
+{
+    int strongest = -1;
+
+    for (int i = 0; i < s_config.toneCount; i++)
+    {
+        const SimulatedTone &tone = s_config.tones[i];
+        if (tone.frequencyHz / frame.binWidth >= SPECTRUM_BINS - 1)
+        {
+            continue;
+        }
+        if (strongest < 0 || tone.amplitude > s_config.tones[strongest].amplitude)
+        {
+            strongest = i;
+        }
+    }
+    return strongest;
+}
+
+#if ENABLE_GYRO
+/* Prints the angular vibration features, returns false if the rocking tone was missed */
+static bool check_gyro(const SpectrumFrame &frame)
+{
+    const SimulatedTone *strongest = NULL;
+
+    printf("  gyro peaks x %.2f Hz (%.3f dps), y %.2f Hz (%.3f dps), z %.2f Hz (%.3f dps)\n", frame.gyroPeakHz[0],
+           frame.gyroPeakDps[0], frame.gyroPeakHz[1], frame.gyroPeakDps[1], frame.gyroPeakHz[2], frame.gyroPeakDps[2]);
+
+    for (int i = 0; i < s_config.gyroToneCount; i++)
+    {
+        if (strongest == NULL || s_config.gyroTones[i].amplitude > strongest->amplitude)
+        {
+            strongest = &s_config.gyroTones[i];
+        }
+    }
+    if (strongest != NULL && fabsf(frame.gyroPeakHz[0] - strongest->frequencyHz) > frame.sampleRate / TOTAL_READS)
+    {
+        printf("  expected the gyroscope x peak at %.2f Hz\n", strongest->frequencyHz);
+        return false;
+    }
+    return true;
+}
+#endif
+
+#if ENVELOPE_ANALYSIS
+/* Prints the envelope peaks, returns false if impacts ringing inside the
+ * envelope band are not the strongest of them. Modulated impacts only need
+ * to be among the printed peaks, the shaft line and the sidebands of an
+ * inner race defect can be stronger than its BPFI line */
+static bool check_envelope(const SpectrumFrame &frame, bool impacts)
+{
+    int bins[PEAKS_PRINTED];
+    int found = find_peaks(frame.envelope, ENVELOPE_BINS, bins, PEAKS_PRINTED);
+
+    printf("  envelope bin %.4f Hz, peaks:", frame.envelopeBinWidth);
+    for (int i = 0; i < found; i++)
+    {
+        printf(" %.2f Hz (%.2f)", bins[i] * frame.envelopeBinWidth, frame.envelope[bins[i]]);
+    }
+    printf("\n");
+
+    const float rate = s_config.impulseRateHz;
+    if (rate <= 0 || !impacts || s_config.impulseResonanceHz < ENVELOPE_BAND_LOW_HZ ||
+        s_config.impulseResonanceHz > ENVELOPE_BAND_HIGH_HZ || rate / frame.envelopeBinWidth >= ENVELOPE_BINS - 1)
+    {
+        return true;
+    }
+    const int candidates = s_config.impulseModulationHz > 0 ? found : std::min(found, 1);
+    for (int i = 0; i < candidates; i++)
+    {
+        if (fabsf(bins[i] * frame.envelopeBinWidth - rate) <= frame.envelopeBinWidth)
+        {
+            return true;
+        }
+    }
+    printf("  expected %s envelope peak at %.2f Hz\n", candidates > 1 ? "an" : "the strongest", rate);
+    return false;
+}
+#endif
+
+#if ORDER_TRACKING
+/* Prints the order peaks, returns false if the strongest tone is not the
+ * strongest order peak, at its frequency over the strongest tone in the shaft
+ * range */
+static bool check_orders(const SpectrumFrame &frame)
+{
+    const float orderStep = 1.0f / ORDER_REVOLUTIONS;
+    const SimulatedTone *shaft = NULL;
+    const SimulatedTone *strongest = NULL;
+    int bins[PEAKS_PRINTED];
+
+    if (frame.shaftHz <= 0)
+    {
+        printf("  no shaft speed yet\n");
+        return true;
+    }
+    int found = find_peaks(frame.order, ORDER_BINS, bins, PEAKS_PRINTED);
+    printf("  shaft %.2f Hz, order peaks:", frame.shaftHz);
+    for (int i = 0; i < found; i++)
+    {
+        printf(" %.3f (%.2f)", bins[i] * orderStep, frame.order[bins[i]]);
+    }
+    printf("\n");
+
+    for (int i = 0; i < s_config.toneCount; i++)
+    {
+        const SimulatedTone &tone = s_config.tones[i];
+        if (tone.frequencyHz >= ORDER_SHAFT_MIN_HZ && tone.frequencyHz <= ORDER_SHAFT_MAX_HZ &&
+            (shaft == NULL || tone.amplitude > shaft->amplitude))
+        {
+            shaft = &tone;
+        }
+    }
+    if (shaft == NULL)
+    {
+        return true;
+    }
+    for (int i = 0; i < s_config.toneCount; i++)
+    {
+        const SimulatedTone &tone = s_config.tones[i];
+        if (tone.frequencyHz / shaft->frequencyHz / orderStep < ORDER_BINS - 1 &&
+            (strongest == NULL || tone.amplitude > strongest->amplitude))
+        {
+            strongest = &tone;
+        }
+    }
+    const float expected = strongest->frequencyHz / shaft->frequencyHz;
+    if (found == 0 || fabsf(bins[0] * orderStep - expected) > orderStep)
+    {
+        printf("  expected the strongest order peak at %.3f\n", expected);
+        return false;
+    }
+    return true;
+}
+#endif
+
+/* Prints the peak list, returns false if a simulated tone is not in it at
+ * its frequency and amplitude, or not the expected harmonic of the lowest
+ * tone it is a multiple of */
+static bool check_peaks(const SpectrumFrame &frame)
+{
+    const float nyquist = frame.binWidth * TOTAL_READS / 2;
+    /* Without real time pacing the sensor clock error cannot be measured, and the tones move by it */
+    const float clock = s_config.realTime ? 1.0f : 1.0f / (1.0f + s_config.odrErrorPpm * 1e-6f);
+    float strongest = 0;
+    bool ok = true;
+
+    printf("  peak list:");
+    for (int i = 0; i < frame.peakCount; i++)
+    {
+        const SpectralPeak &peak = frame.peaks[i];
+        printf(" %.3f Hz %.3f m/s2 (%d.%d)", peak.hz, peak.amplitude, peak.family, peak.harmonic);
+    }
+    printf("\n");
+
+    /* Impacts, a gear and a moving speed add peaks the tones do not predict */
+    if (s_config.impulseRateHz > 0 || s_config.gearMeshHz > 0 || s_config.speedVariation != 0)
+    {
+        return true;
+    }
+    for (int i = 0; i < s_config.toneCount; i++)
+    {
+        strongest = fmaxf(strongest, s_config.tones[i].amplitude);
+    }
+    for (int i = 0; i < s_config.toneCount; i++)
+    {
+        const SimulatedTone &tone = s_config.tones[i];
+        if (tone.frequencyHz >= nyquist - frame.binWidth || tone.amplitude < 2 * SPECTRAL_PEAK_MIN_RATIO * strongest)
+        {
+            continue;
+        }
+
+        const SimulatedTone *lowest = &tone;
+        for (int j = 0; j < s_config.toneCount; j++)
+        {
+            const SimulatedTone &other = s_config.tones[j];
+            const float n = roundf(tone.frequencyHz / other.frequencyHz);
+            if (other.frequencyHz < lowest->frequencyHz && n >= 2 &&
+                fabsf(tone.frequencyHz - n * other.frequencyHz) <= HARMONIC_TOLERANCE_BINS * frame.binWidth &&
+                other.amplitude >= 2 * SPECTRAL_PEAK_MIN_RATIO * strongest)
+            {
+                lowest = &other;
+            }
+        }
+        const int harmonic = (int)roundf(tone.frequencyHz / lowest->frequencyHz);
+
+        const SpectralPeak *match = NULL;
+        for (int j = 0; j < frame.peakCount; j++)
+        {
+            if (fabsf(frame.peaks[j].hz - clock * tone.frequencyHz) <= PEAK_HZ_TOLERANCE_BINS * frame.binWidth)
+            {
+                match = &frame.peaks[j];
+            }
+        }
+        const float amplitude = GRAVITY * tone.amplitude;
+        if (match == NULL || fabsf(match->amplitude - amplitude) > RMS_TOLERANCE * amplitude ||
+            match->harmonic != harmonic)
+        {
+            printf("  expected a peak at %.3f Hz of %.3f m/s2, harmonic %d\n", clock * tone.frequencyHz, amplitude,
+                   harmonic);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/* Velocity RMS of the simulated tones in the severity band, in mm/s, -1 when other components make it unknown */
+static double expected_velocity(const SpectrumFrame &frame)
+{
+    const double nyquist = frame.binWidth * TOTAL_READS / 2;
+    double power = 0;
+
+    if (s_config.impulseRateHz > 0 || s_config.gearMeshHz > 0 || s_config.speedVariation != 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < s_config.toneCount; i++)
+    {
+        const SimulatedTone &tone = s_config.tones[i];
+        if (tone.frequencyHz >= SEVERITY_LOW_HZ && tone.frequencyHz <= SEVERITY_HIGH_HZ && tone.frequencyHz < nyquist)
+        {
+            double velocity = 1e3 * GRAVITY * tone.amplitude / (2 * M_PI * tone.frequencyHz);
+            power += velocity * velocity / 2;
+        }
+    }
+    return power > 0 ? sqrt(power) : -1;
+}
+
+/* Whether the window of the frame just received had no impacts at all, or
+ * impacts all along, from the samples generated so far. Up to
+ * SPECTRUM_QUEUE_LENGTH more windows may have been read since it was captured */
+static void impact_state(bool *healthy, bool *impacts)
+{
+    const double rate = SAMPLE_RATE_HZ * (1.0 + s_config.odrErrorPpm * 1e-6);
+    const double generatedS = s_imu->samplesGenerated() / rate;
+    const double windowS = CAPTURE_READS * SAMPLES_NUM / rate;
+
+    *healthy = s_config.impulseRateHz <= 0 || generatedS < s_config.impulseOnsetS;
+    *impacts = s_config.impulseRateHz > 0 && (s_config.impulseOnsetS <= 0 ||
+               generatedS - (SPECTRUM_QUEUE_LENGTH + 2) * windowS > s_config.impulseOnsetS);
+}
+
+/* With --lateral, returns false in the last frame if no window had a range
+ * above the lateral tone, or if the range is not back at ACCEL_RANGE once the
+ * tone ended: the z axis keeps its 1 g of gravity all along */
+static bool check_range(const SpectrumFrame &frame, bool last)
+{
+    static bool rose = false;
+    const float amplitude = s_config.lateralTone.amplitude;
+
+    rose = rose || frame.rangeG > amplitude;
+    if (amplitude <= imu_range_g(ACCEL_RANGE) || !last)
+    {
+        return true;
+    }
+    if (!rose)
+    {
+        printf("  expected the range to rise above the %.1f g lateral tone\n", amplitude);
+        return false;
+    }
+    if (s_config.lateralEndS > 0 && frame.rangeG != imu_range_g(ACCEL_RANGE))
+    {
+        printf("  expected the range back at %.0f g after the lateral tone\n", imu_range_g(ACCEL_RANGE));
+        return false;
+    }
+    return true;
+}
+
+/* Prints the anomaly score and the alerts queued so far, returns false if a
+ * healthy window is anomalous, or if a window with impacts that started after
+ * the baseline was learned is not and raised no alert */
+static bool check_baseline(const SpectrumFrame &frame, bool healthy, bool impacts)
+{
+    static const char *const modes[] = {"learning", "frozen"};
+    AnomalyFrame alert;
+
+    printf("  anomaly score %.2f, baseline %s over %u windows\n", frame.anomalyScore, modes[frame.baselineMode],
+           (unsigned)frame.baselineWindows);
+    while (xQueueReceive(anomalyQueue, &alert, 0) == pdTRUE)
+    {
+        s_alerts++;
+        printf("  anomaly alert, score %.2f, bands off by more than %.0f sigma:", alert.score, ANOMALY_THRESHOLD);
+        for (int band = 0; band < BASELINE_BANDS; band++)
+        {
+            if (fabsf(alert.bandZ[band]) > ANOMALY_THRESHOLD)
+            {
+                printf(" %.0f-%.0f Hz (%+.1f)", alert.bandEdgeHz[band], alert.bandEdgeHz[band + 1], alert.bandZ[band]);
+            }
+        }
+        printf("\n");
+    }
+
+    /* A moving speed moves the tones across the bands */
+    if (frame.anomalyScore < 0 || s_config.speedVariation != 0)
+    {
+        return true;
+    }
+    if (healthy)
+    {
+        s_scoredHealthy = true;
+        if (frame.anomalyScore > ANOMALY_THRESHOLD)
+        {
+            printf("  expected a score below %.1f before the impacts\n", ANOMALY_THRESHOLD);
+            return false;
+        }
+    }
+    else if (impacts && s_scoredHealthy && (frame.anomalyScore <= ANOMALY_THRESHOLD || s_alerts == 0))
+    {
+        printf("  expected a score above %.1f and an alert once the impacts started\n", ANOMALY_THRESHOLD);
+        return false;
+    }
+    return true;
+}
+
+/* RMS of the simulated z in m/s2 without its mean, -1 when other components make it unknown */
+static double expected_z_rms()
+{
+    /* Only tones and noise have a known RMS */
+    if (s_config.impulseRateHz > 0 || s_config.gearMeshHz > 0 || s_config.baselineDriftG != 0)
+    {
+        return -1;
+    }
+    double power = s_config.noiseRmsG * s_config.noiseRmsG;
+    for (int i = 0; i < s_config.toneCount; i++)
+    {
+        power += s_config.tones[i].amplitude * s_config.tones[i].amplitude / 2;
+    }
+    return GRAVITY * sqrt(power);
+}
+
+#if OCTAVE_ANALYSIS
+/* Prints the octave bands around the strongest, returns false if a simulated
+ * tone clear of the band edges is not in the RMS of its band */
+static bool check_octaves(const SpectrumFrame &frame)
+{
+    const OctaveBands &bands = octave_bands();
+    const float *edges = bands.edges();
+    int strongest = 0;
+    bool ok = true;
+
+    for (int i = 1; i < frame.octaveBandCount; i++)
+    {
+        strongest = frame.octave[i] > frame.octave[strongest] ? i : strongest;
+    }
+    printf("  %u octave bands (layout %08x) from %.2f Hz, strongest %.1f-%.1f Hz %.3f\n", frame.octaveBandCount,
+           (unsigned)frame.octaveLayoutId, edges[0], edges[strongest], edges[strongest + 1], frame.octave[strongest]);
+    if (frame.octaveLayoutId != bands.layoutId() || frame.octaveBandCount != bands.count())
+    {
+        printf("  expected layout %08x of %u bands\n", (unsigned)bands.layoutId(), bands.count());
+        return false;
+    }
+
+    /* Only tones and noise have a known RMS, and the noise in a band is well below them */
+    if (SPECTRUM_QUANTITY != SEVERITY_ACCELERATION || s_config.impulseRateHz > 0 || s_config.gearMeshHz > 0 ||
+        s_config.speedVariation != 0)
+    {
+        return true;
+    }
+    for (int i = 0; i < s_config.toneCount; i++)
+    {
+        const SimulatedTone &tone = s_config.tones[i];
+        const float margin = OCTAVE_EDGE_MARGIN_BINS * frame.binWidth;
+        int band = 0;
+        while (band < frame.octaveBandCount && edges[band + 1] <= tone.frequencyHz)
+        {
+            band++;
+        }
+        if (band == frame.octaveBandCount || tone.frequencyHz - edges[band] < margin ||
+            edges[band + 1] - tone.frequencyHz < margin)
+        {
+            continue;
+        }
+        const float rms = GRAVITY * tone.amplitude / sqrtf(2.0f);
+        if (fabsf(frame.octave[band] - rms) > RMS_TOLERANCE * rms)
+        {
+            printf("  expected %.3f m/s2 RMS in the %.1f-%.1f Hz band\n", rms, edges[band], edges[band + 1]);
+            ok = false;
+        }
+    }
+    return ok;
+}
+#endif
+
+#if CEPSTRUM_ANALYSIS
+/* Prints the cepstral peaks, returns false if the strongest is not at the
+ * sideband spacing of the --gear family, within a quefrency sample or
+ * CEPSTRUM_FAMILY_TOLERANCE */
+static bool check_cepstrum(const SpectrumFrame &frame)
+{
+    const float sampleRate = frame.binWidth * TOTAL_READS;
+
+    printf("  cepstrum peaks:");
+    for (int i = 0; i < frame.cepstrumPeakCount; i++)
+    {
+        const CepstralPeak &peak = frame.cepstrumPeaks[i];
+        printf(" %.2f ms (%.2f Hz) %.3f x%d", peak.quefrencyMs, peak.hz, peak.amplitude, peak.rahmonics + 1);
+    }
+    printf("\n");
+
+    const float shaftHz = s_config.gearShaftHz;
+    if (s_config.gearMeshHz <= 0 || shaftHz < CEPSTRUM_LOW_HZ || shaftHz > CEPSTRUM_HIGH_HZ ||
+        s_config.speedVariation != 0)
+    {
+        return true;
+    }
+    if (frame.cepstrumPeakCount == 0 ||
+        fabsf(frame.cepstrumPeaks[0].quefrencyMs - 1000 / shaftHz) >
+            std::max(1000 / sampleRate, CEPSTRUM_FAMILY_TOLERANCE * 1000 / shaftHz))
+    {
+        printf("  expected the strongest cepstral peak at %.2f ms\n", 1000 / shaftHz);
+        return false;
+    }
+    return true;
+}
+#endif
+
+#if PUBLISH_SPECTRUM_BINS && SPECTRUM_CODEC
+/* Length of the bins as JSON arrays, with 7 significant digits where ArduinoJson prints up to 9 */
+static size_t json_bytes(const char *name, const float *values, int count)
+{
+    char text[32];
+    size_t bytes = strlen(name) + 5;
+
+    for (int i = 0; i < count; i++)
+    {
+        bytes += snprintf(text, sizeof(text), "%.7g", values[i]) + 1;
+    }
+    return bytes;
+}
+
+/* Codes the bins as iot_setup.cpp does and decodes them on the other side.
+ * Returns false if the decoded bins are off by more than the dead band, or if
+ * the decoder did not notice the lost message and resync on the keyframe the
+ * cloud then asks for with requestKeyframe */
+static bool check_codec(const SpectrumFrame &frame, int n)
+{
+    static const uint8_t ids[] = {
+        SPECTRUM_CHANNEL_FFT,
+#if ORDER_TRACKING
+        SPECTRUM_CHANNEL_ORDER,
+#endif
+#if ENVELOPE_ANALYSIS
+        SPECTRUM_CHANNEL_ENVELOPE,
+#endif
+    };
+    static const uint16_t counts[] = {
+        SPECTRUM_BINS,
+#if ORDER_TRACKING
+        ORDER_BINS,
+#endif
+#if ENVELOPE_ANALYSIS
+        ENVELOPE_BINS,
+#endif
+    };
+    static SpectrumEncoder encoder(sizeof(ids), ids, counts, SPECTRUM_CODEC_STEP_DB, SPECTRUM_CODEC_RANGE_DB,
+                                   SPECTRUM_CODEC_DEADBAND, SPECTRUM_KEYFRAME_INTERVAL);
+    static SpectrumDecoder decoder;
+    static uint8_t coded[SPECTRUM_CODEC_BOUND(3, SPECTRUM_BINS + ORDER_BINS + ENVELOPE_BINS)];
+    const float *values[] = {
+        frame.magnitude,
+#if ORDER_TRACKING
+        frame.order,
+#endif
+#if ENVELOPE_ANALYSIS
+        frame.envelope,
+#endif
+    };
+
+    const size_t size = encoder.encode(values, coded, sizeof(coded));
+    const size_t text = (size + 2) / 3 * 4;
+    size_t json = 0;
+    for (size_t c = 0; c < sizeof(ids); c++)
+    {
+        json += json_bytes(spectrum_channel_name(ids[c]), values[c], counts[c]);
+    }
+    printf("  coded spectrum %u: %s of %u bytes in base64, %u as JSON (%.1fx)\n", encoder.sequence(),
+           encoder.keyframe() ? "keyframe" : "delta", (unsigned)text, (unsigned)json, (double)json / text);
+    if (size == 0)
+    {
+        return false;
+    }
+    if (n == CODEC_LOST_FRAME)
+    {
+        return true;
+    }
+
+    const SpectrumCodecStatus status = decoder.decode(coded, size);
+    const SpectrumCodecStatus expected =
+        n == CODEC_LOST_FRAME + 1 && !encoder.keyframe() ? SPECTRUM_NEED_KEYFRAME : SPECTRUM_DECODED;
+    if (status != expected)
+    {
+        printf("  expected decoder status %d, got %d\n", expected, status);
+        return false;
+    }
+    if (status == SPECTRUM_NEED_KEYFRAME)
+    {
+        encoder.requestKeyframe();
+        return true;
+    }
+    if (!encoder.keyframe())
+    {
+        s_codedBytes += text;
+        s_jsonBytes += json;
+        if (decoder.decode(coded, size) != SPECTRUM_DUPLICATE)
+        {
+            printf("  expected a delta delivered twice to be a duplicate\n");
+            return false;
+        }
+    }
+
+    /* In dB, the levels below the floor of the keyframe all count as the floor */
+    const float bound = (SPECTRUM_CODEC_DEADBAND + 0.5f) * SPECTRUM_CODEC_STEP_DB + 1e-3f;
+    bool ok = true;
+    for (uint8_t c = 0; c < decoder.channels(); c++)
+    {
+        const float *decoded = decoder.values(c);
+        float error = 0;
+        int worst = 0;
+        if (decoder.level(c) <= 0)
+        {
+            continue;
+        }
+        const float floorDb = 20 * log10f(decoder.level(c)) - decoder.range();
+        for (uint16_t i = 0; i < decoder.count(c); i++)
+        {
+            const float level = values[c][i] > 0 ? std::max(20 * log10f(values[c][i]), floorDb) : floorDb;
+            const float held = decoded[i] > 0 ? 20 * log10f(decoded[i]) : floorDb;
+            if (fabsf(held - level) > error)
+            {
+                error = fabsf(held - level);
+                worst = i;
+            }
+        }
+        if (error > bound)
+        {
+            printf("  %s bin %d decoded %.3f dB off, the dead band allows %.3f\n", spectrum_channel_name(decoder.id(c)),
+                   worst, error, bound);
+            ok = false;
+        }
+    }
+    return ok;
+}
+#endif
+
+#if FAULT_CLASSIFIER
+/* Prints the class probabilities, returns false if the model of --model did
+ * not run on the window or its probabilities are not a distribution */
+static bool check_faults(const SpectrumFrame &frame)
+{
+    if (s_faultModel.empty())
+    {
+        return frame.faultModelId == 0;
+    }
+    const FaultModelHeader *model = (const FaultModelHeader *)s_faultModel.data();
+    float sum = 0;
+    bool ok = frame.faultModelId == model->modelId && frame.faultClasses == model->classes;
+
+    printf("  fault model %u in %u us:", (unsigned)frame.faultModelId, (unsigned)frame.inferenceUs);
+    for (int i = 0; i < frame.faultClasses; i++)
+    {
+        printf(" %s %.3f", frame.faultLabels[i], frame.faultProbability[i]);
+        ok = ok && frame.faultProbability[i] >= 0 && frame.faultProbability[i] <= 1;
+        sum += frame.faultProbability[i];
+    }
+    printf("\n");
+    if (!ok || fabsf(sum - 1) > 1e-4f)
+    {
+        printf("  expected the %u probabilities of model %u\n", model->classes, (unsigned)model->modelId);
+        return false;
+    }
+    return true;
+}
+#endif
+
+/* Prints the band RMS and the alarm events queued so far, returns false if a
+ * band is not at the level its RMS held over the last ALARM_PERSISTENCE windows */
+static bool check_alarms(const SpectrumFrame &frame, int n)
+{
+    static const char *const levels[] = {"ok", "warning", "alarm"};
+    /* Windows in a row each band was above its alarm threshold, and below hysteresis times its warning */
+    static int above[ALARM_BANDS_MAX];
+    static int below[ALARM_BANDS_MAX];
+    const AlarmBand bands[] = {ALARM_BANDS};
+    AlarmFrame event;
+    bool ok = true;
+
+    printf("  alarm bands:");
+    for (int i = 0; i < frame.alarmBands; i++)
+    {
+        printf(" %.0f-%.0f Hz %.3f (%s)", bands[i].lowHz, bands[i].highHz, frame.bandRms[i],
+               levels[frame.bandLevel[i]]);
+    }
+    printf("\n");
+    while (xQueueReceive(alarmQueue, &event, 0) == pdTRUE)
+    {
+        printf("  alarm event, band %u %s -> %s at %.3f\n", event.band, levels[event.previous], levels[event.level],
+               event.rms);
+        if (event.level == ALARM_LEVEL_ALARM && s_alarmFrame < 0)
+        {
+            s_alarmFrame = n;
+        }
+    }
+
+    for (int i = 0; i < frame.alarmBands; i++)
+    {
+        above[i] = frame.bandRms[i] >= bands[i].alarm ? above[i] + 1 : 0;
+        below[i] = frame.bandRms[i] < ALARM_HYSTERESIS * bands[i].warning ? below[i] + 1 : 0;
+        if ((above[i] >= ALARM_PERSISTENCE && frame.bandLevel[i] != ALARM_LEVEL_ALARM) ||
+            (below[i] >= ALARM_PERSISTENCE && frame.bandLevel[i] != ALARM_LEVEL_OK))
+        {
+            printf("  expected band %d at %s\n", i, levels[above[i] > 0 ? ALARM_LEVEL_ALARM : ALARM_LEVEL_OK]);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+/* Prints the snapshots queued so far, returns false if one is off its
+ * trigger, its length or the simulated z RMS, or if an alarm brought none in time */
+static bool check_snapshots(int n)
+{
+    static std::vector<int16_t> samples;
+    const double expected = expected_z_rms();
+    SnapshotFrame snapshot;
+    bool ok = true;
+
+    while (xQueueReceive(snapshotQueue, &snapshot, 0) == pdTRUE)
+    {
+        const int axes = __builtin_popcount(snapshot.axes);
+        samples.resize((size_t)snapshot.count * axes);
+        const uint32_t count = read_snapshot(snapshot, 0, samples.data(), samples.size()) / axes;
+        printf("  snapshot %u (%s) at %.3f s, %u samples at %.2f Hz, %u before the trigger, rms", (unsigned)snapshot.id,
+               snapshot.source == SNAPSHOT_ALARM ? "alarm" : "command", snapshot.capturedAt / 1e6,
+               (unsigned)snapshot.count, snapshot.sampleRate, (unsigned)snapshot.preTrigger);
+
+        double zRms = -1;
+        for (int axis = 0, column = 0; axis < ImuSensor::AXES; axis++)
+        {
+            if (!(snapshot.axes & (1 << axis)))
+            {
+                continue;
+            }
+            double sum = 0;
+            double squares = 0;
+            for (uint32_t i = 0; i < count; i++)
+            {
+                const int16_t sample = samples[i * axes + column];
+                sum += sample;
+                squares += (double)sample * sample;
+            }
+            const double mean = count > 0 ? sum / count : 0;
+            const double scale = axis >= ImuSensor::GYRO_X ? snapshot.gyroScale : snapshot.scale;
+            const double rms = count > 0 ? scale * sqrt(std::max(0.0, squares / count - mean * mean)) : 0;
+            printf(" %s %.3f", s_axisNames[axis], rms);
+            zRms = axis == ImuSensor::ACCEL_Z ? rms : zRms;
+            column++;
+        }
+        printf("\n");
+        release_snapshot(snapshot);
+
+        if (snapshot.source == SNAPSHOT_ALARM)
+        {
+            s_snapshots++;
+            if (count != snapshot.count || snapshot.count > SNAPSHOT_SAMPLES || snapshot.preTrigger > SNAPSHOT_PRE_SAMPLES ||
+                snapshot.count - snapshot.preTrigger < SNAPSHOT_POST_SAMPLES)
+            {
+                printf("  expected up to %u samples before the trigger and %u after it\n",
+                       (unsigned)SNAPSHOT_PRE_SAMPLES, (unsigned)SNAPSHOT_POST_SAMPLES);
+                ok = false;
+            }
+        }
+        else
+        {
+            printf("  recorded in %u us, %.3f%% of the read task\n", (unsigned)snapshot.recordUs,
+                   100 * snapshot.recordUs / (snapshot.count / snapshot.sampleRate * 1e6));
+            if (count != s_captureSamples || snapshot.count != s_captureSamples || snapshot.axes != s_captureAxes)
+            {
+                printf("  expected %u samples of each axis asked for\n", (unsigned)s_captureSamples);
+                ok = false;
+            }
+        }
+        /* Averaging takes off the tones near the Nyquist rate of a decimated capture */
+        const bool fullRate = snapshot.sampleRate > SAMPLE_RATE_HZ * 0.9f;
+        if (expected > 0 && zRms >= 0 && fullRate && fabs(zRms - expected) > RMS_TOLERANCE * expected)
+        {
+            printf("  expected a z RMS of %.3f m/s2\n", expected);
+            ok = false;
+        }
+    }
+
+#if RAW_SNAPSHOT
+    /* The trigger waits for SNAPSHOT_POST_SAMPLES, and the spectra may be queued behind */
+    const int frames = SPECTRUM_QUEUE_LENGTH + SNAPSHOT_POST_SAMPLES / TOTAL_READS + 2;
+    if (s_alarmFrame >= 0 && s_snapshots == 0 && n - s_alarmFrame > frames)
+    {
+        printf("  expected a snapshot within %d frames of the alarm\n", frames);
+        s_alarmFrame = -1;
+        ok = false;
+    }
+#endif
+    return ok;
+}
+
+/* Prints the feature frames queued so far, returns false if the z RMS is off the simulated signal */
+static bool check_features()
+{
+    static const char *const names[] = {"ax", "ay", "az", "gx", "gy", "gz"};
+    FeatureFrame frame;
+    bool ok = true;
+    const double expected = expected_z_rms();
+
+    while (xQueueReceive(featureQueue, &frame, 0) == pdTRUE)
+    {
+        printf("  features of %u samples:", frame.samples);
+        for (int i = 0; i < FEATURE_AXES; i++)
+        {
+            const AxisFeatures &axis = frame.axes[i];
+            printf("%s %s rms %.3f peak %.3f p-p %.3f crest %.2f kurt %.2f skew %.2f", i % 3 == 0 ? "\n   " : ",",
+                   names[i], axis.rms, axis.peak, axis.peakToPeak, axis.crestFactor, axis.kurtosis, axis.skewness);
+        }
+        printf("\n");
+
+        const float rms = frame.axes[ImuSensor::ACCEL_Z].rms;
+        if (expected > 0 && fabs(rms - expected) > RMS_TOLERANCE * expected)
+        {
+            printf("  expected a z RMS of %.3f m/s2\n", expected);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    int frames = 3;
+    bool verbose = false;
+    int failures = 0;
+
+    s_config = simulated_imu_default_config();
+    if (!parse_args(argc, argv, &frames, &verbose))
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    esp_log_level_set("*", verbose ? ESP_LOG_INFO : ESP_LOG_WARN);
+
+    ESP_ERROR_CHECK(init_system_events());
+    ESP_ERROR_CHECK(setupQMI8658());
+    if (s_captureMs > 0)
+    {
+        ESP_ERROR_CHECK(request_waveform_capture(s_captureMs, s_captureAxes, &s_captureHz, &s_captureSamples));
+        printf("capturing %u samples per axis at %.2f Hz\n", (unsigned)s_captureSamples, s_captureHz);
+    }
+
+    for (int n = 0; n < frames; n++)
+    {
+        SpectrumFrame frame;
+        int bins[PEAKS_PRINTED];
+
+        if (xQueueReceive(spectrumQueue, &frame, pdMS_TO_TICKS(FRAME_TIMEOUT_MS)) != pdTRUE)
+        {
+            ESP_LOGE(TAG, "No spectrum frame after %d ms", FRAME_TIMEOUT_MS);
+            failures++;
+            break;
+        }
+
+        bool healthy, impacts;
+        impact_state(&healthy, &impacts);
+
+        int found = find_peaks(frame.magnitude, SPECTRUM_BINS, bins, PEAKS_PRINTED);
+        printf("frame %d at %.3f s, measured ODR %.2f Hz, bin %.4f Hz, range %.0f g, %u clipped, peaks:", n,
+               frame.capturedAt / 1e6, frame.sampleRate, frame.binWidth, frame.rangeG, frame.clipped);
+        for (int i = 0; i < found; i++)
+        {
+            printf(" %.2f Hz (%.2f)", bins[i] * frame.binWidth, frame.magnitude[bins[i]]);
+        }
+        printf("\n");
+
+        printf("  velocity %.3f mm/s RMS (zone %c), displacement %.3f um RMS\n", frame.velocityRms,
+               iso_zone_letter((IsoZone)frame.isoZone), frame.displacementRms);
+        double velocity = expected_velocity(frame);
+        if (velocity > 0 && fabs(frame.velocityRms - velocity) > RMS_TOLERANCE * velocity)
+        {
+            printf("  expected a velocity of %.3f mm/s RMS\n", velocity);
+            failures++;
+        }
+
+        int expected = s_config.speedVariation == 0 ? expected_peak(frame) : -1;
+        if (expected >= 0)
+        {
+            float expectedHz = s_config.tones[expected].frequencyHz;
+            if (found == 0 || fabsf(bins[0] * frame.binWidth - expectedHz) > frame.binWidth)
+            {
+                printf("  expected the strongest peak at %.2f Hz\n", expectedHz);
+                failures++;
+            }
+        }
+        if (!check_peaks(frame))
+        {
+            failures++;
+        }
+        if (!check_range(frame, n == frames - 1))
+        {
+            failures++;
+        }
+#if ENABLE_GYRO
+        if (s_config.speedVariation == 0 && !check_gyro(frame))
+        {
+            failures++;
+        }
+#endif
+#if ENVELOPE_ANALYSIS
+        if (!check_envelope(frame, impacts))
+        {
+            failures++;
+        }
+#endif
+#if ORDER_TRACKING
+        if (!check_orders(frame))
+        {
+            failures++;
+        }
+#endif
+        if (!check_baseline(frame, healthy, impacts))
+        {
+            failures++;
+        }
+        if (!check_alarms(frame, n))
+        {
+            failures++;
+        }
+#if OCTAVE_ANALYSIS
+        if (!check_octaves(frame))
+        {
+            failures++;
+        }
+#endif
+#if CEPSTRUM_ANALYSIS
+        if (!check_cepstrum(frame))
+        {
+            failures++;
+        }
+#endif
+#if PUBLISH_SPECTRUM_BINS && SPECTRUM_CODEC
+        if (!check_codec(frame, n))
+        {
+            failures++;
+        }
+#endif
+#if FAULT_CLASSIFIER
+        if (!check_faults(frame))
+        {
+            failures++;
+        }
+#endif
+        if (!check_snapshots(n))
+        {
+            failures++;
+        }
+        if (!check_features())
+        {
+            failures++;
+        }
+    }
+
+#if PUBLISH_SPECTRUM_BINS && SPECTRUM_CODEC
+    if (s_codedBytes > 0)
+    {
+        const double ratio = (double)s_jsonBytes / s_codedBytes;
+        printf("delta coded bins: %.1fx smaller than as JSON\n", ratio);
+        if (ratio < CODEC_MIN_RATIO)
+        {
+            printf("expected at least %.0fx\n", CODEC_MIN_RATIO);
+            failures++;
+        }
+    }
+#endif
+
+    /* The pipeline tasks never return, leave without running static destructors under them */
+    fflush(stdout);
+    _exit(failures == 0 ? 0 : 1);
+}
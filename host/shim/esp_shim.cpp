@@ -0,0 +1,81 @@
+#include <chrono>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+static esp_log_level_t s_log_level = ESP_LOG_INFO;
+
+int64_t esp_timer_get_time(void)
+{
+    /* Counted from the first call, which comes from static initialization */
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
+
+void esp_restart(void)
+{
+    fprintf(stderr, "esp_restart() called, exiting\n");
+    exit(EXIT_FAILURE);
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    s_log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = {'N', 'E', 'W', 'I', 'D', 'V'};
+    va_list args;
+
+    if (level > s_log_level)
+    {
+        return;
+    }
+    /* One call per line so lines of different threads do not interleave */
+    char line[512];
+    int length = snprintf(line, sizeof(line), "%c (%lld) %s: ", letters[level], (long long)(esp_timer_get_time() / 1000), tag);
+    va_start(args, format);
+    vsnprintf(line + length, sizeof(line) - length, format, args);
+    va_end(args);
+    fprintf(stderr, "%s\n", line);
+}
@@ -0,0 +1,61 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+/*
+ * Minimal FreeRTOS API on top of std::thread for the host build, covering what
+ * the acquisition and DSP pipeline uses. Tasks are plain preemptive threads:
+ * priorities and core affinity are accepted and ignored, "ISRs" are whatever
+ * thread calls the FromISR functions.
+ */
+
+#ifndef __cplusplus
+#error "The host FreeRTOS shim is C++ only"
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <mutex>
+
+#include "esp_bit_defs.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint32_t StackType_t;
+
+#define pdFALSE ((BaseType_t)0)
+#define pdTRUE ((BaseType_t)1)
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS (1000 / configTICK_RATE_HZ)
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define pdMS_TO_TICKS(xTimeInMs) ((TickType_t)(((uint64_t)(xTimeInMs) * configTICK_RATE_HZ) / 1000U))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+struct portMUX_TYPE
+{
+    std::recursive_mutex mutex;
+};
+
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portMUX_INITIALIZE(mux) ((void)(mux))
+#define portENTER_CRITICAL(mux) (mux)->mutex.lock()
+#define portEXIT_CRITICAL(mux) (mux)->mutex.unlock()
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+#define portYIELD_FROM_ISR(...) ((void)0)
+
+#define configASSERT(x)                                                                 \
+    do                                                                                  \
+    {                                                                                   \
+        if (!(x))                                                                       \
+        {                                                                               \
+            vAssertCalled(__FILE__, __LINE__);                                          \
+        }                                                                               \
+    } while (0)
+
+void vAssertCalled(const char *file, int line) __attribute__((noreturn));
+
+#endif // FREERTOS_H
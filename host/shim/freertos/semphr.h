@@ -0,0 +1,20 @@
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include "queue.h"
+
+/* Semaphores are queues of empty items, as in FreeRTOS. The mutex has no
+ * priority inheritance and is not recursive. */
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount);
+
+#define xSemaphoreTake(xSemaphore, xBlockTime) xQueueReceive((xSemaphore), NULL, (xBlockTime))
+#define xSemaphoreGive(xSemaphore) xQueueSend((xSemaphore), NULL, 0)
+#define xSemaphoreGiveFromISR(xSemaphore, pxHigherPriorityTaskWoken) \
+    xQueueSendFromISR((xSemaphore), NULL, (pxHigherPriorityTaskWoken))
+#define vSemaphoreDelete(xSemaphore) vQueueDelete(xSemaphore)
+
+#endif // SEMAPHORE_H
@@ -0,0 +1,334 @@
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+
+struct tskTaskControlBlock
+{
+    std::string name;
+    uint32_t stackDepth = 0;
+    std::mutex lock;
+    std::condition_variable notified;
+    uint32_t notifyCount = 0;
+};
+
+struct QueueDefinition
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    /* Items are only stored when itemSize is not 0, semaphores just count */
+    std::deque<std::vector<uint8_t>> items;
+    UBaseType_t count = 0;
+};
+
+struct EventGroupDef_t
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    EventBits_t bits = 0;
+};
+
+/* Thrown by vTaskDelete(NULL) to unwind the task thread */
+struct TaskDeleted
+{
+};
+
+static thread_local TaskHandle_t s_current_task = NULL;
+
+/* Waits on a condition variable for a number of ticks, portMAX_DELAY waits forever */
+template <typename Predicate>
+static bool wait_ticks(std::condition_variable &cv, std::unique_lock<std::mutex> &lock, TickType_t ticks, Predicate ready)
+{
+    if (ticks == portMAX_DELAY)
+    {
+        cv.wait(lock, ready);
+        return true;
+    }
+    return cv.wait_for(lock, std::chrono::milliseconds((uint64_t)ticks * portTICK_PERIOD_MS), ready);
+}
+
+void vAssertCalled(const char *file, int line)
+{
+    fprintf(stderr, "configASSERT failed at %s:%d\n", file, line);
+    abort();
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth,
+                                   void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask,
+                                   BaseType_t xCoreID)
+{
+    TaskHandle_t task = new tskTaskControlBlock();
+    task->name = pcName != NULL ? pcName : "";
+    task->stackDepth = usStackDepth;
+
+    /* The handle is published before the task runs, as with FreeRTOS when the
+     * new task has a lower priority than its creator */
+    if (pxCreatedTask != NULL)
+    {
+        *pxCreatedTask = task;
+    }
+
+    std::thread([task, pxTaskCode, pvParameters]() {
+        s_current_task = task;
+        try
+        {
+            pxTaskCode(pvParameters);
+        }
+        catch (const TaskDeleted &)
+        {
+        }
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t pxTaskCode, const char *pcName, uint32_t usStackDepth,
+                       void *pvParameters, UBaseType_t uxPriority, TaskHandle_t *pxCreatedTask)
+{
+    return xTaskCreatePinnedToCore(pxTaskCode, pcName, usStackDepth, pvParameters, uxPriority, pxCreatedTask,
+                                   tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    if (xTaskToDelete != NULL && xTaskToDelete != xTaskGetCurrentTaskHandle())
+    {
+        fprintf(stderr, "vTaskDelete of another task is not supported on the host\n");
+        abort();
+    }
+    /* The control block is leaked, a late xTaskNotifyGive() must not crash */
+    throw TaskDeleted();
+}
+
+void vTaskDelay(TickType_t xTicksToDelay)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds((uint64_t)xTicksToDelay * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if (s_current_task == NULL)
+    {
+        /* A thread that was not created by the shim, like main() */
+        s_current_task = new tskTaskControlBlock();
+        s_current_task->name = "main";
+    }
+    return s_current_task;
+}
+
+const char *pcTaskGetName(TaskHandle_t xTaskToQuery)
+{
+    TaskHandle_t task = xTaskToQuery != NULL ? xTaskToQuery : xTaskGetCurrentTaskHandle();
+    return task->name.c_str();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+{
+    TaskHandle_t task = xTask != NULL ? xTask : xTaskGetCurrentTaskHandle();
+    return task->stackDepth;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->lock);
+
+    wait_ticks(task->notified, lock, xTicksToWait, [task] { return task->notifyCount > 0; });
+
+    uint32_t count = task->notifyCount;
+    if (count > 0)
+    {
+        task->notifyCount = xClearCountOnExit ? 0 : count - 1;
+    }
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    {
+        std::lock_guard<std::mutex> lock(xTaskToNotify->lock);
+        xTaskToNotify->notifyCount++;
+    }
+    xTaskToNotify->notified.notify_all();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    xTaskNotifyGive(xTaskToNotify);
+    if (pxHigherPriorityTaskWoken != NULL)
+    {
+        *pxHigherPriorityTaskWoken = pdTRUE;
+    }
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    QueueHandle_t queue = new QueueDefinition();
+    queue->length = uxQueueLength;
+    queue->itemSize = uxItemSize;
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    delete xQueue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    std::unique_lock<std::mutex> lock(xQueue->lock);
+
+    if (!wait_ticks(xQueue->changed, lock, xTicksToWait, [xQueue] { return xQueue->count < xQueue->length; }))
+    {
+        return pdFALSE;
+    }
+    if (xQueue->itemSize > 0)
+    {
+        const uint8_t *item = (const uint8_t *)pvItemToQueue;
+        xQueue->items.emplace_back(item, item + xQueue->itemSize);
+    }
+    xQueue->count++;
+    lock.unlock();
+    xQueue->changed.notify_all();
+    return pdTRUE;
+}
+
+BaseType_t xQueueOverwrite(QueueHandle_t xQueue, const void *pvItemToQueue)
+{
+    std::unique_lock<std::mutex> lock(xQueue->lock);
+
+    if (xQueue->count > 0)
+    {
+        xQueue->items.clear();
+        xQueue->count = 0;
+    }
+    if (xQueue->itemSize > 0)
+    {
+        const uint8_t *item = (const uint8_t *)pvItemToQueue;
+        xQueue->items.emplace_back(item, item + xQueue->itemSize);
+    }
+    xQueue->count++;
+    lock.unlock();
+    xQueue->changed.notify_all();
+    return pdPASS;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    BaseType_t sent = xQueueSend(xQueue, pvItemToQueue, 0);
+    if (sent == pdTRUE && pxHigherPriorityTaskWoken != NULL)
+    {
+        *pxHigherPriorityTaskWoken = pdTRUE;
+    }
+    return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    std::unique_lock<std::mutex> lock(xQueue->lock);
+
+    if (!wait_ticks(xQueue->changed, lock, xTicksToWait, [xQueue] { return xQueue->count > 0; }))
+    {
+        return pdFALSE;
+    }
+    if (xQueue->itemSize > 0)
+    {
+        memcpy(pvBuffer, xQueue->items.front().data(), xQueue->itemSize);
+        xQueue->items.pop_front();
+    }
+    xQueue->count--;
+    lock.unlock();
+    xQueue->changed.notify_all();
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t xQueue)
+{
+    std::lock_guard<std::mutex> lock(xQueue->lock);
+    return xQueue->count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    SemaphoreHandle_t semaphore = xQueueCreate(uxMaxCount, 0);
+    semaphore->count = uxInitialCount;
+    return semaphore;
+}
+
+EventGroupHandle_t xEventGroupCreate(void)
+{
+    return new EventGroupDef_t();
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToSet)
+{
+    EventBits_t bits;
+    {
+        std::lock_guard<std::mutex> lock(xEventGroup->lock);
+        xEventGroup->bits |= uxBitsToSet;
+        bits = xEventGroup->bits;
+    }
+    xEventGroup->changed.notify_all();
+    return bits;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToClear)
+{
+    std::lock_guard<std::mutex> lock(xEventGroup->lock);
+    EventBits_t bits = xEventGroup->bits;
+    xEventGroup->bits &= ~uxBitsToClear;
+    return bits;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t xEventGroup)
+{
+    std::lock_guard<std::mutex> lock(xEventGroup->lock);
+    return xEventGroup->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup, EventBits_t uxBitsToWaitFor,
+                                BaseType_t xClearOnExit, BaseType_t xWaitForAllBits, TickType_t xTicksToWait)
+{
+    std::unique_lock<std::mutex> lock(xEventGroup->lock);
+    auto ready = [&] {
+        EventBits_t set = xEventGroup->bits & uxBitsToWaitFor;
+        return xWaitForAllBits ? set == uxBitsToWaitFor : set != 0;
+    };
+
+    bool met = wait_ticks(xEventGroup->changed, lock, xTicksToWait, ready);
+    EventBits_t bits = xEventGroup->bits;
+    if (met && xClearOnExit)
+    {
+        xEventGroup->bits &= ~uxBitsToWaitFor;
+    }
+    return bits;
+}
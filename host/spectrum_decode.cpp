@@ -0,0 +1,130 @@
+/*
+ * Decodes the delta coded spectra of a device with the spectrum_codec library,
+ * the way the Linux side of the telemetry does. Reads one message per line,
+ * a telemetry message with a spectrumCoded field or the bare base64 text,
+ * and prints the bins of each spectrum as a JSON line:
+ *
+ *   {"sequence":12,"keyframe":false,"FFT":[...],"envelope":[...]}
+ *
+ * A delta after a lost message prints {"sequence":n,"status":"needKeyframe"}
+ * instead, call the requestKeyframe command of the device then. Messages of
+ * one device only, in the order they were sent.
+ *
+ *   spectrum_decode < messages.jsonl
+ *
+ * Exits with 1 if a coded spectrum is not valid.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "spectrum_codec.h"
+
+#define CODED_FIELD "\"spectrumCoded\":\""
+
+static int base64_value(char c)
+{
+    if (c >= 'A' && c <= 'Z')
+    {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z')
+    {
+        return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9')
+    {
+        return c - '0' + 52;
+    }
+    return c == '+' ? 62 : c == '/' ? 63 : -1;
+}
+
+/* Up to the first character out of the alphabet, padding included */
+static void base64_decode(const char *text, std::vector<uint8_t> *data)
+{
+    uint32_t bits = 0;
+    int count = 0;
+
+    data->clear();
+    for (; base64_value(*text) >= 0; text++)
+    {
+        bits = bits << 6 | base64_value(*text);
+        count += 6;
+        if (count >= 8)
+        {
+            count -= 8;
+            data->push_back((bits >> count) & 0xFF);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static SpectrumDecoder decoder;
+    std::vector<uint8_t> coded;
+    char *line = NULL;
+    size_t length = 0;
+    int invalid = 0;
+
+    if (argc != 1)
+    {
+        fprintf(stderr, "usage: %s < MESSAGES\n", argv[0]);
+        return 2;
+    }
+    while (getline(&line, &length, stdin) > 0)
+    {
+        const char *field = strstr(line, CODED_FIELD);
+        const char *text = field != NULL ? field + strlen(CODED_FIELD) : line;
+        if (field == NULL && strchr(line, '{') != NULL)
+        {
+            /* A message without a spectrum */
+            continue;
+        }
+        base64_decode(text, &coded);
+        if (coded.empty())
+        {
+            continue;
+        }
+
+        const SpectrumCodecStatus status = decoder.decode(coded.data(), coded.size());
+        const unsigned sequence = coded.size() >= 4 ? coded[2] | coded[3] << 8 : 0;
+        if (status == SPECTRUM_INVALID)
+        {
+            printf("{\"sequence\":%u,\"status\":\"invalid\"}\n", sequence);
+            invalid++;
+            continue;
+        }
+        if (status == SPECTRUM_NEED_KEYFRAME)
+        {
+            printf("{\"sequence\":%u,\"status\":\"needKeyframe\"}\n", sequence);
+            continue;
+        }
+        if (status == SPECTRUM_DUPLICATE)
+        {
+            continue;
+        }
+        printf("{\"sequence\":%u,\"keyframe\":%s", decoder.sequence(), decoder.keyframe() ? "true" : "false");
+        for (uint8_t c = 0; c < decoder.channels(); c++)
+        {
+            const char *name = spectrum_channel_name(decoder.id(c));
+            if (name != NULL)
+            {
+                printf(",\"%s\":[", name);
+            }
+            else
+            {
+                printf(",\"channel%u\":[", decoder.id(c));
+            }
+            for (uint16_t i = 0; i < decoder.count(c); i++)
+            {
+                printf(i == 0 ? "%.7g" : ",%.7g", decoder.values(c)[i]);
+            }
+            printf("]");
+        }
+        printf("}\n");
+    }
+    free(line);
+    return invalid == 0 ? 0 : 1;
+}
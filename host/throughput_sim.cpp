@@ -0,0 +1,223 @@
+/*
+ * Runs SimulatedImu at a given ODR, with readFifo() taking the bus time of a
+ * QMI8658 FIFO drain (imu_bus.h), drains it block by block like the read
+ * task of main/QMI8658_setup.cpp and reports the sustained sample rate and
+ * the samples lost to FIFO overflows. --gyro captures the 6 axis samples,
+ * which come at the gyroscope rates and take twice the bus time.
+ *
+ * --budget prints the bus time budget of the drain for the supported ODRs
+ * and buses instead.
+ *
+ * Exits with 1 if more than --max-loss percent of the samples were lost, so
+ * it can gate CI. The samples are paced against the host clock, and a drain
+ * late by a scheduling delay of the host loses a few: a bus too slow for the
+ * ODR loses a share of every drain instead, tens of percent.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "QMI8658_setup.h"
+#include "imu_bus.h"
+#include "simulated_imu.h"
+
+#define READER_TASK_PRIORITY 6
+/* Default of --max-loss, in percent: host scheduling delays lose up to about 0.5 % */
+#define MAX_LOSS_PERCENT 1.0f
+
+static SimulatedImu *s_imu;
+static TaskHandle_t s_reader;
+static uint16_t s_watermark = SAMPLES_NUM;
+static volatile uint64_t s_read;
+static bool s_gyro;
+
+struct BusSetting
+{
+    ImuBus bus;
+    uint32_t clockHz;
+};
+
+static const char *bus_name(ImuBus bus)
+{
+    return bus == IMU_BUS_SPI ? "SPI" : bus == IMU_BUS_I2C ? "I2C" : "no bus";
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+            "usage: %s [options]\n"
+            "  --odr HZ           accelerometer ODR, up to 8000 (default 8000)\n"
+            "  --bus i2c|spi      bus of the drain (default spi)\n"
+            "  --clock HZ         bus clock (default 400000 on I2C, 10000000 on SPI)\n"
+            "  --watermark N      samples per drain (default %d)\n"
+            "  --gyro             capture the gyroscope too (6 axis samples)\n"
+            "  --seconds S        length of the run (default 5)\n"
+            "  --max-loss PERCENT samples that may be lost to host scheduling (default %.0f)\n"
+            "  --budget           print the bus time budget table and exit\n",
+            name, SAMPLES_NUM, MAX_LOSS_PERCENT);
+}
+
+static void print_budget()
+{
+    static const BusSetting buses[] = {
+        {IMU_BUS_I2C, 400000},
+        {IMU_BUS_I2C, 1000000},
+        {IMU_BUS_SPI, 10000000},
+    };
+    static const uint16_t odrs[] = {1000, 2000, 4000, 8000};
+    const uint8_t sampleBytes = s_gyro ? 12 : 6;
+
+    printf("QMI8658 %s FIFO drain of %d samples (%d bytes), FIFO of %d samples\n", s_gyro ? "6 axis" : "accelerometer",
+           s_watermark, s_watermark * sampleBytes, SIMULATED_IMU_FIFO_SIZE);
+    printf("%-4s %9s %7s %10s %10s %8s  %s\n", "bus", "clock Hz", "ODR Hz", "drain us", "slack us", "load %", "");
+    for (const BusSetting &setting : buses)
+    {
+        float drainUs = imu_drain_time_us(setting.bus, setting.clockHz, s_watermark, sampleBytes);
+        for (uint16_t odr : odrs)
+        {
+            float rate = s_gyro ? imu_6axis_odr_hz(odr) : odr;
+            float slackUs = imu_fifo_slack_us(rate, SIMULATED_IMU_FIFO_SIZE, s_watermark);
+            float load = imu_bus_load(drainUs, rate, s_watermark);
+            printf("%-4s %9u %7.0f %10.0f %10.0f %8.1f  %s\n", bus_name(setting.bus), setting.clockHz, rate,
+                   drainUs, slackUs, 100 * load, drainUs < slackUs ? "ok" : "overflows");
+        }
+    }
+}
+
+static void on_watermark()
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    vTaskNotifyGiveFromISR(s_reader, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+static void vTaskReader(void *pvParameters)
+{
+    (void)pvParameters;
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        s_read += s_imu->readFifo(NULL, s_watermark);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    SimulatedImuConfig config = simulated_imu_default_config();
+    uint16_t odr = 8000;
+    float seconds = 5;
+    float maxLossPercent = MAX_LOSS_PERCENT;
+    bool budget = false;
+
+    config.bus = IMU_BUS_SPI;
+    config.busClockHz = 0;
+    config.odrErrorPpm = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *option = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (strcmp(option, "--budget") == 0)
+        {
+            budget = true;
+            continue;
+        }
+        if (strcmp(option, "--gyro") == 0)
+        {
+            s_gyro = true;
+            continue;
+        }
+        if (value == NULL)
+        {
+            usage(argv[0]);
+            return 2;
+        }
+        i++;
+
+        if (strcmp(option, "--odr") == 0)
+        {
+            odr = (uint16_t)atoi(value);
+        }
+        else if (strcmp(option, "--bus") == 0 && (strcmp(value, "i2c") == 0 || strcmp(value, "spi") == 0))
+        {
+            config.bus = strcmp(value, "i2c") == 0 ? IMU_BUS_I2C : IMU_BUS_SPI;
+        }
+        else if (strcmp(option, "--clock") == 0)
+        {
+            config.busClockHz = (uint32_t)strtoul(value, NULL, 10);
+        }
+        else if (strcmp(option, "--watermark") == 0)
+        {
+            s_watermark = (uint16_t)atoi(value);
+        }
+        else if (strcmp(option, "--seconds") == 0)
+        {
+            seconds = strtof(value, NULL);
+        }
+        else if (strcmp(option, "--max-loss") == 0)
+        {
+            maxLossPercent = strtof(value, NULL);
+        }
+        else
+        {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (config.busClockHz == 0)
+    {
+        config.busClockHz = config.bus == IMU_BUS_I2C ? 400000 : 10000000;
+    }
+
+    if (budget)
+    {
+        print_budget();
+        return 0;
+    }
+
+    static SimulatedImu imu(config);
+    s_imu = &imu;
+    esp_log_level_set("*", ESP_LOG_WARN);
+    if (!imu.begin() || !imu.configAccelerometer(ImuSensor::ACCEL_RANGE_2G, odr) ||
+        (s_gyro && !imu.configGyroscope(ImuSensor::GYRO_RANGE_256DPS)) || !imu.configFifo(s_watermark) ||
+        seconds <= 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+    imu.setWatermarkCallback(on_watermark);
+    xTaskCreatePinnedToCore(vTaskReader, "ReaderTask", 4096, NULL, READER_TASK_PRIORITY, &s_reader, 1);
+
+    const float drainUs = imu.drainTimeUs(s_watermark);
+    const float rate = s_gyro ? imu_6axis_odr_hz(odr) : odr;
+    const int64_t start = esp_timer_get_time();
+    imu.enable();
+    vTaskDelay(pdMS_TO_TICKS((uint32_t)(seconds * 1000)));
+    const double elapsed = (esp_timer_get_time() - start) / 1e6;
+    const uint64_t read = s_read;
+    const uint32_t lost = imu.overflows();
+    const uint64_t generated = imu.samplesGenerated();
+    const float lostPercent = generated > 0 ? 100.0f * lost / generated : 0.0f;
+
+    printf("ODR %.1f Hz %s, %s at %u Hz, %u samples per drain: drain %.0f us, slack %.0f us, bus load %.1f %%\n",
+           rate, s_gyro ? "6 axis" : "accelerometer", bus_name(config.bus), config.busClockHz, s_watermark, drainUs,
+           imu_fifo_slack_us(rate, imu.fifoSize(), s_watermark), 100 * imu_bus_load(drainUs, rate, s_watermark));
+    printf("%.0f samples/s sustained over %.1f s, %llu generated, %u lost to FIFO overflows (%.2f %%)\n",
+           read / elapsed, elapsed, (unsigned long long)generated, lost, lostPercent);
+    if (lostPercent > maxLossPercent)
+    {
+        printf("more than %.2f %% lost\n", maxLossPercent);
+    }
+
+    /* The simulator task never returns, leave without running static destructors under it */
+    fflush(stdout);
+    _exit(lostPercent <= maxLossPercent ? 0 : 1);
+}
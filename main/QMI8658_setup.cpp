@@ -1,100 +1,1319 @@
-#include "Arduino.h"
-#include <Wire.h>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"
+#endif
 
 #include "QMI8658_setup.h"
 #include "arduinoFFT.h"
-#include "SensorQMI8658.hpp"
-#include "device_configuration.h"
+#include "auto_range.h"
+#include "band_alarms.h"
+#include "cepstrum.h"
+#include "envelope.h"
+#include "fault_classifier.h"
+#include "file_setup.h"
+#include "fixed_fft.h"
+#include "imu_bus.h"
+#include "imu_sensor.h"
+#include "octave_bands.h"
+#include "system_events.h"
+#include "odr_clock.h"
+#include "order_tracker.h"
+#include "resampler.h"
+#include "sample_ring.h"
+#include "spectral_baseline.h"
+#include "spectral_peaks.h"
+#include "tachometer.h"
+#include "time_features.h"
+#include "vibration_severity.h"
 
-SensorQMI8658 qmi;
+ImuSensor *imu = NULL;
 
-#define FREQUENCY 1000
 #define GRAVITY 9.81
 
 SemaphoreHandle_t xMutex = xSemaphoreCreateMutex();
-SemaphoreHandle_t canRead = xSemaphoreCreateMutex();
+QueueHandle_t spectrumQueue = xQueueCreate(SPECTRUM_QUEUE_LENGTH, sizeof(SpectrumFrame));
+QueueHandle_t featureQueue = xQueueCreate(FEATURE_QUEUE_LENGTH, sizeof(FeatureFrame));
+QueueHandle_t anomalyQueue = xQueueCreate(ANOMALY_QUEUE_LENGTH, sizeof(AnomalyFrame));
+QueueHandle_t alarmQueue = xQueueCreate(ALARM_QUEUE_LENGTH, sizeof(AlarmFrame));
+/* One snapshot of each source at a time, the ring or the capture buffer holds it until it was uploaded */
+QueueHandle_t snapshotQueue = xQueueCreate(2, sizeof(SnapshotFrame));
 
-IMUdata acceleration[TOTAL_READS];
+#if ENABLE_GYRO
+/* Every axis of the window in sensor counts, in ImuSensor::Axis order. Sample
+ * i of each axis comes from the same FIFO sample, so the axes stay in sync */
+#define CAPTURED_AXES ImuSensor::AXES
+#define FIRST_CAPTURED_AXIS ImuSensor::ACCEL_X
+#else
+/* z axis of the window in sensor counts, the only axis analysed */
+#define CAPTURED_AXES 1
+#define FIRST_CAPTURED_AXIS ImuSensor::ACCEL_Z
+#endif
+int16_t capture[CAPTURED_AXES][CAPTURE_READS * SAMPLES_NUM];
+int16_t *const accelerationZ = capture[ImuSensor::ACCEL_Z - FIRST_CAPTURED_AXIS];
 TaskHandle_t readDataHandle = NULL;
 TaskHandle_t calculateFFTHandle = NULL;
 
+ImuSensor::AccelRange accelRange = ACCEL_RANGE;
+/* x, y and z, any of them clips */
+#define ACCEL_AXES 3
+#if AUTO_RANGE
+AutoRange autoRange(ACCEL_RANGE, ImuSensor::ACCEL_RANGE_2G, ImuSensor::ACCEL_RANGE_16G);
+#endif
+/* Range the window in accelerationZ was captured with, its clipped samples,
+ * the watermark interrupt of its first block and the measured ODR. Feature
+ * windows in between leave them alone */
+ImuSensor::AccelRange windowRange = ACCEL_RANGE;
+uint16_t windowClipped = 0;
+int64_t windowStartedAt = 0;
+float windowRate = SAMPLE_RATE_HZ;
+
+#if FIXED_POINT_FFT
+/* Sensor counts of the window, replaced in place by the spectrum */
+int16_t counts[TOTAL_READS];
+FixedFFT<int16_t> fixedFFT(counts, TOTAL_READS);
+#if ENVELOPE_ANALYSIS
+FixedFFT<int16_t> envelopeFFT(counts, ENVELOPE_POINTS);
+#endif
+#if ORDER_TRACKING
+FixedFFT<int16_t> orderFFT(counts, ORDER_POINTS);
+#endif
+#else
 float vImag[TOTAL_READS];
 float reads[TOTAL_READS];
+#endif
+
+/* Monotonic time of the last FIFO watermark interrupt */
+volatile int64_t fifoInterruptAt = 0;
+
+OdrClock odrClock(SAMPLE_RATE_HZ);
+Resampler resampler;
+
+#if FIXED_POINT_FFT
+/* The FFT input is in sensor counts */
+static float inputScale(float countScale)
+{
+    (void)countScale;
+    return 1.0f;
+}
+
+static void storeSample(int index, float value)
+{
+    counts[index] = (int16_t)std::min(32767L, std::max(-32768L, lroundf(value)));
+}
+
+/* Spectrum of the stored window, returns the weight of a bin in input units */
+static float computeSpectrum(FixedFFT<int16_t> &fft = fixedFFT)
+{
+    fft.dcRemoval();
+    fft.windowing(FFTWindow::Blackman_Harris);
+    fft.compute();
+    fft.complexToMagnitude();
+    return ldexpf(1.0f, fft.exponent());
+}
+
+static float spectrumBin(int index)
+{
+    return counts[index];
+}
+
+static const int16_t *spectrumBins()
+{
+    return counts;
+}
+
+#if CEPSTRUM_ANALYSIS
+/* The transform of a real input leaves bin k in counts[2k], its real part first */
+#define CEPSTRUM_STRIDE 2
+
+/* Real cepstrum of the magnitudes in counts, in place, returns the weight of a stored value */
+static float computeCepstrum()
+{
+    cepstrum_log_spectrum(counts, TOTAL_READS);
+    fixedFFT.compute(-CEPSTRUM_LOG_FRACTION_BITS);
+    return ldexpf(1.0f, fixedFFT.exponent()) / TOTAL_READS;
+}
+#endif
+#else
+ArduinoFFT<float> FFT = ArduinoFFT<float>(reads, vImag, TOTAL_READS, SAMPLE_RATE_HZ);
+#if ENVELOPE_ANALYSIS
+ArduinoFFT<float> envelopeFFT = ArduinoFFT<float>(reads, vImag, ENVELOPE_POINTS, SAMPLE_RATE_HZ / ENVELOPE_DECIMATION);
+#endif
+#if ORDER_TRACKING
+/* Sampled per revolution, the rate is only used by functions of arduinoFFT the pipeline does not call */
+ArduinoFFT<float> orderFFT = ArduinoFFT<float>(reads, vImag, ORDER_POINTS, ORDER_SAMPLES_PER_REV);
+#endif
+
+/* The FFT input is in physical units */
+static float inputScale(float countScale)
+{
+    return countScale;
+}
+
+static void storeSample(int index, float value)
+{
+    reads[index] = value;
+}
+
+static float computeSpectrum(ArduinoFFT<float> &fft = FFT)
+{
+    memset(vImag, 0, sizeof(vImag));
+    fft.dcRemoval();
+    fft.windowing(FFTWindow::Blackman_Harris, FFTDirection::Forward);
+    fft.compute(FFTDirection::Forward);
+    fft.complexToMagnitude();
+    return 1.0f;
+}
+
+static float spectrumBin(int index)
+{
+    return reads[index];
+}
+
+static const float *spectrumBins()
+{
+    return reads;
+}
+
+#if CEPSTRUM_ANALYSIS
+#define CEPSTRUM_STRIDE 1
+
+/* Real cepstrum of the magnitudes in reads, in place, returns the weight of a stored value */
+static float computeCepstrum()
+{
+    cepstrum_log_spectrum(reads, TOTAL_READS);
+    memset(vImag, 0, sizeof(vImag));
+    FFT.compute(FFTDirection::Forward);
+    return 1.0f / TOTAL_READS;
+}
+#endif
+#endif
+
+/* Keep the newest frames while nobody is publishing them */
+template <typename Frame>
+static void queueNewest(QueueHandle_t queue, const Frame &frame, const char *name)
+{
+    if (xQueueSend(queue, &frame, 0) != pdTRUE)
+    {
+        Frame dropped;
+        xQueueReceive(queue, &dropped, 0);
+        xQueueSend(queue, &frame, 0);
+        ESP_LOGW("QMI8658", "%s queue full, dropped the oldest frame", name);
+    }
+}
+
+/* Weight of a count of an ImuSensor::Axis in the units of the features */
+static float axisScale(int axis, ImuSensor::AccelRange range)
+{
+    return axis < ImuSensor::GYRO_X ? GRAVITY * imu_count_g(range) : imu_count_dps(GYRO_RANGE);
+}
+
+/* Velocity and displacement RMS of the window from its acceleration spectrum,
+ * @p magnitudeScale turns a bin into m/s2 */
+static void severity(SpectrumFrame &frame, float magnitudeScale)
+{
+    double velocity = 0;
+    double displacement = 0;
+
+    for (int i = 1; i < TOTAL_READS / 2; i++)
+    {
+        const float hz = i * frame.binWidth;
+        const float acceleration = spectrumBin(i) * magnitudeScale;
+        const float v = acceleration * severity_gain(SEVERITY_VELOCITY, hz);
+        const float d = acceleration * severity_gain(SEVERITY_DISPLACEMENT, hz);
+        velocity += v * v;
+        displacement += d * d;
+    }
+    frame.velocityRms = spectrum_rms(velocity, TOTAL_READS);
+    frame.displacementRms = spectrum_rms(displacement, TOTAL_READS);
+    frame.isoZone = iso_zone(frame.velocityRms);
+}
+
+#if ENABLE_GYRO
+/* Strongest tone of each gyroscope axis, from the raw samples at the
+ * measured rate. Uses the FFT buffers, so it runs before the z window is
+ * stored */
+static void angularFeatures(SpectrumFrame &frame)
+{
+    const float gyroScale = imu_count_dps(GYRO_RANGE);
+    const float scale = inputScale(gyroScale);
+
+    for (int axis = 0; axis < 3; axis++)
+    {
+        const int16_t *samples = capture[ImuSensor::GYRO_X + axis];
+        for (int i = 0; i < TOTAL_READS; i++)
+        {
+            storeSample(i, samples[i] * scale);
+        }
+        const float magnitudeScale = computeSpectrum() * gyroScale / scale;
+
+        int peak = 1;
+        for (int i = 2; i < TOTAL_READS / 2; i++)
+        {
+            peak = spectrumBin(i) > spectrumBin(peak) ? i : peak;
+        }
+        frame.gyroPeakHz[axis] = peak * frame.sampleRate / TOTAL_READS;
+        frame.gyroPeakDps[axis] = 2 * spectrumBin(peak) * magnitudeScale / (TOTAL_READS * BLACKMAN_HARRIS_GAIN);
+    }
+}
+#endif
+
+#if ENVELOPE_ANALYSIS
+/* Envelope of the z window in FFT input units, kept from the capture until
+ * the z spectrum has freed the FFT buffers */
+float envelope[ENVELOPE_POINTS];
+EnvelopeDetector envelopeDetector;
+
+/* Runs the z window through the envelope detector at the measured rate. The
+ * blocks captured beyond NUM_READS let the filters settle first */
+static void detectEnvelope(float sampleRate, float scale)
+{
+    float block[SAMPLES_NUM];
+    size_t written = 0;
+
+    envelopeDetector.configure(sampleRate, ENVELOPE_BAND_LOW_HZ, ENVELOPE_BAND_HIGH_HZ, ENVELOPE_DECIMATION);
+    for (int i = 0; i < CAPTURE_READS; i++)
+    {
+        for (int j = 0; j < SAMPLES_NUM; j++)
+        {
+            block[j] = accelerationZ[i * SAMPLES_NUM + j] * scale;
+        }
+        const bool settling = i < CAPTURE_READS - NUM_READS;
+        written += envelopeDetector.process(block, SAMPLES_NUM, settling ? NULL : &envelope[written],
+                                            ENVELOPE_POINTS - written);
+    }
+}
+
+/* Envelope spectrum into the frame, in the FFT buffers once the z bins are out */
+static void envelopeSpectrum(SpectrumFrame &frame, float countScale, float scale)
+{
+    for (int i = 0; i < ENVELOPE_POINTS; i++)
+    {
+        storeSample(i, envelope[i]);
+    }
+    const float magnitudeScale = computeSpectrum(envelopeFFT) * countScale / scale;
+
+    frame.envelopeBinWidth = frame.sampleRate / ENVELOPE_DECIMATION / ENVELOPE_POINTS;
+    for (int i = 0; i < ENVELOPE_BINS; i++)
+    {
+        frame.envelope[i] = spectrumBin(i) * magnitudeScale;
+    }
+}
+#endif
+
+#if ORDER_TRACKING
+OrderTracker orderTracker(ORDER_SAMPLES_PER_REV);
+/* z of the spectrum window at ORDER_SAMPLES_PER_REV per revolution in sensor
+ * counts, filled by the read task block by block */
+float angularSamples[ORDER_POINTS];
+/* Copy of angularSamples for the FFT task, the read task may start the next window meanwhile */
+float orders[ORDER_POINTS];
+/* Angular samples and mean shaft rate of the window in angularSamples */
+uint16_t windowAngularSamples = 0;
+float windowShaftHz = 0;
+/* Shaft rate of the last spectrum, the speed of the next window without a tachometer */
+volatile float spectrumShaftHz = 0;
+
+/* Shaft rate at a block, 0 when unknown */
+static float shaftSpeed(int64_t blockAt)
+{
+#if ORDER_TACH_PIN >= 0
+    return tachometer_hz(blockAt);
+#else
+    (void)blockAt;
+    return spectrumShaftHz;
+#endif
+}
+
+#if ORDER_TACH_PIN < 0
+/* 1x peak of the z spectrum between ORDER_SHAFT_MIN_HZ and ORDER_SHAFT_MAX_HZ, interpolated between bins */
+static float shaftFromSpectrum(float binWidth)
+{
+    const int first = std::max(2, (int)ceilf(ORDER_SHAFT_MIN_HZ / binWidth));
+    const int last = std::min(TOTAL_READS / 2 - 2, (int)(ORDER_SHAFT_MAX_HZ / binWidth));
+    int peak = first;
+
+    for (int i = first + 1; i <= last; i++)
+    {
+        peak = spectrumBin(i) > spectrumBin(peak) ? i : peak;
+    }
+    return (peak + spectral_peak_offset(spectrumBin(peak - 1), spectrumBin(peak), spectrumBin(peak + 1))) * binWidth;
+}
+#endif
+
+/* Order spectrum of the window into the frame, in the FFT buffers once the z bins are out */
+static void orderSpectrum(SpectrumFrame &frame, uint16_t samples, float countScale, float scale)
+{
+    if (samples < ORDER_POINTS)
+    {
+        if (frame.shaftHz > 0)
+        {
+            ESP_LOGW("QMI8658", "%u of %d angular samples, the window spans less than %d revolutions at %.2f Hz",
+                     samples, ORDER_POINTS, ORDER_REVOLUTIONS, frame.shaftHz);
+        }
+        memset(frame.order, 0, sizeof(frame.order));
+        return;
+    }
+    for (int i = 0; i < ORDER_POINTS; i++)
+    {
+        storeSample(i, orders[i] * scale);
+    }
+    const float magnitudeScale = computeSpectrum(orderFFT) * countScale / scale;
+    for (int i = 0; i < ORDER_BINS; i++)
+    {
+        frame.order[i] = spectrumBin(i) * magnitudeScale;
+    }
+}
+#endif
+
+#if OCTAVE_ANALYSIS
+/* Laid out by setupQMI8658(), only the FFT task aggregates with it */
+OctaveBands octaveBands(TOTAL_READS / 2);
+
+const OctaveBands &octave_bands()
+{
+    return octaveBands;
+}
+#endif
+
+/* NVS key of the baseline */
+#define BASELINE_NVS_KEY "baseline"
+
+/* Only the FFT task touches the baseline, other tasks go through baselineCommand */
+SpectralBaseline baseline(TOTAL_READS / 2, SAMPLE_RATE_HZ, BASELINE_ALPHA, BASELINE_MIN_WINDOWS, ANOMALY_THRESHOLD);
+static volatile BaselineCommand baselineCommand = BASELINE_COMMAND_NONE;
+
+void request_baseline_command(BaselineCommand command)
+{
+    baselineCommand = command;
+}
+
+static void saveBaseline()
+{
+    const esp_err_t err = write_nvs_blob(BASELINE_NVS_KEY, &baseline.model(), sizeof(BaselineModel));
+    if (err != ESP_OK)
+    {
+        ESP_LOGW("QMI8658", "Failed to store the baseline (%s)", esp_err_to_name(err));
+    }
+}
+
+static void applyBaselineCommand()
+{
+    const BaselineCommand command = baselineCommand;
+    baselineCommand = BASELINE_COMMAND_NONE;
+
+    switch (command)
+    {
+    case BASELINE_COMMAND_LEARN:
+        baseline.learn();
+        break;
+    case BASELINE_COMMAND_FREEZE:
+        baseline.freeze();
+        break;
+    case BASELINE_COMMAND_RESET:
+        baseline.reset();
+        break;
+    default:
+        return;
+    }
+    ESP_LOGI("QMI8658", "Baseline %s after %u windows", baseline.mode() == BASELINE_FROZEN ? "frozen" : "learning",
+             (unsigned)baseline.windows());
+    saveBaseline();
+}
+
+/* Score the band levels against the baseline, one alert each time the score rises above ANOMALY_THRESHOLD */
+static void scoreAnomaly(SpectrumFrame &frame, const float *levels)
+{
+    static bool anomalous = false;
+    AnomalyFrame alert;
+
+    applyBaselineCommand();
+    const uint32_t learned = baseline.windows();
+    frame.anomalyScore = baseline.update(levels, alert.bandZ);
+    frame.baselineMode = baseline.mode();
+    frame.baselineWindows = baseline.windows();
+    if (baseline.windows() != learned && baseline.windows() % BASELINE_SAVE_WINDOWS == 0)
+    {
+        saveBaseline();
+    }
+
+    if (frame.anomalyScore < ANOMALY_CLEAR_RATIO * ANOMALY_THRESHOLD)
+    {
+        anomalous = false;
+    }
+    if (anomalous || frame.anomalyScore <= ANOMALY_THRESHOLD)
+    {
+        return;
+    }
+    anomalous = true;
+    alert.capturedAt = frame.capturedAt;
+    alert.score = frame.anomalyScore;
+    for (int band = 0; band <= BASELINE_BANDS; band++)
+    {
+        alert.bandEdgeHz[band] = spectral_band_edge(TOTAL_READS / 2, band) * frame.binWidth;
+    }
+    ESP_LOGW("QMI8658", "Anomaly score %.1f above %.1f", alert.score, ANOMALY_THRESHOLD);
+    queueNewest(anomalyQueue, alert, "Anomaly");
+}
+
+/* NVS key of the alarm bands set by command */
+#define ALARM_NVS_KEY "alarms"
+
+static AlarmConfig defaultAlarmConfig()
+{
+    static const AlarmBand bands[] = {ALARM_BANDS};
+    AlarmConfig config;
+
+    memset(&config, 0, sizeof(config));
+    config.count = std::min<size_t>(sizeof(bands) / sizeof(bands[0]), ALARM_BANDS_MAX);
+    config.hysteresis = ALARM_HYSTERESIS;
+    config.persistence = ALARM_PERSISTENCE;
+    memcpy(config.bands, bands, config.count * sizeof(AlarmBand));
+    return config;
+}
+
+/* Only the FFT task touches the alarms, other tasks go through alarmConfigQueue */
+BandAlarms bandAlarms(defaultAlarmConfig());
+QueueHandle_t alarmConfigQueue = xQueueCreate(1, sizeof(AlarmConfig));
+
+bool request_alarm_config(const AlarmConfig &config)
+{
+    if (!BandAlarms::valid(config))
+    {
+        return false;
+    }
+    xQueueOverwrite(alarmConfigQueue, &config);
+    return true;
+}
+
+#if RAW_SNAPSHOT
+/* z counts of the continuous stream, the read task keeps draining the FIFO between windows */
+int16_t ringSamples[SNAPSHOT_SAMPLES];
+SampleRing ring(ringSamples, SNAPSHOT_SAMPLES);
+/* Ring position of the end of the spectrum window in accelerationZ */
+uint64_t windowEnd = 0;
+/* Ring position of the end of the window that raised an alarm, from the FFT task to the read task */
+QueueHandle_t snapshotTriggerQueue = xQueueCreate(1, sizeof(uint64_t));
+#endif
+
+/* Recording for the captureWaveform command, from the IoT task to the read task */
+struct WaveformCapture
+{
+    int16_t *buffer;
+    /* Samples per axis */
+    uint32_t samples;
+    uint8_t axes;
+    /* Samples averaged into one */
+    uint16_t decimation;
+};
+QueueHandle_t captureRequestQueue = xQueueCreate(1, sizeof(WaveformCapture));
+/* Buffer of the capture, from the request until its snapshot is released */
+static int16_t *volatile captureBuffer = NULL;
+
+/* Snapshots of both sources so far, only counted by the read task */
+static uint32_t snapshots = 0;
+
+static int16_t *allocateCapture(size_t bytes)
+{
+#ifdef ESP_PLATFORM
+    void *buffer = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return (int16_t *)(buffer != NULL ? buffer : heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT));
+#else
+    return (int16_t *)malloc(bytes);
+#endif
+}
+
+esp_err_t request_waveform_capture(uint32_t durationMs, uint8_t axes, float *rateHz, uint32_t *samples)
+{
+    const int axisCount = __builtin_popcount(axes);
+
+    if (captureBuffer != NULL)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    /* The decimation is a uint16_t */
+    if (axisCount == 0 || (axes >> FEATURE_AXES) != 0 || durationMs == 0 || !(*rateHz >= SAMPLE_RATE_HZ / UINT16_MAX) ||
+        *rateHz > SAMPLE_RATE_HZ * 1.001f)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    WaveformCapture request;
+    request.axes = axes;
+    request.decimation = (uint16_t)std::max(1L, lroundf(SAMPLE_RATE_HZ / *rateHz));
+    *rateHz = SAMPLE_RATE_HZ / request.decimation;
+    *samples = request.samples = (uint32_t)(durationMs * (double)*rateHz / 1000);
+    const size_t bytes = (size_t)request.samples * axisCount * sizeof(int16_t);
+    if (request.samples == 0 || bytes > CAPTURE_MAX_BYTES)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    request.buffer = allocateCapture(bytes);
+    if (request.buffer == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    captureBuffer = request.buffer;
+    xQueueOverwrite(captureRequestQueue, &request);
+    return ESP_OK;
+}
+
+uint32_t read_snapshot(const SnapshotFrame &snapshot, uint32_t offset, int16_t *samples, uint32_t count)
+{
+    const uint32_t total = snapshot.count * __builtin_popcount(snapshot.axes);
+
+    if (offset >= total)
+    {
+        return 0;
+    }
+    count = std::min(count, total - offset);
+    if (snapshot.source == SNAPSHOT_COMMAND)
+    {
+        memcpy(samples, &captureBuffer[offset], count * sizeof(int16_t));
+        return count;
+    }
+#if RAW_SNAPSHOT
+    return ring.copy(snapshot.first + offset, samples, count);
+#else
+    return 0;
+#endif
+}
+
+void release_snapshot(const SnapshotFrame &snapshot)
+{
+    if (snapshot.source == SNAPSHOT_COMMAND)
+    {
+        free(captureBuffer);
+        captureBuffer = NULL;
+        return;
+    }
+#if RAW_SNAPSHOT
+    ring.release();
+#endif
+}
+
+/* Level of the alarm bands from the spectrum, an AlarmFrame for each band that
+ * changed and a snapshot around the window when one entered the alarm level */
+static void evaluateAlarms(SpectrumFrame &frame, float magnitudeScale, uint64_t trigger)
+{
+    AlarmConfig config;
+    if (xQueueReceive(alarmConfigQueue, &config, 0) == pdTRUE && bandAlarms.configure(config))
+    {
+        ESP_LOGI("QMI8658", "%u alarm bands set", config.count);
+        const esp_err_t err = write_nvs_blob(ALARM_NVS_KEY, &config, sizeof(config));
+        if (err != ESP_OK)
+        {
+            ESP_LOGW("QMI8658", "Failed to store the alarm bands (%s)", esp_err_to_name(err));
+        }
+    }
+
+    const AlarmConfig &bands = bandAlarms.config();
+    AlarmLevel previous[ALARM_BANDS_MAX];
+    frame.alarmBands = bands.count;
+    for (int i = 0; i < bands.count; i++)
+    {
+        frame.bandRms[i] = band_rms(spectrumBins(), TOTAL_READS, frame.binWidth, magnitudeScale, bands.bands[i]);
+        previous[i] = bandAlarms.level(i);
+    }
+    const uint8_t changed = bandAlarms.update(frame.bandRms);
+
+    bool alarm = false;
+    for (int i = 0; i < bands.count; i++)
+    {
+        frame.bandLevel[i] = bandAlarms.level(i);
+        if (!(changed & (1 << i)))
+        {
+            continue;
+        }
+        AlarmFrame event;
+        event.capturedAt = frame.capturedAt;
+        event.band = i;
+        event.level = frame.bandLevel[i];
+        event.previous = previous[i];
+        event.rms = frame.bandRms[i];
+        event.config = bands.bands[i];
+        ESP_LOGW("QMI8658", "Band %d (%.0f-%.0f Hz) level %u -> %u at %.2f", i, event.config.lowHz,
+                 event.config.highHz, event.previous, event.level, event.rms);
+        queueNewest(alarmQueue, event, "Alarm");
+        alarm |= event.level == ALARM_LEVEL_ALARM;
+    }
+#if RAW_SNAPSHOT
+    if (alarm)
+    {
+        xQueueOverwrite(snapshotTriggerQueue, &trigger);
+    }
+#endif
+}
+
+#if RAW_SNAPSHOT
+/* Freeze the ring once SNAPSHOT_POST_SAMPLES followed a trigger, and hand the snapshot to the IoT task */
+static void serviceSnapshot(int64_t blockAt)
+{
+    static uint64_t trigger = 0;
+    static bool pending = false;
+
+    if (!pending && xQueueReceive(snapshotTriggerQueue, &trigger, 0) == pdTRUE)
+    {
+        pending = !ring.isFrozen();
+        if (!pending)
+        {
+            ESP_LOGW("QMI8658", "Snapshot still uploading, alarm not captured");
+        }
+    }
+    /* A range switch may have restarted the ring past the trigger, the samples after it then count from there */
+    if (!pending || ring.end() < std::max(trigger, ring.begin()) + SNAPSHOT_POST_SAMPLES)
+    {
+        return;
+    }
+    pending = false;
+
+    SnapshotFrame snapshot;
+    snapshot.id = ++snapshots;
+    snapshot.source = SNAPSHOT_ALARM;
+    snapshot.axes = 1 << ImuSensor::ACCEL_Z;
+    snapshot.recordUs = 0;
+    snapshot.first = std::max(ring.begin(), trigger > SNAPSHOT_PRE_SAMPLES ? trigger - SNAPSHOT_PRE_SAMPLES : 0);
+    snapshot.count = (uint32_t)(ring.end() - snapshot.first);
+    snapshot.preTrigger = (uint32_t)(std::max(trigger, snapshot.first) - snapshot.first);
+    snapshot.sampleRate = odrClock.rateHz();
+    snapshot.scale = GRAVITY * imu_count_g(accelRange);
+    snapshot.gyroScale = imu_count_dps(GYRO_RANGE);
+    /* blockAt is the interrupt of the last block, about when its last sample was taken */
+    snapshot.capturedAt = blockAt - (int64_t)(snapshot.count * 1e6 / snapshot.sampleRate);
+    ring.freeze();
+    if (xQueueSend(snapshotQueue, &snapshot, 0) != pdTRUE)
+    {
+        ring.release();
+        ESP_LOGW("QMI8658", "Snapshot queue full, dropped snapshot %u", (unsigned)snapshot.id);
+    }
+}
+
+#endif
+
+/* Capture being recorded by the read task, and its snapshot so far */
+static bool recording = false;
+static WaveformCapture waveform;
+static SnapshotFrame captureFrame;
+static uint32_t captureWritten = 0;
+static uint16_t capturePhase = 0;
+static int32_t captureSums[FEATURE_AXES];
+
+/* A capture is recorded or about to be, the FIFO must then be drained between windows */
+static bool capturing()
+{
+    return recording || uxQueueMessagesWaiting(captureRequestQueue) > 0;
+}
+
+/* Average waveform.decimation samples of each axis of the capture into its buffer, interleaved */
+static void recordCapture(int16_t (*block)[SAMPLES_NUM], uint16_t count, int64_t blockAt)
+{
+    if (!recording)
+    {
+        if (xQueueReceive(captureRequestQueue, &waveform, 0) != pdTRUE)
+        {
+            return;
+        }
+        recording = true;
+        captureWritten = 0;
+        capturePhase = 0;
+        memset(captureSums, 0, sizeof(captureSums));
+        captureFrame.id = ++snapshots;
+        captureFrame.source = SNAPSHOT_COMMAND;
+        captureFrame.axes = waveform.axes;
+        captureFrame.capturedAt = odrClock.sampleTime(blockAt, 0, count);
+        captureFrame.sampleRate = odrClock.rateHz() / waveform.decimation;
+        captureFrame.scale = GRAVITY * imu_count_g(accelRange);
+        captureFrame.gyroScale = imu_count_dps(GYRO_RANGE);
+        captureFrame.count = waveform.samples;
+        captureFrame.preTrigger = 0;
+        captureFrame.first = 0;
+        captureFrame.recordUs = 0;
+    }
+
+    const int64_t startedAt = esp_timer_get_time();
+    const uint32_t total = waveform.samples * __builtin_popcount(waveform.axes);
+    for (uint16_t i = 0; i < count && recording; i++)
+    {
+        for (int axis = 0; axis < FEATURE_AXES; axis++)
+        {
+            captureSums[axis] += block[axis][i];
+        }
+        if (++capturePhase < waveform.decimation)
+        {
+            continue;
+        }
+        capturePhase = 0;
+        for (int axis = 0; axis < FEATURE_AXES; axis++)
+        {
+            if (waveform.axes & (1 << axis))
+            {
+                waveform.buffer[captureWritten++] = (int16_t)lroundf((float)captureSums[axis] / waveform.decimation);
+            }
+            captureSums[axis] = 0;
+        }
+        recording = captureWritten < total;
+    }
+    captureFrame.recordUs += (uint32_t)(esp_timer_get_time() - startedAt);
+
+    if (!recording)
+    {
+        ESP_LOGI("QMI8658", "Waveform %u recorded, %u samples per axis at %.1f Hz in %u us",
+                 (unsigned)captureFrame.id, (unsigned)captureFrame.count, captureFrame.sampleRate,
+                 (unsigned)captureFrame.recordUs);
+        if (xQueueSend(snapshotQueue, &captureFrame, 0) != pdTRUE)
+        {
+            ESP_LOGW("QMI8658", "Snapshot queue full, dropped waveform %u", (unsigned)captureFrame.id);
+            release_snapshot(captureFrame);
+        }
+    }
+}
+
+/* Everything a drained block feeds besides the window: the ring and the capture */
+static void keepBlock(int16_t (*block)[SAMPLES_NUM], uint16_t count, int64_t blockAt)
+{
+#if RAW_SNAPSHOT
+    ring.push(block[ImuSensor::ACCEL_Z], count);
+    serviceSnapshot(blockAt);
+#endif
+    recordCapture(block, count, blockAt);
+}
 
-ArduinoFFT<float> FFT = ArduinoFFT<float>(reads, vImag, TOTAL_READS, FREQUENCY);
+/* Read the blocks in the FIFO into keepBlock(), until @p until
+ * (esp_timer_get_time()), or until it is empty when 0 */
+static void drainFifo(int64_t until)
+{
+    int16_t block[FEATURE_AXES][SAMPLES_NUM];
+    int16_t *axes[ImuSensor::AXES] = {};
+    for (int axis = 0; axis < FEATURE_AXES; axis++)
+    {
+        axes[axis] = block[axis];
+    }
+
+    if (until == 0)
+    {
+        /* Bounded, the sensor goes on filling the FIFO while it drains */
+        for (int i = 0; i <= imu->fifoSize() / SAMPLES_NUM; i++)
+        {
+            const uint16_t read = imu->readFifo(axes, SAMPLES_NUM);
+            keepBlock(block, read, esp_timer_get_time());
+            if (read < SAMPLES_NUM)
+            {
+                break;
+            }
+        }
+        return;
+    }
+    for (int64_t now = esp_timer_get_time(); now < until; now = esp_timer_get_time())
+    {
+        if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS((until - now) / 1000) + 1) == 0)
+        {
+            continue;
+        }
+        const int64_t blockAt = fifoInterruptAt;
+        keepBlock(block, imu->readFifo(axes, SAMPLES_NUM), blockAt);
+    }
+}
 
 void vTaskReadDataFromSensorBuffer(void *pvParameters)
 {
-    vTaskSuspend(NULL);
+    (void)pvParameters;
+    /* One FIFO block of every feature axis */
+    int16_t block[FEATURE_AXES][SAMPLES_NUM];
+    TimeFeatures features[FEATURE_AXES];
+    FeatureFrame featureFrame;
+    int64_t spectrumAt = 0;
+    bool firstWindow = true;
+
     while (true)
     {
-        qmi.readFromFifo(acceleration, SAMPLES_NUM, NULL, 0);
+        /* Every ANALYSIS_PERIOD_MS the window is also kept for the spectrum */
+        const int64_t now = esp_timer_get_time();
+        bool spectrum = firstWindow || now - spectrumAt >= ANALYSIS_PERIOD_MS * 1000LL;
+        const int blocks = spectrum ? CAPTURE_READS : NUM_READS;
+        int64_t firstBlockAt = 0;
+        /* Of each accelerometer axis over the window, for the range */
+        int16_t peaks[ACCEL_AXES] = {};
+        int16_t offsets[ACCEL_AXES] = {};
+        uint16_t clipped = 0;
+#if ORDER_TRACKING
+        /* Spectrum windows are also resampled per revolution while the shaft speed is known */
+        bool tracking = spectrum;
+        size_t angular = 0;
+        double shaftSum = 0;
+        orderTracker.reset();
+#endif
+
+        if (spectrum)
+        {
+            spectrumAt = now;
+            firstWindow = false;
+        }
+        for (TimeFeatures &axis : features)
+        {
+            axis.reset();
+        }
+
         xSemaphoreTake(xMutex, portMAX_DELAY);
-        for(int i = 0; i < NUM_READS; i++)
+        /* Start the window from an empty FIFO, drop interrupts from the previous one first: the
+         * flush clears the interrupt, and one raised right after it must not be lost */
+        ulTaskNotifyTake(pdTRUE, 0);
+        if (RAW_SNAPSHOT || capturing())
+        {
+            /* The ring and the capture must not miss the samples between windows */
+            drainFifo(0);
+        }
+        else
         {
-            ESP_LOGI("QMI8658", "Reading data from sensor");
-            qmi.readFromFifo(&acceleration[i * SAMPLES_NUM], SAMPLES_NUM, NULL, 0);
-            vTaskSuspend(NULL);
+            imu->readFifo(NULL, imu->fifoSize());
+        }
+        odrClock.restart();
+
+        for(int i = 0; i < blocks; i++)
+        {
+            int16_t *axes[ImuSensor::AXES] = {};
+            for (int axis = 0; axis < FEATURE_AXES; axis++)
+            {
+                axes[axis] = block[axis];
+            }
+            /* Wait for the watermark interrupt */
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            const int64_t blockAt = fifoInterruptAt;
+            ESP_LOGD("QMI8658", "Reading data from sensor");
+            const uint16_t read = imu->readFifo(axes, SAMPLES_NUM);
+            if (read == SAMPLES_NUM)
+            {
+                odrClock.addBlock(blockAt, SAMPLES_NUM);
+            }
+            else
+            {
+                /* A bus error or a short FIFO leaves a gap in the stream: the rate fit starts over, and the
+                 * spectrum moves to the next window. The features and the range take what was read */
+                ESP_LOGW("QMI8658", "Read %u of %d samples, no spectrum from this window", read, SAMPLES_NUM);
+                odrClock.restart();
+                spectrumAt = spectrum ? 0 : spectrumAt;
+                spectrum = false;
+            }
+            firstBlockAt = i == 0 ? blockAt : firstBlockAt;
+            mark_boot_milestone(BOOT_MILESTONE_FIRST_SAMPLE);
+            keepBlock(block, read, blockAt);
+
+            /* Reduce the block while it is in cache */
+            for (int axis = 0; axis < FEATURE_AXES; axis++)
+            {
+                features[axis].addBlock(block[axis], read);
+            }
+            for (int axis = 0; axis < ACCEL_AXES; axis++)
+            {
+                int16_t blockPeak;
+                int16_t blockOffset;
+                clipped += AutoRange::measure(block[ImuSensor::ACCEL_X + axis], read, &blockPeak, &blockOffset);
+                peaks[axis] = std::max(peaks[axis], blockPeak);
+                offsets[axis] = std::max(offsets[axis], blockOffset);
+            }
+            if (spectrum)
+            {
+                for (int axis = 0; axis < CAPTURED_AXES; axis++)
+                {
+                    memcpy(&capture[axis][i * SAMPLES_NUM], block[FIRST_CAPTURED_AXIS + axis], sizeof(block[0]));
+                }
+            }
+#if ORDER_TRACKING
+            const float shaftHz = tracking && spectrum ? shaftSpeed(blockAt) : 0.0f;
+            tracking = shaftHz > 0;
+            if (tracking)
+            {
+                float z[SAMPLES_NUM];
+                for (int j = 0; j < read; j++)
+                {
+                    z[j] = block[ImuSensor::ACCEL_Z][j];
+                }
+                /* The first block only settles the anti aliasing filter */
+                const size_t capacity = i < CAPTURE_READS - NUM_READS ? 0 : ORDER_POINTS - angular;
+                angular += orderTracker.process(z, read, odrClock.rateHz(), shaftHz, &angularSamples[angular],
+                                                capacity);
+                shaftSum += shaftHz;
+            }
+#endif
+        }
+        featureFrame.capturedAt = odrClock.sampleTime(firstBlockAt, 0, SAMPLES_NUM);
+        if (spectrum)
+        {
+            windowRange = accelRange;
+            windowClipped = clipped;
+            windowStartedAt = firstBlockAt;
+            windowRate = odrClock.rateHz();
+#if RAW_SNAPSHOT
+            windowEnd = ring.end();
+#endif
+#if ORDER_TRACKING
+            windowAngularSamples = tracking ? (uint16_t)angular : 0;
+            windowShaftHz = tracking ? (float)(shaftSum / blocks) : 0.0f;
+#endif
         }
         xSemaphoreGive(xMutex);
-        vTaskDelay(30000 / portTICK_PERIOD_MS);
+        if (spectrum)
+        {
+            xTaskNotifyGive(calculateFFTHandle);
+        }
+
+        featureFrame.samples = (uint16_t)features[0].samples();
+        featureFrame.rangeG = imu_range_g(accelRange);
+        featureFrame.clipped = clipped;
+        for (int axis = 0; axis < FEATURE_AXES; axis++)
+        {
+            featureFrame.axes[axis] = features[axis].result(axisScale(axis, accelRange));
+        }
+        queueNewest(featureQueue, featureFrame, "Feature");
+
+        if (clipped > 0)
+        {
+            ESP_LOGW("QMI8658", "%u samples clipped at %.0f g", clipped, imu_range_g(accelRange));
+        }
+#if AUTO_RANGE
+        /* Switch between windows, the flush of the next one drops the samples of the old range. A capture
+         * keeps the range it started with */
+        ImuSensor::AccelRange range =
+            capturing() ? accelRange : autoRange.update(peaks, offsets, ACCEL_AXES, clipped);
+        if (range != accelRange)
+        {
+            if (imu->configAccelerometer(range, ACCEL_ODR_HZ))
+            {
+                ESP_LOGI("QMI8658", "Range %.0f g -> %.0f g, peak %.2f g about the mean", imu_range_g(accelRange),
+                         imu_range_g(range), *std::max_element(peaks, peaks + ACCEL_AXES) * imu_count_g(accelRange));
+                accelRange = range;
+#if RAW_SNAPSHOT
+                /* The counts of the two ranges do not mix, drop the samples of the old one */
+                imu->readFifo(NULL, imu->fifoSize());
+                ring.restart();
+#endif
+            }
+            else
+            {
+                ESP_LOGE("QMI8658", "Failed to switch to %.0f g", imu_range_g(range));
+            }
+        }
+#endif
+        if (RAW_SNAPSHOT || capturing())
+        {
+            drainFifo(esp_timer_get_time() + FEATURE_PERIOD_MS * 1000LL);
+        }
+        else
+        {
+            vTaskDelay(FEATURE_PERIOD_MS / portTICK_PERIOD_MS);
+        }
+    }
+}
+
+#if FAULT_CLASSIFIER
+/* Only the FFT task runs the model, the mutex keeps it off the partition while it is rewritten */
+static FaultClassifier faultClassifier;
+static SemaphoreHandle_t faultModelMutex = xSemaphoreCreateMutex();
+
+void suspend_fault_model()
+{
+    xSemaphoreTake(faultModelMutex, portMAX_DELAY);
+    faultClassifier.unload();
+    xSemaphoreGive(faultModelMutex);
+}
+
+uint32_t resume_fault_model()
+{
+    size_t size = 0;
+    uint32_t modelId = 0;
+
+    xSemaphoreTake(faultModelMutex, portMAX_DELAY);
+    const uint8_t *blob = map_fault_model(&size);
+    if (blob != NULL && faultClassifier.load(blob, size) && faultClassifier.inputs() == FAULT_MODEL_INPUTS)
+    {
+        modelId = faultClassifier.modelId();
+        ESP_LOGI("QMI8658", "Fault model %u loaded, %u classes", (unsigned)modelId, faultClassifier.classes());
+    }
+    else if (blob != NULL)
+    {
+        faultClassifier.unload();
+        ESP_LOGW("QMI8658", "No valid fault model of %d features in the model partition", FAULT_MODEL_INPUTS);
+    }
+    xSemaphoreGive(faultModelMutex);
+    return modelId;
+}
+
+/* Class probabilities of the window from its band levels and severity, timed */
+static void classifyFault(SpectrumFrame &frame, const float *levels)
+{
+    float features[FAULT_MODEL_INPUTS];
+    memcpy(features, levels, BASELINE_BANDS * sizeof(float));
+    features[BASELINE_BANDS] = frame.velocityRms;
+    features[BASELINE_BANDS + 1] = frame.displacementRms;
+
+    xSemaphoreTake(faultModelMutex, portMAX_DELAY);
+    frame.faultModelId = 0;
+    frame.faultClasses = 0;
+    frame.inferenceUs = 0;
+    if (faultClassifier.loaded())
+    {
+        const int64_t startedAt = esp_timer_get_time();
+        faultClassifier.classify(features, frame.faultProbability);
+        frame.inferenceUs = (uint32_t)(esp_timer_get_time() - startedAt);
+        frame.faultModelId = faultClassifier.modelId();
+        frame.faultClasses = faultClassifier.classes();
+        for (int i = 0; i < frame.faultClasses; i++)
+        {
+            strncpy(frame.faultLabels[i], faultClassifier.label(i), FAULT_LABEL_LENGTH - 1);
+            frame.faultLabels[i][FAULT_LABEL_LENGTH - 1] = '\0';
+        }
     }
+    xSemaphoreGive(faultModelMutex);
+}
+#else
+void suspend_fault_model()
+{
 }
 
+uint32_t resume_fault_model()
+{
+    return 0;
+}
+#endif
+
 void vTaskCalculatedFFT(void *pvParameters)
 {
+    (void)pvParameters;
+    SpectrumFrame frame;
+
     while (true)
     {
+        /* Wait for the read task to fill a window */
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
         xSemaphoreTake(xMutex, portMAX_DELAY);
-        xSemaphoreTake(canRead, portMAX_DELAY);
+        frame.sampleRate = windowRate;
+        frame.rangeG = imu_range_g(windowRange);
+        frame.clipped = windowClipped;
+#if ENABLE_GYRO
+        angularFeatures(frame);
+#endif
+        const float countScale = GRAVITY * imu_count_g(windowRange);
+        const float scale = inputScale(countScale);
+#if RESAMPLE_TO_NOMINAL_RATE
+        /* Convert block by block so no second full size buffer is needed */
+        float block[SAMPLES_NUM];
+        /* Room for a block at the largest rate error OdrClock accepts */
+        float resampled[2 * SAMPLES_NUM];
+        int written = 0;
+        resampler.reset();
+        resampler.setRates(frame.sampleRate, SAMPLE_RATE_HZ);
+        for (int i = 0; i < CAPTURE_READS && written < TOTAL_READS; i++)
+        {
+            for (int j = 0; j < SAMPLES_NUM; j++)
+            {
+                block[j] = accelerationZ[i * SAMPLES_NUM + j] * scale;
+            }
+            size_t produced = resampler.process(block, SAMPLES_NUM, resampled,
+                                                std::min(2 * SAMPLES_NUM, TOTAL_READS - written));
+            for (size_t j = 0; j < produced; j++)
+            {
+                storeSample(written++, resampled[j]);
+            }
+        }
+        if (written < TOTAL_READS)
+        {
+            ESP_LOGW("QMI8658", "Resampler produced %d of %d samples", written, TOTAL_READS);
+            while (written < TOTAL_READS)
+            {
+                storeSample(written++, 0);
+            }
+        }
+        frame.capturedAt = odrClock.sampleTime(windowStartedAt, RESAMPLER_DELAY, SAMPLES_NUM);
+        frame.binWidth = SAMPLE_RATE_HZ / TOTAL_READS;
+#else
         for (int i = 0; i < TOTAL_READS; i++)
         {
-            reads[i] = acceleration[i].z * GRAVITY;
-            vImag[i] = 0;
+            storeSample(i, accelerationZ[i] * scale);
         }
+        frame.capturedAt = odrClock.sampleTime(windowStartedAt, 0, SAMPLES_NUM);
+        frame.binWidth = frame.sampleRate / TOTAL_READS;
+#endif
+#if ENVELOPE_ANALYSIS
+        detectEnvelope(frame.sampleRate, scale);
+#endif
+#if ORDER_TRACKING
+        const uint16_t angularCount = windowAngularSamples;
+        frame.shaftHz = windowShaftHz;
+        memcpy(orders, angularSamples, sizeof(orders));
+#endif
+#if RAW_SNAPSHOT
+        const uint64_t trigger = windowEnd;
+#else
+        const uint64_t trigger = 0;
+#endif
         xSemaphoreGive(xMutex);
-        FFT.dcRemoval();
-        FFT.compute(FFTDirection::Forward);
-        FFT.complexToMagnitude();
-        xSemaphoreGive(canRead);
-        vTaskDelay(30000 / portTICK_PERIOD_MS);
+
+        /* Back to physical units only for the published bins */
+        const float magnitudeScale = computeSpectrum() * countScale / scale;
+        /* From a bin to the amplitude of a tone in m/s2 */
+        const float amplitudeScale = 2 * magnitudeScale / (TOTAL_READS * BLACKMAN_HARRIS_GAIN);
+        severity(frame, magnitudeScale);
+        frame.peakCount = find_spectral_peaks(spectrumBins(), TOTAL_READS / 2, frame.binWidth, amplitudeScale,
+                                              SPECTRAL_PEAK_MIN_RATIO, frame.peaks, SPECTRAL_PEAKS);
+        float levels[BASELINE_BANDS];
+        spectral_band_levels(spectrumBins(), TOTAL_READS / 2, amplitudeScale, levels);
+        scoreAnomaly(frame, levels);
+        evaluateAlarms(frame, magnitudeScale, trigger);
+#if FAULT_CLASSIFIER
+        classifyFault(frame, levels);
+#endif
+        for (int i = 0; i < SPECTRUM_BINS; i++)
+        {
+            frame.magnitude[i] = spectrumBin(i) * magnitudeScale *
+                                 severity_gain((SeverityQuantity)SPECTRUM_QUANTITY, i * frame.binWidth);
+        }
+#if OCTAVE_ANALYSIS
+        octaveBands.aggregate(spectrumBins(), frame.binWidth, magnitudeScale, (SeverityQuantity)SPECTRUM_QUANTITY,
+                              frame.octave);
+        frame.octaveLayoutId = octaveBands.layoutId();
+        frame.octaveBandCount = octaveBands.count();
+#endif
+#if ORDER_TRACKING && ORDER_TACH_PIN < 0
+        spectrumShaftHz = shaftFromSpectrum(frame.binWidth);
+#endif
+#if CEPSTRUM_ANALYSIS
+        /* The even log spectrum is real, so its forward transform is the inverse one times TOTAL_READS */
+        const float cepstrumScale = computeCepstrum();
+        frame.cepstrumPeakCount =
+            find_cepstral_peaks(spectrumBins(), CEPSTRUM_STRIDE, TOTAL_READS / 2, cepstrumScale,
+                                frame.binWidth * TOTAL_READS, CEPSTRUM_LOW_HZ, CEPSTRUM_HIGH_HZ,
+                                frame.cepstrumPeaks, CEPSTRUM_PEAKS);
+#endif
+#if ENVELOPE_ANALYSIS
+        envelopeSpectrum(frame, countScale, scale);
+#endif
+#if ORDER_TRACKING
+        orderSpectrum(frame, angularCount, countScale, scale);
+#endif
+        queueNewest(spectrumQueue, frame, "Spectrum");
     }
 }
 
 void IRAM_ATTR gpio_isr_handler()
 {
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    xTaskResumeFromISR(readDataHandle);
+    fifoInterruptAt = esp_timer_get_time();
+    if (readDataHandle != NULL)
+    {
+        vTaskNotifyGiveFromISR(readDataHandle, &xHigherPriorityTaskWoken);
+    }
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
-extern void setupQMI8658()
+extern esp_err_t setupQMI8658()
 {
-    FFT.windowing(FFTWindow::Blackman_Harris, FFTDirection::Forward);
+#if FIXED_POINT_FFT
+    if (!fixedFFT.ready())
+    {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+#if FIXED_POINT_FFT && ENVELOPE_ANALYSIS
+    if (!envelopeFFT.ready())
+    {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
+#if FIXED_POINT_FFT && ORDER_TRACKING
+    if (!orderFFT.ready())
+    {
+        return ESP_ERR_NO_MEM;
+    }
+#endif
 
-    qmi.setPins(DEV_INT2_PIN);
+#if OCTAVE_ANALYSIS
+    if (!octaveBands.ready())
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    if (!octaveBands.configure(OCTAVE_BANDS_PER_OCTAVE, OCTAVE_LOW_HZ, OCTAVE_HIGH_HZ, OCTAVE_CUSTOM_BANDS,
+                               SAMPLE_RATE_HZ / TOTAL_READS))
+    {
+        ESP_LOGE("QMI8658", "No octave band between %.1f and %.1f Hz", OCTAVE_LOW_HZ, OCTAVE_HIGH_HZ);
+        return ESP_ERR_INVALID_ARG;
+    }
+    ESP_LOGI("QMI8658", "%u octave bands from %.2f to %.2f Hz, layout %08x", octaveBands.count(),
+             octaveBands.edges()[0], octaveBands.edges()[octaveBands.count()], (unsigned)octaveBands.layoutId());
+#endif
 
-    if (!qmi.begin(Wire, QMI8658_L_SLAVE_ADDRESS, DEV_SDA_PIN, DEV_SCL_PIN))
+    BaselineModel stored;
+    if (read_nvs_blob(BASELINE_NVS_KEY, &stored, sizeof(stored)) == ESP_OK && baseline.restore(stored))
     {
-        ESP_LOGE("QMI8658", "Failed to find QMI8658 - check your wiring!");
-        ESP.restart();
+        ESP_LOGI("QMI8658", "Baseline of %u windows restored, %s", (unsigned)baseline.windows(),
+                 baseline.mode() == BASELINE_FROZEN ? "frozen" : "learning");
     }
-    // set wire buffer size
-    Wire.setBufferSize(2048);
-    // set frequency
-    Wire.setClock(400000);
 
-    qmi.configAccelerometer(SensorQMI8658::ACC_RANGE_2G, SensorQMI8658::ACC_ODR_1000Hz, SensorQMI8658::LPF_MODE_3);
+    AlarmConfig alarms;
+    if (read_nvs_blob(ALARM_NVS_KEY, &alarms, sizeof(alarms)) == ESP_OK && bandAlarms.configure(alarms))
+    {
+        ESP_LOGI("QMI8658", "%u alarm bands restored", alarms.count);
+    }
 
-    attachInterrupt(DEV_INT2_PIN, gpio_isr_handler, RISING);
+#if FAULT_CLASSIFIER
+    resume_fault_model();
+#endif
 
-    qmi.configFIFO(SensorQMI8658::FIFO_MODE_FIFO, SensorQMI8658::FIFO_SAMPLES_128, SensorQMI8658::INTERRUPT_PIN_2, SAMPLES_NUM);
+    imu = create_imu_sensor();
+
+    if (!imu->begin())
+    {
+        ESP_LOGE("QMI8658", "Failed to find %s - check your wiring!", imu->name());
+        esp_restart();
+    }
+
+    if (!imu->configAccelerometer(accelRange, ACCEL_ODR_HZ))
+    {
+        ESP_LOGE("QMI8658", "%s does not support %d Hz", imu->name(), ACCEL_ODR_HZ);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+#if ENABLE_GYRO
+    if (!imu->configGyroscope(GYRO_RANGE))
+    {
+        ESP_LOGE("QMI8658", "Failed to enable the gyroscope of %s", imu->name());
+        return ESP_FAIL;
+    }
+#endif
+
+#if ORDER_TRACKING && ORDER_TACH_PIN >= 0
+    if (!tachometer_begin(ORDER_TACH_PIN, ORDER_TACH_PULSES_PER_REV))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+#endif
+
+    imu->setWatermarkCallback(gpio_isr_handler);
+
+    imu->configFifo(SAMPLES_NUM);
+
+    /* A block must be off the bus before the rest of the FIFO fills up */
+    const float drainUs = imu->drainTimeUs(SAMPLES_NUM);
+    const float slackUs = imu_fifo_slack_us(SAMPLE_RATE_HZ, imu->fifoSize(), SAMPLES_NUM);
+    ESP_LOGI("QMI8658", "%.1f Hz, %d axes, FIFO drain of %d samples takes %.0f us of %.0f us, bus load %.0f%%",
+             SAMPLE_RATE_HZ, ENABLE_GYRO ? 6 : 3, SAMPLES_NUM, drainUs, slackUs,
+             100 * imu_bus_load(drainUs, SAMPLE_RATE_HZ, SAMPLES_NUM));
+    if (drainUs > slackUs)
+    {
+        ESP_LOGW("QMI8658", "The bus cannot keep up with %.1f Hz, samples will be lost", SAMPLE_RATE_HZ);
+    }
+
+    imu->enable();
 
-    qmi.enableAccelerometer();
-    
-    qmi.enableINT(SensorQMI8658::INTERRUPT_PIN_1, false);
-    qmi.enableINT(SensorQMI8658::INTERRUPT_PIN_2, true);
-    pinMode(DEV_INT2_PIN, INPUT);
-    xTaskCreatePinnedToCore(vTaskReadDataFromSensorBuffer, "ReadTask", 20480, NULL, 1, &readDataHandle, 1);
     xTaskCreatePinnedToCore(vTaskCalculatedFFT, "FFTTask", 20480, NULL, 1, &calculateFFTHandle, 1);
+    xTaskCreatePinnedToCore(vTaskReadDataFromSensorBuffer, "ReadTask", 20480, NULL, 1, &readDataHandle, 1);
+    mark_boot_milestone(BOOT_MILESTONE_SENSOR_READY);
+    return ESP_OK;
 }
@@ -0,0 +1,71 @@
+#include "auto_range.h"
+
+/* Counts treated as clipped, the QMI8658 saturates at -32768 and 32767 */
+#define AUTO_RANGE_CLIP_COUNTS 32700
+/* Move down when the peak would use less than this share of the lower range left above the offset */
+#define AUTO_RANGE_DOWN_FRACTION 0.45f
+/* Windows in a row that must fit in the lower range before moving down */
+#define AUTO_RANGE_DOWN_WINDOWS 3
+
+AutoRange::AutoRange(ImuSensor::AccelRange initial, ImuSensor::AccelRange min, ImuSensor::AccelRange max)
+    : current(initial), lowest(min), highest(max), quietWindows(0)
+{
+}
+
+uint16_t AutoRange::measure(const int16_t *counts, uint16_t samples, int16_t *peak, int16_t *offset)
+{
+    int32_t sum = 0;
+    int32_t low = 0;
+    int32_t high = 0;
+    uint16_t clipped = 0;
+
+    for (uint16_t i = 0; i < samples; i++)
+    {
+        const int32_t value = counts[i];
+        sum += value;
+        low = i == 0 || value < low ? value : low;
+        high = i == 0 || value > high ? value : high;
+        if (value >= AUTO_RANGE_CLIP_COUNTS || value <= -AUTO_RANGE_CLIP_COUNTS)
+        {
+            clipped++;
+        }
+    }
+    const int32_t mean = samples > 0 ? sum / samples : 0;
+    const int32_t max = high - mean > mean - low ? high - mean : mean - low;
+    *peak = (int16_t)(max > INT16_MAX ? INT16_MAX : max);
+    *offset = (int16_t)(mean < 0 ? -mean : mean);
+    return clipped;
+}
+
+ImuSensor::AccelRange AutoRange::update(const int16_t *peaks, const int16_t *offsets, uint8_t axes, uint16_t clipped)
+{
+    if (clipped > 0)
+    {
+        quietWindows = 0;
+        if (current < highest)
+        {
+            current = (ImuSensor::AccelRange)(current + 1);
+        }
+        return current;
+    }
+
+    /* The lower range has half the full scale, the same peak and offset are twice the counts */
+    bool fits = current > lowest;
+    for (uint8_t axis = 0; axis < axes && fits; axis++)
+    {
+        fits = 2 * (int32_t)peaks[axis] < AUTO_RANGE_DOWN_FRACTION * (32768 - 2 * (int32_t)offsets[axis]);
+    }
+    if (fits)
+    {
+        if (++quietWindows >= AUTO_RANGE_DOWN_WINDOWS)
+        {
+            quietWindows = 0;
+            current = (ImuSensor::AccelRange)(current - 1);
+        }
+    }
+    else
+    {
+        quietWindows = 0;
+    }
+    return current;
+}
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "band_alarms.h"
+
+template <typename T>
+float band_rms(const T *magnitude, uint16_t points, float binWidth, float magnitudeScale, const AlarmBand &band)
+{
+    const int first = std::max(1, (int)ceilf(band.lowHz / binWidth));
+    const int last = std::min(points / 2 - 1, (int)floorf(band.highHz / binWidth));
+    double sum = 0;
+
+    for (int i = first; i <= last; i++)
+    {
+        const float value = magnitude[i] * magnitudeScale * severity_gain((SeverityQuantity)band.quantity, i * binWidth);
+        sum += value * value;
+    }
+    return spectrum_rms(sum, points);
+}
+
+template float band_rms<float>(const float *, uint16_t, float, float, const AlarmBand &);
+template float band_rms<int16_t>(const int16_t *, uint16_t, float, float, const AlarmBand &);
+
+BandAlarms::BandAlarms(const AlarmConfig &config)
+{
+    memset(&settings, 0, sizeof(settings));
+    configure(config);
+}
+
+bool BandAlarms::valid(const AlarmConfig &config)
+{
+    if (config.count > ALARM_BANDS_MAX || !(config.hysteresis > 0 && config.hysteresis <= 1))
+    {
+        return false;
+    }
+    for (int i = 0; i < config.count; i++)
+    {
+        const AlarmBand &band = config.bands[i];
+        if (!(band.lowHz >= 0 && band.lowHz < band.highHz) || !(band.warning > 0 && band.warning <= band.alarm) ||
+            band.quantity > SEVERITY_DISPLACEMENT)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool BandAlarms::configure(const AlarmConfig &config)
+{
+    if (!valid(config))
+    {
+        return false;
+    }
+    settings = config;
+    for (int i = 0; i < ALARM_BANDS_MAX; i++)
+    {
+        levels[i] = pending[i] = ALARM_LEVEL_OK;
+        windows[i] = 0;
+    }
+    return true;
+}
+
+float BandAlarms::threshold(uint8_t band, AlarmLevel level) const
+{
+    return level == ALARM_LEVEL_ALARM ? settings.bands[band].alarm : settings.bands[band].warning;
+}
+
+uint8_t BandAlarms::update(const float *rms)
+{
+    uint8_t changed = 0;
+
+    for (uint8_t i = 0; i < settings.count; i++)
+    {
+        const AlarmBand &band = settings.bands[i];
+        AlarmLevel target = rms[i] >= band.alarm     ? ALARM_LEVEL_ALARM
+                            : rms[i] >= band.warning ? ALARM_LEVEL_WARNING
+                                                     : ALARM_LEVEL_OK;
+        /* Down only as far as the hysteresis lets it */
+        if (target < levels[i])
+        {
+            target = levels[i];
+            while (target > ALARM_LEVEL_OK && rms[i] < settings.hysteresis * threshold(i, target))
+            {
+                target = (AlarmLevel)(target - 1);
+            }
+        }
+
+        if (target == levels[i])
+        {
+            pending[i] = target;
+            windows[i] = 0;
+            continue;
+        }
+        if (target != pending[i])
+        {
+            pending[i] = target;
+            windows[i] = 0;
+        }
+        if (++windows[i] >= std::max<uint8_t>(settings.persistence, 1))
+        {
+            levels[i] = target;
+            windows[i] = 0;
+            changed |= 1 << i;
+        }
+    }
+    return changed;
+}
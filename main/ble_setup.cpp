@@ -418,6 +418,15 @@ void build_adv_data()
     }
 }
 
+/**
+ * initArduino() releases the BT controller memory unless BT is reported in use,
+ * BLE is now brought up concurrently, possibly after initArduino().
+ */
+extern "C" bool btInUse()
+{
+    return true;
+}
+
 esp_err_t init_ble()
 {
     build_adv_data();
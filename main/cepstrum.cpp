@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <math.h>
+
+#include "cepstrum.h"
+
+/* Local maxima kept before the ones at multiples of stronger peaks are dropped */
+#define CEPSTRAL_CANDIDATES (2 * CEPSTRAL_PEAKS_MAX)
+
+static void storeLog(float &bin, float value)
+{
+    bin = value;
+}
+
+static void storeLog(int16_t &bin, float value)
+{
+    bin = (int16_t)lroundf(ldexpf(value, CEPSTRUM_LOG_FRACTION_BITS));
+}
+
+template <typename T>
+void cepstrum_log_spectrum(T *data, uint16_t points)
+{
+    const uint16_t half = points / 2;
+    T largest = 0;
+
+    for (uint16_t k = 0; k < half; k++)
+    {
+        largest = std::max(largest, data[k]);
+    }
+    /* ln(m / max), so the fixed point values fit and the zero quefrency does not depend on the scale */
+    const float reference = largest > 0 ? logf((float)largest) : 0.0f;
+    for (uint16_t k = 0; k < half; k++)
+    {
+        const float value = data[k] > 0 ? std::max(logf((float)data[k]) - reference, CEPSTRUM_LOG_FLOOR)
+                                        : CEPSTRUM_LOG_FLOOR;
+        storeLog(data[k], largest > 0 ? value : 0.0f);
+    }
+    data[half] = data[half - 1];
+    for (uint16_t k = 1; k < half; k++)
+    {
+        data[points - k] = data[k];
+    }
+}
+
+template <typename T>
+uint8_t find_cepstral_peaks(const T *cepstrum, uint8_t stride, uint16_t count, float valueScale, float sampleRate,
+                            float lowHz, float highHz, CepstralPeak *peaks, uint8_t capacity)
+{
+    auto value = [cepstrum, stride, valueScale](int q) { return cepstrum[q * stride] * valueScale; };
+    const int first = std::max(2, (int)ceilf(sampleRate / highHz));
+    const int last = std::min(count - 3, (int)(sampleRate / lowHz));
+    int candidates[CEPSTRAL_CANDIDATES];
+    int size = 0;
+
+    capacity = std::min<uint8_t>(capacity, CEPSTRAL_PEAKS_MAX);
+    /* Positive local maxima, strongest first by insertion */
+    for (int q = first; q <= last; q++)
+    {
+        const float centre = value(q);
+        if (centre <= 0 || centre <= value(q - 1) || centre < value(q + 1))
+        {
+            continue;
+        }
+        if (size == CEPSTRAL_CANDIDATES && centre <= value(candidates[size - 1]))
+        {
+            continue;
+        }
+        int i = std::min(size, CEPSTRAL_CANDIDATES - 1);
+        for (; i > 0 && value(candidates[i - 1]) < centre; i--)
+        {
+            candidates[i] = candidates[i - 1];
+        }
+        candidates[i] = q;
+        size = std::min(size + 1, CEPSTRAL_CANDIDATES);
+    }
+
+    uint8_t found = 0;
+    float quefrency[CEPSTRAL_PEAKS_MAX];
+    for (int i = 0; i < size && found < capacity; i++)
+    {
+        const int q = candidates[i];
+        /* A split maximum or a rahmonic of a stronger peak is not a family of its own */
+        bool known = false;
+        for (uint8_t j = 0; j < found && !known; j++)
+        {
+            const long n = lroundf(q / quefrency[j]);
+            known = n >= 1 &&
+                    fabsf(q - n * quefrency[j]) <= std::max(1.0f, CEPSTRUM_FAMILY_TOLERANCE * n * quefrency[j]);
+        }
+        if (known)
+        {
+            continue;
+        }
+
+        const float a = value(q - 1);
+        const float b = value(q);
+        const float c = value(q + 1);
+        const float curvature = a - 2 * b + c;
+        const float offset = curvature < 0 ? std::min(0.5f, std::max(-0.5f, 0.5f * (a - c) / curvature)) : 0.0f;
+        quefrency[found] = q + offset;
+
+        CepstralPeak &peak = peaks[found];
+        peak.quefrencyMs = 1000.0f * quefrency[found] / sampleRate;
+        peak.hz = sampleRate / quefrency[found];
+        peak.amplitude = b - 0.25f * (a - c) * offset;
+        peak.rahmonics = 0;
+        for (int n = 2; n <= CEPSTRUM_RAHMONICS_MAX; n++)
+        {
+            const int r = (int)lroundf(n * quefrency[found]);
+            if (r + 2 >= count)
+            {
+                break;
+            }
+            /* The rahmonic may fall on either neighbour of the rounded position */
+            int top = r;
+            for (int k = r - 1; k <= r + 1; k++)
+            {
+                top = value(k) > value(top) ? k : top;
+            }
+            if (value(top) >= value(top - 1) && value(top) >= value(top + 1) &&
+                value(top) >= CEPSTRUM_RAHMONIC_RATIO * peak.amplitude)
+            {
+                peak.rahmonics++;
+            }
+        }
+        found++;
+    }
+    return found;
+}
+
+template void cepstrum_log_spectrum<float>(float *, uint16_t);
+template void cepstrum_log_spectrum<int16_t>(int16_t *, uint16_t);
+template uint8_t find_cepstral_peaks<float>(const float *, uint8_t, uint16_t, float, float, float, float,
+                                            CepstralPeak *, uint8_t);
+template uint8_t find_cepstral_peaks<int16_t>(const int16_t *, uint8_t, uint16_t, float, float, float, float,
+                                              CepstralPeak *, uint8_t);
@@ -33,8 +33,32 @@
  * Sensors CONFIG
  **/
 
-#define SENSOR_I2C_ADDR (0x68)
+/* QMI8658 with SA0 high */
+#define SENSOR_I2C_ADDR (0x6B)
+/* 1000000 (fast mode plus) cuts a 128 sample FIFO drain from ~18 ms to ~7 ms
+ * on the bus, check the QMI8658 revision supports it before using it */
+#ifndef SENSOR_I2C_FREQ
 #define SENSOR_I2C_FREQ (400000)
+#endif
+
+/* QMI8658 accelerometer low pass filter: mode 0 to 3 cuts at 2.66 %, 3.63 %,
+ * 5.39 % or 13.37 % of the ODR, -1 disables it */
+#ifndef SENSOR_ACCEL_LPF_MODE
+#define SENSOR_ACCEL_LPF_MODE 3
+#endif
+
+/* 1 talks to the QMI8658 over 4 wire SPI, 400 kHz I2C cannot drain the FIFO
+ * at 8 kHz of ODR (see README). SCL and SDA become SPC and SDI, the board must also route SDO and
+ * CS, which the ESP32-S3-Touch-LCD-1.28 does not: adapt the pins */
+#ifndef SENSOR_BUS_SPI
+#define SENSOR_BUS_SPI 0
+#endif
+#define DEV_SPI_SCK_PIN DEV_SCL_PIN
+#define DEV_SPI_MOSI_PIN DEV_SDA_PIN
+#define DEV_SPI_MISO_PIN (15)
+#define DEV_SPI_CS_PIN (16)
+/* The QMI8658 accepts up to 15 MHz */
+#define SENSOR_SPI_FREQ (10000000)
 
 /**
  * BLE UUIDs
@@ -0,0 +1,794 @@
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+#else
+#include <chrono>
+#endif
+
+#include "arduinoFFT.h"
+#include "band_alarms.h"
+#include "cepstrum.h"
+#include "dsp_benchmark.h"
+#include "envelope.h"
+#include "fault_classifier.h"
+#include "fixed_fft.h"
+#include "octave_bands.h"
+#include "order_tracker.h"
+#include "resampler.h"
+#include "spectral_baseline.h"
+#include "spectral_peaks.h"
+#include "spectrum_codec.h"
+#include "time_features.h"
+
+#define TAG "DSP_BENCHMARK"
+
+#define BENCHMARK_MIN_POINTS 256
+#define BENCHMARK_MAX_POINTS 4096
+#define BENCHMARK_FREQUENCY 1000
+#define BENCHMARK_SIZES 5
+/* float, double, Q15 and Q31 */
+#define BENCHMARK_PATHS 4
+/* +-2 g full scale */
+#define BENCHMARK_COUNTS_PER_G 16384
+#define BENCHMARK_MS2_PER_COUNT (9.81 / BENCHMARK_COUNTS_PER_G)
+/* Samples per FIFO watermark block */
+#define BENCHMARK_FEATURE_BLOCK 64
+/* Decimation of the envelope at 1 kHz, like ENVELOPE_DECIMATION */
+#define BENCHMARK_ENVELOPE_DECIMATION 4
+/* Angular resampling of a 1475 rpm shaft, like ORDER_SAMPLES_PER_REV */
+#define BENCHMARK_SHAFT_HZ 24.58f
+#define BENCHMARK_SAMPLES_PER_REV 16
+/* Peak list size, like SPECTRAL_PEAKS */
+#define BENCHMARK_PEAKS 8
+/* Cepstral peaks between 2 and 200 Hz of line spacing, like CEPSTRUM_PEAKS */
+#define BENCHMARK_CEPSTRUM_PEAKS 4
+#define BENCHMARK_CEPSTRUM_LOW_HZ 2.0f
+#define BENCHMARK_CEPSTRUM_HIGH_HZ 200.0f
+/* Fault model of the shape tools/fault_model/fault_model.py --demo writes, like FAULT_MODEL_INPUTS */
+#define BENCHMARK_MODEL_LAYERS 3
+static const uint16_t BENCHMARK_MODEL_WIDTHS[BENCHMARK_MODEL_LAYERS + 1] = {BASELINE_BANDS + 2, 16, 12, 5};
+
+#ifdef ESP_PLATFORM
+#define BENCHMARK_UNIT "cycles"
+#define BENCHMARK_UNITS_PER_US CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+
+static inline uint32_t benchmark_counter()
+{
+    return esp_cpu_get_cycle_count();
+}
+
+/* Internal RAM like the pipeline buffers, PSRAM would be measured otherwise */
+static void *benchmark_alloc(size_t size)
+{
+    return heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+}
+#else
+#define BENCHMARK_UNIT "ns"
+#define BENCHMARK_UNITS_PER_US 1000
+
+static inline uint32_t benchmark_counter()
+{
+    return (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void *benchmark_alloc(size_t size)
+{
+    return malloc(size);
+}
+#endif
+
+struct BenchmarkResult
+{
+    uint32_t iterations;
+    uint32_t median;
+    uint32_t min;
+};
+
+struct WindowCase
+{
+    FFTWindow window;
+    const char *name;
+};
+
+static const WindowCase s_windows[] = {
+    {FFTWindow::Hamming, "Hamming"},
+    {FFTWindow::Hann, "Hann"},
+    {FFTWindow::Blackman_Harris, "Blackman-Harris"},
+    {FFTWindow::Flat_top, "Flat top"},
+};
+
+/* Blackman-Harris is the window of the pipeline, used for the per window totals */
+#define PIPELINE_WINDOW 2
+
+static uint32_t s_samples[DSP_BENCHMARK_MAX_ITERATIONS];
+
+/* Times stage() until the minimum time and iterations are reached, prepare()
+ * runs before each iteration and is not timed */
+template <typename Prepare, typename Stage>
+static BenchmarkResult measure(Prepare prepare, Stage stage)
+{
+    BenchmarkResult result;
+    uint32_t count = 0;
+    int64_t start = esp_timer_get_time();
+
+    while (count < DSP_BENCHMARK_MAX_ITERATIONS &&
+           (count < DSP_BENCHMARK_MIN_ITERATIONS || esp_timer_get_time() - start < DSP_BENCHMARK_MIN_TIME_US))
+    {
+        prepare();
+        uint32_t begin = benchmark_counter();
+        stage();
+        s_samples[count++] = benchmark_counter() - begin;
+    }
+
+    std::sort(s_samples, s_samples + count);
+    result.iterations = count;
+    result.median = s_samples[count / 2];
+    result.min = s_samples[0];
+
+    /* Let the idle task run between cases, the task watchdog watches it */
+    vTaskDelay(1);
+    return result;
+}
+
+static void print_result(const char *stage, const char *type, uint16_t points, const char *window,
+                         const BenchmarkResult &result)
+{
+    printf("%-20s %-6s %5u %-16s %10lu %10lu %10.2f %10.1f %6lu\n", stage, type, points, window,
+           (unsigned long)result.median, (unsigned long)result.min, (double)result.median / points,
+           (double)result.median / BENCHMARK_UNITS_PER_US, (unsigned long)result.iterations);
+}
+
+/* Test signal in sensor counts at +-2 g: gravity and two tones over noise, like
+ * a machine with a little imbalance */
+static void fill_counts(int16_t *counts, uint16_t points)
+{
+    uint32_t state = 1;
+
+    for (int i = 0; i < points; i++)
+    {
+        state = state * 1664525u + 1013904223u;
+        double g = 1.0 + 0.2 * sin(2.0 * M_PI * 24.58 * i / BENCHMARK_FREQUENCY) +
+                   0.05 * sin(2.0 * M_PI * 49.17 * i / BENCHMARK_FREQUENCY) +
+                   0.01 * ((double)(state >> 8) / 16777216.0 - 0.5);
+        counts[i] = (int16_t)lround(g * BENCHMARK_COUNTS_PER_G);
+    }
+}
+
+/* The float path input, scaled to m/s2 like the pipeline does */
+template <typename T>
+static void load_input(T *input, const int16_t *counts, uint16_t points)
+{
+    for (int i = 0; i < points; i++)
+    {
+        input[i] = (T)(counts[i] * BENCHMARK_MS2_PER_COUNT);
+    }
+}
+
+/* Runs the arduinoFFT stages for one type and size, returns the median time of a whole window */
+template <typename T>
+static uint32_t benchmark_fft(const char *type, uint16_t points, const int16_t *counts, T *input, T *real, T *imag)
+{
+    uint32_t window_total = 0;
+    auto reload = [&]() {
+        memcpy(real, input, points * sizeof(T));
+        memset(imag, 0, points * sizeof(T));
+    };
+
+    load_input(input, counts, points);
+
+    {
+        ArduinoFFT<T> fft(real, imag, points, (T)BENCHMARK_FREQUENCY);
+        BenchmarkResult result = measure(reload, [&]() { fft.dcRemoval(); });
+        print_result("dcRemoval", type, points, "-", result);
+        window_total += result.median;
+    }
+
+    for (size_t w = 0; w < sizeof(s_windows) / sizeof(s_windows[0]); w++)
+    {
+        ArduinoFFT<T> fft(real, imag, points, (T)BENCHMARK_FREQUENCY);
+        BenchmarkResult result = measure(reload, [&]() { fft.windowing(s_windows[w].window, FFTDirection::Forward); });
+        print_result("windowing", type, points, s_windows[w].name, result);
+
+        /* With windowingFactors the factors are computed by the first call and reused */
+        ArduinoFFT<T> cached(real, imag, points, (T)BENCHMARK_FREQUENCY, true);
+        reload();
+        cached.windowing(s_windows[w].window, FFTDirection::Forward);
+        result = measure(reload, [&]() { cached.windowing(s_windows[w].window, FFTDirection::Forward); });
+        print_result("windowing (cached)", type, points, s_windows[w].name, result);
+        if (w == PIPELINE_WINDOW)
+        {
+            window_total += result.median;
+        }
+    }
+
+    {
+        ArduinoFFT<T> fft(real, imag, points, (T)BENCHMARK_FREQUENCY);
+        BenchmarkResult result = measure(reload, [&]() { fft.compute(FFTDirection::Forward); });
+        print_result("compute", type, points, "-", result);
+        window_total += result.median;
+
+        auto transformed = [&]() {
+            reload();
+            fft.compute(FFTDirection::Forward);
+        };
+        result = measure(transformed, [&]() { fft.complexToMagnitude(); });
+        print_result("complexToMagnitude", type, points, "-", result);
+        window_total += result.median;
+    }
+
+    return window_total;
+}
+
+/* Same stages on the fixed point path, the counts are loaded shifted left by
+ * input_shift (16 for Q31 to use the whole word) */
+template <typename T>
+static uint32_t benchmark_fixed(const char *type, uint16_t points, const int16_t *counts, T *data, int input_shift)
+{
+    uint32_t window_total = 0;
+    FixedFFT<T> fft(data, points);
+    auto reload = [&]() {
+        for (int i = 0; i < points; i++)
+        {
+            data[i] = (T)((int32_t)counts[i] * (1 << input_shift));
+        }
+    };
+
+    if (!fft.ready())
+    {
+        ESP_LOGE(TAG, "Not enough memory for the %s tables", type);
+        return 0;
+    }
+
+    BenchmarkResult result = measure(reload, [&]() { fft.dcRemoval(); });
+    print_result("dcRemoval", type, points, "-", result);
+    window_total += result.median;
+
+    /* The window factors are always cached, the first call computes them */
+    for (size_t w = 0; w < sizeof(s_windows) / sizeof(s_windows[0]); w++)
+    {
+        reload();
+        fft.windowing(s_windows[w].window);
+        result = measure(reload, [&]() { fft.windowing(s_windows[w].window); });
+        print_result("windowing (cached)", type, points, s_windows[w].name, result);
+        if (w == PIPELINE_WINDOW)
+        {
+            window_total += result.median;
+        }
+    }
+
+    auto windowed = [&]() {
+        reload();
+        fft.dcRemoval();
+        fft.windowing(s_windows[PIPELINE_WINDOW].window);
+    };
+    result = measure(windowed, [&]() { fft.compute(-input_shift); });
+    print_result("compute", type, points, "-", result);
+    window_total += result.median;
+
+    auto transformed = [&]() {
+        windowed();
+        fft.compute(-input_shift);
+    };
+    result = measure(transformed, [&]() { fft.complexToMagnitude(); });
+    print_result("complexToMagnitude", type, points, "-", result);
+    window_total += result.median;
+
+    return window_total;
+}
+
+/* Signal to error ratio of a magnitude spectrum against the double precision one */
+static double snr_db(const double *reference, uint16_t bins, double (*magnitude)(const void *, uint16_t),
+                     const void *spectrum)
+{
+    double signal = 0;
+    double error = 0;
+
+    for (uint16_t k = 0; k < bins; k++)
+    {
+        double difference = magnitude(spectrum, k) - reference[k];
+        signal += reference[k] * reference[k];
+        error += difference * difference;
+    }
+    return error > 0 ? 10.0 * log10(signal / error) : INFINITY;
+}
+
+struct FixedSpectrum
+{
+    const void *data;
+    double scale;
+};
+
+template <typename T>
+static double fixed_magnitude(const void *spectrum, uint16_t k)
+{
+    const FixedSpectrum *fixed = (const FixedSpectrum *)spectrum;
+    return ((const T *)fixed->data)[k] * fixed->scale;
+}
+
+static double float_magnitude(const void *spectrum, uint16_t k)
+{
+    return ((const float *)spectrum)[k];
+}
+
+/* Accuracy of the float, Q15 and Q31 paths for one size, all with Blackman-Harris */
+static void accuracy(uint16_t points, const int16_t *counts, double *reference, double *real, double *imag,
+                     double *snr)
+{
+    const FFTWindow window = s_windows[PIPELINE_WINDOW].window;
+
+    load_input(real, counts, points);
+    memset(imag, 0, points * sizeof(double));
+    {
+        ArduinoFFT<double> fft(real, imag, points, (double)BENCHMARK_FREQUENCY);
+        fft.dcRemoval();
+        fft.windowing(window, FFTDirection::Forward);
+        fft.compute(FFTDirection::Forward);
+        fft.complexToMagnitude();
+    }
+    memcpy(reference, real, points / 2 * sizeof(double));
+
+    float *real_float = (float *)real;
+    float *imag_float = (float *)imag;
+    load_input(real_float, counts, points);
+    memset(imag_float, 0, points * sizeof(float));
+    {
+        ArduinoFFT<float> fft(real_float, imag_float, points, (float)BENCHMARK_FREQUENCY);
+        fft.dcRemoval();
+        fft.windowing(window, FFTDirection::Forward);
+        fft.compute(FFTDirection::Forward);
+        fft.complexToMagnitude();
+    }
+    snr[0] = snr_db(reference, points / 2, float_magnitude, real_float);
+
+    int16_t *q15 = (int16_t *)real;
+    memcpy(q15, counts, points * sizeof(int16_t));
+    {
+        FixedFFT<int16_t> fft(q15, points);
+        fft.dcRemoval();
+        fft.windowing(window);
+        fft.compute();
+        fft.complexToMagnitude();
+        FixedSpectrum spectrum = {q15, ldexp(BENCHMARK_MS2_PER_COUNT, fft.exponent())};
+        snr[1] = fft.ready() ? snr_db(reference, points / 2, fixed_magnitude<int16_t>, &spectrum) : NAN;
+    }
+
+    int32_t *q31 = (int32_t *)real;
+    for (int i = 0; i < points; i++)
+    {
+        q31[i] = (int32_t)counts[i] * (1 << 16);
+    }
+    {
+        FixedFFT<int32_t> fft(q31, points);
+        fft.dcRemoval();
+        fft.windowing(window);
+        fft.compute(-16);
+        fft.complexToMagnitude();
+        FixedSpectrum spectrum = {q31, ldexp(BENCHMARK_MS2_PER_COUNT, fft.exponent())};
+        snr[2] = fft.ready() ? snr_db(reference, points / 2, fixed_magnitude<int32_t>, &spectrum) : NAN;
+    }
+}
+
+static void benchmark_resampler(const int16_t *counts, float *input, float *output, uint16_t points)
+{
+    Resampler resampler;
+
+    load_input(input, counts, points);
+    BenchmarkResult result = measure(
+        [&]() {
+            resampler.reset();
+            resampler.setRates(BENCHMARK_FREQUENCY * 0.998f, BENCHMARK_FREQUENCY);
+        },
+        [&]() { resampler.process(input, points, output, points); });
+    print_result("resampler", "float", points, "-", result);
+}
+
+/* Envelope detector over a window, the spectrum of its decimated output
+ * costs the FFT row of 1/BENCHMARK_ENVELOPE_DECIMATION the size on top */
+static void benchmark_envelope(const int16_t *counts, float *input, float *output, uint16_t points)
+{
+    EnvelopeDetector detector;
+
+    load_input(input, counts, points);
+    BenchmarkResult result = measure(
+        [&]() {
+            detector.configure(BENCHMARK_FREQUENCY, BENCHMARK_FREQUENCY / 4, BENCHMARK_FREQUENCY * 0.4f,
+                               BENCHMARK_ENVELOPE_DECIMATION);
+        },
+        [&]() { detector.process(input, points, output, points); });
+    print_result("envelope", "float", points, "-", result);
+}
+
+/* Angular resampling of a window in FIFO sized blocks, like the read task */
+static void benchmark_order_tracker(const int16_t *counts, float *input, float *output, uint16_t points)
+{
+    OrderTracker tracker(BENCHMARK_SAMPLES_PER_REV);
+
+    load_input(input, counts, points);
+    BenchmarkResult result = measure(
+        [&]() { tracker.reset(); },
+        [&]() {
+            size_t written = 0;
+            for (uint16_t i = 0; i < points; i += BENCHMARK_FEATURE_BLOCK)
+            {
+                written += tracker.process(&input[i], BENCHMARK_FEATURE_BLOCK, BENCHMARK_FREQUENCY, BENCHMARK_SHAFT_HZ,
+                                           &output[written], points - written);
+            }
+        });
+    print_result("order tracker", "float", points, "-", result);
+}
+
+/* Peak list over the magnitudes of a window, like the FFT task after each spectrum */
+static void benchmark_spectral_peaks(const int16_t *counts, float *real, float *imag, uint16_t points)
+{
+    SpectralPeak peaks[BENCHMARK_PEAKS];
+    ArduinoFFT<float> fft(real, imag, points, (float)BENCHMARK_FREQUENCY);
+
+    load_input(real, counts, points);
+    memset(imag, 0, points * sizeof(float));
+    fft.windowing(FFTWindow::Blackman_Harris, FFTDirection::Forward);
+    fft.compute(FFTDirection::Forward);
+    fft.complexToMagnitude();
+    BenchmarkResult result = measure([]() {}, [&]() {
+        find_spectral_peaks(real, points / 2, (float)BENCHMARK_FREQUENCY / points, 1.0f, 0.01f, peaks,
+                            BENCHMARK_PEAKS);
+    });
+    print_result("spectral peaks", "float", points, "-", result);
+}
+
+/* Third octave band RMS over the magnitudes of a window through the bin table, like the FFT task after each
+ * spectrum. The table is built once, outside the timing */
+static void benchmark_octave_bands(const int16_t *counts, float *real, float *imag, uint16_t points)
+{
+    OctaveBands bands(points / 2);
+    ArduinoFFT<float> fft(real, imag, points, (float)BENCHMARK_FREQUENCY);
+    const float binWidth = (float)BENCHMARK_FREQUENCY / points;
+    float rms[OCTAVE_BANDS_MAX];
+
+    if (!bands.ready() || !bands.configure(3, 4.0f, 0.0f, 0, binWidth))
+    {
+        ESP_LOGE(TAG, "No octave bands for %u points", points);
+        return;
+    }
+    load_input(real, counts, points);
+    memset(imag, 0, points * sizeof(float));
+    fft.windowing(FFTWindow::Blackman_Harris, FFTDirection::Forward);
+    fft.compute(FFTDirection::Forward);
+    fft.complexToMagnitude();
+    BenchmarkResult result = measure([]() {}, [&]() {
+        bands.aggregate(real, binWidth, BENCHMARK_MS2_PER_COUNT, SEVERITY_VELOCITY, rms);
+    });
+    print_result("octave bands", "float", points, "-", result);
+}
+
+/* Delta coding of the one sided spectrum against the one sent before, like the
+ * telemetry between keyframes. Two spectra take turns, the second with every
+ * bin moved by up to 3 dB, as noise bins wander from window to window */
+static void benchmark_spectrum_codec(const int16_t *counts, float *real, float *imag, uint16_t points)
+{
+    const uint16_t bins = points / 2;
+    const uint8_t id = SPECTRUM_CHANNEL_FFT;
+    const size_t capacity = SPECTRUM_CODEC_BOUND(1, bins);
+    SpectrumEncoder encoder(1, &id, &bins, 0.5f, 80.0f, 1, UINT16_MAX);
+    SpectrumDecoder decoder;
+    ArduinoFFT<float> fft(real, imag, points, (float)BENCHMARK_FREQUENCY);
+    uint8_t *coded = (uint8_t *)malloc(capacity);
+    uint32_t state = 1;
+    size_t size = 0;
+    int next = 0;
+
+    if (coded == NULL || !encoder.ready())
+    {
+        ESP_LOGE(TAG, "Not enough memory for the spectrum codec");
+        free(coded);
+        return;
+    }
+    load_input(real, counts, points);
+    memset(imag, 0, points * sizeof(float));
+    fft.windowing(FFTWindow::Blackman_Harris, FFTDirection::Forward);
+    fft.compute(FFTDirection::Forward);
+    fft.complexToMagnitude();
+    for (uint16_t k = 0; k < bins; k++)
+    {
+        state = state * 1664525 + 1013904223;
+        real[bins + k] = real[k] * powf(10.0f, ((state >> 8) / 16777216.0f - 0.5f) * 6 / 20);
+    }
+    const float *spectra[] = {real, real + bins};
+
+    BenchmarkResult result = measure([&]() { next ^= 1; }, [&]() {
+        size = encoder.encode(&spectra[next], coded, capacity);
+    });
+    print_result("spectrum encode", "float", points, "-", result);
+
+    /* From a keyframe on, each delta coded ahead of its turn */
+    encoder.requestKeyframe();
+    decoder.decode(coded, encoder.encode(&spectra[next], coded, capacity));
+    result = measure([&]() {
+        next ^= 1;
+        size = encoder.encode(&spectra[next], coded, capacity);
+    }, [&]() { decoder.decode(coded, size); });
+    print_result("spectrum decode", "float", points, "-", result);
+    free(coded);
+}
+
+/* Log spectrum, its transform in the spectrum buffer and the quefrency peaks, like the FFT task after the
+ * peak list, on the float and the Q15 path. Each run starts from the magnitudes of the window again */
+static void benchmark_cepstrum(const int16_t *counts, float *real, float *imag, uint16_t points)
+{
+    CepstralPeak peaks[BENCHMARK_CEPSTRUM_PEAKS];
+    ArduinoFFT<float> fft(real, imag, points, (float)BENCHMARK_FREQUENCY);
+    auto magnitudes = [&]() {
+        load_input(real, counts, points);
+        memset(imag, 0, points * sizeof(float));
+        fft.windowing(FFTWindow::Blackman_Harris, FFTDirection::Forward);
+        fft.compute(FFTDirection::Forward);
+        fft.complexToMagnitude();
+    };
+    BenchmarkResult result = measure(magnitudes, [&]() {
+        cepstrum_log_spectrum(real, points);
+        memset(imag, 0, points * sizeof(float));
+        fft.compute(FFTDirection::Forward);
+        find_cepstral_peaks(real, 1, points / 2, 1.0f / points, (float)BENCHMARK_FREQUENCY, BENCHMARK_CEPSTRUM_LOW_HZ,
+                            BENCHMARK_CEPSTRUM_HIGH_HZ, peaks, BENCHMARK_CEPSTRUM_PEAKS);
+    });
+    print_result("cepstrum", "float", points, "-", result);
+
+    /* The fixed point spectrum works in place on the counts */
+    int16_t *data = (int16_t *)imag;
+    FixedFFT<int16_t> fixed(data, points);
+    if (!fixed.ready())
+    {
+        ESP_LOGE(TAG, "Not enough memory for the Q15 tables");
+        return;
+    }
+    auto fixedMagnitudes = [&]() {
+        memcpy(data, counts, points * sizeof(int16_t));
+        fixed.dcRemoval();
+        fixed.windowing(FFTWindow::Blackman_Harris);
+        fixed.compute();
+        fixed.complexToMagnitude();
+    };
+    result = measure(fixedMagnitudes, [&]() {
+        cepstrum_log_spectrum(data, points);
+        fixed.compute(-CEPSTRUM_LOG_FRACTION_BITS);
+        find_cepstral_peaks(data, 2, points / 2, ldexpf(1.0f, fixed.exponent()) / points, (float)BENCHMARK_FREQUENCY,
+                            BENCHMARK_CEPSTRUM_LOW_HZ, BENCHMARK_CEPSTRUM_HIGH_HZ, peaks, BENCHMARK_CEPSTRUM_PEAKS);
+    });
+    print_result("cepstrum", "Q15", points, "-", result);
+}
+
+/* Band levels of a spectrum scored against the baseline and learned, like the FFT task after each spectrum */
+static void benchmark_spectral_baseline(const int16_t *counts, float *real, float *imag, uint16_t points)
+{
+    SpectralBaseline baseline(points / 2, (float)BENCHMARK_FREQUENCY, 0.02f, 1, INFINITY);
+    ArduinoFFT<float> fft(real, imag, points, (float)BENCHMARK_FREQUENCY);
+    float levels[BASELINE_BANDS];
+    volatile float sink;
+
+    load_input(real, counts, points);
+    memset(imag, 0, points * sizeof(float));
+    fft.windowing(FFTWindow::Blackman_Harris, FFTDirection::Forward);
+    fft.compute(FFTDirection::Forward);
+    fft.complexToMagnitude();
+    BenchmarkResult result = measure([]() {}, [&]() {
+        spectral_band_levels(real, points / 2, 1.0f, levels);
+        sink = baseline.update(levels, NULL);
+    });
+    (void)sink;
+    print_result("spectral baseline", "float", points, "-", result);
+}
+
+/* RMS and level of ALARM_BANDS_MAX velocity bands, like the FFT task after each spectrum */
+static void benchmark_band_alarms(const int16_t *counts, float *real, float *imag, uint16_t points)
+{
+    AlarmConfig config;
+    ArduinoFFT<float> fft(real, imag, points, (float)BENCHMARK_FREQUENCY);
+    const float binWidth = (float)BENCHMARK_FREQUENCY / points;
+    float rms[ALARM_BANDS_MAX];
+    volatile uint8_t sink;
+
+    memset(&config, 0, sizeof(config));
+    config.count = ALARM_BANDS_MAX;
+    config.hysteresis = 0.9f;
+    config.persistence = 2;
+    for (int i = 0; i < ALARM_BANDS_MAX; i++)
+    {
+        const float width = BENCHMARK_FREQUENCY / 2.0f / ALARM_BANDS_MAX;
+        config.bands[i] = {i * width, (i + 1) * width, SEVERITY_VELOCITY, 2.8f, 4.5f};
+    }
+    BandAlarms alarms(config);
+
+    load_input(real, counts, points);
+    memset(imag, 0, points * sizeof(float));
+    fft.windowing(FFTWindow::Blackman_Harris, FFTDirection::Forward);
+    fft.compute(FFTDirection::Forward);
+    fft.complexToMagnitude();
+    BenchmarkResult result = measure([]() {}, [&]() {
+        for (int i = 0; i < ALARM_BANDS_MAX; i++)
+        {
+            rms[i] = band_rms(real, points, binWidth, BENCHMARK_MS2_PER_COUNT, config.bands[i]);
+        }
+        sink = alarms.update(rms);
+    });
+    (void)sink;
+    print_result("band alarms", "float", points, "-", result);
+}
+
+/* Dense int8 model over the band levels, like the FFT task after each spectrum. The
+ * blob is built in RAM with seeded weights, only its shape matters for the time */
+static void benchmark_fault_classifier(const int16_t *counts, float *real, float *imag, uint16_t points)
+{
+    static uint32_t blob[1024];
+    static FaultClassifier classifier;
+    uint8_t *bytes = (uint8_t *)blob;
+    FaultModelHeader *header = (FaultModelHeader *)bytes;
+    const uint16_t inputs = BENCHMARK_MODEL_WIDTHS[0];
+    ArduinoFFT<float> fft(real, imag, points, (float)BENCHMARK_FREQUENCY);
+    float features[BASELINE_BANDS + 2];
+    float probabilities[FAULT_CLASSES_MAX];
+    uint32_t seed = 47;
+
+    memset(blob, 0, sizeof(blob));
+    header->magic = FAULT_MODEL_MAGIC;
+    header->version = FAULT_MODEL_VERSION;
+    header->inputs = inputs;
+    header->modelId = 1;
+    header->classes = BENCHMARK_MODEL_WIDTHS[BENCHMARK_MODEL_LAYERS];
+    header->layers = BENCHMARK_MODEL_LAYERS;
+    float *offset = (float *)(header + 1);
+    for (int i = 0; i < inputs; i++)
+    {
+        offset[i] = -60.0f;
+        offset[inputs + i] = 1.0f;
+    }
+    size_t size = sizeof(FaultModelHeader) + 2 * inputs * sizeof(float);
+    for (int l = 0; l < BENCHMARK_MODEL_LAYERS; l++)
+    {
+        FaultLayer *layer = (FaultLayer *)(bytes + size);
+        layer->inputs = BENCHMARK_MODEL_WIDTHS[l];
+        layer->outputs = BENCHMARK_MODEL_WIDTHS[l + 1];
+        layer->activation = l + 1 < BENCHMARK_MODEL_LAYERS ? FAULT_ACTIVATION_RELU : FAULT_ACTIVATION_NONE;
+        layer->outputZeroPoint = -128;
+        layer->multiplier = 1 << 30;
+        layer->shift = -8;
+        layer->outputScale = 0.1f;
+        int8_t *weights = (int8_t *)((int32_t *)(layer + 1) + layer->outputs);
+        for (int i = 0; i < layer->inputs * layer->outputs; i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            weights[i] = (int8_t)(seed >> 24);
+        }
+        size += sizeof(FaultLayer) + layer->outputs * sizeof(int32_t) + (layer->inputs * layer->outputs + 3) / 4 * 4;
+    }
+    header->size = size;
+    header->crc =
+        fault_model_crc(bytes + offsetof(FaultModelHeader, modelId), size - offsetof(FaultModelHeader, modelId));
+    if (!classifier.load(bytes, size))
+    {
+        ESP_LOGE(TAG, "Benchmark fault model does not load");
+        return;
+    }
+
+    load_input(real, counts, points);
+    memset(imag, 0, points * sizeof(float));
+    fft.windowing(FFTWindow::Blackman_Harris, FFTDirection::Forward);
+    fft.compute(FFTDirection::Forward);
+    fft.complexToMagnitude();
+    spectral_band_levels(real, points / 2, 1.0f, features);
+    features[BASELINE_BANDS] = 2.0f;
+    features[BASELINE_BANDS + 1] = 10.0f;
+    BenchmarkResult result = measure([]() {}, [&]() { classifier.classify(features, probabilities); });
+    print_result("fault classifier", "int8", points, "-", result);
+}
+
+/* Single pass features of one axis, fed in FIFO sized blocks like the read task */
+static void benchmark_time_features(const int16_t *counts, uint16_t points)
+{
+    TimeFeatures features;
+    volatile float sink;
+
+    BenchmarkResult result = measure(
+        [&]() { features.reset(); },
+        [&]() {
+            for (uint16_t i = 0; i < points; i += BENCHMARK_FEATURE_BLOCK)
+            {
+                features.addBlock(&counts[i], BENCHMARK_FEATURE_BLOCK);
+            }
+            sink = features.result(1.0f).kurtosis;
+        });
+    (void)sink;
+    print_result("time features", "int16", points, "-", result);
+}
+
+/* Whole window cost, memory and accuracy of one path */
+static void print_path(uint16_t points, const char *type, uint32_t total, size_t buffer_bytes, size_t table_bytes,
+                       double snr)
+{
+    double us = (double)total / BENCHMARK_UNITS_PER_US;
+    printf("%5u %-6s %10.1f %12.1f %12u %12u %10.1f\n", points, type, us, 1e6 / us, (unsigned)buffer_bytes,
+           (unsigned)table_bytes, snr);
+}
+
+esp_err_t run_dsp_benchmark()
+{
+    const size_t bytes = BENCHMARK_MAX_POINTS * sizeof(double);
+    double *input = (double *)benchmark_alloc(bytes);
+    double *real = (double *)benchmark_alloc(bytes);
+    double *imag = (double *)benchmark_alloc(bytes);
+    int16_t *counts = (int16_t *)benchmark_alloc(BENCHMARK_MAX_POINTS * sizeof(int16_t));
+    uint32_t totals[BENCHMARK_SIZES][BENCHMARK_PATHS];
+    double snr[BENCHMARK_SIZES][3];
+    int sizes = 0;
+
+    if (input == NULL || real == NULL || imag == NULL || counts == NULL)
+    {
+        ESP_LOGE(TAG, "Not enough memory for %d point buffers", BENCHMARK_MAX_POINTS);
+        free(input);
+        free(real);
+        free(imag);
+        free(counts);
+        return ESP_ERR_NO_MEM;
+    }
+
+#ifdef ESP_PLATFORM
+    printf("DSP benchmark on ESP32-S3 at %d MHz, times in %s\n", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ, BENCHMARK_UNIT);
+#else
+    printf("DSP benchmark on the host, times in %s\n", BENCHMARK_UNIT);
+#endif
+    printf("%-20s %-6s %5s %-16s %10s %10s %10s %10s %6s\n", "stage", "type", "N", "window", "median", "min",
+           "per point", "median us", "iters");
+
+    for (uint16_t points = BENCHMARK_MIN_POINTS; points <= BENCHMARK_MAX_POINTS; points *= 2, sizes++)
+    {
+        fill_counts(counts, points);
+        totals[sizes][0] = benchmark_fft<float>("float", points, counts, (float *)input, (float *)real, (float *)imag);
+        totals[sizes][1] = benchmark_fft<double>("double", points, counts, input, real, imag);
+        totals[sizes][2] = benchmark_fixed<int16_t>("Q15", points, counts, (int16_t *)real, 0);
+        totals[sizes][3] = benchmark_fixed<int32_t>("Q31", points, counts, (int32_t *)real, 16);
+        benchmark_resampler(counts, (float *)input, (float *)real, points);
+        benchmark_envelope(counts, (float *)input, (float *)real, points);
+        benchmark_order_tracker(counts, (float *)input, (float *)real, points);
+        benchmark_spectral_peaks(counts, (float *)real, (float *)imag, points);
+        benchmark_octave_bands(counts, (float *)real, (float *)imag, points);
+        benchmark_cepstrum(counts, (float *)real, (float *)imag, points);
+        benchmark_spectral_baseline(counts, (float *)real, (float *)imag, points);
+        benchmark_band_alarms(counts, (float *)real, (float *)imag, points);
+        benchmark_fault_classifier(counts, (float *)real, (float *)imag, points);
+        benchmark_time_features(counts, points);
+        benchmark_spectrum_codec(counts, (float *)real, (float *)imag, points);
+        accuracy(points, counts, input, real, imag, snr[sizes]);
+    }
+
+    printf("\nWhole window (dcRemoval, cached Blackman-Harris, compute, complexToMagnitude) on one core,\n"
+           "signal to error ratio of the magnitudes against the double path\n");
+    printf("%5s %-6s %10s %12s %12s %12s %10s\n", "N", "type", "us", "windows/s", "buffer B", "tables B", "SNR dB");
+    for (int i = 0; i < sizes; i++)
+    {
+        size_t n = BENCHMARK_MIN_POINTS << i;
+        /* arduinoFFT needs a real and an imaginary array, caches half a window when asked to */
+        print_path(n, "float", totals[i][0], 2 * n * sizeof(float), n / 2 * sizeof(float), snr[i][0]);
+        print_path(n, "double", totals[i][1], 2 * n * sizeof(double), n / 2 * sizeof(double), INFINITY);
+        /* FixedFFT works in place on the real samples, with half period cosine and half window tables */
+        print_path(n, "Q15", totals[i][2], n * sizeof(int16_t), n * sizeof(int16_t), snr[i][1]);
+        print_path(n, "Q31", totals[i][3], n * sizeof(int32_t), n * sizeof(int32_t), snr[i][2]);
+    }
+
+    free(input);
+    free(real);
+    free(imag);
+    free(counts);
+    return ESP_OK;
+}
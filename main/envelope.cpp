@@ -0,0 +1,71 @@
+#include <math.h>
+
+#include "envelope.h"
+
+/* Corner of the envelope low pass relative to the decimated rate */
+#define ENVELOPE_SMOOTHING_CORNER 0.4f
+
+EnvelopeDetector::EnvelopeDetector()
+    : decimation(1), phase(0)
+{
+}
+
+void EnvelopeDetector::configure(float sampleRateHz, float lowHz, float highHz, uint8_t decimation)
+{
+    this->decimation = decimation > 0 ? decimation : 1;
+    for (int i = 0; i < ENVELOPE_BAND_SECTIONS; i++)
+    {
+        const float q = biquad_butterworth_q(i, ENVELOPE_BAND_SECTIONS);
+        highPass[i].highPass(sampleRateHz, lowHz, q);
+        lowPass[i].lowPass(sampleRateHz, highHz, q);
+    }
+    for (int i = 0; i < ENVELOPE_SMOOTHING_SECTIONS; i++)
+    {
+        smoothing[i].lowPass(sampleRateHz, ENVELOPE_SMOOTHING_CORNER * sampleRateHz / this->decimation,
+                             biquad_butterworth_q(i, ENVELOPE_SMOOTHING_SECTIONS));
+    }
+    reset();
+}
+
+void EnvelopeDetector::reset()
+{
+    for (int i = 0; i < ENVELOPE_BAND_SECTIONS; i++)
+    {
+        highPass[i].reset();
+        lowPass[i].reset();
+    }
+    for (Biquad &section : smoothing)
+    {
+        section.reset();
+    }
+    phase = 0;
+}
+
+size_t EnvelopeDetector::process(const float *input, size_t count, float *output, size_t capacity)
+{
+    size_t written = 0;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        float x = input[i];
+        for (int s = 0; s < ENVELOPE_BAND_SECTIONS; s++)
+        {
+            x = lowPass[s].process(highPass[s].process(x));
+        }
+        x = fabsf(x);
+        for (Biquad &section : smoothing)
+        {
+            x = section.process(x);
+        }
+
+        if (++phase >= decimation)
+        {
+            phase = 0;
+            if (output != NULL && written < capacity)
+            {
+                output[written++] = x;
+            }
+        }
+    }
+    return written;
+}
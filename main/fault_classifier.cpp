@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <limits.h>
+#include <math.h>
+#include <string.h>
+
+#include "fault_classifier.h"
+
+/* Input and output of a layer each get half of the arena */
+#define FAULT_ARENA_HALF (FAULT_ARENA_BYTES / 2)
+
+uint32_t fault_model_crc(const uint8_t *data, size_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+
+    for (size_t i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+int32_t fault_requantize(int32_t accumulator, int32_t multiplier, int32_t shift)
+{
+    const int left = shift > 0 ? shift : 0;
+    const int right = shift > 0 ? 0 : -shift;
+    const int64_t value = std::min<int64_t>(std::max<int64_t>((int64_t)accumulator * (1LL << left), INT32_MIN),
+                                            INT32_MAX);
+
+    /* Rounding doubling high half of value * multiplier, the one product out of range saturated */
+    int32_t high = INT32_MAX;
+    if (value != INT32_MIN || multiplier != INT32_MIN)
+    {
+        const int64_t product = value * multiplier;
+        const int64_t nudge = product >= 0 ? (1LL << 30) : (1 - (1LL << 30));
+        high = (int32_t)((product + nudge) / (1LL << 31));
+    }
+
+    /* Rounding divide by 2^right, halves away from zero */
+    const int32_t mask = (int32_t)((1LL << right) - 1);
+    const int32_t remainder = high & mask;
+    const int32_t threshold = (mask >> 1) + (high < 0 ? 1 : 0);
+    return (high >> right) + (remainder > threshold ? 1 : 0);
+}
+
+static size_t layerBytes(const FaultLayer *layer)
+{
+    const size_t weights = (size_t)layer->inputs * layer->outputs;
+    return sizeof(FaultLayer) + layer->outputs * sizeof(int32_t) + (weights + 3) / 4 * 4;
+}
+
+static int8_t saturate(int32_t value)
+{
+    return (int8_t)std::min<int32_t>(std::max<int32_t>(value, INT8_MIN), INT8_MAX);
+}
+
+FaultClassifier::FaultClassifier() : header(NULL), offset(NULL), gain(NULL)
+{
+}
+
+bool FaultClassifier::load(const uint8_t *blob, size_t size)
+{
+    const FaultModelHeader *candidate = (const FaultModelHeader *)blob;
+
+    unload();
+    if (blob == NULL || size < sizeof(FaultModelHeader) || candidate->magic != FAULT_MODEL_MAGIC ||
+        candidate->version != FAULT_MODEL_VERSION || candidate->size > size ||
+        candidate->size < sizeof(FaultModelHeader) ||
+        fault_model_crc(blob + offsetof(FaultModelHeader, modelId),
+                        candidate->size - offsetof(FaultModelHeader, modelId)) != candidate->crc)
+    {
+        return false;
+    }
+    if (candidate->classes == 0 || candidate->classes > FAULT_CLASSES_MAX || candidate->layers == 0 ||
+        candidate->layers > FAULT_LAYERS_MAX || candidate->inputs == 0 || candidate->inputs > FAULT_ARENA_HALF)
+    {
+        return false;
+    }
+    for (int i = 0; i < candidate->classes; i++)
+    {
+        if (memchr(candidate->labels[i], '\0', FAULT_LABEL_LENGTH) == NULL)
+        {
+            return false;
+        }
+    }
+
+    size_t position = sizeof(FaultModelHeader) + 2 * candidate->inputs * sizeof(float);
+    uint16_t width = candidate->inputs;
+    for (int i = 0; i < candidate->layers; i++)
+    {
+        if (position + sizeof(FaultLayer) > candidate->size)
+        {
+            return false;
+        }
+        const FaultLayer *layer = (const FaultLayer *)(blob + position);
+        if (layer->inputs != width || layer->outputs == 0 || layer->outputs > FAULT_ARENA_HALF ||
+            layer->activation > FAULT_ACTIVATION_RELU || layer->shift > 31 || layer->shift < -31 ||
+            position + layerBytes(layer) > candidate->size)
+        {
+            return false;
+        }
+        layers[i] = layer;
+        width = layer->outputs;
+        position += layerBytes(layer);
+    }
+    if (width != candidate->classes)
+    {
+        return false;
+    }
+
+    offset = (const float *)(blob + sizeof(FaultModelHeader));
+    gain = offset + candidate->inputs;
+    header = candidate;
+    return true;
+}
+
+void FaultClassifier::classify(const float *features, float *probabilities, int8_t *logits)
+{
+    int8_t *input = arena;
+    int8_t *output = arena + FAULT_ARENA_HALF;
+
+    for (int i = 0; i < header->inputs; i++)
+    {
+        /* Not x * gain - offset * gain, the rounding must not depend on a fused multiply-add */
+        float scaled = (features[i] - offset[i]) * gain[i];
+        scaled = std::isfinite(scaled) ? std::min(std::max(scaled, -256.0f), 256.0f) : 0;
+        input[i] = saturate(lroundf(scaled) + header->inputZeroPoint);
+    }
+
+    for (int l = 0; l < header->layers; l++)
+    {
+        const FaultLayer *layer = layers[l];
+        const int32_t *bias = (const int32_t *)(layer + 1);
+        const int8_t *weights = (const int8_t *)(bias + layer->outputs);
+        /* ReLU is a floor at the real 0 */
+        const int32_t low =
+            layer->activation == FAULT_ACTIVATION_RELU ? std::max<int32_t>(layer->outputZeroPoint, INT8_MIN) : INT8_MIN;
+
+        for (int o = 0; o < layer->outputs; o++)
+        {
+            const int8_t *row = weights + (size_t)o * layer->inputs;
+            int32_t accumulator = bias[o];
+            for (int i = 0; i < layer->inputs; i++)
+            {
+                accumulator += (input[i] - layer->inputZeroPoint) * row[i];
+            }
+            const int32_t value =
+                fault_requantize(accumulator, layer->multiplier, layer->shift) + layer->outputZeroPoint;
+            output[o] = (int8_t)std::min<int32_t>(std::max(value, low), INT8_MAX);
+        }
+        std::swap(input, output);
+    }
+
+    /* The last layer wrote the logits, softmax them from their real values */
+    const FaultLayer *last = layers[header->layers - 1];
+    float largest = -INFINITY;
+    for (int c = 0; c < header->classes; c++)
+    {
+        probabilities[c] = (input[c] - last->outputZeroPoint) * last->outputScale;
+        largest = std::max(largest, probabilities[c]);
+    }
+    float sum = 0;
+    for (int c = 0; c < header->classes; c++)
+    {
+        probabilities[c] = expf(probabilities[c] - largest);
+        sum += probabilities[c];
+    }
+    for (int c = 0; c < header->classes; c++)
+    {
+        probabilities[c] /= sum;
+        if (logits != NULL)
+        {
+            logits[c] = input[c];
+        }
+    }
+}
@@ -3,11 +3,13 @@
 
 #include <nvs_flash.h>
 #include "esp_spiffs.h"
+#include "esp_partition.h"
 
 #include "device_configuration.h"
 #include "file_setup.h"
 
 #define TAG "FILE_SETUP"
+#define FAULT_MODEL_PARTITION "model"
 
 DynamicJsonDocument *g_device_document = new DynamicJsonDocument(1024);
 wifi_sta_config_t g_wifi_connection = {};
@@ -108,6 +110,45 @@ esp_err_t write_nvs(const char *key, char *value, uint16_t len)
     return ESP_OK;
 }
 
+esp_err_t read_nvs_blob(const char *key, void *value, size_t len)
+{
+    nvs_handle handle;
+    esp_err_t err = nvs_open("nvs", NVS_READONLY, &handle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    size_t stored = 0;
+    err = nvs_get_blob(handle, key, NULL, &stored);
+    if (err == ESP_OK && stored != len)
+    {
+        err = ESP_ERR_INVALID_SIZE;
+    }
+    if (err == ESP_OK)
+    {
+        err = nvs_get_blob(handle, key, value, &stored);
+    }
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t write_nvs_blob(const char *key, const void *value, size_t len)
+{
+    nvs_handle handle;
+    esp_err_t err = nvs_open("nvs", NVS_READWRITE, &handle);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    err = nvs_set_blob(handle, key, value, len);
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
+
 esp_err_t read_deviceconfig()
 {
     FILE *f = fopen(device_config_json_path, "r");
@@ -160,4 +201,55 @@ esp_err_t read_spiffs(const char *file_path, char **out, size_t *len)
     
     fclose(f);
     return ESP_OK;
+}
+
+static const void *model_mapped = NULL;
+static esp_partition_mmap_handle_t model_mapping;
+
+const uint8_t *map_fault_model(size_t *size)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                FAULT_MODEL_PARTITION);
+    if (partition == NULL)
+    {
+        return NULL;
+    }
+    if (model_mapped == NULL && esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA,
+                                                   &model_mapped, &model_mapping) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to map the fault model partition");
+        model_mapped = NULL;
+        return NULL;
+    }
+    *size = partition->size;
+    return (const uint8_t *)model_mapped;
+}
+
+esp_err_t write_fault_model(uint32_t offset, const void *data, size_t len)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                                                FAULT_MODEL_PARTITION);
+    if (partition == NULL)
+    {
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (offset + len > partition->size)
+    {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (offset == 0)
+    {
+        // A new model, the old one is unmapped and erased
+        if (model_mapped != NULL)
+        {
+            esp_partition_munmap(model_mapping);
+            model_mapped = NULL;
+        }
+        esp_err_t err = esp_partition_erase_range(partition, 0, partition->size);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    return esp_partition_write(partition, offset, data, len);
 }
\ No newline at end of file
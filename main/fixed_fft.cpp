@@ -0,0 +1,373 @@
+#include <math.h>
+#include <new>
+#include <stdlib.h>
+
+#include "fixed_fft.h"
+
+template <typename T>
+struct FixedTraits;
+
+template <>
+struct FixedTraits<int16_t>
+{
+    typedef int32_t Wide;
+    typedef uint32_t Power;
+    static const int FRACTION_BITS = 15;
+    static const int16_t MAX = INT16_MAX;
+    static const int16_t MIN = INT16_MIN;
+};
+
+template <>
+struct FixedTraits<int32_t>
+{
+    typedef int64_t Wide;
+    typedef uint64_t Power;
+    static const int FRACTION_BITS = 31;
+    static const int32_t MAX = INT32_MAX;
+    static const int32_t MIN = INT32_MIN;
+};
+
+/* A butterfly output is at most (1 + sqrt(2)) times its largest input component */
+#define BUTTERFLY_HEADROOM 0.41421356
+
+template <typename T>
+static T to_fixed(double value)
+{
+    double scaled = round(value * ((double)FixedTraits<T>::MAX + 1.0));
+    if (scaled > FixedTraits<T>::MAX)
+    {
+        return FixedTraits<T>::MAX;
+    }
+    if (scaled < FixedTraits<T>::MIN)
+    {
+        return FixedTraits<T>::MIN;
+    }
+    return (T)scaled;
+}
+
+template <typename U>
+static U isqrt(U value)
+{
+    U root = 0;
+    U bit = (U)1 << (sizeof(U) * 8 - 2);
+
+    while (bit > value)
+    {
+        bit >>= 2;
+    }
+    while (bit != 0)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+template <typename T>
+FixedFFT<T>::FixedFFT(T *data, uint16_t samples)
+    : data(data),
+      samples(samples),
+      cosTable(new (std::nothrow) T[samples / 2]),
+      windowTable(new (std::nothrow) T[samples / 2]),
+      windowType(-1),
+      exp(0)
+{
+    if (cosTable != NULL)
+    {
+        for (int k = 0; k < samples / 2; k++)
+        {
+            cosTable[k] = to_fixed<T>(cos(2.0 * M_PI * k / samples));
+        }
+    }
+}
+
+template <typename T>
+FixedFFT<T>::~FixedFFT()
+{
+    delete[] cosTable;
+    delete[] windowTable;
+}
+
+template <typename T>
+void FixedFFT<T>::dcRemoval()
+{
+    typedef typename FixedTraits<T>::Wide Wide;
+    int64_t sum = 0;
+
+    for (int i = 0; i < samples; i++)
+    {
+        sum += data[i];
+    }
+    Wide mean = (Wide)((sum + (sum >= 0 ? samples / 2 : -samples / 2)) / samples);
+
+    for (int i = 0; i < samples; i++)
+    {
+        Wide value = (Wide)data[i] - mean;
+        if (value > FixedTraits<T>::MAX)
+        {
+            value = FixedTraits<T>::MAX;
+        }
+        else if (value < FixedTraits<T>::MIN)
+        {
+            value = FixedTraits<T>::MIN;
+        }
+        data[i] = (T)value;
+    }
+}
+
+template <typename T>
+void FixedFFT<T>::windowing(FFTWindow window)
+{
+    typedef typename FixedTraits<T>::Wide Wide;
+    const int shift = FixedTraits<T>::FRACTION_BITS;
+    const Wide round = (Wide)1 << (shift - 1);
+
+    if (windowType != (int)window)
+    {
+        const double last = samples - 1.0;
+        for (int i = 0; i < samples / 2; i++)
+        {
+            double r = 2.0 * M_PI * i / last;
+            double factor;
+            switch (window)
+            {
+            case FFTWindow::Hamming:
+                factor = 0.54 - 0.46 * cos(r);
+                break;
+            case FFTWindow::Hann:
+                factor = 0.5 - 0.5 * cos(r);
+                break;
+            case FFTWindow::Triangle:
+                factor = 1.0 - fabs(2.0 * i - last) / last;
+                break;
+            case FFTWindow::Nuttall:
+                factor = 0.355768 - 0.487396 * cos(r) + 0.144232 * cos(2 * r) - 0.012604 * cos(3 * r);
+                break;
+            case FFTWindow::Blackman:
+                factor = 0.42323 - 0.49755 * cos(r) + 0.07922 * cos(2 * r);
+                break;
+            case FFTWindow::Blackman_Nuttall:
+                factor = 0.3635819 - 0.4891775 * cos(r) + 0.1365995 * cos(2 * r) - 0.0106411 * cos(3 * r);
+                break;
+            case FFTWindow::Blackman_Harris:
+                factor = 0.35875 - 0.48829 * cos(r) + 0.14128 * cos(2 * r) - 0.01168 * cos(3 * r);
+                break;
+            case FFTWindow::Flat_top:
+                factor = 0.2810639 - 0.5208972 * cos(r) + 0.1980399 * cos(2 * r);
+                break;
+            case FFTWindow::Welch:
+                factor = 1.0 - pow((i - last / 2.0) / (last / 2.0), 2);
+                break;
+            default:
+                factor = 1.0;
+                break;
+            }
+            windowTable[i] = to_fixed<T>(factor);
+        }
+        windowType = (int)window;
+    }
+
+    for (int i = 0; i < samples / 2; i++)
+    {
+        Wide factor = windowTable[i];
+        data[i] = (T)(((Wide)data[i] * factor + round) >> shift);
+        data[samples - 1 - i] = (T)(((Wide)data[samples - 1 - i] * factor + round) >> shift);
+    }
+}
+
+template <typename T>
+T FixedFFT<T>::maxComponent() const
+{
+    typedef typename FixedTraits<T>::Wide Wide;
+    Wide max = 0;
+
+    for (int i = 0; i < samples; i++)
+    {
+        Wide value = data[i] < 0 ? -(Wide)data[i] : (Wide)data[i];
+        max = value > max ? value : max;
+    }
+    return max > FixedTraits<T>::MAX ? FixedTraits<T>::MAX : (T)max;
+}
+
+template <typename T>
+uint8_t FixedFFT<T>::headroomShift(T max) const
+{
+    const T threshold = (T)(FixedTraits<T>::MAX * BUTTERFLY_HEADROOM);
+    uint8_t shift = 0;
+
+    while ((max >> shift) > threshold)
+    {
+        shift++;
+    }
+    return shift;
+}
+
+/* One radix-2 stage over groups of span complex values, inputs shifted right by shift */
+template <typename T>
+void FixedFFT<T>::butterflies(uint16_t span, uint8_t shift)
+{
+    typedef typename FixedTraits<T>::Wide Wide;
+    const int fraction = FixedTraits<T>::FRACTION_BITS;
+    const Wide round = (Wide)1 << (fraction - 1);
+    const uint16_t points = samples / 2;
+    const uint16_t half = span / 2;
+    const uint16_t step = samples / span;
+
+    for (uint16_t start = 0; start < points; start += span)
+    {
+        for (uint16_t k = 0; k < half; k++)
+        {
+            uint16_t j = k * step;
+            Wide c = cosTable[j];
+            Wide s = cosTable[abs((int)samples / 4 - (int)j)];
+            T *a = &data[2 * (start + k)];
+            T *b = &data[2 * (start + k + half)];
+            Wide ar = a[0] >> shift;
+            Wide ai = a[1] >> shift;
+            Wide br = b[0] >> shift;
+            Wide bi = b[1] >> shift;
+            /* b * e^(-j 2 pi k / span) */
+            Wide tr = (br * c + bi * s + round) >> fraction;
+            Wide ti = (bi * c - br * s + round) >> fraction;
+            a[0] = (T)(ar + tr);
+            a[1] = (T)(ai + ti);
+            b[0] = (T)(ar - tr);
+            b[1] = (T)(ai - ti);
+        }
+    }
+}
+
+/* Spectrum of the real input from the transform of its even/odd packing */
+template <typename T>
+void FixedFFT<T>::split(uint8_t shift)
+{
+    typedef typename FixedTraits<T>::Wide Wide;
+    const int fraction = FixedTraits<T>::FRACTION_BITS;
+    const Wide round = (Wide)1 << (fraction - 1);
+    const uint16_t points = samples / 2;
+
+    Wide r0 = data[0] >> shift;
+    Wide i0 = data[1] >> shift;
+    data[0] = (T)(r0 + i0);
+    data[1] = (T)(r0 - i0);
+    data[points] = (T)(data[points] >> shift);
+    data[points + 1] = (T)(-(data[points + 1] >> shift));
+
+    for (uint16_t k = 1; k < points / 2; k++)
+    {
+        T *p = &data[2 * k];
+        T *q = &data[2 * (points - k)];
+        Wide c = cosTable[k];
+        Wide s = cosTable[samples / 4 - k];
+        Wide ar = p[0] >> shift;
+        Wide ai = p[1] >> shift;
+        Wide br = q[0] >> shift;
+        Wide bi = -(q[1] >> shift);
+        /* Twice the even and odd parts: Xe = (A + B) / 2, Xo = -j (A - B) / 2 */
+        Wide er = ar + br;
+        Wide ei = ai + bi;
+        Wide dr = ar - br;
+        Wide di = ai - bi;
+        /* e^(-j 2 pi k / samples) * Xo */
+        Wide wr = (c * di - s * dr + round) >> fraction;
+        Wide wi = (-c * dr - s * di + round) >> fraction;
+        p[0] = (T)((er + wr + 1) >> 1);
+        p[1] = (T)((ei + wi + 1) >> 1);
+        q[0] = (T)((er - wr + 1) >> 1);
+        q[1] = (T)(-((ei - wi + 1) >> 1));
+    }
+}
+
+template <typename T>
+void FixedFFT<T>::compute(int inputExponent)
+{
+    const uint16_t points = samples / 2;
+    uint8_t shift;
+
+    exp = inputExponent;
+
+    /* Bit reversal of the complex values */
+    for (uint16_t i = 1, j = 0; i < points; i++)
+    {
+        uint16_t bit = points >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            T re = data[2 * i];
+            T im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+
+    /* Small inputs (after dcRemoval) are scaled up to use the full word */
+    T max = maxComponent();
+    const T threshold = (T)(FixedTraits<T>::MAX * BUTTERFLY_HEADROOM);
+    uint8_t gain = 0;
+    while (max != 0 && ((typename FixedTraits<T>::Wide)max << (gain + 1)) <= threshold)
+    {
+        gain++;
+    }
+    if (gain > 0)
+    {
+        for (int i = 0; i < samples; i++)
+        {
+            data[i] = (T)(data[i] * ((T)1 << gain));
+        }
+        exp -= gain;
+    }
+
+    for (uint16_t span = 2; span <= points; span <<= 1)
+    {
+        shift = headroomShift(maxComponent());
+        exp += shift;
+        butterflies(span, shift);
+    }
+
+    shift = headroomShift(maxComponent());
+    exp += shift;
+    split(shift);
+}
+
+template <typename T>
+void FixedFFT<T>::complexToMagnitude()
+{
+    typedef typename FixedTraits<T>::Wide Wide;
+    typedef typename FixedTraits<T>::Power Power;
+    const uint16_t points = samples / 2;
+    Power maxPower = (Power)((Wide)data[0] * data[0]);
+    uint8_t shift;
+
+    for (uint16_t k = 1; k < points; k++)
+    {
+        Power power = (Power)((Wide)data[2 * k] * data[2 * k]) + (Power)((Wide)data[2 * k + 1] * data[2 * k + 1]);
+        maxPower = power > maxPower ? power : maxPower;
+    }
+    /* A magnitude can be sqrt(2) times the largest component */
+    shift = isqrt(maxPower) > (Power)FixedTraits<T>::MAX ? 1 : 0;
+    exp += shift;
+
+    data[0] = (T)((data[0] < 0 ? -(Wide)data[0] : (Wide)data[0]) >> shift);
+    for (uint16_t k = 1; k < points; k++)
+    {
+        Power power = (Power)((Wide)data[2 * k] * data[2 * k]) + (Power)((Wide)data[2 * k + 1] * data[2 * k + 1]);
+        data[k] = (T)(isqrt(power) >> shift);
+    }
+}
+
+template class FixedFFT<int16_t>;
+template class FixedFFT<int32_t>;
@@ -1,17 +1,542 @@
 #ifndef QMI8658_SETUP_H
 #define QMI8658_SETUP_H
 
-#include <Wire.h>
-#include "SensorQMI8658.hpp"
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 
-#define SAMPLES_NUM 128
-#define NUM_READS 8
-#define TOTAL_READS (NUM_READS * SAMPLES_NUM)
+#include "band_alarms.h"
+#include "cepstrum.h"
+#include "fault_classifier.h"
+#include "imu_sensor.h"
+#include "octave_bands.h"
+#include "spectral_baseline.h"
+#include "spectral_peaks.h"
+#include "time_features.h"
+#include "vibration_severity.h"
 
+/* 1 feeds the pipeline from SimulatedImu instead of the QMI8658, for bench tests without a sensor */
+#ifndef USE_SIMULATED_IMU
+#define USE_SIMULATED_IMU 0
+#endif
+
+/* Accelerometer output data rate, 125 to 8000 Hz. 8000 Hz needs the SPI bus
+ * or 1 MHz I2C (SENSOR_BUS_SPI and SENSOR_I2C_FREQ in device_configuration.h) */
+#ifndef ACCEL_ODR_HZ
+#define ACCEL_ODR_HZ 1000
+#endif
+
+/* Accelerometer full scale at boot, an ImuSensor::AccelRange */
+#ifndef ACCEL_RANGE
+#define ACCEL_RANGE ImuSensor::ACCEL_RANGE_2G
+#endif
+/* 1 adjusts the full scale between windows from their peaks and clipped samples (AutoRange) */
+#ifndef AUTO_RANGE
+#define AUTO_RANGE 1
+#endif
+
+/* 1 captures the gyroscope in the same FIFO samples for the angular vibration
+ * features (rocking, torsion). Both sensors then run at the gyroscope rates
+ * (SAMPLE_RATE_HZ) and each sample takes twice the bus time */
+#ifndef ENABLE_GYRO
+#define ENABLE_GYRO 0
+#endif
+/* Gyroscope full scale, an ImuSensor::GyroRange */
+#ifndef GYRO_RANGE
+#define GYRO_RANGE ImuSensor::GYRO_RANGE_256DPS
+#endif
+
+/* Nominal rate of the samples in the FIFO */
+#if ENABLE_GYRO
+#define SAMPLE_RATE_HZ imu_6axis_odr_hz(ACCEL_ODR_HZ)
+#else
+#define SAMPLE_RATE_HZ ((float)ACCEL_ODR_HZ)
+#endif
+
+/* Samples per FIFO watermark interrupt: half of the 128 sample FIFO, so the
+ * sensor keeps filling the other half while a block is drained */
+#ifndef SAMPLES_NUM
+#define SAMPLES_NUM 64
+#endif
+/* Samples per analysis window (FFT size), keeps the bins below 2 Hz up to 8 kHz */
+#ifndef TOTAL_READS
+#if ACCEL_ODR_HZ > 2000
+#define TOTAL_READS 4096
+#else
+#define TOTAL_READS 1024
+#endif
+#endif
+#define NUM_READS (TOTAL_READS / SAMPLES_NUM)
+
+/* Resample each window from the measured sensor rate to exactly SAMPLE_RATE_HZ,
+ * 0 keeps the raw samples and only reports the measured bin width */
+#define RESAMPLE_TO_NOMINAL_RATE 1
+/* One extra block gives the resampler room for its kernel and several percent of drift */
+#if RESAMPLE_TO_NOMINAL_RATE
+#define CAPTURE_READS (NUM_READS + 1)
+#else
+#define CAPTURE_READS NUM_READS
+#endif
+
+/* 1 computes the spectrum with the Q15 block floating point FixedFFT straight
+ * from the sensor counts (2 KB of buffers for 1024 points instead of 8 KB),
+ * 0 with the float arduinoFFT */
+#ifndef FIXED_POINT_FFT
+#define FIXED_POINT_FFT 0
+#endif
+
+/* Time between two windows that get a spectrum */
+#ifndef ANALYSIS_PERIOD_MS
+#define ANALYSIS_PERIOD_MS 30000
+#endif
+/* Pause between two windows of time domain features, much shorter than
+ * ANALYSIS_PERIOD_MS since they cost no FFT and little telemetry */
+#ifndef FEATURE_PERIOD_MS
+#define FEATURE_PERIOD_MS 5000
+#endif
+
+/* 1 adds the envelope spectrum of a band around a structural resonance to
+ * each spectrum frame, where the impacts of a bearing defect show up at their
+ * repetition rate (BPFO, BPFI) */
+#ifndef ENVELOPE_ANALYSIS
+#define ENVELOPE_ANALYSIS 1
+#endif
+/* Band passed to the envelope detector, set it around the resonance the
+ * impacts ring, above the shaft harmonics and below Nyquist */
+#ifndef ENVELOPE_BAND_LOW_HZ
+#define ENVELOPE_BAND_LOW_HZ (SAMPLE_RATE_HZ / 4)
+#endif
+#ifndef ENVELOPE_BAND_HIGH_HZ
+#define ENVELOPE_BAND_HIGH_HZ (SAMPLE_RATE_HZ * 0.4f)
+#endif
+/* Envelope samples are one per ENVELOPE_DECIMATION input samples, the envelope
+ * spectrum keeps the resolution of the window over 1/ENVELOPE_DECIMATION of
+ * its band */
+#ifndef ENVELOPE_DECIMATION
+#if ACCEL_ODR_HZ > 2000
+#define ENVELOPE_DECIMATION 16
+#else
+#define ENVELOPE_DECIMATION 4
+#endif
+#endif
+#define ENVELOPE_POINTS (TOTAL_READS / ENVELOPE_DECIMATION)
+#define ENVELOPE_BINS (ENVELOPE_POINTS / 2)
+
+/* 1 adds an order spectrum to each spectrum frame: z resampled block by
+ * block to ORDER_SAMPLES_PER_REV samples per shaft revolution, so the shaft
+ * harmonics of a variable speed machine stay in their bins */
+#ifndef ORDER_TRACKING
+#define ORDER_TRACKING 0
+#endif
+/* GPIO of a tachometer or key phasor giving the shaft speed of every block,
+ * -1 takes the 1x peak of the last spectrum between ORDER_SHAFT_MIN_HZ and
+ * ORDER_SHAFT_MAX_HZ instead, which only follows speed changes slower than
+ * the windows */
+#ifndef ORDER_TACH_PIN
+#define ORDER_TACH_PIN -1
+#endif
+#ifndef ORDER_TACH_PULSES_PER_REV
+#define ORDER_TACH_PULSES_PER_REV 1
+#endif
+#ifndef ORDER_SHAFT_MIN_HZ
+#define ORDER_SHAFT_MIN_HZ 5.0f
+#endif
+#ifndef ORDER_SHAFT_MAX_HZ
+#define ORDER_SHAFT_MAX_HZ 60.0f
+#endif
+/* Orders up to half of ORDER_SAMPLES_PER_REV, in steps of 1/ORDER_REVOLUTIONS.
+ * ORDER_SAMPLES_PER_REV times the shaft rate should stay below the sample
+ * rate, and the window must span ORDER_REVOLUTIONS at the lowest speed */
+#ifndef ORDER_SAMPLES_PER_REV
+#define ORDER_SAMPLES_PER_REV 16
+#endif
+#ifndef ORDER_REVOLUTIONS
+#define ORDER_REVOLUTIONS 16
+#endif
+#define ORDER_POINTS (ORDER_SAMPLES_PER_REV * ORDER_REVOLUTIONS)
+#define ORDER_BINS (ORDER_POINTS / 2)
+
+/* Number of spectrum bins published per frame */
+#define SPECTRUM_BINS 128
+/* Quantity of the published bins, a SeverityQuantity: acceleration in m/s2,
+ * velocity in mm/s or displacement in um, integrated in the spectrum */
+#ifndef SPECTRUM_QUANTITY
+#define SPECTRUM_QUANTITY SEVERITY_ACCELERATION
+#endif
+/* 0 leaves the bins out of the telemetry when only the severity is needed */
+#ifndef PUBLISH_SPECTRUM_BINS
+#define PUBLISH_SPECTRUM_BINS 1
+#endif
+/* 1 sends the published bins as one base64 blob delta coded against the last
+ * spectrum sent (spectrum_codec.h) instead of JSON arrays: a keyframe every
+ * SPECTRUM_KEYFRAME_INTERVAL spectra, after every connection and on the
+ * requestKeyframe command, only the changes in between. Levels are kept in
+ * SPECTRUM_CODEC_STEP_DB steps down to SPECTRUM_CODEC_RANGE_DB below the
+ * strongest bin, and changes of up to SPECTRUM_CODEC_DEADBAND steps wait */
+#ifndef SPECTRUM_CODEC
+#define SPECTRUM_CODEC 1
+#endif
+#ifndef SPECTRUM_KEYFRAME_INTERVAL
+#define SPECTRUM_KEYFRAME_INTERVAL 20
+#endif
+#ifndef SPECTRUM_CODEC_STEP_DB
+#define SPECTRUM_CODEC_STEP_DB 0.5f
+#endif
+#ifndef SPECTRUM_CODEC_RANGE_DB
+#define SPECTRUM_CODEC_RANGE_DB 80.0f
+#endif
+#ifndef SPECTRUM_CODEC_DEADBAND
+#define SPECTRUM_CODEC_DEADBAND 1
+#endif
+/* Strongest peaks of the z spectrum sent with their harmonic families, the
+ * compact alternative to the bins (PUBLISH_SPECTRUM_BINS 0) */
+#ifndef SPECTRAL_PEAKS
+#define SPECTRAL_PEAKS 8
+#endif
+/* Peaks below this fraction of the strongest are left out of the list */
+#ifndef SPECTRAL_PEAK_MIN_RATIO
+#define SPECTRAL_PEAK_MIN_RATIO 0.01f
+#endif
+/* 1 sends the RMS of constant percentage bands of the whole z spectrum, in
+ * SPECTRUM_QUANTITY, the compact alternative to the bins: OCTAVE_BANDS_PER_OCTAVE
+ * (1, 3 or 6) bands per octave on the IEC 61260 mid-band frequencies, or with
+ * 0 OCTAVE_CUSTOM_BANDS log spaced bands, between OCTAVE_LOW_HZ and
+ * OCTAVE_HIGH_HZ (0 for the Nyquist rate) */
+#ifndef OCTAVE_ANALYSIS
+#define OCTAVE_ANALYSIS 1
+#endif
+#ifndef OCTAVE_BANDS_PER_OCTAVE
+#define OCTAVE_BANDS_PER_OCTAVE 3
+#endif
+#ifndef OCTAVE_CUSTOM_BANDS
+#define OCTAVE_CUSTOM_BANDS 24
+#endif
+#ifndef OCTAVE_LOW_HZ
+#define OCTAVE_LOW_HZ 4.0f
+#endif
+#ifndef OCTAVE_HIGH_HZ
+#define OCTAVE_HIGH_HZ 0.0f
+#endif
+/* 1 takes the real cepstrum of the z spectrum, in the FFT buffers, and sends
+ * its strongest quefrency peaks: the spacing of the sideband families gear
+ * mesh and bearing defects modulate, between CEPSTRUM_LOW_HZ and CEPSTRUM_HIGH_HZ */
+#ifndef CEPSTRUM_ANALYSIS
+#define CEPSTRUM_ANALYSIS 1
+#endif
+#ifndef CEPSTRUM_PEAKS
+#define CEPSTRUM_PEAKS 4
+#endif
+#ifndef CEPSTRUM_LOW_HZ
+#define CEPSTRUM_LOW_HZ 2.0f
+#endif
+#ifndef CEPSTRUM_HIGH_HZ
+#define CEPSTRUM_HIGH_HZ 200.0f
+#endif
+/* Baseline of the band levels of the z spectrum, learned on the device:
+ * weight of a new window once it settled (about 1 / alpha windows of memory)
+ * and windows learned before they are scored */
+#ifndef BASELINE_ALPHA
+#define BASELINE_ALPHA 0.02f
+#endif
+#ifndef BASELINE_MIN_WINDOWS
+#define BASELINE_MIN_WINDOWS 20
+#endif
+/* Learned windows between two writes of the baseline to flash */
+#ifndef BASELINE_SAVE_WINDOWS
+#define BASELINE_SAVE_WINDOWS 10
+#endif
+/* Anomaly score an alert goes out above, and the fraction of it the score
+ * must fall below before the next alert */
+#ifndef ANOMALY_THRESHOLD
+#define ANOMALY_THRESHOLD 3.0f
+#endif
+#define ANOMALY_CLEAR_RATIO 0.7f
+/* Bands with a warning and an alarm level, evaluated on every spectrum, as
+ * AlarmBand {low Hz, high Hz, SeverityQuantity, warning, alarm}. The defaults
+ * are the velocity of the severity band at the zone B/C and C/D limits, and
+ * the acceleration in the envelope band, where bearing impacts ring. The
+ * setAlarmBands command replaces them */
+#ifndef ALARM_BANDS
+#define ALARM_BANDS                                                                                \
+    {SEVERITY_LOW_HZ, SEVERITY_HIGH_HZ, SEVERITY_VELOCITY, ISO_ZONE_BC_MM_S, ISO_ZONE_CD_MM_S},    \
+    {                                                                                              \
+        ENVELOPE_BAND_LOW_HZ, ENVELOPE_BAND_HIGH_HZ, SEVERITY_ACCELERATION, 2.0f, 5.0f             \
+    }
+#endif
+/* A level is left below this fraction of its threshold, and entered after
+ * this many spectrum windows in a row */
+#ifndef ALARM_HYSTERESIS
+#define ALARM_HYSTERESIS 0.9f
+#endif
+#ifndef ALARM_PERSISTENCE
+#define ALARM_PERSISTENCE 2
+#endif
+/* 1 runs the fault model of the model partition over every spectrum window,
+ * once one was flashed or sent with the updateFaultModel command */
+#ifndef FAULT_CLASSIFIER
+#define FAULT_CLASSIFIER 1
+#endif
+/* Features the fault model takes, in this order: the BASELINE_BANDS band
+ * levels in dB, the velocity RMS in mm/s and the displacement RMS in um */
+#define FAULT_MODEL_INPUTS (BASELINE_BANDS + 2)
+/* 1 keeps the raw z samples of the last SNAPSHOT_PRE_MS + SNAPSHOT_POST_MS in
+ * a ring and uploads the stretch around a band entering the alarm level. The
+ * read task then drains the FIFO between windows too, instead of sleeping */
+#ifndef RAW_SNAPSHOT
+#define RAW_SNAPSHOT 1
+#endif
+#ifndef SNAPSHOT_PRE_MS
+#define SNAPSHOT_PRE_MS 2000
+#endif
+#ifndef SNAPSHOT_POST_MS
+#define SNAPSHOT_POST_MS 2000
+#endif
+/* Counted at ACCEL_ODR_HZ, the slower samples with ENABLE_GYRO span a little longer */
+#define SNAPSHOT_PRE_SAMPLES ((uint32_t)SNAPSHOT_PRE_MS * ACCEL_ODR_HZ / 1000)
+#define SNAPSHOT_POST_SAMPLES ((uint32_t)SNAPSHOT_POST_MS * ACCEL_ODR_HZ / 1000)
+#define SNAPSHOT_SAMPLES (SNAPSHOT_PRE_SAMPLES + SNAPSHOT_POST_SAMPLES)
+/* Samples per telemetry message of an uploaded snapshot, over all its axes */
+#define SNAPSHOT_CHUNK_SAMPLES 1024
+/* Largest waveform the captureWaveform command records, in bytes of PSRAM
+ * (internal RAM without it) taken for the time of the capture and upload */
+#ifndef CAPTURE_MAX_BYTES
+#define CAPTURE_MAX_BYTES (1024 * 1024)
+#endif
+/* Frames kept while the device is not publishing (no network or time yet) */
+#define SPECTRUM_QUEUE_LENGTH 8
+#define FEATURE_QUEUE_LENGTH 16
+#define ANOMALY_QUEUE_LENGTH 4
+#define ALARM_QUEUE_LENGTH 8
+
+/* Axes with time domain features: the accelerometer, and the gyroscope with ENABLE_GYRO */
+#if ENABLE_GYRO
+#define FEATURE_AXES 6
+#else
+#define FEATURE_AXES 3
+#endif
+
+struct SpectrumFrame
+{
+    /* Monotonic time (esp_timer_get_time()) of the first sample of the window */
+    int64_t capturedAt;
+    /* Sensor output data rate measured against the CPU clock */
+    float sampleRate;
+    /* Frequency step between bins, exact when resampled, from the measured rate otherwise */
+    float binWidth;
+    /* Accelerometer full scale of the window, in g */
+    float rangeG;
+    /* Samples of the window at the full scale, the spectrum is distorted when not 0 */
+    uint16_t clipped;
+    float magnitude[SPECTRUM_BINS];
+    /* RMS over SEVERITY_LOW_HZ to SEVERITY_HIGH_HZ (capped at Nyquist) of the
+     * velocity in mm/s and the displacement in um, and the IsoZone of the velocity */
+    float velocityRms;
+    float displacementRms;
+    uint8_t isoZone;
+    /* Strongest tones of the whole z spectrum, amplitudes in m/s2 */
+    uint8_t peakCount;
+    SpectralPeak peaks[SPECTRAL_PEAKS];
+#if OCTAVE_ANALYSIS
+    /* RMS of each band of octave_bands() in SPECTRUM_QUANTITY, and the id of the layout */
+    uint32_t octaveLayoutId;
+    uint8_t octaveBandCount;
+    float octave[OCTAVE_BANDS_MAX];
+#endif
+#if CEPSTRUM_ANALYSIS
+    /* Strongest peaks of the real cepstrum of the z spectrum, line spacings of sideband families */
+    uint8_t cepstrumPeakCount;
+    CepstralPeak cepstrumPeaks[CEPSTRUM_PEAKS];
+#endif
+    /* Score against the learned baseline, negative until BASELINE_MIN_WINDOWS
+     * windows were learned, a BaselineMode and the windows learned */
+    float anomalyScore;
+    uint8_t baselineMode;
+    uint32_t baselineWindows;
+    /* RMS of each alarm band in its quantity, and its AlarmLevel */
+    uint8_t alarmBands;
+    float bandRms[ALARM_BANDS_MAX];
+    uint8_t bandLevel[ALARM_BANDS_MAX];
+#if FAULT_CLASSIFIER
+    /* Id of the fault model, 0 without one, the probability of each of its
+     * classes and the time the inference took */
+    uint32_t faultModelId;
+    uint8_t faultClasses;
+    char faultLabels[FAULT_CLASSES_MAX][FAULT_LABEL_LENGTH];
+    float faultProbability[FAULT_CLASSES_MAX];
+    uint32_t inferenceUs;
+#endif
+#if ENABLE_GYRO
+    /* Strongest angular vibration about x, y, z (rocking, torsion) over the whole spectrum */
+    float gyroPeakHz[3];
+    float gyroPeakDps[3];
+#endif
+#if ENVELOPE_ANALYSIS
+    /* Envelope spectrum of the z axis in m/s2, from the measured rate */
+    float envelopeBinWidth;
+    float envelope[ENVELOPE_BINS];
+#endif
+#if ORDER_TRACKING
+    /* Mean shaft rate of the window, 0 when it was unknown and the orders are empty */
+    float shaftHz;
+    /* Order spectrum of the z axis in m/s2, bin k is order k / ORDER_REVOLUTIONS */
+    float order[ORDER_BINS];
+#endif
+};
+
+struct FeatureFrame
+{
+    /* Monotonic time (esp_timer_get_time()) of the first sample of the window */
+    int64_t capturedAt;
+    /* Samples the features were computed over */
+    uint16_t samples;
+    float rangeG;
+    uint16_t clipped;
+    /* In ImuSensor::Axis order: m/s2 for the accelerometer, dps for the gyroscope */
+    AxisFeatures axes[FEATURE_AXES];
+};
+
+/* Queued ahead of the spectra when the anomaly score rises above ANOMALY_THRESHOLD */
+struct AnomalyFrame
+{
+    /* Monotonic time (esp_timer_get_time()) of the first sample of the window */
+    int64_t capturedAt;
+    float score;
+    /* Edges of the baseline bands in Hz, and the z-score of each: the bands
+     * that moved point at the fault */
+    float bandEdgeHz[BASELINE_BANDS + 1];
+    float bandZ[BASELINE_BANDS];
+};
+
+/* Queued when an alarm band changes level */
+struct AlarmFrame
+{
+    /* Monotonic time (esp_timer_get_time()) of the first sample of the window */
+    int64_t capturedAt;
+    uint8_t band;
+    /* AlarmLevel now and before */
+    uint8_t level;
+    uint8_t previous;
+    float rms;
+    AlarmBand config;
+};
+
+enum SnapshotSource : uint8_t
+{
+    /* z around an alarm, in the ring */
+    SNAPSHOT_ALARM,
+    /* Recorded for the captureWaveform command, in a buffer of its own */
+    SNAPSHOT_COMMAND,
+};
+
+/* Raw samples held until release_snapshot(), around an alarm or captured on demand */
+struct SnapshotFrame
+{
+    /* Counts up with every snapshot */
+    uint32_t id;
+    uint8_t source;
+    /* Bit per ImuSensor::Axis, the samples of the axes are interleaved in axis order */
+    uint8_t axes;
+    /* Monotonic time (esp_timer_get_time()) of the first sample */
+    int64_t capturedAt;
+    float sampleRate;
+    /* m/s2 per count of the accelerometer, dps per count of the gyroscope */
+    float scale;
+    float gyroScale;
+    /* Samples per axis, the first preTrigger of them before the end of the window that raised the alarm */
+    uint32_t count;
+    uint32_t preTrigger;
+    /* Ring position of the first sample */
+    uint64_t first;
+    /* Read task time spent recording it, its share of the capture is the cost to the DSP cadence */
+    uint32_t recordUs;
+};
+
+enum BaselineCommand : uint8_t
+{
+    BASELINE_COMMAND_NONE,
+    /* Go on learning, or start again after a freeze */
+    BASELINE_COMMAND_LEARN,
+    BASELINE_COMMAND_FREEZE,
+    /* Forget the baseline and learn it again */
+    BASELINE_COMMAND_RESET,
+};
+
+#if !FIXED_POINT_FFT
 extern float reads[TOTAL_READS];
+#endif
+
+extern QueueHandle_t spectrumQueue;
+extern QueueHandle_t featureQueue;
+extern QueueHandle_t anomalyQueue;
+extern QueueHandle_t alarmQueue;
+extern QueueHandle_t snapshotQueue;
+
+/**
+ * @brief Change the baseline from another task, the FFT task applies it
+ * before its next window and stores the baseline.
+ */
+void request_baseline_command(BaselineCommand command);
+
+/**
+ * @brief Replace the alarm bands from another task, the FFT task applies
+ * them before its next window and stores them.
+ *
+ * @return false when the bands are out of range (BandAlarms::valid()).
+ */
+bool request_alarm_config(const AlarmConfig &config);
+
+/**
+ * @brief Copy samples of a snapshot out, only until release_snapshot().
+ *
+ * @param[in] offset First sample, counted over all axes of the snapshot.
+ *
+ * @return Number of samples copied, fewer past the end of the snapshot.
+ */
+uint32_t read_snapshot(const SnapshotFrame &snapshot, uint32_t offset, int16_t *samples, uint32_t count);
+
+/**
+ * @brief Give the ring back to the read task, or free the capture buffer,
+ * once a snapshot was uploaded.
+ */
+void release_snapshot(const SnapshotFrame &snapshot);
+
+/**
+ * @brief Record the next @p durationMs of the @p axes (bit per ImuSensor::Axis)
+ * alongside the monitoring, the read task copies them from the blocks it
+ * drains anyway. The rate is rounded to the sample rate over a whole number
+ * of samples averaged together. The snapshot then comes from snapshotQueue.
+ *
+ * @param[in,out] rateHz Rate asked for, set to the rate recorded at.
+ * @param[out] samples Samples per axis it will record.
+ *
+ * @return ESP_ERR_INVALID_STATE while a capture is recorded or uploaded,
+ * ESP_ERR_INVALID_ARG for axes without features or a rate above the sample
+ * rate or below SAMPLE_RATE_HZ / UINT16_MAX, ESP_ERR_INVALID_SIZE above
+ * CAPTURE_MAX_BYTES, ESP_ERR_NO_MEM.
+ */
+esp_err_t request_waveform_capture(uint32_t durationMs, uint8_t axes, float *rateHz, uint32_t *samples);
+
+/**
+ * @brief Stop the fault classifier until resume_fault_model(), so the model
+ * partition can be rewritten. Waits for an inference in progress.
+ */
+void suspend_fault_model();
+
+/**
+ * @brief Load the fault model from the partition again.
+ *
+ * @return Id of the model, 0 when the partition holds no valid model of
+ * FAULT_MODEL_INPUTS features.
+ */
+uint32_t resume_fault_model();
 
-extern SemaphoreHandle_t canRead;
+#if OCTAVE_ANALYSIS
+/**
+ * @brief Layout of the octave bands of the spectrum frames, fixed once setupQMI8658() returned.
+ */
+const OctaveBands &octave_bands();
+#endif
 
-extern void setupQMI8658();
+extern esp_err_t setupQMI8658();
 
 #endif
\ No newline at end of file
@@ -0,0 +1,58 @@
+#ifndef AUTO_RANGE_H
+#define AUTO_RANGE_H
+
+#include <stdint.h>
+
+#include "imu_sensor.h"
+
+/**
+ * Picks the accelerometer full scale from the peaks of the analysis windows.
+ *
+ * A clipped sample turns into harmonics all over the spectrum, so a window
+ * with clipped samples (or a peak within a few counts of the full scale) on
+ * any accelerometer axis moves one range up right away. Moving down only
+ * buys resolution, so it waits until several windows in a row would have
+ * fitted with headroom in the lower range, which keeps intermittent impacts
+ * from toggling the range. The headroom is that of the vibration about the
+ * mean of each axis: the 1 g of gravity stays whatever the vibration does,
+ * it only takes its share of the full scale.
+ *
+ * The range only changes between windows: the caller applies it to the
+ * sensor before the next capture and converts each window with the range it
+ * was captured with.
+ */
+class AutoRange
+{
+public:
+    AutoRange(ImuSensor::AccelRange initial, ImuSensor::AccelRange min, ImuSensor::AccelRange max);
+
+    /**
+     * @brief Peak and clipped samples of a block of one axis, in counts.
+     *
+     * @param[out] peak Largest distance from the mean of the block.
+     * @param[out] offset Absolute value of the mean of the block.
+     * @return Number of samples at the full scale.
+     */
+    static uint16_t measure(const int16_t *counts, uint16_t samples, int16_t *peak, int16_t *offset);
+
+    /**
+     * @brief Range for the next window.
+     *
+     * @param[in] peaks Largest peak of each accelerometer axis over the last window, captured at range().
+     * @param[in] offsets Largest offset of each axis over the last window.
+     * @param[in] axes Axes of @p peaks and @p offsets.
+     * @param[in] clipped Samples of the last window at the full scale, all axes.
+     */
+    ImuSensor::AccelRange update(const int16_t *peaks, const int16_t *offsets, uint8_t axes, uint16_t clipped);
+
+    ImuSensor::AccelRange range() const { return current; }
+
+private:
+    ImuSensor::AccelRange current;
+    ImuSensor::AccelRange lowest;
+    ImuSensor::AccelRange highest;
+    /* Consecutive windows that would have fitted in the lower range */
+    uint8_t quietWindows;
+};
+
+#endif // AUTO_RANGE_H
@@ -0,0 +1,100 @@
+#ifndef BAND_ALARMS_H
+#define BAND_ALARMS_H
+
+#include <stdint.h>
+
+#include "vibration_severity.h"
+
+/* Most bands an AlarmConfig holds */
+#define ALARM_BANDS_MAX 8
+
+enum AlarmLevel : uint8_t
+{
+    ALARM_LEVEL_OK,
+    ALARM_LEVEL_WARNING,
+    ALARM_LEVEL_ALARM,
+};
+
+struct AlarmBand
+{
+    float lowHz;
+    float highHz;
+    /* SeverityQuantity of the band RMS: m/s2, mm/s or um. Velocity and
+     * displacement only count the bins within SEVERITY_LOW_HZ..SEVERITY_HIGH_HZ */
+    uint8_t quantity;
+    /* Band RMS the warning and the alarm levels start at */
+    float warning;
+    float alarm;
+};
+
+struct AlarmConfig
+{
+    uint8_t count;
+    /* A level is left once the RMS falls below this fraction of its threshold */
+    float hysteresis;
+    /* Windows in a row a band must be at a new level before it changes to it */
+    uint8_t persistence;
+    AlarmBand bands[ALARM_BANDS_MAX];
+};
+
+/**
+ * @brief RMS of a band of a Blackman-Harris windowed spectrum, in the quantity of the band.
+ *
+ * @param[in] magnitude One sided magnitudes from bin 0, float or Q15 counts.
+ * @param[in] points FFT size.
+ * @param[in] binWidth Frequency step between bins.
+ * @param[in] magnitudeScale Factor from a bin value to m/s2.
+ * @param[in] band Band to sum, its edges are rounded inwards to bins.
+ */
+template <typename T>
+float band_rms(const T *magnitude, uint16_t points, float binWidth, float magnitudeScale, const AlarmBand &band);
+
+/**
+ * Warning and alarm levels of a set of bands, evaluated once per window.
+ *
+ * A band goes up a level when its RMS reaches the threshold, and down once
+ * it falls below hysteresis times the threshold of its level, so an RMS
+ * hovering around a threshold does not flap. Either way the new level must
+ * hold for persistence windows in a row before the band changes to it, which
+ * keeps a single transient (a door slam, a forklift) from raising an alarm.
+ */
+class BandAlarms
+{
+public:
+    explicit BandAlarms(const AlarmConfig &config);
+
+    /**
+     * @brief Whether every band has its edges and thresholds in order, and the hysteresis is in (0, 1].
+     */
+    static bool valid(const AlarmConfig &config);
+
+    /**
+     * @brief Replace the bands, every band starts again at ALARM_LEVEL_OK.
+     *
+     * @return false, and the bands left alone, when the configuration is out of range.
+     */
+    bool configure(const AlarmConfig &config);
+
+    const AlarmConfig &config() const { return settings; }
+    AlarmLevel level(uint8_t band) const { return levels[band]; }
+
+    /**
+     * @brief Evaluate a window.
+     *
+     * @param[in] rms RMS of each band, from band_rms().
+     *
+     * @return One bit per band that changed level with this window.
+     */
+    uint8_t update(const float *rms);
+
+private:
+    float threshold(uint8_t band, AlarmLevel level) const;
+
+    AlarmConfig settings;
+    AlarmLevel levels[ALARM_BANDS_MAX];
+    /* Level each band is heading to, and the windows in a row it has been there */
+    AlarmLevel pending[ALARM_BANDS_MAX];
+    uint8_t windows[ALARM_BANDS_MAX];
+};
+
+#endif // BAND_ALARMS_H
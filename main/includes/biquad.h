@@ -0,0 +1,67 @@
+#ifndef BIQUAD_H
+#define BIQUAD_H
+
+#include <math.h>
+
+/* Butterworth Q of a second order section, a cascade takes the Q of each of
+ * its sections from biquad_butterworth_q() */
+#define BIQUAD_Q 0.70710678f
+
+/* Q of section k of a Butterworth filter of 2 * sections poles */
+inline float biquad_butterworth_q(int k, int sections)
+{
+    return 1.0f / (2.0f * sinf((float)M_PI * (2 * k + 1) / (4 * sections)));
+}
+
+/**
+ * Second order IIR section, transposed direct form II.
+ *
+ * The coefficients come from the bilinear transform of the RBJ audio EQ
+ * cookbook. Setting them keeps the state, so a corner can follow a changing
+ * rate while streaming; reset() before a new stream.
+ */
+struct Biquad
+{
+    float b0, b1, b2, a1, a2;
+    float z1, z2;
+
+    void lowPass(float sampleRateHz, float cornerHz, float q = BIQUAD_Q)
+    {
+        const float w0 = 2.0f * (float)M_PI * cornerHz / sampleRateHz;
+        const float alpha = sinf(w0) / (2.0f * q);
+        const float cosw0 = cosf(w0);
+        const float a0 = 1.0f + alpha;
+
+        b0 = (1.0f - cosw0) / 2.0f / a0;
+        b1 = (1.0f - cosw0) / a0;
+        b2 = b0;
+        a1 = -2.0f * cosw0 / a0;
+        a2 = (1.0f - alpha) / a0;
+    }
+
+    void highPass(float sampleRateHz, float cornerHz, float q = BIQUAD_Q)
+    {
+        const float w0 = 2.0f * (float)M_PI * cornerHz / sampleRateHz;
+        const float alpha = sinf(w0) / (2.0f * q);
+        const float cosw0 = cosf(w0);
+        const float a0 = 1.0f + alpha;
+
+        b0 = (1.0f + cosw0) / 2.0f / a0;
+        b1 = -(1.0f + cosw0) / a0;
+        b2 = b0;
+        a1 = -2.0f * cosw0 / a0;
+        a2 = (1.0f - alpha) / a0;
+    }
+
+    void reset() { z1 = z2 = 0; }
+
+    float process(float x)
+    {
+        float y = b0 * x + z1;
+        z1 = b1 * x - a1 * y + z2;
+        z2 = b2 * x - a2 * y;
+        return y;
+    }
+};
+
+#endif // BIQUAD_H
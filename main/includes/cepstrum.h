@@ -0,0 +1,71 @@
+#ifndef CEPSTRUM_H
+#define CEPSTRUM_H
+
+#include <stdint.h>
+
+/* Most peaks find_cepstral_peaks() returns */
+#define CEPSTRAL_PEAKS_MAX 8
+/* Log magnitudes are floored this far below the strongest bin (ln 1e-3, 60 dB),
+ * so the random levels of the noise bins do not dominate the cepstrum: a
+ * family a few % of the bins wide at high rates otherwise drowns in them */
+#define CEPSTRUM_LOG_FLOOR -6.9f
+/* Fraction bits of the Q4.11 log magnitudes of the fixed point path, the floor
+ * stays clear of the int16 range */
+#define CEPSTRUM_LOG_FRACTION_BITS 11
+/* Rahmonics counted up to this multiple of a quefrency, and from this fraction
+ * of the peak on */
+#define CEPSTRUM_RAHMONICS_MAX 8
+#define CEPSTRUM_RAHMONIC_RATIO 0.2f
+/* A local maximum within this fraction (and at least a sample) of a multiple
+ * of a stronger peak belongs to its family: at high rates a peak splits into
+ * several maxima a few samples apart */
+#define CEPSTRUM_FAMILY_TOLERANCE 0.01f
+
+struct CepstralPeak
+{
+    /* Quefrency of the peak in ms, the spacing of its family of spectral lines is 1000 / quefrencyMs Hz */
+    float quefrencyMs;
+    float hz;
+    /* Value of the real cepstrum, in nepers of log magnitude */
+    float amplitude;
+    /* Multiples 2..CEPSTRUM_RAHMONICS_MAX of the quefrency that peak too,
+     * the more the more regular the family */
+    uint8_t rahmonics;
+};
+
+/**
+ * @brief Turn a magnitude spectrum into the even log spectrum the cepstrum is the transform of, in place.
+ *
+ * Bins 0 to @p points / 2 - 1 hold the magnitudes, as complexToMagnitude()
+ * of either FFT path leaves them. They are replaced by ln(m / max), floored
+ * at CEPSTRUM_LOG_FLOOR (in Q4.11 for int16_t), the Nyquist bin repeats the
+ * one below it and the upper half mirrors the lower one. A forward real FFT
+ * of the result then is @p points times the inverse one, the real cepstrum,
+ * so the FFT engine and the buffer of the spectrum serve again as they are.
+ */
+template <typename T>
+void cepstrum_log_spectrum(T *data, uint16_t points);
+
+/**
+ * @brief Strongest quefrency peaks of a real cepstrum, with their rahmonics.
+ *
+ * Positive local maxima between quefrencies of 1 / @p highHz and 1 / @p lowHz
+ * are kept strongest first, leaving out those at or near a multiple of a
+ * stronger one, and interpolated between samples with a parabola.
+ *
+ * @param[in] cepstrum Sample q of the cepstrum is cepstrum[q * stride] * valueScale.
+ * @param[in] stride 1 after the float FFT, 2 for the real parts of the fixed point one.
+ * @param[in] count Number of quefrency samples searched, at most points / 2.
+ * @param[in] valueScale Factor from a stored value to the cepstrum.
+ * @param[in] sampleRate Rate of the time samples, the quefrency step is its inverse.
+ * @param[in] lowHz, highHz Range of line spacings searched.
+ * @param[out] peaks Peaks found, strongest first.
+ * @param[in] capacity Size of @p peaks, at most CEPSTRAL_PEAKS_MAX.
+ *
+ * @return Number of peaks written.
+ */
+template <typename T>
+uint8_t find_cepstral_peaks(const T *cepstrum, uint8_t stride, uint16_t count, float valueScale, float sampleRate,
+                            float lowHz, float highHz, CepstralPeak *peaks, uint8_t capacity);
+
+#endif // CEPSTRUM_H
@@ -0,0 +1,38 @@
+#ifndef DSP_BENCHMARK_H
+#define DSP_BENCHMARK_H
+
+#include "esp_err.h"
+
+/* 1 runs the DSP benchmark at boot, before the sensor and network are started */
+#ifndef RUN_DSP_BENCHMARK
+#define RUN_DSP_BENCHMARK 0
+#endif
+
+/* Minimum time and iterations spent on each benchmark case */
+#ifndef DSP_BENCHMARK_MIN_TIME_US
+#define DSP_BENCHMARK_MIN_TIME_US 100000
+#endif
+#define DSP_BENCHMARK_MIN_ITERATIONS 5
+#define DSP_BENCHMARK_MAX_ITERATIONS 512
+
+/**
+ * @brief Time every stage of the spectrum pipeline and print a table.
+ *
+ * Each case runs until DSP_BENCHMARK_MIN_TIME_US and DSP_BENCHMARK_MIN_ITERATIONS
+ * are reached, every iteration starting from the same input (refilled outside
+ * of the timed region), and reports the median and minimum. Times are CPU
+ * cycles from esp_cpu_get_cycle_count() on the device and nanoseconds on the
+ * host; the table layout is the same so the two can be compared side by side.
+ *
+ * Cases cover the arduinoFFT stages (dcRemoval, windowing with computed and
+ * cached factors for each window, compute, complexToMagnitude) in float and
+ * double and the same stages of FixedFFT in Q15 and Q31, for 256 to 4096
+ * points, plus the resampler. A summary gives for each path the time of a
+ * whole window, the windows per second one core could process, the memory
+ * used and the accuracy of the magnitudes against the double path.
+ *
+ * @return ESP_ERR_NO_MEM if the buffers for the largest FFT can not be allocated.
+ */
+esp_err_t run_dsp_benchmark();
+
+#endif // DSP_BENCHMARK_H
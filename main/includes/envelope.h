@@ -0,0 +1,66 @@
+#ifndef ENVELOPE_H
+#define ENVELOPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "biquad.h"
+
+/* Sections of the high pass and of the low pass of the band, each a
+ * Butterworth of twice this order (Q 0.54 and 1.31 for 2) */
+#define ENVELOPE_BAND_SECTIONS 2
+/* Sections of the Butterworth anti aliasing low pass of the decimation */
+#define ENVELOPE_SMOOTHING_SECTIONS 2
+
+/**
+ * Streaming envelope detector for bearing defect analysis.
+ *
+ * A defect on a race hits the rolling elements at a fixed rate (BPFO, BPFI),
+ * and each impact rings a structural resonance well above the shaft
+ * harmonics. Band passing around the resonance keeps the ringing, full wave
+ * rectifying and low passing it leaves its envelope, which repeats at the
+ * defect rate, and decimating brings that down to a rate where a short FFT
+ * resolves it. Rectify and low pass works sample by sample over the
+ * acquisition blocks, with no full window buffer and no transform pair a
+ * Hilbert envelope would need.
+ */
+class EnvelopeDetector
+{
+public:
+    EnvelopeDetector();
+
+    /**
+     * @brief Set the band around the resonance and the decimation factor.
+     *
+     * The envelope low pass sits at 0.4 of the decimated rate.
+     */
+    void configure(float sampleRateHz, float lowHz, float highHz, uint8_t decimation);
+
+    /**
+     * @brief Restart the stream, the filters start from rest.
+     */
+    void reset();
+
+    /**
+     * @brief Run a block of the input stream through the detector.
+     *
+     * @param[in] input Input samples.
+     * @param[in] count Number of input samples.
+     * @param[out] output Decimated envelope, NULL while the filters settle.
+     * @param[in] capacity Size of @p output, the envelope left over once it is full is dropped.
+     *
+     * @return Number of envelope samples written.
+     */
+    size_t process(const float *input, size_t count, float *output, size_t capacity);
+
+private:
+    Biquad highPass[ENVELOPE_BAND_SECTIONS];
+    Biquad lowPass[ENVELOPE_BAND_SECTIONS];
+    /* Anti aliasing of the decimation, on the rectified signal */
+    Biquad smoothing[ENVELOPE_SMOOTHING_SECTIONS];
+    uint8_t decimation;
+    /* Input samples since the last envelope sample */
+    uint8_t phase;
+};
+
+#endif // ENVELOPE_H
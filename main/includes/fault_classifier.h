@@ -0,0 +1,121 @@
+#ifndef FAULT_CLASSIFIER_H
+#define FAULT_CLASSIFIER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* "FMDL" read as a little endian word */
+#define FAULT_MODEL_MAGIC 0x4C444D46
+/* Bumped when the layout of the blob changes, a blob of another version is not loaded */
+#define FAULT_MODEL_VERSION 1
+#define FAULT_CLASSES_MAX 8
+#define FAULT_LABEL_LENGTH 16
+#define FAULT_LAYERS_MAX 8
+/* Activations of the layer being run, its input and its output side by side */
+#ifndef FAULT_ARENA_BYTES
+#define FAULT_ARENA_BYTES 512
+#endif
+
+enum FaultActivation : uint8_t
+{
+    FAULT_ACTIVATION_NONE,
+    FAULT_ACTIVATION_RELU,
+};
+
+/**
+ * Start of a model blob, all little endian. It is followed by float
+ * offset[inputs] and float gain[inputs], which quantize the features
+ * (q = round((x - offset) * gain) + inputZeroPoint), then by the layers.
+ */
+struct FaultModelHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t inputs;
+    /* Bytes of the whole blob, and the CRC-32 of the bytes after crc */
+    uint32_t size;
+    uint32_t crc;
+    /* Set by whoever trained the model, reported with every result */
+    uint32_t modelId;
+    uint8_t classes;
+    uint8_t layers;
+    uint16_t reserved;
+    int32_t inputZeroPoint;
+    char labels[FAULT_CLASSES_MAX][FAULT_LABEL_LENGTH];
+};
+
+/**
+ * A fully connected int8 layer, followed by int32 bias[outputs] and int8
+ * weights[outputs][inputs] padded to 4 bytes. Weights are symmetric, the
+ * accumulator is scaled to the output by multiplier * 2^(shift - 31), as in
+ * TensorFlow Lite.
+ */
+struct FaultLayer
+{
+    uint16_t inputs;
+    uint16_t outputs;
+    uint8_t activation;
+    uint8_t reserved[3];
+    int32_t inputZeroPoint;
+    int32_t outputZeroPoint;
+    int32_t multiplier;
+    int32_t shift;
+    /* Real value of an output count, only used for the logits of the last layer */
+    float outputScale;
+};
+
+/**
+ * @brief CRC-32 (IEEE 802.3) of @p size bytes, as zlib computes it.
+ */
+uint32_t fault_model_crc(const uint8_t *data, size_t size);
+
+/**
+ * @brief Scale an accumulator by multiplier * 2^(shift - 31), rounding like TensorFlow Lite.
+ */
+int32_t fault_requantize(int32_t accumulator, int32_t multiplier, int32_t shift);
+
+/**
+ * Quantized multilayer perceptron over a feature vector, one class probability per output.
+ *
+ * The blob is used in place, so it can stay in memory mapped flash and be
+ * replaced without a firmware update. The only memory taken is the arena,
+ * a member, so nothing is allocated at run time.
+ */
+class FaultClassifier
+{
+public:
+    FaultClassifier();
+
+    /**
+     * @brief Check a blob and use it, it must stay readable until unload().
+     *
+     * @return false, and no model, when the CRC, the version or the shape is
+     * wrong, or a layer does not fit FAULT_ARENA_BYTES.
+     */
+    bool load(const uint8_t *blob, size_t size);
+    void unload() { header = NULL; }
+    bool loaded() const { return header != NULL; }
+
+    uint16_t inputs() const { return header->inputs; }
+    uint8_t classes() const { return header->classes; }
+    uint32_t modelId() const { return header->modelId; }
+    const char *label(uint8_t index) const { return header->labels[index]; }
+
+    /**
+     * @brief Run the model over a feature vector.
+     *
+     * @param[in] features inputs() values.
+     * @param[out] probabilities classes() values, the softmax of the logits.
+     * @param[out] logits classes() quantized logits, may be NULL.
+     */
+    void classify(const float *features, float *probabilities, int8_t *logits = NULL);
+
+private:
+    const FaultModelHeader *header;
+    const float *offset;
+    const float *gain;
+    const FaultLayer *layers[FAULT_LAYERS_MAX];
+    int8_t arena[FAULT_ARENA_BYTES];
+};
+
+#endif // FAULT_CLASSIFIER_H
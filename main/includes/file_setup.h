@@ -37,5 +37,52 @@ esp_err_t init_memory();
  */
 esp_err_t write_nvs(const char *key, char *value, uint16_t len);
 
+/**
+ * @brief Read a binary value written by write_nvs_blob().
+ *
+ * @param[in] key The key to read.
+ * @param[out] value Buffer of the value.
+ * @param[in] len Size of the value, a stored value of another size is not read.
+ *
+ * @return
+ *     - ESP_OK: Success
+ *     - ESP_ERR_NVS_NOT_FOUND: The key does not exist
+ *     - ESP_ERR_INVALID_SIZE: The stored value has another size
+ */
+esp_err_t read_nvs_blob(const char *key, void *value, size_t len);
+
+/**
+ * @brief Write a binary value to NVS, unlike write_nvs() a failure is returned, not fatal.
+ *
+ * @param[in] key The key to write.
+ * @param[in] value The value to write.
+ * @param[in] len Size of the value.
+ *
+ * @return
+ *     - ESP_OK: Success
+ *     - ESP_ERR_NVS_NOT_ENOUGH_SPACE: There is not enough space to write the value
+ */
+esp_err_t write_nvs_blob(const char *key, const void *value, size_t len);
+
 esp_err_t read_spiffs(const char *file_path, char **out, size_t *len);
+
+/**
+ * @brief Map the fault model partition ("model") into the address space.
+ *
+ * @param[out] size Size of the partition, the blob is shorter.
+ *
+ * @return The start of the partition, NULL without one.
+ */
+const uint8_t *map_fault_model(size_t *size);
+
+/**
+ * @brief Write part of a fault model to its partition, a write at offset 0
+ * unmaps and erases the whole partition first. Suspend the classifier before.
+ *
+ * @return
+ *     - ESP_OK: Success
+ *     - ESP_ERR_NOT_FOUND: There is no model partition
+ *     - ESP_ERR_INVALID_SIZE: The model does not fit the partition
+ */
+esp_err_t write_fault_model(uint32_t offset, const void *data, size_t len);
 #endif
\ No newline at end of file
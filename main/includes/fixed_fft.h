@@ -0,0 +1,84 @@
+#ifndef FIXED_FFT_H
+#define FIXED_FFT_H
+
+#include <stdint.h>
+
+#include "arduinoFFT.h"
+
+/**
+ * Block floating point FFT of real fixed point samples.
+ *
+ * Works in place on @p samples values of type T: int16_t for Q15 (half the
+ * memory of the float path, samples straight from the sensor counts) or
+ * int32_t for Q31 (more headroom, same memory as float). The real input is
+ * packed as samples / 2 complex values, transformed with a radix-2 FFT and
+ * split into the spectrum of the real signal, so no imaginary buffer is
+ * needed.
+ *
+ * Before each stage the largest component of the block is checked and the
+ * whole block is shifted right just enough for the butterflies not to
+ * overflow, every shift is counted in exponent(): the true value of an
+ * output is data[k] * 2^exponent(), in the units of the input. Magnitudes
+ * are not normalized, like arduinoFFT, so the two paths give the same
+ * numbers once scaled.
+ *
+ * Layout after compute(): data[2k], data[2k + 1] are the real and imaginary
+ * parts of bin k for k < samples / 2, except data[1] which holds the real
+ * Nyquist bin. After complexToMagnitude(): data[k] is the magnitude of bin k
+ * for k < samples / 2.
+ */
+template <typename T>
+class FixedFFT
+{
+public:
+    /**
+     * @param[in,out] data Real input, replaced by the spectrum.
+     * @param[in] samples Number of samples, a power of two of at least 4.
+     */
+    FixedFFT(T *data, uint16_t samples);
+    ~FixedFFT();
+
+    /* false if the tables could not be allocated */
+    bool ready() const { return cosTable != NULL && windowTable != NULL; }
+
+    void setData(T *data) { this->data = data; }
+
+    /**
+     * @brief Subtract the mean, saturating, so gravity does not use up the headroom.
+     */
+    void dcRemoval();
+
+    /**
+     * @brief Apply a window, with the same coefficients as arduinoFFT.
+     * The factors are cached, changing the window recomputes them.
+     */
+    void windowing(FFTWindow window);
+
+    /**
+     * @brief Forward transform.
+     *
+     * @param[in] inputExponent Exponent of the input, the data is data * 2^inputExponent.
+     */
+    void compute(int inputExponent = 0);
+
+    void complexToMagnitude();
+
+    int exponent() const { return exp; }
+
+private:
+    uint8_t headroomShift(T max) const;
+    void butterflies(uint16_t span, uint8_t shift);
+    void split(uint8_t shift);
+    T maxComponent() const;
+
+    T *data;
+    uint16_t samples;
+    /* cos(2 pi k / samples) for k < samples / 2, sines are read from it too */
+    T *cosTable;
+    /* First half of the symmetric window */
+    T *windowTable;
+    int windowType;
+    int exp;
+};
+
+#endif // FIXED_FFT_H
@@ -0,0 +1,62 @@
+#ifndef IMU_BUS_H
+#define IMU_BUS_H
+
+#include <stdint.h>
+
+enum ImuBus
+{
+    /* No bus time, the simulator without a bus model */
+    IMU_BUS_NONE,
+    IMU_BUS_I2C,
+    IMU_BUS_SPI,
+};
+
+/*
+ * A FIFO drain of Qmi8658Imu::readFifo() is 8 transactions: the CTRL9 FIFO
+ * request and its acknowledge with one STATUSINT poll each, the fill level,
+ * the data burst, and the FIFO_CTRL read and write that leave the read mode.
+ */
+#define IMU_DRAIN_TRANSACTIONS 8
+/* Bytes of those transactions besides the samples, device addresses included on I2C */
+#define IMU_DRAIN_I2C_BYTES 29
+#define IMU_DRAIN_SPI_BYTES 16
+/* Driver time per transaction (queueing, interrupt, task wake up), measured order of magnitude */
+#define IMU_TRANSACTION_OVERHEAD_US 20.0f
+
+/**
+ * @brief Estimated time to drain @p samples of @p bytesPerSample from the FIFO, in us.
+ *
+ * I2C moves 9 bits per byte plus about 2 for the start and stop of each
+ * transaction, SPI 8 bits per byte.
+ */
+static inline float imu_drain_time_us(ImuBus bus, uint32_t clockHz, uint16_t samples, uint8_t bytesPerSample)
+{
+    float bits;
+
+    switch (bus)
+    {
+    case IMU_BUS_I2C:
+        bits = 9.0f * (IMU_DRAIN_I2C_BYTES + samples * bytesPerSample) + 2.0f * IMU_DRAIN_TRANSACTIONS;
+        break;
+    case IMU_BUS_SPI:
+        bits = 8.0f * (IMU_DRAIN_SPI_BYTES + samples * bytesPerSample);
+        break;
+    default:
+        return 0.0f;
+    }
+    return bits * 1e6f / clockHz + IMU_DRAIN_TRANSACTIONS * IMU_TRANSACTION_OVERHEAD_US;
+}
+
+/* Share of the bus taken by draining blocks of @p watermark samples at @p odrHz */
+static inline float imu_bus_load(float drainUs, float odrHz, uint16_t watermark)
+{
+    return drainUs * odrHz / (watermark * 1e6f);
+}
+
+/* Time from the watermark interrupt to a full FIFO, a drain must fit in it */
+static inline float imu_fifo_slack_us(float odrHz, uint16_t fifoSize, uint16_t watermark)
+{
+    return (fifoSize - watermark) * 1e6f / odrHz;
+}
+
+#endif // IMU_BUS_H
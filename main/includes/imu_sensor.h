@@ -0,0 +1,154 @@
+#ifndef IMU_SENSOR_H
+#define IMU_SENSOR_H
+
+#include <stdint.h>
+
+/**
+ * Hardware abstraction of the IMU used by the acquisition pipeline.
+ *
+ * The pipeline only needs to configure the accelerometer and optionally the
+ * gyroscope, arm the FIFO watermark interrupt and drain the FIFO, so it runs
+ * unchanged on the
+ * QMI8658 of the board (Qmi8658Imu) and on the signal generator used by the
+ * host build and for bench tests without a sensor (SimulatedImu).
+ */
+class ImuSensor
+{
+public:
+    enum AccelRange
+    {
+        ACCEL_RANGE_2G,
+        ACCEL_RANGE_4G,
+        ACCEL_RANGE_8G,
+        ACCEL_RANGE_16G,
+    };
+
+    enum GyroRange
+    {
+        GYRO_RANGE_16DPS,
+        GYRO_RANGE_32DPS,
+        GYRO_RANGE_64DPS,
+        GYRO_RANGE_128DPS,
+        GYRO_RANGE_256DPS,
+        GYRO_RANGE_512DPS,
+        GYRO_RANGE_1024DPS,
+        GYRO_RANGE_2048DPS,
+    };
+
+    /* Axes of a FIFO sample, in the order of the QMI8658 6 axis records */
+    enum Axis
+    {
+        ACCEL_X,
+        ACCEL_Y,
+        ACCEL_Z,
+        GYRO_X,
+        GYRO_Y,
+        GYRO_Z,
+        AXES,
+    };
+
+    /* Called from interrupt context when the FIFO reaches the watermark */
+    typedef void (*WatermarkCallback)();
+
+    virtual ~ImuSensor() {}
+
+    virtual const char *name() const = 0;
+
+    /**
+     * @brief Probe and reset the sensor.
+     *
+     * @return false if the sensor does not answer.
+     */
+    virtual bool begin() = 0;
+
+    /**
+     * @brief Set the accelerometer full scale and output data rate.
+     *
+     * @return false if @p odrHz is not supported by the sensor.
+     */
+    virtual bool configAccelerometer(AccelRange range, uint16_t odrHz) = 0;
+
+    /**
+     * @brief Capture the gyroscope in the same FIFO samples as the accelerometer.
+     *
+     * Call after configAccelerometer() and before configFifo() and enable().
+     * The gyroscope runs at the accelerometer ODR setting, and with both
+     * sensors on the sample rate becomes imu_6axis_odr_hz() of it.
+     */
+    virtual bool configGyroscope(GyroRange range) = 0;
+
+    /**
+     * @brief Configure the FIFO to raise the watermark interrupt every @p watermark samples.
+     */
+    virtual bool configFifo(uint16_t watermark) = 0;
+
+    virtual void setWatermarkCallback(WatermarkCallback callback) = 0;
+
+    /**
+     * @brief Start the accelerometer and the watermark interrupt.
+     */
+    virtual bool enable() = 0;
+
+    /**
+     * @brief Read up to @p count samples from the FIFO, oldest first.
+     *
+     * Samples are left in raw sensor counts (imu_count_g() and
+     * imu_count_dps() each), one array per Axis, so the caller converts them
+     * once with a single scale factor. An axis whose array is NULL is skipped,
+     * gyroscope axes are only filled after configGyroscope(). NULL @p axes
+     * discards the samples.
+     *
+     * @return Number of samples read.
+     */
+    virtual uint16_t readFifo(int16_t *const *axes, uint16_t count) = 0;
+
+    /* Depth of the FIFO in samples */
+    virtual uint16_t fifoSize() const = 0;
+
+    /**
+     * @brief Estimated bus time of a readFifo() of @p samples, in us, see imu_bus.h.
+     */
+    virtual float drainTimeUs(uint16_t samples) const = 0;
+};
+
+/* Full scale of a range in g */
+static inline float imu_range_g(ImuSensor::AccelRange range)
+{
+    return (float)(2 << range);
+}
+
+/* Weight of one sensor count in g */
+static inline float imu_count_g(ImuSensor::AccelRange range)
+{
+    return imu_range_g(range) / 32768.0f;
+}
+
+/* Full scale of a gyroscope range in degrees per second */
+static inline float imu_range_dps(ImuSensor::GyroRange range)
+{
+    return (float)(16 << range);
+}
+
+/* Weight of one gyroscope count in degrees per second */
+static inline float imu_count_dps(ImuSensor::GyroRange range)
+{
+    return imu_range_dps(range) / 32768.0f;
+}
+
+/* With the gyroscope on, the QMI8658 runs both sensors at the gyroscope
+ * rates, 7174.4 Hz instead of 8000 Hz and so on down */
+#define IMU_6AXIS_ODR_RATIO 0.8968f
+
+/* Sample rate of the 6 axis FIFO for an accelerometer ODR setting */
+static inline float imu_6axis_odr_hz(uint16_t odrHz)
+{
+    return odrHz * IMU_6AXIS_ODR_RATIO;
+}
+
+/**
+ * @brief IMU used by setupQMI8658(), the board sensor or the simulator
+ * depending on USE_SIMULATED_IMU. The host build provides its own.
+ */
+ImuSensor *create_imu_sensor();
+
+#endif // IMU_SENSOR_H
@@ -0,0 +1,93 @@
+#ifndef OCTAVE_BANDS_H
+#define OCTAVE_BANDS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vibration_severity.h"
+
+/* Most bands of a layout, 1/6 octave from 4 Hz to 4 kHz takes 60 */
+#define OCTAVE_BANDS_MAX 64
+/* Band of a bin outside every band */
+#define OCTAVE_NO_BAND 0xFF
+/* Share of the power of a bin in a band, out of this */
+#define OCTAVE_SHARE_ONE 255
+
+/* Where the power of a bin goes: a share to its band and a share to the next one */
+struct OctaveBinShare
+{
+    uint8_t band;
+    uint8_t lower;
+    uint8_t upper;
+};
+
+/**
+ * Constant percentage bands of a spectrum, the compact alternative to its bins.
+ *
+ * The bands are 1/1, 1/3 or 1/6 octave wide on the base 10 mid-band
+ * frequencies of IEC 61260-1 (1 kHz and its multiples of 10^(0.3 / b)), or
+ * a number of bands spaced evenly in log frequency. A table precomputed for
+ * the bin width tells for each bin how its power splits between the (at
+ * most two) bands it overlaps, so the band powers add up to the power of
+ * the spectrum however the edges fall between bins. Bands narrower than a
+ * bin are left out at the low end, which keeps that at two.
+ *
+ * The layout has an id, a hash of its edges, so the edges can be sent once
+ * and every message after only carries the band values.
+ */
+class OctaveBands
+{
+public:
+    /**
+     * @param[in] bins Number of bins of the spectra, the table is allocated here.
+     */
+    OctaveBands(uint16_t bins);
+    ~OctaveBands();
+
+    /* false if the table could not be allocated */
+    bool ready() const { return table != NULL; }
+
+    /**
+     * @brief Lay the bands out.
+     *
+     * @param[in] perOctave 1, 3 or 6 bands per octave, 0 for @p custom log spaced bands.
+     * @param[in] lowHz, highHz Range the bands lie in, a highHz of 0 or above
+     * the last bin stops at the last bin.
+     * @param[in] custom Number of bands when @p perOctave is 0.
+     * @param[in] binWidth Nominal bin width, for the range and the narrowest band.
+     *
+     * @return false, and no bands, when the arguments leave none.
+     */
+    bool configure(uint8_t perOctave, float lowHz, float highHz, uint8_t custom, float binWidth);
+
+    uint8_t count() const { return bands; }
+    uint8_t perOctave() const { return fraction; }
+    /* count() + 1 edges in Hz, band i spans edges()[i] to edges()[i + 1] */
+    const float *edges() const { return edgeHz; }
+    uint32_t layoutId() const { return id; }
+
+    /**
+     * @brief RMS of each band of a Blackman-Harris windowed spectrum.
+     *
+     * @param[in] magnitude One sided magnitudes from bin 0, float or Q15 counts.
+     * @param[in] binWidth Bin width of the spectrum, the table is rebuilt when it changed.
+     * @param[in] magnitudeScale Factor from a bin value to an acceleration magnitude in m/s2.
+     * @param[in] quantity Quantity of the RMS, integrated in the spectrum.
+     * @param[out] rms count() values.
+     */
+    template <typename T>
+    void aggregate(const T *magnitude, float binWidth, float magnitudeScale, SeverityQuantity quantity, float *rms);
+
+private:
+    void buildTable(float binWidth);
+
+    uint16_t bins;
+    OctaveBinShare *table;
+    float tableBinWidth;
+    uint8_t fraction;
+    uint8_t bands;
+    float edgeHz[OCTAVE_BANDS_MAX + 1];
+    uint32_t id;
+};
+
+#endif // OCTAVE_BANDS_H
@@ -0,0 +1,59 @@
+#ifndef ODR_CLOCK_H
+#define ODR_CLOCK_H
+
+#include <stdint.h>
+
+/**
+ * Tracks the sensor output data rate against the CPU clock.
+ *
+ * The QMI8658 runs from its own oscillator, so the real ODR differs from the
+ * configured one by up to a few percent. Each FIFO watermark interrupt is
+ * stamped with the monotonic clock, and the stamps of an uninterrupted run of
+ * blocks are fitted with a least squares line (time against sample count),
+ * which averages out the interrupt latency jitter. The rate of each run is
+ * then folded into a long term estimate, weighted by the run duration.
+ */
+class OdrClock
+{
+public:
+    explicit OdrClock(float nominalHz);
+
+    /**
+     * @brief End the current run, call when the stream was interrupted
+     * (FIFO flushed, overflowed or sensor reconfigured).
+     */
+    void restart();
+
+    /**
+     * @brief Add a FIFO block.
+     *
+     * @param[in] timestampUs Monotonic time of the watermark interrupt, i.e. of the last sample of the block.
+     * @param[in] samples Number of samples in the block.
+     */
+    void addBlock(int64_t timestampUs, uint16_t samples);
+
+    /**
+     * @brief Monotonic time of a sample of a block, from the interrupt timestamp of the block.
+     */
+    int64_t sampleTime(int64_t blockTimestampUs, uint16_t sampleIndex, uint16_t samples) const;
+
+    float nominalHz() const { return nominal; }
+    float rateHz() const;
+    float driftPpm() const { return (rateHz() - nominal) / nominal * 1e6f; }
+
+private:
+    void fold();
+    bool runRate(double *rate) const;
+
+    float nominal;
+    double longTermRate;
+    double longTermWeightUs;
+
+    /* Least squares sums of the current run, x in samples, y in microseconds from the first block */
+    int64_t firstTimestampUs;
+    uint32_t samplesInRun;
+    uint16_t blocksInRun;
+    double sumX, sumY, sumXX, sumXY;
+};
+
+#endif // ODR_CLOCK_H
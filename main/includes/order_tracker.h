@@ -0,0 +1,55 @@
+#ifndef ORDER_TRACKER_H
+#define ORDER_TRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "biquad.h"
+#include "resampler.h"
+
+/* Sections of the anti aliasing low pass ahead of the resampler */
+#define ORDER_ANTI_ALIAS_SECTIONS 2
+
+/**
+ * Streaming angular resampler for order analysis.
+ *
+ * Resamples the acceleration stream from the sensor rate to a fixed number
+ * of samples per shaft revolution, block by block, with the shaft rate of
+ * each block. A FFT of the output then has its bins in orders of the shaft
+ * rate, so the harmonics of a machine whose speed changes stay in their
+ * bins. The stream is low passed below the Nyquist frequency of the angular
+ * rate first, since the resampler kernel only band limits to the input rate.
+ */
+class OrderTracker
+{
+public:
+    explicit OrderTracker(uint8_t samplesPerRevolution);
+
+    /**
+     * @brief Restart the stream, the filters start from rest.
+     */
+    void reset();
+
+    /**
+     * @brief Resample a block of the input stream.
+     *
+     * @param[in] input Input samples.
+     * @param[in] count Number of input samples.
+     * @param[in] inputHz Measured rate of the input.
+     * @param[in] shaftHz Shaft rate over the block, must be above 0.
+     * @param[out] output Samples at samplesPerRevolution per revolution.
+     * @param[in] capacity Size of @p output, input left over once it is full is dropped.
+     *
+     * @return Number of output samples written.
+     */
+    size_t process(const float *input, size_t count, float inputHz, float shaftHz, float *output, size_t capacity);
+
+private:
+    Resampler resampler;
+    Biquad antiAlias[ORDER_ANTI_ALIAS_SECTIONS];
+    uint8_t samplesPerRevolution;
+    /* Corner the filter coefficients were computed for, relative to the input rate */
+    float filterCorner;
+};
+
+#endif // ORDER_TRACKER_H
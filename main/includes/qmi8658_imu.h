@@ -0,0 +1,75 @@
+#ifndef QMI8658_IMU_H
+#define QMI8658_IMU_H
+
+#include "driver/i2c_master.h"
+#include "driver/spi_master.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "device_configuration.h"
+#include "imu_sensor.h"
+
+/* Depth of the FIFO in samples, with or without the gyroscope */
+#define QMI8658_FIFO_SAMPLES 128
+/* One accelerometer sample in the FIFO: x, y, z as little endian int16 */
+#define QMI8658_FIFO_SAMPLE_BYTES 6
+/* With the gyroscope on, each sample is the accelerometer record followed by the gyroscope x, y, z */
+#define QMI8658_FIFO_6AXIS_SAMPLE_BYTES 12
+
+/**
+ * QMI8658 of the board on the ESP-IDF i2c_master driver, or spi_master when
+ * SENSOR_BUS_SPI is 1. The FIFO watermark interrupt is routed to DEV_INT2_PIN.
+ *
+ * On I2C the bus runs in asynchronous mode: every transfer is queued to the
+ * driver and the calling task sleeps on a semaphore given by the transfer
+ * done interrupt, so a FIFO drain costs no CPU while the bytes are on the
+ * bus. spi_master blocks the same way and moves the burst with DMA. The FIFO
+ * is read in a single burst sized to the samples it holds.
+ *
+ * The driver owns the I2C port, so the Arduino Wire library (legacy
+ * driver) must not be used in the same firmware.
+ */
+class Qmi8658Imu : public ImuSensor
+{
+public:
+    Qmi8658Imu();
+
+    const char *name() const override { return "QMI8658"; }
+    bool begin() override;
+    bool configAccelerometer(AccelRange range, uint16_t odrHz) override;
+    bool configGyroscope(GyroRange range) override;
+    bool configFifo(uint16_t watermark) override;
+    void setWatermarkCallback(WatermarkCallback callback) override;
+    bool enable() override;
+    uint16_t readFifo(int16_t *const *axes, uint16_t count) override;
+    uint16_t fifoSize() const override { return QMI8658_FIFO_SAMPLES; }
+    float drainTimeUs(uint16_t samples) const override;
+
+private:
+    bool setupBus();
+#if !SENSOR_BUS_SPI
+    static bool onTransferDone(i2c_master_dev_handle_t dev, const i2c_master_event_data_t *event, void *arg);
+    esp_err_t transfer(const uint8_t *write, size_t writeLength, uint8_t *read, size_t readLength);
+#endif
+    esp_err_t readRegisters(uint8_t reg, uint8_t *buffer, size_t length);
+    esp_err_t writeRegister(uint8_t reg, uint8_t value);
+    esp_err_t updateRegister(uint8_t reg, uint8_t mask, uint8_t value);
+    esp_err_t command(uint8_t cmd);
+    uint8_t sampleBytes() const { return gyroEnabled ? QMI8658_FIFO_6AXIS_SAMPLE_BYTES : QMI8658_FIFO_SAMPLE_BYTES; }
+
+#if SENSOR_BUS_SPI
+    spi_device_handle_t device;
+#else
+    i2c_master_bus_handle_t bus;
+    i2c_master_dev_handle_t device;
+    SemaphoreHandle_t transferDone;
+    volatile i2c_master_event_t transferEvent;
+#endif
+    /* aODR code of the accelerometer, the gyroscope runs at the same code */
+    uint8_t odrCode;
+    bool gyroEnabled;
+    /* Word aligned for the SPI DMA */
+    alignas(4) uint8_t fifoBuffer[QMI8658_FIFO_SAMPLES * QMI8658_FIFO_6AXIS_SAMPLE_BYTES];
+};
+
+#endif // QMI8658_IMU_H
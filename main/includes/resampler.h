@@ -0,0 +1,63 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Streaming fractional resampler.
+ *
+ * Converts a stream sampled at the measured sensor rate to the exact nominal
+ * rate, so FFT bins land on the frequencies the rest of the pipeline assumes.
+ * Uses a polyphase windowed sinc kernel (RESAMPLER_TAPS taps, RESAMPLER_PHASES
+ * phases, linear interpolation between phases), good for ratios close to 1.
+ *
+ * Output sample 0 is aligned on input sample RESAMPLER_DELAY, the first samples
+ * are only used as history for the kernel.
+ */
+#define RESAMPLER_TAPS 32
+#define RESAMPLER_PHASES 64
+#define RESAMPLER_DELAY (RESAMPLER_TAPS / 2 - 1)
+
+class Resampler
+{
+public:
+    Resampler();
+
+    /**
+     * @brief Restart the stream, the next input sample is sample 0.
+     */
+    void reset();
+
+    /**
+     * @brief Set the conversion ratio, can be updated while streaming.
+     */
+    void setRates(float inputHz, float outputHz);
+
+    /**
+     * @brief Resample a block of the input stream.
+     *
+     * @param[in] input Input samples.
+     * @param[in] count Number of input samples.
+     * @param[out] output Output samples.
+     * @param[in] capacity Size of @p output, input left over once it is full is dropped.
+     *
+     * @return Number of output samples written.
+     */
+    size_t process(const float *input, size_t count, float *output, size_t capacity);
+
+private:
+    float sample(const float *input, uint64_t index) const;
+
+    static float kernel[RESAMPLER_PHASES + 1][RESAMPLER_TAPS];
+    static bool kernelReady;
+
+    double step;
+    /* Position of the next output sample, in input samples since reset() */
+    double position;
+    /* Input samples consumed since reset() */
+    uint64_t consumed;
+    float history[RESAMPLER_TAPS];
+};
+
+#endif // RESAMPLER_H
@@ -0,0 +1,58 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+
+/**
+ * Ring of the most recent samples of a continuous stream.
+ *
+ * Samples are numbered from the first one ever pushed, so a position taken
+ * when an event happens still points at the same sample later. The ring is
+ * frozen while a reader copies a stretch out of it: samples pushed meanwhile
+ * are dropped, and since that breaks the stream, the next push after the
+ * release starts the ring over.
+ */
+class SampleRing
+{
+public:
+    SampleRing(int16_t *buffer, uint32_t capacity);
+
+    /**
+     * @brief Drop the samples kept, the stream was interrupted. Deferred to
+     * the release while frozen.
+     */
+    void restart();
+
+    void push(const int16_t *samples, uint32_t count);
+
+    /* Number of the next sample pushed */
+    uint64_t end() const { return written; }
+    /* Number of the oldest sample kept, the samples up to end() are continuous */
+    uint64_t begin() const { return start; }
+
+    /**
+     * @brief Stop keeping samples until release(), so the kept ones can be read.
+     */
+    void freeze() { frozen = true; }
+    void release() { frozen = false; }
+    bool isFrozen() const { return frozen; }
+
+    /**
+     * @brief Copy samples from number @p from on.
+     *
+     * @return Number of samples copied, fewer than @p count past end() and
+     * none before begin().
+     */
+    uint32_t copy(uint64_t from, int16_t *output, uint32_t count) const;
+
+private:
+    int16_t *buffer;
+    uint32_t capacity;
+    uint64_t written;
+    uint64_t start;
+    volatile bool frozen;
+    /* Samples were dropped while frozen */
+    bool broken;
+};
+
+#endif // SAMPLE_RING_H
@@ -0,0 +1,145 @@
+#ifndef SIMULATED_IMU_H
+#define SIMULATED_IMU_H
+
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "imu_bus.h"
+#include "imu_sensor.h"
+
+#define SIMULATED_IMU_MAX_TONES 8
+/* Same depth as the QMI8658 FIFO */
+#define SIMULATED_IMU_FIFO_SIZE 128
+
+struct SimulatedTone
+{
+    float frequencyHz;
+    /* In g on the accelerometer, in dps on the gyroscope */
+    float amplitude;
+    float phaseRad;
+};
+
+struct SimulatedImuConfig
+{
+    /* Stationary vibration, added to the 1 g of gravity on the z axis */
+    SimulatedTone tones[SIMULATED_IMU_MAX_TONES];
+    uint8_t toneCount;
+    /* White noise on every axis, RMS in g */
+    float noiseRmsG;
+    /* Angular vibration about the x axis (rocking), only produced after configGyroscope() */
+    SimulatedTone gyroTones[SIMULATED_IMU_MAX_TONES];
+    uint8_t gyroToneCount;
+    /* White noise on every gyroscope axis, RMS in dps */
+    float gyroNoiseRmsDps;
+    /* Periodic impacts ringing at a resonance, like a bearing defect, 0 Hz disables them */
+    float impulseRateHz;
+    float impulseAmplitudeG;
+    float impulseResonanceHz;
+    float impulseDecayS;
+    /* Impact amplitude modulated by 1 + depth * cos(2 pi f t): a defect on the
+     * inner race turns with the shaft in and out of the load zone (BPFI), 0 Hz
+     * keeps every impact equal like a defect on the fixed outer race (BPFO) */
+    float impulseModulationHz;
+    float impulseModulationDepth;
+    /* Time the impacts start at, like a defect developing on a healthy machine */
+    float impulseOnsetS;
+    /* Gear mesh tone whose amplitude rises by 1 + depth for a short part of
+     * every turn of the gear shaft, like a cracked tooth, which spreads it into
+     * a family of sidebands spaced by the shaft rate. 0 Hz disables it */
+    float gearMeshHz;
+    float gearAmplitudeG;
+    float gearShaftHz;
+    float gearModulationDepth;
+    /* Machine speed varying by +-speedVariation (a fraction) over speedPeriodS,
+     * like a VFD following a process, every tone follows it. 0 keeps the speed */
+    float speedVariation;
+    float speedPeriodS;
+    /* Vibration on the x axis, like a mount shaking sideways, until lateralEndS (0 s keeps it) */
+    SimulatedTone lateralTone;
+    float lateralEndS;
+    /* Slow baseline wander of the z axis (temperature, mounting), 0 g disables it */
+    float baselineDriftG;
+    float baselineDriftPeriodS;
+    /* Error of the sensor oscillator, samples come at ODR * (1 + odrErrorPpm / 1e6) */
+    float odrErrorPpm;
+    uint32_t noiseSeed;
+    /* Bus modelled by readFifo(), which takes the estimated drain time of
+     * imu_drain_time_us(), IMU_BUS_NONE reads instantly */
+    ImuBus bus;
+    uint32_t busClockHz;
+    /* true paces the samples at the ODR against esp_timer, false produces a
+     * watermark block as soon as the previous one was read (interrupt
+     * timestamps are then meaningless) */
+    bool realTime;
+};
+
+/**
+ * @brief Two shaft harmonics over a little noise, with a 0.2 % slow sensor
+ * clock, and rocking at the shaft frequency on the gyroscope.
+ */
+SimulatedImuConfig simulated_imu_default_config();
+
+/**
+ * Signal generator behind the ImuSensor interface.
+ *
+ * A task fills a FIFO of SIMULATED_IMU_FIFO_SIZE samples at the configured
+ * ODR and calls the watermark callback when the fill level reaches the
+ * watermark, like the QMI8658 does in FIFO mode: a read clears the
+ * interrupt, and once the FIFO is full new samples are dropped until it is
+ * read. readFifo() takes the bus time of the configured bus. Samples are
+ * clipped to the full scale and quantized to 16 bits, so range and
+ * resolution effects show up as on the real sensor. With the gyroscope on,
+ * the samples come at imu_6axis_odr_hz() and take 12 bytes on the bus.
+ */
+class SimulatedImu : public ImuSensor
+{
+public:
+    explicit SimulatedImu(const SimulatedImuConfig &config);
+
+    const char *name() const override { return "simulated IMU"; }
+    bool begin() override;
+    bool configAccelerometer(AccelRange range, uint16_t odrHz) override;
+    bool configGyroscope(GyroRange range) override;
+    bool configFifo(uint16_t watermark) override;
+    void setWatermarkCallback(WatermarkCallback callback) override;
+    bool enable() override;
+    uint16_t readFifo(int16_t *const *axes, uint16_t count) override;
+    uint16_t fifoSize() const override { return SIMULATED_IMU_FIFO_SIZE; }
+    float drainTimeUs(uint16_t samples) const override;
+
+    /* Samples produced since enable() */
+    uint64_t samplesGenerated() const { return generated; }
+    /* Samples dropped because the FIFO was full */
+    uint32_t overflows() const { return dropped; }
+
+private:
+    static void vTaskGenerate(void *pvParameters);
+    void run();
+    double sampleRateHz() const;
+    void sample(uint64_t index, int16_t *counts);
+    float noise(float rms);
+    static int16_t quantize(float value, float fullScale);
+
+    SimulatedImuConfig config;
+    float rangeG;
+    /* 0 while the gyroscope is off */
+    float rangeDps;
+    uint16_t odrHz;
+    uint16_t watermark;
+    WatermarkCallback callback;
+    TaskHandle_t generateHandle;
+    uint32_t noiseState;
+
+    portMUX_TYPE fifoLock;
+    /* Counts of each sample in ImuSensor::Axis order, like the records of the QMI8658 FIFO */
+    int16_t fifo[SIMULATED_IMU_FIFO_SIZE][AXES];
+    uint16_t fifoHead;
+    uint16_t fifoCount;
+    bool interruptRaised;
+    volatile uint64_t generated;
+    volatile uint32_t dropped;
+};
+
+#endif // SIMULATED_IMU_H
@@ -0,0 +1,128 @@
+#ifndef SPECTRAL_BASELINE_H
+#define SPECTRAL_BASELINE_H
+
+#include <stdint.h>
+
+/* Log spaced bands of the spectrum the baseline keeps a mean and a variance of */
+#define BASELINE_BANDS 16
+/* Band levels are in dB re 1 (m/s2)^2, an empty band reads this */
+#define BASELINE_FLOOR_DB -120.0f
+/* Deviations below this are taken as this, a band that never moved while
+ * learning would otherwise turn any change into a huge z-score */
+#define BASELINE_MIN_DEVIATION_DB 1.0f
+/* Bumped when the layout of BaselineModel changes, a stored model of another version is dropped */
+#define BASELINE_MODEL_VERSION 1
+
+enum BaselineMode : uint8_t
+{
+    /* Every window that is not anomalous moves the mean and the variance */
+    BASELINE_LEARNING,
+    /* Windows are only scored */
+    BASELINE_FROZEN,
+};
+
+/* All the baseline keeps, written as is to flash so it survives a reboot */
+struct BaselineModel
+{
+    uint8_t version;
+    uint8_t mode;
+    /* Spectrum the bands were laid over */
+    uint16_t bins;
+    float sampleRateHz;
+    /* Windows learned since the last reset */
+    uint32_t windows;
+    /* Mean level of each band in dB, and its variance in dB^2 */
+    float mean[BASELINE_BANDS];
+    float variance[BASELINE_BANDS];
+};
+
+/**
+ * @brief First bin of a band, band BASELINE_BANDS gives the end of the last one.
+ *
+ * Bands are spaced evenly in log frequency from bin 2 to @p bins, so each
+ * covers the same fraction of an octave and the low bands, where the shaft
+ * harmonics sit, are not swamped by the wide high ones. Every band has at
+ * least one bin.
+ */
+uint16_t spectral_band_edge(uint16_t bins, uint8_t band);
+
+/**
+ * @brief Power of each band in dB re 1 (m/s2)^2.
+ *
+ * @param[in] magnitude One sided magnitudes from bin 0, float or Q15 counts.
+ * @param[in] bins Number of bins of @p magnitude.
+ * @param[in] amplitudeScale Factor from a bin value to the amplitude of a tone.
+ * @param[out] levels BASELINE_BANDS levels.
+ */
+template <typename T>
+void spectral_band_levels(const T *magnitude, uint16_t bins, float amplitudeScale, float *levels);
+
+/**
+ * Healthy state of a machine learned from its own spectra.
+ *
+ * Each band keeps an exponentially weighted mean and variance of its level.
+ * The weight of a new window is 1/n over the first windows, a plain average
+ * that settles quickly, and then alpha, so the baseline follows slow changes
+ * of the machine while learning. A window scores the RMS over the bands of
+ * its z-scores, a Mahalanobis distance with the bands taken as independent:
+ * about 1 for a spectrum like the baseline, and growing with the number of
+ * bands that moved and how far. Anomalous windows are not learned, a
+ * developing fault does not become the baseline.
+ */
+class SpectralBaseline
+{
+public:
+    /**
+     * @param[in] bins Number of bins of the scored spectra.
+     * @param[in] sampleRateHz Rate of the scored spectra, a stored model of another rate is dropped.
+     * @param[in] alpha Weight of a new window once learning settled.
+     * @param[in] minWindows Windows learned before windows are scored.
+     * @param[in] threshold Score above which a window is anomalous and not learned.
+     */
+    SpectralBaseline(uint16_t bins, float sampleRateHz, float alpha, uint16_t minWindows, float threshold);
+
+    /**
+     * @brief Forget the baseline and learn it again.
+     */
+    void reset();
+
+    /**
+     * @brief Go on learning from the next window.
+     */
+    void learn();
+
+    /**
+     * @brief Stop learning, windows are only scored.
+     */
+    void freeze();
+
+    /**
+     * @brief Continue from a stored model.
+     *
+     * @return false, and the baseline left alone, when the model is of
+     * another version or was learned over another spectrum.
+     */
+    bool restore(const BaselineModel &model);
+
+    const BaselineModel &model() const { return state; }
+    BaselineMode mode() const { return (BaselineMode)state.mode; }
+    uint32_t windows() const { return state.windows; }
+
+    /**
+     * @brief Score a window against the baseline, then learn it while learning.
+     *
+     * @param[in] levels BASELINE_BANDS band levels from spectral_band_levels().
+     * @param[out] z z-score of each band, NULL when not needed.
+     *
+     * @return The anomaly score, negative while fewer than minWindows windows were learned.
+     */
+    float update(const float *levels, float *z);
+
+private:
+    BaselineModel state;
+    float alpha;
+    uint16_t minWindows;
+    float threshold;
+};
+
+#endif // SPECTRAL_BASELINE_H
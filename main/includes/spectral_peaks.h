@@ -0,0 +1,54 @@
+#ifndef SPECTRAL_PEAKS_H
+#define SPECTRAL_PEAKS_H
+
+#include <stdint.h>
+
+/* Most peaks find_spectral_peaks() returns */
+#define SPECTRAL_PEAKS_MAX 32
+/* Harmonic n of a family lies within this many bins of n times its fundamental */
+#define HARMONIC_TOLERANCE_BINS 0.5f
+
+struct SpectralPeak
+{
+    float hz;
+    /* Amplitude of the tone, from the interpolated top of the peak */
+    float amplitude;
+    /* Index in the peak list of the lowest peak of the harmonic family */
+    uint8_t family;
+    /* 1 for the lowest peak of the family, n for its nth harmonic */
+    uint8_t harmonic;
+};
+
+/**
+ * @brief Position of a peak between bins, -0.5 to 0.5 from the centre bin.
+ *
+ * Fits a parabola through the log magnitudes of the peak bin and its two
+ * neighbours, exact for the Gaussian shaped main lobe of a Blackman-Harris
+ * window and within a few hundredths of a bin otherwise.
+ */
+float spectral_peak_offset(float left, float centre, float right);
+
+/**
+ * @brief Strongest peaks of a magnitude spectrum, grouped in harmonic families.
+ *
+ * Local maxima go through a min heap of @p capacity entries, so one pass
+ * keeps the strongest. Each is then interpolated between bins for its
+ * frequency and amplitude. Going up in frequency, every peak not yet in a
+ * family starts one, and the peaks within HARMONIC_TOLERANCE_BINS of an
+ * integer multiple of it join as harmonics.
+ *
+ * @param[in] magnitude One sided magnitudes from bin 0, float or Q15 counts.
+ * @param[in] bins Number of bins searched.
+ * @param[in] binWidth Frequency step between bins.
+ * @param[in] amplitudeScale Factor from a bin value to the amplitude of a tone.
+ * @param[in] minRatio Peaks below this fraction of the strongest are left out.
+ * @param[out] peaks Peaks found, strongest first.
+ * @param[in] capacity Size of @p peaks, at most SPECTRAL_PEAKS_MAX.
+ *
+ * @return Number of peaks written.
+ */
+template <typename T>
+uint8_t find_spectral_peaks(const T *magnitude, uint16_t bins, float binWidth, float amplitudeScale,
+                            float minRatio, SpectralPeak *peaks, uint8_t capacity);
+
+#endif // SPECTRAL_PEAKS_H
@@ -0,0 +1,164 @@
+#ifndef SPECTRUM_CODEC_H
+#define SPECTRUM_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Format of the coded spectra, their first byte */
+#define SPECTRUM_CODEC_VERSION 1
+/* Most arrays a coded spectrum carries */
+#define SPECTRUM_CODEC_CHANNELS_MAX 4
+/* Bytes a coded spectrum of this many channels and values in all never exceeds */
+#define SPECTRUM_CODEC_BOUND(channels, values) (13 + 12 * (channels) + 5 * (values))
+
+/* Ids of the arrays of a spectrum frame, carried by the keyframes */
+enum SpectrumChannel : uint8_t
+{
+    SPECTRUM_CHANNEL_FFT,
+    SPECTRUM_CHANNEL_ORDER,
+    SPECTRUM_CHANNEL_ENVELOPE,
+};
+
+/* Outcome of SpectrumDecoder::decode() */
+enum SpectrumCodecStatus : uint8_t
+{
+    /* The values are those of the spectrum */
+    SPECTRUM_DECODED,
+    /* The delta decoded last, delivered again (QoS 1 may), the values did not change */
+    SPECTRUM_DUPLICATE,
+    /* A delta that does not follow the last spectrum decoded, a message was
+     * lost: no values until the next keyframe */
+    SPECTRUM_NEED_KEYFRAME,
+    /* Not a coded spectrum of this version, or cut short: no values until the next keyframe */
+    SPECTRUM_INVALID,
+};
+
+/**
+ * @brief Name of the telemetry array of a SpectrumChannel, NULL for an unknown id.
+ */
+const char *spectrum_channel_name(uint8_t id);
+
+/**
+ * Delta coding of the spectra of a steady machine, which hardly change from
+ * one to the next.
+ *
+ * Every value is quantized to steps of its level in dB, relative to the
+ * strongest value of its channel in the last keyframe, and values more than
+ * the range below it become 0. A keyframe sends the step of each value from
+ * the one below it, a delta frame the step of each value from what the
+ * decoder holds, or 0 while it stays within the dead band. The differences
+ * are coded as runs of zeros (exp-Golomb) between the others (Rice, with the
+ * parameter that makes each channel shortest). The decoder then holds every
+ * value within (deadband + 0.5) steps of the spectrum, and a steady spectrum
+ * takes a few bits per value.
+ *
+ * All little endian: a version byte, a flags byte (bit 0 keyframe) and a
+ * uint16 sequence number counting up from spectrum to spectrum. A keyframe
+ * goes on with the float step and range in dB, the number of channels, and
+ * per channel its uint8 id, uint16 count and float reference level. The bit
+ * stream of the channels follows, most significant bit first.
+ */
+class SpectrumEncoder
+{
+public:
+    /**
+     * @param[in] channels Arrays of each spectrum, at most SPECTRUM_CODEC_CHANNELS_MAX.
+     * @param[in] ids SpectrumChannel of each array.
+     * @param[in] counts Values of each array.
+     * @param[in] stepDb Quantization step.
+     * @param[in] rangeDb Values this far below the strongest of their channel in the keyframe go as 0.
+     * @param[in] deadband Changes of up to this many steps are not sent.
+     * @param[in] keyframeInterval Spectra from a keyframe to the next.
+     */
+    SpectrumEncoder(uint8_t channels, const uint8_t *ids, const uint16_t *counts, float stepDb, float rangeDb,
+                    uint8_t deadband, uint16_t keyframeInterval);
+    ~SpectrumEncoder();
+
+    /* false if the codes could not be allocated */
+    bool ready() const { return codes != NULL && scratch != NULL; }
+
+    /* The next spectrum is a keyframe: after a reconnect, or when a decoder lost a message */
+    void requestKeyframe() { keyframeDue = true; }
+
+    /**
+     * @brief Code a spectrum, as a keyframe when one is due and as the changes
+     * from the last one otherwise.
+     *
+     * @param[in] values Values of each channel.
+     * @param[out] out Coded spectrum, SPECTRUM_CODEC_BOUND() bytes are always enough.
+     *
+     * @return Bytes written, 0 when @p capacity was too small, the next spectrum is then a keyframe.
+     */
+    size_t encode(const float *const *values, uint8_t *out, size_t capacity);
+
+    /* Of the last spectrum coded */
+    bool keyframe() const { return lastKeyframe; }
+    uint16_t sequence() const { return seq; }
+
+private:
+    uint8_t channels;
+    uint8_t ids[SPECTRUM_CODEC_CHANNELS_MAX];
+    uint16_t counts[SPECTRUM_CODEC_CHANNELS_MAX];
+    float stepDb;
+    float rangeDb;
+    uint8_t deadband;
+    uint16_t keyframeInterval;
+    /* Codes the decoder holds, all channels one after the other, and the differences of a channel */
+    int16_t *codes;
+    int32_t *scratch;
+    float reference[SPECTRUM_CODEC_CHANNELS_MAX];
+    bool keyframeDue;
+    bool lastKeyframe;
+    uint16_t sinceKeyframe;
+    uint16_t seq;
+};
+
+/**
+ * Decoder of the spectra of a SpectrumEncoder, sequence numbers checked. It
+ * is built into the firmware and, as the spectrum_codec library of host/,
+ * into the Linux side that receives the telemetry.
+ */
+class SpectrumDecoder
+{
+public:
+    SpectrumDecoder();
+    ~SpectrumDecoder();
+
+    /**
+     * @brief Decode the next coded spectrum of the device.
+     */
+    SpectrumCodecStatus decode(const uint8_t *data, size_t size);
+
+    /* Layout of the last keyframe */
+    uint8_t channels() const { return channelCount; }
+    uint8_t id(uint8_t channel) const { return ids[channel]; }
+    uint16_t count(uint8_t channel) const { return counts[channel]; }
+    /* Step and range of the last keyframe, the values are within (deadband + 0.5) steps */
+    float step() const { return stepDb; }
+    float range() const { return rangeDb; }
+    /* Strongest value of a channel in the last keyframe, the values range() dB below it are 0 */
+    float level(uint8_t channel) const { return reference[channel]; }
+    /* Values of a channel after SPECTRUM_DECODED or SPECTRUM_DUPLICATE */
+    const float *values(uint8_t channel) const { return decoded[channel]; }
+    /* Of the last spectrum decoded */
+    bool keyframe() const { return lastKeyframe; }
+    uint16_t sequence() const { return seq; }
+
+private:
+    bool layout(uint8_t count, const uint8_t *ids, const uint16_t *counts);
+    void release();
+
+    uint8_t channelCount;
+    uint8_t ids[SPECTRUM_CODEC_CHANNELS_MAX];
+    uint16_t counts[SPECTRUM_CODEC_CHANNELS_MAX];
+    float reference[SPECTRUM_CODEC_CHANNELS_MAX];
+    int16_t *codes[SPECTRUM_CODEC_CHANNELS_MAX];
+    float *decoded[SPECTRUM_CODEC_CHANNELS_MAX];
+    float stepDb;
+    float rangeDb;
+    bool synced;
+    bool lastKeyframe;
+    uint16_t seq;
+};
+
+#endif // SPECTRUM_CODEC_H
@@ -0,0 +1,63 @@
+#ifndef SYSTEM_EVENTS_H
+#define SYSTEM_EVENTS_H
+
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+
+/**
+ * Startup dependency graph
+ *
+ * Subsystems are started concurrently and signal readiness through
+ * g_system_events, consumers wait only for the bits they depend on:
+ *
+ *   memory ──┬── BLE ──────────────────────────────► SYSTEM_EVENT_BLE_READY
+ *            ├── sensor (captures right away) ─────► SYSTEM_EVENT_SENSOR_READY
+ *            └── Wi-Fi ──► IP ──► SNTP ──┬─────────► SYSTEM_EVENT_WIFI_CONNECTED
+ *                                        └─────────► SYSTEM_EVENT_TIME_SYNCED
+ *   IoT task waits for SYSTEM_EVENT_WIFI_CONNECTED | SYSTEM_EVENT_TIME_SYNCED
+ */
+#define SYSTEM_EVENT_WIFI_CONNECTED BIT0
+#define SYSTEM_EVENT_TIME_SYNCED BIT1
+#define SYSTEM_EVENT_SENSOR_READY BIT2
+#define SYSTEM_EVENT_BLE_READY BIT3
+
+extern EventGroupHandle_t g_system_events;
+
+typedef enum
+{
+    BOOT_MILESTONE_SENSOR_READY = 0,
+    BOOT_MILESTONE_FIRST_SAMPLE,
+    BOOT_MILESTONE_WIFI_CONNECTED,
+    BOOT_MILESTONE_TIME_SYNCED,
+    BOOT_MILESTONE_FIRST_PUBLISH,
+    BOOT_MILESTONE_COUNT
+} boot_milestone_t;
+
+/**
+ * @brief Create the system event group. Must be called before any subsystem is started.
+ */
+esp_err_t init_system_events();
+
+/**
+ * @brief Run an initialization function in its own task, so it does not hold back
+ * the rest of the startup. The task sets @p ready_bit on success and deletes itself.
+ *
+ * @param[in] name Task name, also used in the logs.
+ * @param[in] init Initialization function.
+ * @param[in] ready_bit Bit set in g_system_events once @p init returns ESP_OK.
+ * @param[in] core Core to pin the task to.
+ */
+esp_err_t start_init_task(const char *name, esp_err_t (*init)(), EventBits_t ready_bit, BaseType_t core);
+
+/**
+ * @brief Record the first time a boot milestone is reached, later calls are ignored.
+ */
+void mark_boot_milestone(boot_milestone_t milestone);
+
+/**
+ * @brief Time from boot to a milestone in milliseconds, or -1 if not reached yet.
+ */
+int32_t get_boot_milestone_ms(boot_milestone_t milestone);
+
+#endif // SYSTEM_EVENTS_H
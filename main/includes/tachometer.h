@@ -0,0 +1,27 @@
+#ifndef TACHOMETER_H
+#define TACHOMETER_H
+
+#include <stdint.h>
+
+/* Pulses remembered, the most pulses per revolution supported */
+#define TACHOMETER_PULSES 64
+/* A shaft without a pulse for this long is stopped */
+#define TACHOMETER_TIMEOUT_US 2000000
+
+/**
+ * @brief Timestamp the rising edges of a tachometer or key phasor input.
+ *
+ * @param[in] pin GPIO of the pulses.
+ * @param[in] pulsesPerRevolution Pulses of one shaft revolution, below TACHOMETER_PULSES.
+ */
+bool tachometer_begin(int pin, uint8_t pulsesPerRevolution);
+
+/**
+ * @brief Shaft rate over the last revolution before @p atUs (esp_timer_get_time()).
+ *
+ * @return Revolutions per second, 0 while fewer than a revolution of pulses
+ * came or the last one is older than TACHOMETER_TIMEOUT_US.
+ */
+float tachometer_hz(int64_t atUs);
+
+#endif // TACHOMETER_H
@@ -0,0 +1,55 @@
+#ifndef TIME_BASE_H
+#define TIME_BASE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/time.h>
+
+/**
+ * Mapping between the monotonic clock (esp_timer_get_time(), microseconds since
+ * boot) and UTC.
+ *
+ * Samples are always stamped with the monotonic clock, which is available from
+ * boot and never jumps. The mapping is only known once SNTP synchronizes, so
+ * conversion happens when data is published: anything buffered before the
+ * first synchronization is corrected retroactively.
+ */
+
+/**
+ * @brief Record a SNTP synchronization. Call from the SNTP notification callback.
+ *
+ * @param[in] tv UTC time set by SNTP.
+ */
+void time_base_synchronized(const struct timeval *tv);
+
+/**
+ * @brief True once SNTP synchronized at least once.
+ */
+bool time_base_is_synchronized();
+
+/**
+ * @brief Convert a monotonic timestamp to UTC.
+ *
+ * Extrapolates from the last synchronization, correcting for the CPU clock
+ * drift measured between the last two synchronizations.
+ *
+ * @param[in] monotonic_us Timestamp from esp_timer_get_time().
+ * @param[out] utc_us Microseconds since the Unix epoch.
+ *
+ * @return false if time was never synchronized.
+ */
+bool time_base_to_utc(int64_t monotonic_us, int64_t *utc_us);
+
+/**
+ * @brief CPU clock drift against UTC in parts per million, 0 until measured.
+ */
+float time_base_cpu_drift_ppm();
+
+/**
+ * @brief Format a UTC timestamp as ISO 8601 with microseconds, e.g. 2025-01-31T12:00:00.123456Z
+ *
+ * @return Number of characters written, 0 on error.
+ */
+size_t time_base_format_utc(int64_t utc_us, char *out, size_t len);
+
+#endif // TIME_BASE_H
@@ -0,0 +1,61 @@
+#ifndef TIME_FEATURES_H
+#define TIME_FEATURES_H
+
+#include <stdint.h>
+
+/* Time domain condition indicators of one axis over a window */
+struct AxisFeatures
+{
+    /* About the mean, so gravity does not count */
+    float rms;
+    /* Largest deviation from the mean */
+    float peak;
+    float peakToPeak;
+    /* peak / rms, rises with impacts before the RMS does */
+    float crestFactor;
+    /* 3 for gaussian vibration, above with impacts (bearing defects) */
+    float kurtosis;
+    float skewness;
+};
+
+/**
+ * Single pass accumulator of the time domain features of one axis.
+ *
+ * Blocks are added as they come out of the FIFO, while they are still in
+ * cache, so nothing is kept of the window. Each block is reduced to its mean
+ * and central sums by plain loops over the int16 counts that the compiler
+ * can vectorize, and merged into the moments of the window with the pairwise
+ * form of Welford's update (Pebay 2008). Central moments keep the 1 g of
+ * the z axis out of the sums, which would otherwise swamp the fourth power.
+ */
+class TimeFeatures
+{
+public:
+    TimeFeatures() { reset(); }
+
+    void reset();
+
+    void addBlock(const int16_t *counts, uint16_t samples);
+
+    uint32_t samples() const { return n; }
+
+    /**
+     * @brief Features of the samples added since reset().
+     *
+     * @param[in] scale Weight of a count, the features come out in its units
+     * (crest factor, kurtosis and skewness have none).
+     */
+    AxisFeatures result(float scale) const;
+
+private:
+    uint32_t n;
+    double mean;
+    /* Sums of the 2nd to 4th powers of the deviations from the mean */
+    double m2;
+    double m3;
+    double m4;
+    int16_t min;
+    int16_t max;
+};
+
+#endif // TIME_FEATURES_H
@@ -0,0 +1,105 @@
+#ifndef VIBRATION_SEVERITY_H
+#define VIBRATION_SEVERITY_H
+
+#include <math.h>
+#include <stdint.h>
+
+/*
+ * Velocity and displacement from the acceleration spectrum, by dividing each
+ * bin by j 2 pi f (once for velocity, twice for displacement) instead of
+ * integrating in time and running another FFT. Bins below the low corner
+ * are zeroed: they hold the leakage of the removed gravity and the sensor
+ * drift, which the 1/f gain would turn into huge velocities.
+ */
+
+/* Band of the ISO 10816 / 20816 velocity RMS */
+#ifndef SEVERITY_LOW_HZ
+#define SEVERITY_LOW_HZ 10.0f
+#endif
+#ifndef SEVERITY_HIGH_HZ
+#define SEVERITY_HIGH_HZ 1000.0f
+#endif
+
+/* Zone boundaries A/B, B/C and C/D in mm/s RMS. The defaults are ISO 10816-3
+ * group 2 (15 to 300 kW) on rigid foundations; group 2 flexible is 2.3, 4.5,
+ * 7.1, group 1 (300 kW to 50 MW) rigid 2.3, 4.5, 7.1 and flexible 3.5, 7.1, 11 */
+#ifndef ISO_ZONE_AB_MM_S
+#define ISO_ZONE_AB_MM_S 1.4f
+#endif
+#ifndef ISO_ZONE_BC_MM_S
+#define ISO_ZONE_BC_MM_S 2.8f
+#endif
+#ifndef ISO_ZONE_CD_MM_S
+#define ISO_ZONE_CD_MM_S 4.5f
+#endif
+
+/* Mean square of the Blackman-Harris window, the power lost to windowing */
+#define BLACKMAN_HARRIS_POWER 0.257964f
+/* Coherent gain of the Blackman-Harris window, turns a peak bin into a tone amplitude */
+#define BLACKMAN_HARRIS_GAIN 0.35875f
+
+enum SeverityQuantity
+{
+    SEVERITY_ACCELERATION,
+    SEVERITY_VELOCITY,
+    SEVERITY_DISPLACEMENT,
+};
+
+/* A newly commissioned machine is in zone A, D is severe enough to cause damage */
+enum IsoZone
+{
+    ISO_ZONE_A,
+    ISO_ZONE_B,
+    ISO_ZONE_C,
+    ISO_ZONE_D,
+};
+
+/**
+ * @brief Factor from an acceleration bin in m/s2 to @p quantity: 1, mm/s or um.
+ *
+ * 0 outside SEVERITY_LOW_HZ..SEVERITY_HIGH_HZ for velocity and displacement.
+ */
+static inline float severity_gain(SeverityQuantity quantity, float hz)
+{
+    if (quantity == SEVERITY_ACCELERATION)
+    {
+        return 1.0f;
+    }
+    if (hz < SEVERITY_LOW_HZ || hz > SEVERITY_HIGH_HZ)
+    {
+        return 0.0f;
+    }
+    const float omega = 2.0f * (float)M_PI * hz;
+    return quantity == SEVERITY_VELOCITY ? 1e3f / omega : 1e6f / (omega * omega);
+}
+
+/**
+ * @brief RMS from the sum of the squared one sided magnitudes of a Blackman-Harris windowed FFT.
+ *
+ * Parseval: the bins hold N times the windowed signal power, and the one
+ * sided spectrum half of it.
+ */
+static inline float spectrum_rms(double sumSquares, uint16_t points)
+{
+    return (float)sqrt(2.0 * sumSquares / ((double)points * points * BLACKMAN_HARRIS_POWER));
+}
+
+static inline IsoZone iso_zone(float velocityRmsMmS)
+{
+    if (velocityRmsMmS < ISO_ZONE_AB_MM_S)
+    {
+        return ISO_ZONE_A;
+    }
+    if (velocityRmsMmS < ISO_ZONE_BC_MM_S)
+    {
+        return ISO_ZONE_B;
+    }
+    return velocityRmsMmS < ISO_ZONE_CD_MM_S ? ISO_ZONE_C : ISO_ZONE_D;
+}
+
+static inline char iso_zone_letter(IsoZone zone)
+{
+    return (char)('A' + zone);
+}
+
+#endif // VIBRATION_SEVERITY_H
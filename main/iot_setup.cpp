@@ -19,6 +19,7 @@
 
 /* Exponential backoff retry include. */
 #include "backoff_algorithm.h"
+#include "backoff_dither.h"
 
 /* Transport interface implementation include header for TLS. */
 #include "transport_tls_socket.h"
@@ -38,20 +39,35 @@
 #include "wifi_setup.h"
 #include "device_configuration.h"
 #include <ArduinoJson.h>
+#include "esp_timer.h"
+#include "mbedtls/base64.h"
 #include "QMI8658_setup.h"
 #include "iot_setup.h"
+#include "spectrum_codec.h"
 #include "file_setup.h"
+#include "system_events.h"
+#include "time_base.h"
 
 /**
  * @brief The maximum number of retries for network operation with server.
+ *
+ * A field device has nothing better to do than keep trying, so retries never
+ * exhaust; the loop only gives up when the Wi-Fi link goes down.
  */
-#define sampleazureiotRETRY_MAX_ATTEMPTS (5U)
+#define sampleazureiotRETRY_MAX_ATTEMPTS BACKOFF_ALGORITHM_RETRY_FOREVER
 
 /**
  * @brief The maximum back-off delay (in milliseconds) for retrying failed operation
  *  with server.
  */
-#define sampleazureiotRETRY_MAX_BACKOFF_DELAY_MS (5000U)
+#define sampleazureiotRETRY_MAX_BACKOFF_DELAY_MS (60 * 1000U)
+
+/**
+ * @brief Window (in milliseconds) over which the first connection attempt of a
+ * cycle is spread, based on the device ID. Keeps a whole plant from hitting the
+ * hub at the same instant after an access point reboot.
+ */
+#define sampleazureiotCONNECT_DITHER_WINDOW_MS (30 * 1000U)
 
 /**
  * @brief The base back-off delay (in milliseconds) to use for network operation retry
@@ -107,6 +123,33 @@
 
 #define DOUBLE_DECIMAL_PLACE_DIGITS 2
 #define REBOOT_COMAND "reboot"
+#define LEARN_BASELINE_COMMAND "learnBaseline"
+#define FREEZE_BASELINE_COMMAND "freezeBaseline"
+#define RESET_BASELINE_COMMAND "resetBaseline"
+#define SET_ALARM_BANDS_COMMAND "setAlarmBands"
+#define CAPTURE_WAVEFORM_COMMAND "captureWaveform"
+#define UPDATE_FAULT_MODEL_COMMAND "updateFaultModel"
+#define REQUEST_KEYFRAME_COMMAND "requestKeyframe"
+
+/**
+ * @brief Snapshot chunks sent per publish cycle, so a long capture leaves
+ * room for the alerts and the telemetry in between.
+ */
+#define SNAPSHOT_CHUNKS_PER_CYCLE 32
+
+/**
+ * @brief A fault model upload without a part for this long is dropped, and
+ * the classifier runs again from what the partition holds.
+ */
+#define FAULT_MODEL_UPLOAD_TIMEOUT_MS (60 * 1000U)
+
+/**
+ * @brief Application property of the anomaly alerts and alarm events, IoT Hub
+ * routes can send them apart from the periodic telemetry.
+ */
+#define ALERT_PRIORITY_PROPERTY "priority"
+#define ALERT_PRIORITY_HIGH "high"
+#define ALERT_PRIORITY_NORMAL "normal"
 
 char *g_certificate;
 char *g_key;
@@ -125,7 +168,62 @@ static uint8_t ucScratchBuffer[4098];
 /* Command buffers */
 static uint8_t ucCommandResponsePayloadBuffer[256];
 
+/* Alert buffers */
+static uint8_t ucAlertPropertyBuffer[32];
+
+/* Snapshot buffers, a chunk of samples and its base64 text */
+static int16_t sSnapshotChunk[SNAPSHOT_CHUNK_SAMPLES];
+static uint8_t ucSnapshotText[(sizeof(sSnapshotChunk) + 2) / 3 * 4 + 1];
+
+/* Decoded part of a fault model, a direct method payload fits democonfigNETWORK_BUFFER_SIZE */
+static uint8_t ucModelChunk[democonfigNETWORK_BUFFER_SIZE / 4 * 3];
+
+/* Fault model being uploaded, its size (0 for none), the offset of the next part and the time of the last one */
+static uint32_t ulModelUploadSize = 0;
+static uint32_t ulModelUploadNext;
+static int64_t llModelUploadAt;
+
+/* Snapshot being uploaded over several publish cycles, the next chunk and the time spent sending */
+static SnapshotFrame xUpload;
+static bool xUploading = false;
+static uint32_t ulUploadChunk;
+static int64_t llUploadStartedAt;
+static int64_t llUploadSendUs;
+
+#if PUBLISH_SPECTRUM_BINS && SPECTRUM_CODEC
+/* Arrays of the coded bins in the order of the frame, and their lengths */
+static const uint8_t ucSpectrumChannels[] = {
+    SPECTRUM_CHANNEL_FFT,
+#if ORDER_TRACKING
+    SPECTRUM_CHANNEL_ORDER,
+#endif
+#if ENVELOPE_ANALYSIS
+    SPECTRUM_CHANNEL_ENVELOPE,
+#endif
+};
+static const uint16_t usSpectrumChannelBins[] = {
+    SPECTRUM_BINS,
+#if ORDER_TRACKING
+    ORDER_BINS,
+#endif
+#if ENVELOPE_ANALYSIS
+    ENVELOPE_BINS,
+#endif
+};
+static SpectrumEncoder xSpectrumEncoder(sizeof(ucSpectrumChannels), ucSpectrumChannels, usSpectrumChannelBins,
+                                        SPECTRUM_CODEC_STEP_DB, SPECTRUM_CODEC_RANGE_DB, SPECTRUM_CODEC_DEADBAND,
+                                        SPECTRUM_KEYFRAME_INTERVAL);
+/* Coded bins of a spectrum and their base64 text */
+static uint8_t ucSpectrumCoded[SPECTRUM_CODEC_BOUND(3, SPECTRUM_BINS + ORDER_BINS + ENVELOPE_BINS)];
+static uint8_t ucSpectrumCodedText[(sizeof(ucSpectrumCoded) + 2) / 3 * 4 + 1];
+#endif
+
 /* Reported Properties buffers */
+#if OCTAVE_ANALYSIS
+/* Layout of the octave bands whose edges went out on this connection, 0 for none yet */
+static uint32_t ulOctaveLayoutSent = 0;
+#endif
+
 static uint8_t ucReportedPropertiesUpdate[380];
 static uint32_t ulReportedPropertiesUpdateLength;
 /*-----------------------------------------------------------*/
@@ -140,11 +238,221 @@ static uint8_t ucMQTTMessageBuffer[democonfigNETWORK_BUFFER_SIZE];
  *
  * @remark This function is required for the interface with samples to work properly.
  */
+static bool prvIsCommand(const AzureIoTHubClientCommandRequest_t *pxMessage, const char *pcName)
+{
+    return pxMessage->usCommandNameLength == strlen(pcName) &&
+           strncmp((const char *)pxMessage->pucCommandName, pcName, strlen(pcName)) == 0;
+}
+
+static const char *const pcQuantities[] = {"acceleration", "velocity", "displacement"};
+/* In ImuSensor::Axis order */
+static const char *const pcAxisNames[] = {"ax", "ay", "az", "gx", "gy", "gz"};
+
+/**
+ * @brief Alarm bands from the payload of the setAlarmBands command:
+ * {"hysteresis": 0.9, "persistence": 2, "bands": [{"lowHz", "highHz", "quantity", "warning", "alarm"}]},
+ * hysteresis and persistence are optional.
+ *
+ * @return 200 when the FFT task takes the bands, 400 when they are malformed or out of range.
+ */
+static uint32_t prvSetAlarmBands(const AzureIoTHubClientCommandRequest_t *pxMessage)
+{
+    JsonDocument doc;
+    AlarmConfig xConfig;
+
+    if (deserializeJson(doc, (const char *)pxMessage->pvMessagePayload, pxMessage->ulPayloadLength) !=
+            DeserializationError::Ok ||
+        !doc["bands"].is<JsonArrayConst>())
+    {
+        return 400;
+    }
+    JsonArrayConst xBands = doc["bands"];
+    if (xBands.size() > ALARM_BANDS_MAX)
+    {
+        return 400;
+    }
+
+    memset(&xConfig, 0, sizeof(xConfig));
+    xConfig.count = xBands.size();
+    xConfig.hysteresis = doc["hysteresis"] | ALARM_HYSTERESIS;
+    xConfig.persistence = doc["persistence"] | ALARM_PERSISTENCE;
+    for (int i = 0; i < xConfig.count; i++)
+    {
+        JsonObjectConst xBand = xBands[i];
+        AlarmBand &xAlarmBand = xConfig.bands[i];
+        const char *pcQuantity = xBand["quantity"] | pcQuantities[SEVERITY_ACCELERATION];
+        xAlarmBand.quantity = 0xFF;
+        for (uint8_t q = 0; q < sizeof(pcQuantities) / sizeof(pcQuantities[0]); q++)
+        {
+            xAlarmBand.quantity = strcmp(pcQuantity, pcQuantities[q]) == 0 ? q : xAlarmBand.quantity;
+        }
+        xAlarmBand.lowHz = xBand["lowHz"] | -1.0f;
+        xAlarmBand.highHz = xBand["highHz"] | -1.0f;
+        xAlarmBand.warning = xBand["warning"] | -1.0f;
+        xAlarmBand.alarm = xBand["alarm"] | -1.0f;
+    }
+    return request_alarm_config(xConfig) ? 200 : 400;
+}
+
+/**
+ * @brief Start a recording from the payload of the captureWaveform command:
+ * {"durationMs": 1000, "axes": ["az"], "rateHz": sample rate}, every field optional.
+ * The response carries the rate and the samples per axis it records.
+ *
+ * @return 200 once the read task records, 400 for axes, a rate or a length
+ * out of range, 409 while the last capture is recorded or uploaded, 503
+ * without the memory for it.
+ */
+static uint32_t prvCaptureWaveform(const AzureIoTHubClientCommandRequest_t *pxMessage, uint32_t *pulResponseLength)
+{
+    JsonDocument doc;
+    uint8_t ucAxes = 0;
+
+    if (pxMessage->ulPayloadLength > 0 &&
+        deserializeJson(doc, (const char *)pxMessage->pvMessagePayload, pxMessage->ulPayloadLength) !=
+            DeserializationError::Ok)
+    {
+        return 400;
+    }
+    if (doc["axes"].is<JsonArrayConst>())
+    {
+        for (JsonVariantConst xAxis : doc["axes"].as<JsonArrayConst>())
+        {
+            const char *pcAxis = xAxis | "";
+            uint8_t ucBit = 0;
+            for (int i = 0; i < ImuSensor::AXES; i++)
+            {
+                ucBit = strcmp(pcAxis, pcAxisNames[i]) == 0 ? 1 << i : ucBit;
+            }
+            if (ucBit == 0)
+            {
+                return 400;
+            }
+            ucAxes |= ucBit;
+        }
+    }
+    else
+    {
+        ucAxes = 1 << ImuSensor::ACCEL_Z;
+    }
+
+    float fRate = doc["rateHz"] | (float)SAMPLE_RATE_HZ;
+    uint32_t ulSamples = 0;
+    const esp_err_t xErr = request_waveform_capture(doc["durationMs"] | 1000U, ucAxes, &fRate, &ulSamples);
+    if (xErr != ESP_OK)
+    {
+        ESP_LOGW("Command", "No waveform capture (%s)", esp_err_to_name(xErr));
+        return xErr == ESP_ERR_INVALID_STATE ? 409 : xErr == ESP_ERR_NO_MEM ? 503 : 400;
+    }
+
+    JsonDocument response;
+    response["sampleRate"] = fRate;
+    response["samples"] = ulSamples;
+    *pulResponseLength = serializeJson(response, (char *)ucCommandResponsePayloadBuffer,
+                                       sizeof(ucCommandResponsePayloadBuffer));
+    return 200;
+}
+
+/**
+ * @brief End the fault model upload, the classifier runs again from what the
+ * partition holds: nothing once the upload erased it without completing.
+ */
+static uint32_t prvEndFaultModelUpload()
+{
+    ulModelUploadSize = 0;
+    return resume_fault_model();
+}
+
+/**
+ * @brief Drop a fault model upload that got no part for FAULT_MODEL_UPLOAD_TIMEOUT_MS.
+ */
+static void prvExpireFaultModelUpload()
+{
+    if (ulModelUploadSize != 0 && esp_timer_get_time() - llModelUploadAt > FAULT_MODEL_UPLOAD_TIMEOUT_MS * 1000LL)
+    {
+        ESP_LOGW("Command", "Fault model upload stopped at %u of %u bytes", (unsigned)ulModelUploadNext,
+                 (unsigned)ulModelUploadSize);
+        prvEndFaultModelUpload();
+    }
+}
+
+/**
+ * @brief Write a part of a fault model from the payload of the updateFaultModel
+ * command: {"offset": 0, "size": blob size, "data": base64 bytes}. The part at
+ * offset 0 starts an upload and erases the model partition, the next parts
+ * must follow it with the same size, and the part that ends at size loads the
+ * new model. The classifier stops from the first part to the end of the
+ * upload, or until FAULT_MODEL_UPLOAD_TIMEOUT_MS without a part.
+ *
+ * @return 200 with the bytes received, or the model id once loaded, 400 for a
+ * payload out of range, 409 for a part that does not follow the upload, 413
+ * for a model larger than the partition, 422 when the blob received is not a
+ * valid model, 500 when the flash fails.
+ */
+static uint32_t prvUpdateFaultModel(const AzureIoTHubClientCommandRequest_t *pxMessage, uint32_t *pulResponseLength)
+{
+    JsonDocument doc;
+    size_t xLength = 0;
+
+    if (deserializeJson(doc, (const char *)pxMessage->pvMessagePayload, pxMessage->ulPayloadLength) !=
+        DeserializationError::Ok)
+    {
+        return 400;
+    }
+    const uint32_t ulOffset = doc["offset"] | 0U;
+    const uint32_t ulSize = doc["size"] | 0U;
+    const char *pcData = doc["data"] | "";
+    if (mbedtls_base64_decode(ucModelChunk, sizeof(ucModelChunk), &xLength, (const unsigned char *)pcData,
+                              strlen(pcData)) != 0 ||
+        xLength == 0 || ulOffset + xLength > ulSize)
+    {
+        return 400;
+    }
+
+    /* A part at 0 starts over, any other must continue the upload: the partition is only erased at 0 */
+    if (ulOffset != 0 && (ulModelUploadSize == 0 || ulSize != ulModelUploadSize || ulOffset != ulModelUploadNext))
+    {
+        ESP_LOGW("Command", "Fault model part at %u does not follow the upload", (unsigned)ulOffset);
+        return 409;
+    }
+    /* The classifier reads the mapped partition, it stays off while it is written */
+    suspend_fault_model();
+    ulModelUploadSize = ulSize;
+    llModelUploadAt = esp_timer_get_time();
+    const esp_err_t xErr = write_fault_model(ulOffset, ucModelChunk, xLength);
+    if (xErr != ESP_OK)
+    {
+        ESP_LOGE("Command", "Failed to write the fault model at %u (%s)", (unsigned)ulOffset, esp_err_to_name(xErr));
+        prvEndFaultModelUpload();
+        return xErr == ESP_ERR_INVALID_SIZE ? 413 : 500;
+    }
+    ulModelUploadNext = ulOffset + xLength;
+
+    JsonDocument response;
+    if (ulModelUploadNext == ulSize)
+    {
+        const uint32_t ulModelId = prvEndFaultModelUpload();
+        if (ulModelId == 0)
+        {
+            return 422;
+        }
+        response["modelId"] = ulModelId;
+    }
+    else
+    {
+        response["received"] = ulOffset + xLength;
+    }
+    *pulResponseLength = serializeJson(response, (char *)ucCommandResponsePayloadBuffer,
+                                       sizeof(ucCommandResponsePayloadBuffer));
+    return 200;
+}
+
 static void prvHandleCommand(AzureIoTHubClientCommandRequest_t *pxMessage,
                              void *pvContext)
 {
     AzureIoTHubClient_t *pxHandle = (AzureIoTHubClient_t *)pvContext;
     uint32_t ulResponseStatus = 0;
+    uint32_t ulResponseLength = 0;
     AzureIoTResult_t xResult;
     ESP_LOGI("Command", "Comand name: %s", (const char *)pxMessage->pucCommandName);
     if (strncmp((const char *)pxMessage->pucCommandName, REBOOT_COMAND, strlen(REBOOT_COMAND)) == 0)
@@ -163,6 +471,56 @@ static void prvHandleCommand(AzureIoTHubClientCommandRequest_t *pxMessage,
         vTaskDelay(pdMS_TO_TICKS(1000));
         esp_restart();
     }
+
+    /* The FFT task applies the command before its next window */
+    BaselineCommand xBaselineCommand = BASELINE_COMMAND_NONE;
+    if (prvIsCommand(pxMessage, LEARN_BASELINE_COMMAND))
+    {
+        xBaselineCommand = BASELINE_COMMAND_LEARN;
+    }
+    else if (prvIsCommand(pxMessage, FREEZE_BASELINE_COMMAND))
+    {
+        xBaselineCommand = BASELINE_COMMAND_FREEZE;
+    }
+    else if (prvIsCommand(pxMessage, RESET_BASELINE_COMMAND))
+    {
+        xBaselineCommand = BASELINE_COMMAND_RESET;
+    }
+    else if (prvIsCommand(pxMessage, SET_ALARM_BANDS_COMMAND))
+    {
+        ulResponseStatus = prvSetAlarmBands(pxMessage);
+    }
+    else if (prvIsCommand(pxMessage, CAPTURE_WAVEFORM_COMMAND))
+    {
+        ulResponseStatus = prvCaptureWaveform(pxMessage, &ulResponseLength);
+    }
+    else if (prvIsCommand(pxMessage, UPDATE_FAULT_MODEL_COMMAND))
+    {
+        ulResponseStatus = prvUpdateFaultModel(pxMessage, &ulResponseLength);
+    }
+#if PUBLISH_SPECTRUM_BINS && SPECTRUM_CODEC
+    else if (prvIsCommand(pxMessage, REQUEST_KEYFRAME_COMMAND))
+    {
+        /* The telemetry is sent from this task, the next spectrum is the keyframe */
+        xSpectrumEncoder.requestKeyframe();
+        ulResponseStatus = 200;
+    }
+#endif
+    else
+    {
+        ulResponseStatus = 404;
+    }
+    if (xBaselineCommand != BASELINE_COMMAND_NONE)
+    {
+        request_baseline_command(xBaselineCommand);
+        ulResponseStatus = 200;
+    }
+    if ((xResult = AzureIoTHubClient_SendCommandResponse(pxHandle, pxMessage, ulResponseStatus,
+                                                         ucCommandResponsePayloadBuffer,
+                                                         ulResponseLength)) != eAzureIoTSuccess)
+    {
+        LogError(("Error sending command response: result 0x%08x", (uint16_t)xResult));
+    }
 }
 
 static void prvDispatchPropertiesUpdate(AzureIoTHubClientPropertiesResponse_t *pxMessage)
@@ -242,18 +600,396 @@ static uint32_t prvSetupNetworkCredentials(NetworkCredentials_t *pxNetworkCreden
 }
 /*-----------------------------------------------------------*/
 
+/* Frames captured before SNTP synchronized are corrected here */
+static void addTimestamp(JsonDocument &doc, int64_t capturedAt)
+{
+    char timestamp[32];
+    int64_t utc;
+
+    if (time_base_to_utc(capturedAt, &utc) && time_base_format_utc(utc, timestamp, sizeof(timestamp)) > 0)
+    {
+        doc["timestamp"] = timestamp;
+    }
+}
+
+#if PUBLISH_SPECTRUM_BINS && SPECTRUM_CODEC
+/**
+ * @brief Delta code the bins of a frame into ucSpectrumCodedText.
+ *
+ * @return false when the encoder got no memory or the coded bins no room,
+ * the next spectrum is then a keyframe.
+ */
+static bool prvEncodeBins(const SpectrumFrame &frame)
+{
+    const float *pfValues[] = {
+        frame.magnitude,
+#if ORDER_TRACKING
+        frame.order,
+#endif
+#if ENVELOPE_ANALYSIS
+        frame.envelope,
+#endif
+    };
+    size_t xLength = xSpectrumEncoder.encode(pfValues, ucSpectrumCoded, sizeof(ucSpectrumCoded));
+    size_t xTextLength = 0;
+
+    if (xLength == 0 || mbedtls_base64_encode(ucSpectrumCodedText, sizeof(ucSpectrumCodedText), &xTextLength,
+                                              ucSpectrumCoded, xLength) != 0)
+    {
+        ESP_LOGE("Telemetry", "Failed to code the spectrum bins, sending them as arrays");
+        xSpectrumEncoder.requestKeyframe();
+        return false;
+    }
+    return true;
+}
+#endif
+
+static void serializeSpectrum(const SpectrumFrame &frame, JsonDocument &doc)
+{
+    addTimestamp(doc, frame.capturedAt);
+    doc["sampleRate"] = frame.sampleRate;
+    doc["binWidth"] = frame.binWidth;
+    doc["rangeG"] = frame.rangeG;
+    doc["clipped"] = frame.clipped;
+    doc["velocityRms"] = frame.velocityRms;
+    doc["displacementRms"] = frame.displacementRms;
+    /* Not const, so the document keeps a copy */
+    char zone[] = {iso_zone_letter((IsoZone)frame.isoZone), '\0'};
+    doc["isoZone"] = zone;
+    static const char *const baselineModes[] = {"learning", "frozen"};
+    doc["baselineMode"] = baselineModes[frame.baselineMode];
+    doc["baselineWindows"] = frame.baselineWindows;
+    if (frame.anomalyScore >= 0)
+    {
+        doc["anomalyScore"] = frame.anomalyScore;
+    }
+    for (int i = 0; i < frame.alarmBands; i++)
+    {
+        doc["bandRms"][i] = frame.bandRms[i];
+        doc["bandLevel"][i] = frame.bandLevel[i];
+    }
+#if FAULT_CLASSIFIER
+    if (frame.faultModelId != 0)
+    {
+        doc["faultModelId"] = frame.faultModelId;
+        doc["inferenceUs"] = frame.inferenceUs;
+        for (int i = 0; i < frame.faultClasses; i++)
+        {
+            doc["faultProbability"][(const char *)frame.faultLabels[i]] = frame.faultProbability[i];
+        }
+    }
+#endif
+    /* [Hz, amplitude, family, harmonic] per peak, a few dozen bytes against the bins */
+    for (int i = 0; i < frame.peakCount; i++)
+    {
+        const SpectralPeak &peak = frame.peaks[i];
+        JsonArray entry = doc["peaks"].add<JsonArray>();
+        entry.add(peak.hz);
+        entry.add(peak.amplitude);
+        entry.add(peak.family);
+        entry.add(peak.harmonic);
+    }
+#if OCTAVE_ANALYSIS
+    /* The edges ride on the first spectrum of a connection and after a layout change, then only the id */
+    doc["octaveLayoutId"] = frame.octaveLayoutId;
+    if (frame.octaveLayoutId != ulOctaveLayoutSent)
+    {
+        const OctaveBands &xBands = octave_bands();
+        doc["bandsPerOctave"] = xBands.perOctave();
+        doc["octaveQuantity"] = pcQuantities[SPECTRUM_QUANTITY];
+        for (int i = 0; i <= frame.octaveBandCount; i++)
+        {
+            doc["octaveEdgeHz"][i] = xBands.edges()[i];
+        }
+        ulOctaveLayoutSent = frame.octaveLayoutId;
+    }
+    for (int i = 0; i < frame.octaveBandCount; i++)
+    {
+        doc["octave"][i] = frame.octave[i];
+    }
+#endif
+#if CEPSTRUM_ANALYSIS
+    /* [quefrency ms, Hz, amplitude, rahmonics] per cepstral peak, the spacing of a sideband family */
+    for (int i = 0; i < frame.cepstrumPeakCount; i++)
+    {
+        const CepstralPeak &peak = frame.cepstrumPeaks[i];
+        JsonArray entry = doc["cepstrum"].add<JsonArray>();
+        entry.add(peak.quefrencyMs);
+        entry.add(peak.hz);
+        entry.add(peak.amplitude);
+        entry.add(peak.rahmonics);
+    }
+#endif
+#if ORDER_TRACKING
+    doc["shaftHz"] = frame.shaftHz;
+#endif
+#if PUBLISH_SPECTRUM_BINS
+    doc["FFTQuantity"] = pcQuantities[SPECTRUM_QUANTITY];
+#if ENVELOPE_ANALYSIS
+    doc["envelopeBinWidth"] = frame.envelopeBinWidth;
+#endif
+    bool xCoded = false;
+#if SPECTRUM_CODEC
+    /* A tenth of the arrays, the changes from the spectrum sent before */
+    xCoded = prvEncodeBins(frame);
+    if (xCoded)
+    {
+        doc["spectrumCoded"] = (const char *)ucSpectrumCodedText;
+    }
+#endif
+    for (int i = 0; i < SPECTRUM_BINS && !xCoded; i++)
+    {
+        doc["FFT"][i] = frame.magnitude[i];
+    }
+#if ORDER_TRACKING
+    for (int i = 0; i < ORDER_BINS && !xCoded; i++)
+    {
+        doc["order"][i] = frame.order[i];
+    }
+#endif
+#if ENVELOPE_ANALYSIS
+    for (int i = 0; i < ENVELOPE_BINS && !xCoded; i++)
+    {
+        doc["envelope"][i] = frame.envelope[i];
+    }
+#endif
+#endif
+#if ENABLE_GYRO
+    for (int i = 0; i < 3; i++)
+    {
+        doc["gyroPeakHz"][i] = frame.gyroPeakHz[i];
+        doc["gyroPeakDps"][i] = frame.gyroPeakDps[i];
+    }
+#endif
+}
+
+/* One array per feature, with an entry per axis in ImuSensor::Axis order */
+static void serializeFeatures(const FeatureFrame &frame, JsonDocument &doc)
+{
+    addTimestamp(doc, frame.capturedAt);
+    doc["samples"] = frame.samples;
+    doc["rangeG"] = frame.rangeG;
+    doc["clipped"] = frame.clipped;
+    for (int i = 0; i < FEATURE_AXES; i++)
+    {
+        const AxisFeatures &axis = frame.axes[i];
+        doc["rms"][i] = axis.rms;
+        doc["peak"][i] = axis.peak;
+        doc["peakToPeak"][i] = axis.peakToPeak;
+        doc["crestFactor"][i] = axis.crestFactor;
+        doc["kurtosis"][i] = axis.kurtosis;
+        doc["skewness"][i] = axis.skewness;
+    }
+}
+
+/* The score with the edges and z-score of every band, the cloud sees which bands moved */
+static void serializeAnomaly(const AnomalyFrame &frame, JsonDocument &doc)
+{
+    addTimestamp(doc, frame.capturedAt);
+    doc["anomalyScore"] = frame.score;
+    doc["anomalyThreshold"] = ANOMALY_THRESHOLD;
+    for (int i = 0; i <= BASELINE_BANDS; i++)
+    {
+        doc["bandEdgeHz"][i] = frame.bandEdgeHz[i];
+    }
+    for (int i = 0; i < BASELINE_BANDS; i++)
+    {
+        doc["bandZ"][i] = frame.bandZ[i];
+    }
+}
+
+/* The band and its thresholds travel with the level, the event stands on its own */
+static void serializeAlarm(const AlarmFrame &frame, JsonDocument &doc)
+{
+    static const char *const levels[] = {"ok", "warning", "alarm"};
+
+    addTimestamp(doc, frame.capturedAt);
+    doc["alarmBand"] = frame.band;
+    doc["alarmLevel"] = levels[frame.level];
+    doc["previousLevel"] = levels[frame.previous];
+    doc["alarmRms"] = frame.rms;
+    doc["lowHz"] = frame.config.lowHz;
+    doc["highHz"] = frame.config.highHz;
+    doc["quantity"] = pcQuantities[frame.config.quantity];
+    doc["warning"] = frame.config.warning;
+    doc["alarm"] = frame.config.alarm;
+}
+
+/**
+ * @brief Send the document in ucScratchBuffer with its priority as application property.
+ */
+static void prvSendAlert(JsonDocument &doc, const char *pcPriority)
+{
+    AzureIoTMessageProperties_t xProperties;
+    AzureIoTResult_t xResult;
+    uint32_t ulLength = serializeJson(doc, (char *)ucScratchBuffer, sizeof(ucScratchBuffer));
+
+    xResult = AzureIoTMessage_PropertiesInit(&xProperties, ucAlertPropertyBuffer, 0, sizeof(ucAlertPropertyBuffer));
+    configASSERT(xResult == eAzureIoTSuccess);
+    xResult = AzureIoTMessage_PropertiesAppend(&xProperties,
+                                               (const uint8_t *)ALERT_PRIORITY_PROPERTY,
+                                               sizeof(ALERT_PRIORITY_PROPERTY) - 1,
+                                               (const uint8_t *)pcPriority, strlen(pcPriority));
+    configASSERT(xResult == eAzureIoTSuccess);
+
+    ESP_LOGW("Telemetry", "Alert %s, length: %d", ucScratchBuffer, (int)ulLength);
+    xResult = AzureIoTHubClient_SendTelemetry(&xAzureIoTHubClient, ucScratchBuffer, ulLength,
+                                              &xProperties, eAzureIoTHubMessageQoS1, NULL);
+    configASSERT(xResult == eAzureIoTSuccess);
+}
+
+/**
+ * @brief Upload the next chunks of xUpload, up to SNAPSHOT_CHUNKS_PER_CYCLE, in
+ * messages of SNAPSHOT_CHUNK_SAMPLES little endian int16 counts (the axes
+ * interleaved), base64 encoded. Every chunk carries the whole header, so the
+ * cloud can put the waveform together from snapshotId, chunk and offset
+ * whatever order they arrive in. A last message without data reports the
+ * upload throughput and, for a capture, its cost to the read task.
+ */
+static void prvSendSnapshot(void)
+{
+    static const char *const pcSources[] = {"alarm", "command"};
+    const uint32_t ulAxes = __builtin_popcount(xUpload.axes);
+    const uint32_t ulChunkSamples = SNAPSHOT_CHUNK_SAMPLES - SNAPSHOT_CHUNK_SAMPLES % ulAxes;
+    const uint32_t ulChunks = (xUpload.count * ulAxes + ulChunkSamples - 1) / ulChunkSamples;
+    AzureIoTResult_t xResult;
+
+    for (int i = 0; i < SNAPSHOT_CHUNKS_PER_CYCLE && ulUploadChunk < ulChunks; i++, ulUploadChunk++)
+    {
+        const int64_t llSendAt = esp_timer_get_time();
+        const uint32_t ulOffset = ulUploadChunk * ulChunkSamples;
+        const uint32_t ulSamples = read_snapshot(xUpload, ulOffset, sSnapshotChunk, ulChunkSamples);
+        size_t xTextLength = 0;
+        if (mbedtls_base64_encode(ucSnapshotText, sizeof(ucSnapshotText), &xTextLength,
+                                  (const unsigned char *)sSnapshotChunk, ulSamples * sizeof(int16_t)) != 0)
+        {
+            ESP_LOGE("Telemetry", "Failed to encode chunk %u of snapshot %u", (unsigned)ulUploadChunk,
+                     (unsigned)xUpload.id);
+            ulUploadChunk = ulChunks;
+            break;
+        }
+
+        JsonDocument doc;
+        addTimestamp(doc, xUpload.capturedAt);
+        doc["snapshotId"] = xUpload.id;
+        doc["source"] = pcSources[xUpload.source];
+        for (int axis = 0; axis < ImuSensor::AXES; axis++)
+        {
+            if (xUpload.axes & (1 << axis))
+            {
+                doc["axes"].add(pcAxisNames[axis]);
+            }
+        }
+        doc["chunk"] = ulUploadChunk;
+        doc["chunks"] = ulChunks;
+        doc["offset"] = ulOffset / ulAxes;
+        doc["samples"] = xUpload.count;
+        doc["preTrigger"] = xUpload.preTrigger;
+        doc["sampleRate"] = xUpload.sampleRate;
+        doc["countScale"] = xUpload.scale;
+        if (xUpload.axes >> ImuSensor::GYRO_X)
+        {
+            doc["gyroScale"] = xUpload.gyroScale;
+        }
+        doc["data"] = (const char *)ucSnapshotText;
+        uint32_t ulLength = serializeJson(doc, (char *)ucScratchBuffer, sizeof(ucScratchBuffer));
+
+        ESP_LOGI("Telemetry", "Snapshot %u chunk %u of %u, length: %d", (unsigned)xUpload.id,
+                 (unsigned)ulUploadChunk + 1, (unsigned)ulChunks, (int)ulLength);
+        xResult = AzureIoTHubClient_SendTelemetry(&xAzureIoTHubClient, ucScratchBuffer, ulLength,
+                                                  NULL, eAzureIoTHubMessageQoS1, NULL);
+        configASSERT(xResult == eAzureIoTSuccess);
+        llUploadSendUs += esp_timer_get_time() - llSendAt;
+    }
+    if (ulUploadChunk < ulChunks)
+    {
+        return;
+    }
+
+    /* Samples over all axes per second: from the first chunk to the last, and while sending */
+    const double dSamples = (double)xUpload.count * ulAxes;
+    const double dUploadS = (esp_timer_get_time() - llUploadStartedAt) / 1e6;
+    JsonDocument doc;
+    doc["snapshotId"] = xUpload.id;
+    doc["uploadMs"] = (uint32_t)(dUploadS * 1e3);
+    doc["uploadSamplesPerS"] = dUploadS > 0 ? dSamples / dUploadS : 0;
+    doc["sendSamplesPerS"] = llUploadSendUs > 0 ? dSamples * 1e6 / llUploadSendUs : 0;
+    if (xUpload.source == SNAPSHOT_COMMAND)
+    {
+        doc["recordUs"] = xUpload.recordUs;
+        doc["recordLoad"] = xUpload.recordUs / (xUpload.count / xUpload.sampleRate * 1e6);
+    }
+    uint32_t ulLength = serializeJson(doc, (char *)ucScratchBuffer, sizeof(ucScratchBuffer));
+    ESP_LOGI("Telemetry", "Snapshot %u uploaded %s", (unsigned)xUpload.id, ucScratchBuffer);
+    xResult = AzureIoTHubClient_SendTelemetry(&xAzureIoTHubClient, ucScratchBuffer, ulLength,
+                                              NULL, eAzureIoTHubMessageQoS1, NULL);
+    configASSERT(xResult == eAzureIoTSuccess);
+    release_snapshot(xUpload);
+    xUploading = false;
+}
+
+/**
+ * @brief Send every buffered anomaly alert and alarm event right away, tagged
+ * with their priority, then go on with the snapshot upload.
+ */
+static void prvSendAlerts(void)
+{
+    static AnomalyFrame alert;
+    static AlarmFrame alarm;
+
+    while (xQueueReceive(anomalyQueue, &alert, 0) == pdTRUE)
+    {
+        JsonDocument doc;
+        serializeAnomaly(alert, doc);
+        prvSendAlert(doc, ALERT_PRIORITY_HIGH);
+    }
+    while (xQueueReceive(alarmQueue, &alarm, 0) == pdTRUE)
+    {
+        JsonDocument doc;
+        serializeAlarm(alarm, doc);
+        prvSendAlert(doc, alarm.level == ALARM_LEVEL_ALARM ? ALERT_PRIORITY_HIGH : ALERT_PRIORITY_NORMAL);
+    }
+    if (!xUploading && xQueueReceive(snapshotQueue, &xUpload, 0) == pdTRUE)
+    {
+        xUploading = true;
+        ulUploadChunk = 0;
+        llUploadStartedAt = esp_timer_get_time();
+        llUploadSendUs = 0;
+    }
+    if (xUploading)
+    {
+        prvSendSnapshot();
+    }
+}
+
+/**
+ * @brief Serialize the oldest buffered spectrum frame, or when there is none
+ * the oldest time domain feature frame.
+ *
+ * @return ESP_OK when a frame was serialized, ESP_ERR_NOT_FOUND when there is nothing to send.
+ */
 uint32_t generateTelemetryPayload(
     uint8_t *pucTelemetryData,
     uint32_t ulTelemetryDataSize,
     uint32_t *ulTelemetryDataLength)
 {
-    xSemaphoreTake(canRead, portMAX_DELAY);
+    static SpectrumFrame spectrum;
+    static FeatureFrame features;
     JsonDocument doc;
-    for (int i = 0; i < 128; i++)
+
+    *ulTelemetryDataLength = 0;
+    if (xQueueReceive(spectrumQueue, &spectrum, 0) == pdTRUE)
+    {
+        serializeSpectrum(spectrum, doc);
+    }
+    else if (xQueueReceive(featureQueue, &features, 0) == pdTRUE)
+    {
+        serializeFeatures(features, doc);
+    }
+    else
     {
-        doc["FFT"][i] = reads[i];
+        return ESP_ERR_NOT_FOUND;
     }
-    xSemaphoreGive(canRead);
     *ulTelemetryDataLength = serializeJson(doc, (char *)pucTelemetryData, ulTelemetryDataSize);
     return ESP_OK;
 }
@@ -279,7 +1015,21 @@ uint32_t createReportedPropertiesUpdate(uint8_t *pucPropertiesData,
                                                     sizeof("samplingFrequency") - 1);
     configASSERT(xResult == eAzureIoTSuccess);
 
-    xResult = AzureIoTJSONWriter_AppendDouble(&xWriter, 1000, DOUBLE_DECIMAL_PLACE_DIGITS);
+    xResult = AzureIoTJSONWriter_AppendDouble(&xWriter, SAMPLE_RATE_HZ, DOUBLE_DECIMAL_PLACE_DIGITS);
+    configASSERT(xResult == eAzureIoTSuccess);
+
+    xResult = AzureIoTJSONWriter_AppendPropertyName(&xWriter, (const uint8_t *)"bootToFirstSampleMs",
+                                                    sizeof("bootToFirstSampleMs") - 1);
+    configASSERT(xResult == eAzureIoTSuccess);
+
+    xResult = AzureIoTJSONWriter_AppendInt32(&xWriter, get_boot_milestone_ms(BOOT_MILESTONE_FIRST_SAMPLE));
+    configASSERT(xResult == eAzureIoTSuccess);
+
+    xResult = AzureIoTJSONWriter_AppendPropertyName(&xWriter, (const uint8_t *)"bootToFirstPublishMs",
+                                                    sizeof("bootToFirstPublishMs") - 1);
+    configASSERT(xResult == eAzureIoTSuccess);
+
+    xResult = AzureIoTJSONWriter_AppendInt32(&xWriter, get_boot_milestone_ms(BOOT_MILESTONE_FIRST_PUBLISH));
     configASSERT(xResult == eAzureIoTSuccess);
 
     xResult = AzureIoTJSONWriter_AppendEndObject(&xWriter);
@@ -296,7 +1046,7 @@ static uint32_t prvConnectToServerWithBackoffRetries(const char *pcHostName,
                                                      NetworkCredentials_t *pxNetworkCredentials,
                                                      NetworkContext_t *pxNetworkContext)
 {
-    TlsTransportStatus_t xNetworkStatus;
+    TlsTransportStatus_t xNetworkStatus = eTLSTransportConnectFailure;
     BackoffAlgorithmStatus_t xBackoffAlgStatus = BackoffAlgorithmSuccess;
     BackoffAlgorithmContext_t xReconnectParams;
     uint16_t usNextRetryBackOff = 0U;
@@ -309,6 +1059,12 @@ static uint32_t prvConnectToServerWithBackoffRetries(const char *pcHostName,
 
     do
     {
+        if (!xAzureSample_IsConnectedToInternet())
+        {
+            LogWarn(("Internet connection lost, stop retrying connection to the IoT Hub."));
+            break;
+        }
+
         LogInfo(("Creating a TLS connection to %s:%u.\r\n", pcHostName, (uint16_t)port));
         xNetworkStatus = TLS_Socket_Connect(pxNetworkContext,
                                             pcHostName, port,
@@ -364,6 +1120,10 @@ static void prvAzureDemoTask(void *pvParameters)
 
     (void)pvParameters;
 
+    /* TLS needs the network and a valid wall clock to check the hub certificate */
+    xEventGroupWaitBits(g_system_events, SYSTEM_EVENT_WIFI_CONNECTED | SYSTEM_EVENT_TIME_SYNCED,
+                        pdFALSE, pdTRUE, portMAX_DELAY);
+
     /* Initialize Azure IoT Middleware.  */
     configASSERT(AzureIoT_Init() == eAzureIoTSuccess);
 
@@ -377,11 +1137,23 @@ static void prvAzureDemoTask(void *pvParameters)
         // 1. Internet connection
         if (xAzureSample_IsConnectedToInternet())
         {
-            // 2. Stablish TLS connection
+            // 2. Spread the fleet before the first attempt
+            uint32_t ulDitherMs = BackoffDither_GetStartupDelay(device_name,
+                                                                sampleazureiotCONNECT_DITHER_WINDOW_MS,
+                                                                configRAND32());
+            LogInfo(("Waiting %u ms before connecting to the IoT Hub.\r\n", (unsigned)ulDitherMs));
+            vTaskDelay(pdMS_TO_TICKS(ulDitherMs));
+
+            // 3. Stablish TLS connection
             ulStatus = prvConnectToServerWithBackoffRetries((const char *)pucIotHubHostname,
                                                             democonfigIOTHUB_PORT,
                                                             &xNetworkCredentials, &xNetworkContext);
-            configASSERT(ulStatus == eAzureIoTSuccess);
+            if (ulStatus != 0)
+            {
+                LogInfo(("Short delay before starting the next iteration.... \r\n\r\n"));
+                vTaskDelay(sampleazureiotDELAY_BETWEEN_DEMO_ITERATIONS_TICKS);
+                continue;
+            }
 
             /* Fill in Transport Interface send and receive function pointers. */
             xTransport.pxNetworkContext = &xNetworkContext;
@@ -412,6 +1184,15 @@ static void prvAzureDemoTask(void *pvParameters)
                                                 sampleazureiotCONNACK_RECV_TIMEOUT_MS);
             configASSERT(xResult == eAzureIoTSuccess);
 
+#if OCTAVE_ANALYSIS
+            /* A new session may reach another consumer, it gets the band edges again */
+            ulOctaveLayoutSent = 0;
+#endif
+#if PUBLISH_SPECTRUM_BINS && SPECTRUM_CODEC
+            /* And a keyframe, messages may have been lost with the last one */
+            xSpectrumEncoder.requestKeyframe();
+#endif
+
             xResult = AzureIoTHubClient_SubscribeCommand(&xAzureIoTHubClient, prvHandleCommand,
                                                          &xAzureIoTHubClient, sampleazureiotSUBSCRIBE_TIMEOUT);
             configASSERT(xResult == eAzureIoTSuccess);
@@ -427,19 +1208,22 @@ static void prvAzureDemoTask(void *pvParameters)
             /* Publish messages with QoS1, send and process Keep alive messages. */
             for (; xAzureSample_IsConnectedToInternet();)
             {
-                /* Hook for sending Telemetry */
-                if ((generateTelemetryPayload(ucScratchBuffer, sizeof(ucScratchBuffer), &ulScratchBufferLength) == ESP_OK) &&
-                    (ulScratchBufferLength > 0))
+                prvSendAlerts();
+
+                /* Hook for sending Telemetry, sends every frame buffered since the last cycle */
+                while (generateTelemetryPayload(ucScratchBuffer, sizeof(ucScratchBuffer), &ulScratchBufferLength) == ESP_OK)
                 {
+                    if (ulScratchBufferLength == 0)
+                    {
+                        ESP_LOGE("Telemetry", "Failed to generate telemetry data, length is zero.");
+                        continue;
+                    }
                     ESP_LOGI("Telemetry", "%s, length: %d", ucScratchBuffer, (int)ulScratchBufferLength);
                     xResult = AzureIoTHubClient_SendTelemetry(&xAzureIoTHubClient,
                                                               ucScratchBuffer, ulScratchBufferLength,
                                                               NULL, eAzureIoTHubMessageQoS1, NULL);
                     configASSERT(xResult == eAzureIoTSuccess);
-                }
-                else
-                {
-                    ESP_LOGE("Telemetry", "Failed to generate telemetry data or length is zero. %d", (int)ulScratchBufferLength);
+                    mark_boot_milestone(BOOT_MILESTONE_FIRST_PUBLISH);
                 }
 
                 /* Hook for sending update to reported properties */
@@ -457,6 +1241,9 @@ static void prvAzureDemoTask(void *pvParameters)
                     xResult = AzureIoTHubClient_ProcessLoop(&xAzureIoTHubClient,
                                                             sampleazureiotPROCESS_LOOP_TIMEOUT_MS);
                     configASSERT(xResult == eAzureIoTSuccess);
+                    /* Alerts do not wait for the next publish cycle */
+                    prvSendAlerts();
+                    prvExpireFaultModelUpload();
                     vTaskDelay(sampleazureiotDELAY_BETWEEN_PUBLISHES_TICKS);
                 }
             }
@@ -8,23 +8,32 @@
 
 // Project-specific setup headers
 #include "file_setup.h"
+#include "system_events.h"
 #include "ble_setup.h"
 #include "wifi_setup.h"
 #include "QMI8658_setup.h"
 #include "iot_setup.h"
+#include "dsp_benchmark.h"
 
 extern "C" void app_main(void)
 {
     ESP_ERROR_CHECK(init_memory());
-    ESP_ERROR_CHECK(init_ble());
+    ESP_ERROR_CHECK(init_system_events());
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    /*Allow other core to finish initialization */
-    vTaskDelay(pdMS_TO_TICKS(100));
 
     initArduino();
     Serial.begin(115200);
-    setupQMI8658();
+
+#if RUN_DSP_BENCHMARK
+    /* Alone on the CPU, nothing else is started yet */
+    ESP_ERROR_CHECK(run_dsp_benchmark());
+#endif
+
+    /* Everything below only depends on memory and the event loop, start it all
+     * concurrently. See system_events.h for the dependency graph. */
+    ESP_ERROR_CHECK(start_init_task("BLE", init_ble, SYSTEM_EVENT_BLE_READY, 1));
+    ESP_ERROR_CHECK(start_init_task("QMI8658", setupQMI8658, SYSTEM_EVENT_SENSOR_READY, 1));
     ESP_ERROR_CHECK(init_wifi());
     ESP_ERROR_CHECK(init_iot());
-}
\ No newline at end of file
+}
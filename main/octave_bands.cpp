@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <math.h>
+#include <new>
+#include <string.h>
+
+#include "octave_bands.h"
+
+/* Bin 1 holds the leakage of the removed mean, the bands start above it */
+#define OCTAVE_FIRST_HZ_BINS 1.5f
+/* Edges within this fraction of the range still count as inside, the IEC
+ * edges are rounded by the float maths */
+#define OCTAVE_EDGE_TOLERANCE 1e-4
+
+/* Lower edge of base 10 band x of b per octave, IEC 61260-1: mid-band
+ * frequencies at 1 kHz times 10^(0.3 x / b) for an odd b, and halfway between
+ * those for an even b */
+static double iecEdge(int x, uint8_t b)
+{
+    const double exponent = b % 2 == 1 ? (2.0 * x - 1) / (2.0 * b) : (double)x / b;
+    return 1000.0 * pow(10.0, 0.3 * exponent);
+}
+
+static float overlap(float low, float high, float bandLow, float bandHigh)
+{
+    return std::max(0.0f, std::min(high, bandHigh) - std::max(low, bandLow));
+}
+
+OctaveBands::OctaveBands(uint16_t bins)
+    : bins(bins), table(new (std::nothrow) OctaveBinShare[bins]), tableBinWidth(0), fraction(0), bands(0), id(0)
+{
+    memset(edgeHz, 0, sizeof(edgeHz));
+}
+
+OctaveBands::~OctaveBands()
+{
+    delete[] table;
+}
+
+bool OctaveBands::configure(uint8_t perOctave, float lowHz, float highHz, uint8_t custom, float binWidth)
+{
+    const float top = (bins - 1) * binWidth;
+
+    bands = 0;
+    id = 0;
+    fraction = perOctave;
+    lowHz = std::max(lowHz, OCTAVE_FIRST_HZ_BINS * binWidth);
+    highHz = highHz > 0 ? std::min(highHz, top) : top;
+    if (table == NULL || !(lowHz < highHz))
+    {
+        return false;
+    }
+
+    if (perOctave == 1 || perOctave == 3 || perOctave == 6)
+    {
+        /* First band starting at lowHz, then the first as wide as a bin */
+        double position = perOctave * log10(lowHz / 1000.0) / 0.3 + (perOctave % 2 == 1 ? 0.5 : 0.0);
+        int x = (int)ceil(position - OCTAVE_EDGE_TOLERANCE);
+        while (iecEdge(x + 1, perOctave) - iecEdge(x, perOctave) < binWidth)
+        {
+            x++;
+        }
+        while (bands < OCTAVE_BANDS_MAX && iecEdge(x + 1, perOctave) <= highHz * (1 + OCTAVE_EDGE_TOLERANCE))
+        {
+            edgeHz[bands++] = (float)iecEdge(x++, perOctave);
+        }
+        edgeHz[bands] = (float)iecEdge(x, perOctave);
+    }
+    else if (perOctave == 0 && custom > 0)
+    {
+        custom = std::min<uint8_t>(custom, OCTAVE_BANDS_MAX);
+        /* Raise the low end until the lowest band is as wide as a bin, the ratio grows as it does */
+        double ratio = pow(highHz / lowHz, 1.0 / custom);
+        while (lowHz * (ratio - 1) < binWidth * (1 - OCTAVE_EDGE_TOLERANCE))
+        {
+            lowHz = binWidth / (ratio - 1);
+            if (lowHz >= highHz)
+            {
+                return false;
+            }
+            ratio = pow(highHz / lowHz, 1.0 / custom);
+        }
+        for (int i = 0; i <= custom; i++)
+        {
+            edgeHz[i] = (float)(lowHz * pow(ratio, i));
+        }
+        bands = custom;
+    }
+    if (bands == 0)
+    {
+        return false;
+    }
+
+    /* FNV-1a of the layout, 0 is left for no bands */
+    id = 2166136261u;
+    const uint8_t *bytes = (const uint8_t *)edgeHz;
+    for (size_t i = 0; i < (bands + 1) * sizeof(float); i++)
+    {
+        id = (id ^ bytes[i]) * 16777619u;
+    }
+    id = (id ^ fraction) * 16777619u;
+    id = id != 0 ? id : 1;
+
+    buildTable(binWidth);
+    return true;
+}
+
+void OctaveBands::buildTable(float binWidth)
+{
+    uint8_t band = 0;
+
+    tableBinWidth = binWidth;
+    for (uint16_t k = 0; k < bins; k++)
+    {
+        /* A bin spans half a bin width on both sides of its frequency */
+        const float low = (k - 0.5f) * binWidth;
+        const float high = (k + 0.5f) * binWidth;
+        OctaveBinShare &share = table[k];
+
+        while (band < bands && edgeHz[band + 1] <= low)
+        {
+            band++;
+        }
+        if (k == 0 || band == bands || high <= edgeHz[0])
+        {
+            share = {OCTAVE_NO_BAND, 0, 0};
+            continue;
+        }
+        const float lower = overlap(low, high, edgeHz[band], edgeHz[band + 1]) / binWidth;
+        const float upper = band + 1 < bands ? overlap(low, high, edgeHz[band + 1], edgeHz[band + 2]) / binWidth : 0;
+        share = {band, (uint8_t)lroundf(lower * OCTAVE_SHARE_ONE), (uint8_t)lroundf(upper * OCTAVE_SHARE_ONE)};
+    }
+}
+
+template <typename T>
+void OctaveBands::aggregate(const T *magnitude, float binWidth, float magnitudeScale, SeverityQuantity quantity,
+                            float *rms)
+{
+    double power[OCTAVE_BANDS_MAX + 1] = {};
+
+    if (binWidth != tableBinWidth)
+    {
+        buildTable(binWidth);
+    }
+    for (uint16_t k = 1; k < bins; k++)
+    {
+        const OctaveBinShare &share = table[k];
+        if (share.band == OCTAVE_NO_BAND)
+        {
+            continue;
+        }
+        const float value = magnitude[k] * magnitudeScale * severity_gain(quantity, k * binWidth);
+        const double squared = (double)value * value / OCTAVE_SHARE_ONE;
+        power[share.band] += squared * share.lower;
+        power[share.band + 1] += squared * share.upper;
+    }
+    for (uint8_t band = 0; band < bands; band++)
+    {
+        rms[band] = spectrum_rms(power[band], 2 * bins);
+    }
+}
+
+template void OctaveBands::aggregate<float>(const float *, float, float, SeverityQuantity, float *);
+template void OctaveBands::aggregate<int16_t>(const int16_t *, float, float, SeverityQuantity, float *);
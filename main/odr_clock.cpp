@@ -0,0 +1,101 @@
+#include "odr_clock.h"
+
+/* Runs shorter than this don't update the long term rate, the interrupt jitter dominates */
+#define ODR_CLOCK_MIN_BLOCKS 3
+/* Time constant of the long term estimate */
+#define ODR_CLOCK_TIME_CONSTANT_US (600 * 1000000.0)
+/* Rates off by more than this are missed interrupts or overflows, not drift */
+#define ODR_CLOCK_MAX_ERROR 0.1
+
+OdrClock::OdrClock(float nominalHz)
+    : nominal(nominalHz), longTermRate(nominalHz), longTermWeightUs(0), blocksInRun(0)
+{
+    restart();
+}
+
+void OdrClock::restart()
+{
+    fold();
+    firstTimestampUs = 0;
+    samplesInRun = 0;
+    blocksInRun = 0;
+    sumX = sumY = sumXX = sumXY = 0;
+}
+
+void OdrClock::addBlock(int64_t timestampUs, uint16_t samples)
+{
+    if (blocksInRun == 0)
+    {
+        firstTimestampUs = timestampUs;
+    }
+    else
+    {
+        samplesInRun += samples;
+    }
+
+    double x = samplesInRun;
+    double y = (double)(timestampUs - firstTimestampUs);
+    sumX += x;
+    sumY += y;
+    sumXX += x * x;
+    sumXY += x * y;
+    blocksInRun++;
+}
+
+bool OdrClock::runRate(double *rate) const
+{
+    if (blocksInRun < ODR_CLOCK_MIN_BLOCKS)
+    {
+        return false;
+    }
+    double n = blocksInRun;
+    double denominator = n * sumXX - sumX * sumX;
+    if (denominator <= 0)
+    {
+        return false;
+    }
+    /* Slope in microseconds per sample */
+    double slope = (n * sumXY - sumX * sumY) / denominator;
+    if (slope <= 0)
+    {
+        return false;
+    }
+    *rate = 1e6 / slope;
+    double error = (*rate - nominal) / nominal;
+    return error > -ODR_CLOCK_MAX_ERROR && error < ODR_CLOCK_MAX_ERROR;
+}
+
+void OdrClock::fold()
+{
+    double rate;
+    if (!runRate(&rate))
+    {
+        return;
+    }
+    double durationUs = samplesInRun * 1e6 / rate;
+    double weight = durationUs / (longTermWeightUs + durationUs);
+    longTermRate += weight * (rate - longTermRate);
+    longTermWeightUs += durationUs;
+    if (longTermWeightUs > ODR_CLOCK_TIME_CONSTANT_US)
+    {
+        longTermWeightUs = ODR_CLOCK_TIME_CONSTANT_US;
+    }
+}
+
+float OdrClock::rateHz() const
+{
+    double rate;
+    if (runRate(&rate))
+    {
+        /* Blend with the long term estimate until the run is as long as its history */
+        double durationUs = samplesInRun * 1e6 / rate;
+        double weight = durationUs / (longTermWeightUs + durationUs);
+        return (float)(longTermRate + weight * (rate - longTermRate));
+    }
+    return (float)longTermRate;
+}
+
+int64_t OdrClock::sampleTime(int64_t blockTimestampUs, uint16_t sampleIndex, uint16_t samples) const
+{
+    return blockTimestampUs - (int64_t)((samples - 1 - sampleIndex) * 1e6f / rateHz());
+}
@@ -0,0 +1,62 @@
+#include <math.h>
+
+#include "order_tracker.h"
+
+/* Corner of the anti aliasing low pass relative to the slower of the two rates */
+#define ORDER_ANTI_ALIAS_CORNER 0.4f
+/* Relative change of the corner that recomputes the filter coefficients */
+#define ORDER_CORNER_TOLERANCE 0.01f
+/* Input samples filtered at once before they go to the resampler */
+#define ORDER_CHUNK 64
+
+OrderTracker::OrderTracker(uint8_t samplesPerRevolution)
+    : samplesPerRevolution(samplesPerRevolution)
+{
+    reset();
+}
+
+void OrderTracker::reset()
+{
+    resampler.reset();
+    for (Biquad &section : antiAlias)
+    {
+        section.reset();
+    }
+    filterCorner = 0;
+}
+
+size_t OrderTracker::process(const float *input, size_t count, float inputHz, float shaftHz, float *output,
+                             size_t capacity)
+{
+    const float angularHz = samplesPerRevolution * shaftHz;
+    const float corner = ORDER_ANTI_ALIAS_CORNER * fminf(angularHz, inputHz) / inputHz;
+    size_t written = 0;
+
+    /* Follow the speed, keeping the filter state so the stream stays continuous */
+    if (fabsf(corner - filterCorner) > ORDER_CORNER_TOLERANCE * filterCorner)
+    {
+        for (Biquad &section : antiAlias)
+        {
+            section.lowPass(1.0f, corner);
+        }
+        filterCorner = corner;
+    }
+    resampler.setRates(inputHz, angularHz);
+
+    float filtered[ORDER_CHUNK];
+    for (size_t i = 0; i < count; i += ORDER_CHUNK)
+    {
+        const size_t chunk = count - i < ORDER_CHUNK ? count - i : ORDER_CHUNK;
+        for (size_t j = 0; j < chunk; j++)
+        {
+            float x = input[i + j];
+            for (Biquad &section : antiAlias)
+            {
+                x = section.process(x);
+            }
+            filtered[j] = x;
+        }
+        written += resampler.process(filtered, chunk, output + written, capacity - written);
+    }
+    return written;
+}
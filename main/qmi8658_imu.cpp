@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <inttypes.h>
+
+#include "Arduino.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+#include "imu_bus.h"
+#include "qmi8658_imu.h"
+#include "simulated_imu.h"
+#include "QMI8658_setup.h"
+#include "device_configuration.h"
+
+#define TAG "QMI8658"
+
+/* Registers, see the QMI8658 datasheet */
+#define QMI_REG_WHO_AM_I 0x00
+#define QMI_REG_CTRL1 0x02
+#define QMI_REG_CTRL2 0x03
+#define QMI_REG_CTRL3 0x04
+#define QMI_REG_CTRL5 0x06
+#define QMI_REG_CTRL7 0x08
+#define QMI_REG_CTRL9 0x0A
+#define QMI_REG_FIFO_WTM_TH 0x13
+#define QMI_REG_FIFO_CTRL 0x14
+#define QMI_REG_FIFO_SMPL_CNT 0x15
+#define QMI_REG_FIFO_DATA 0x17
+#define QMI_REG_STATUSINT 0x2D
+#define QMI_REG_RESET 0x60
+
+#define QMI_WHO_AM_I 0x05
+#define QMI_RESET_VALUE 0xB0
+#define QMI_RESET_TIME_MS 20
+
+/* CTRL1: register address auto increment, INT2 and INT1 outputs. FIFO_INT_SEL
+ * left at 0 routes the FIFO interrupt to INT2 */
+#define QMI_CTRL1_ADDR_AI 0x40
+#define QMI_CTRL1_INT2_EN 0x10
+#define QMI_CTRL1_INT1_EN 0x08
+/* CTRL2: aFS in bits 6:4, aODR in bits 3:0 */
+#define QMI_CTRL2_AFS_SHIFT 4
+/* CTRL3: gFS in bits 6:4, gODR in bits 3:0 */
+#define QMI_CTRL3_GFS_SHIFT 4
+/* CTRL5: accelerometer low pass filter mode in bits 2:1, enable in bit 0,
+ * the gyroscope filter likewise in bits 6:4 */
+#define QMI_CTRL5_ALPF_MASK 0x07
+#define QMI_CTRL5_GLPF_MASK 0x70
+#if SENSOR_ACCEL_LPF_MODE < 0
+#define QMI_CTRL5_ALPF 0x00
+#else
+#define QMI_CTRL5_ALPF ((SENSOR_ACCEL_LPF_MODE << 1) | 0x01)
+#endif
+#define QMI_CTRL5_GLPF (QMI_CTRL5_ALPF << 4)
+/* CTRL7: accelerometer and gyroscope enable */
+#define QMI_CTRL7_AEN 0x01
+#define QMI_CTRL7_GEN 0x02
+/* FIFO_CTRL: FIFO read mode set by CTRL_CMD_REQ_FIFO, 128 samples, FIFO mode */
+#define QMI_FIFO_CTRL_RD_MODE 0x80
+#define QMI_FIFO_CTRL_SIZE_128 0x0C
+#define QMI_FIFO_CTRL_MODE_FIFO 0x01
+/* STATUSINT: the CTRL9 command was executed */
+#define QMI_STATUSINT_CMD_DONE 0x80
+
+#define QMI_CTRL_CMD_ACK 0x00
+#define QMI_CTRL_CMD_RST_FIFO 0x04
+#define QMI_CTRL_CMD_REQ_FIFO 0x05
+
+#define QMI_COMMAND_TIMEOUT_MS 10
+/* Longest transfer is a full 6 axis FIFO, 14 ms at 1 MHz and 35 ms at 400 kHz */
+#define I2C_TRANSFER_TIMEOUT_MS 50
+/* Transfers are waited for one at a time */
+#define I2C_TRANSFER_QUEUE_DEPTH 1
+
+/* aODR codes 0 to 6, the same gODR codes run both sensors at imu_6axis_odr_hz() */
+static const uint16_t accelOdrHz[] = {8000, 4000, 2000, 1000, 500, 250, 125};
+
+#if SENSOR_BUS_SPI
+/* SPI: bit 7 of the address byte selects a read */
+#define QMI_SPI_READ 0x80
+/* SPI2 drives the LCD */
+#define QMI_SPI_HOST SPI3_HOST
+
+Qmi8658Imu::Qmi8658Imu()
+    : device(NULL),
+      odrCode(0),
+      gyroEnabled(false)
+{
+}
+
+bool Qmi8658Imu::setupBus()
+{
+    spi_bus_config_t busConfig = {};
+    busConfig.mosi_io_num = DEV_SPI_MOSI_PIN;
+    busConfig.miso_io_num = DEV_SPI_MISO_PIN;
+    busConfig.sclk_io_num = DEV_SPI_SCK_PIN;
+    busConfig.quadwp_io_num = -1;
+    busConfig.quadhd_io_num = -1;
+    busConfig.max_transfer_sz = sizeof(fifoBuffer) + 1;
+
+    /* The address phase carries the register and the read bit */
+    spi_device_interface_config_t deviceConfig = {};
+    deviceConfig.address_bits = 8;
+    deviceConfig.mode = 3;
+    deviceConfig.clock_speed_hz = SENSOR_SPI_FREQ;
+    deviceConfig.spics_io_num = DEV_SPI_CS_PIN;
+    deviceConfig.queue_size = 1;
+
+    return spi_bus_initialize(QMI_SPI_HOST, &busConfig, SPI_DMA_CH_AUTO) == ESP_OK &&
+           spi_bus_add_device(QMI_SPI_HOST, &deviceConfig, &device) == ESP_OK;
+}
+
+/* spi_device_transmit() sleeps until the transfer done interrupt */
+esp_err_t Qmi8658Imu::readRegisters(uint8_t reg, uint8_t *buffer, size_t length)
+{
+    spi_transaction_t transaction = {};
+    transaction.addr = reg | QMI_SPI_READ;
+    transaction.length = 8 * length;
+    transaction.rxlength = 8 * length;
+    transaction.rx_buffer = buffer;
+    return spi_device_transmit(device, &transaction);
+}
+
+esp_err_t Qmi8658Imu::writeRegister(uint8_t reg, uint8_t value)
+{
+    spi_transaction_t transaction = {};
+    transaction.flags = SPI_TRANS_USE_TXDATA;
+    transaction.addr = reg;
+    transaction.length = 8;
+    transaction.tx_data[0] = value;
+    return spi_device_transmit(device, &transaction);
+}
+
+float Qmi8658Imu::drainTimeUs(uint16_t samples) const
+{
+    return imu_drain_time_us(IMU_BUS_SPI, SENSOR_SPI_FREQ, samples, sampleBytes());
+}
+#else
+Qmi8658Imu::Qmi8658Imu()
+    : bus(NULL),
+      device(NULL),
+      transferDone(NULL),
+      transferEvent(I2C_EVENT_ALIVE),
+      odrCode(0),
+      gyroEnabled(false)
+{
+}
+
+bool Qmi8658Imu::setupBus()
+{
+    i2c_master_bus_config_t busConfig = {};
+    busConfig.i2c_port = I2C_NUM_0;
+    busConfig.sda_io_num = (gpio_num_t)DEV_SDA_PIN;
+    busConfig.scl_io_num = (gpio_num_t)DEV_SCL_PIN;
+    busConfig.clk_source = I2C_CLK_SRC_DEFAULT;
+    busConfig.glitch_ignore_cnt = 7;
+    /* A transfer queue makes the driver asynchronous */
+    busConfig.trans_queue_depth = I2C_TRANSFER_QUEUE_DEPTH;
+    busConfig.flags.enable_internal_pullup = true;
+
+    i2c_device_config_t deviceConfig = {};
+    deviceConfig.dev_addr_length = I2C_ADDR_BIT_LEN_7;
+    deviceConfig.device_address = SENSOR_I2C_ADDR;
+    deviceConfig.scl_speed_hz = SENSOR_I2C_FREQ;
+
+    i2c_master_event_callbacks_t callbacks = {};
+    callbacks.on_trans_done = onTransferDone;
+
+    transferDone = xSemaphoreCreateBinary();
+    return transferDone != NULL &&
+           i2c_new_master_bus(&busConfig, &bus) == ESP_OK &&
+           i2c_master_bus_add_device(bus, &deviceConfig, &device) == ESP_OK &&
+           i2c_master_register_event_callbacks(device, &callbacks, this) == ESP_OK;
+}
+
+bool Qmi8658Imu::onTransferDone(i2c_master_dev_handle_t dev, const i2c_master_event_data_t *event, void *arg)
+{
+    Qmi8658Imu *imu = static_cast<Qmi8658Imu *>(arg);
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    imu->transferEvent = event->event;
+    xSemaphoreGiveFromISR(imu->transferDone, &xHigherPriorityTaskWoken);
+    return xHigherPriorityTaskWoken == pdTRUE;
+}
+
+/* Queue a transfer and sleep until its interrupt, @p write and @p read must
+ * stay valid until then: a transfer that times out is waited for once more,
+ * and the bus reset if it still did not end, so it cannot complete into the
+ * buffers of a caller that returned */
+esp_err_t Qmi8658Imu::transfer(const uint8_t *write, size_t writeLength, uint8_t *read, size_t readLength)
+{
+    esp_err_t err;
+
+    /* A completion left over from an earlier transfer is not this one's */
+    xSemaphoreTake(transferDone, 0);
+    if (read != NULL)
+    {
+        err = i2c_master_transmit_receive(device, write, writeLength, read, readLength, I2C_TRANSFER_TIMEOUT_MS);
+    }
+    else
+    {
+        err = i2c_master_transmit(device, write, writeLength, I2C_TRANSFER_TIMEOUT_MS);
+    }
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    if (xSemaphoreTake(transferDone, pdMS_TO_TICKS(I2C_TRANSFER_TIMEOUT_MS)) != pdTRUE)
+    {
+        if (i2c_master_bus_wait_all_done(bus, I2C_TRANSFER_TIMEOUT_MS) != ESP_OK)
+        {
+            ESP_LOGE(TAG, "I2C transfer stuck, resetting the bus");
+            i2c_master_bus_reset(bus);
+        }
+        xSemaphoreTake(transferDone, 0);
+        return ESP_ERR_TIMEOUT;
+    }
+    return transferEvent == I2C_EVENT_DONE ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t Qmi8658Imu::readRegisters(uint8_t reg, uint8_t *buffer, size_t length)
+{
+    return transfer(&reg, 1, buffer, length);
+}
+
+esp_err_t Qmi8658Imu::writeRegister(uint8_t reg, uint8_t value)
+{
+    const uint8_t data[] = {reg, value};
+    return transfer(data, sizeof(data), NULL, 0);
+}
+
+float Qmi8658Imu::drainTimeUs(uint16_t samples) const
+{
+    return imu_drain_time_us(IMU_BUS_I2C, SENSOR_I2C_FREQ, samples, sampleBytes());
+}
+#endif
+
+bool Qmi8658Imu::begin()
+{
+    if (!setupBus())
+    {
+        ESP_LOGE(TAG, "Failed to set up the %s bus", SENSOR_BUS_SPI ? "SPI" : "I2C");
+        return false;
+    }
+
+    uint8_t id = 0;
+    if (readRegisters(QMI_REG_WHO_AM_I, &id, 1) != ESP_OK || id != QMI_WHO_AM_I)
+    {
+        ESP_LOGE(TAG, "No QMI8658 on the bus (id 0x%02x)", id);
+        return false;
+    }
+    writeRegister(QMI_REG_RESET, QMI_RESET_VALUE);
+    vTaskDelay(pdMS_TO_TICKS(QMI_RESET_TIME_MS));
+
+    ESP_LOGI(TAG, "%s at %d Hz", SENSOR_BUS_SPI ? "SPI" : "I2C", SENSOR_BUS_SPI ? SENSOR_SPI_FREQ : SENSOR_I2C_FREQ);
+    /* SIM left at 0 selects 4 wire SPI */
+    return writeRegister(QMI_REG_CTRL1, QMI_CTRL1_ADDR_AI) == ESP_OK;
+}
+
+bool Qmi8658Imu::configAccelerometer(AccelRange range, uint16_t odrHz)
+{
+    for (uint8_t code = 0; code < sizeof(accelOdrHz) / sizeof(accelOdrHz[0]); code++)
+    {
+        if (accelOdrHz[code] == odrHz)
+        {
+            odrCode = code;
+            return writeRegister(QMI_REG_CTRL2, (range << QMI_CTRL2_AFS_SHIFT) | code) == ESP_OK &&
+                   updateRegister(QMI_REG_CTRL5, QMI_CTRL5_ALPF_MASK, QMI_CTRL5_ALPF) == ESP_OK;
+        }
+    }
+    return false;
+}
+
+bool Qmi8658Imu::configGyroscope(GyroRange range)
+{
+    if (writeRegister(QMI_REG_CTRL3, (range << QMI_CTRL3_GFS_SHIFT) | odrCode) != ESP_OK ||
+        updateRegister(QMI_REG_CTRL5, QMI_CTRL5_GLPF_MASK, QMI_CTRL5_GLPF) != ESP_OK)
+    {
+        return false;
+    }
+    gyroEnabled = true;
+    return true;
+}
+
+bool Qmi8658Imu::configFifo(uint16_t watermark)
+{
+    if (watermark == 0 || watermark > QMI8658_FIFO_SAMPLES)
+    {
+        return false;
+    }
+    return command(QMI_CTRL_CMD_RST_FIFO) == ESP_OK &&
+           writeRegister(QMI_REG_FIFO_WTM_TH, (uint8_t)watermark) == ESP_OK &&
+           writeRegister(QMI_REG_FIFO_CTRL, QMI_FIFO_CTRL_SIZE_128 | QMI_FIFO_CTRL_MODE_FIFO) == ESP_OK;
+}
+
+void Qmi8658Imu::setWatermarkCallback(WatermarkCallback callback)
+{
+    attachInterrupt(DEV_INT2_PIN, callback, RISING);
+}
+
+bool Qmi8658Imu::enable()
+{
+    const uint8_t sensors = QMI_CTRL7_AEN | (gyroEnabled ? QMI_CTRL7_GEN : 0);
+
+    if (updateRegister(QMI_REG_CTRL7, QMI_CTRL7_AEN | QMI_CTRL7_GEN, sensors) != ESP_OK ||
+        updateRegister(QMI_REG_CTRL1, QMI_CTRL1_INT1_EN | QMI_CTRL1_INT2_EN, QMI_CTRL1_INT2_EN) != ESP_OK)
+    {
+        return false;
+    }
+    pinMode(DEV_INT2_PIN, INPUT);
+    return true;
+}
+
+esp_err_t Qmi8658Imu::updateRegister(uint8_t reg, uint8_t mask, uint8_t value)
+{
+    uint8_t current;
+    esp_err_t err = readRegisters(reg, &current, 1);
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+    return writeRegister(reg, (current & ~mask) | (value & mask));
+}
+
+/* CTRL9 handshake: write the command, wait for CmdDone, acknowledge it */
+esp_err_t Qmi8658Imu::command(uint8_t cmd)
+{
+    const uint8_t steps[] = {cmd, QMI_CTRL_CMD_ACK};
+    /* CmdDone is set once the command is executed and cleared by the acknowledge */
+    const uint8_t waitFor[] = {QMI_STATUSINT_CMD_DONE, 0};
+
+    for (int i = 0; i < 2; i++)
+    {
+        esp_err_t err = writeRegister(QMI_REG_CTRL9, steps[i]);
+        int64_t start = esp_timer_get_time();
+        uint8_t status = 0;
+
+        while (err == ESP_OK)
+        {
+            err = readRegisters(QMI_REG_STATUSINT, &status, 1);
+            if ((status & QMI_STATUSINT_CMD_DONE) == waitFor[i])
+            {
+                break;
+            }
+            if (esp_timer_get_time() - start > QMI_COMMAND_TIMEOUT_MS * 1000)
+            {
+                err = ESP_ERR_TIMEOUT;
+            }
+        }
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+uint16_t Qmi8658Imu::readFifo(int16_t *const *axes, uint16_t count)
+{
+    const int64_t start = esp_timer_get_time();
+    const uint8_t bytes = sampleBytes();
+    const int axisCount = bytes / 2;
+    uint8_t fill[2];
+    uint8_t fifoCtrl;
+
+    if (command(QMI_CTRL_CMD_REQ_FIFO) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "FIFO read request failed");
+        return 0;
+    }
+
+    /* FIFO_SMPL_CNT and FIFO_STATUS hold the fill level in 2 byte words */
+    uint16_t available = 0;
+    if (readRegisters(QMI_REG_FIFO_SMPL_CNT, fill, sizeof(fill)) == ESP_OK)
+    {
+        available = 2 * (((fill[1] & 0x03) << 8) | fill[0]) / bytes;
+    }
+    count = std::min(count, std::min(available, (uint16_t)QMI8658_FIFO_SAMPLES));
+
+    /* One burst sized to the block, the task sleeps while it is on the bus */
+    const int64_t burstStart = esp_timer_get_time();
+    if (count > 0 && readRegisters(QMI_REG_FIFO_DATA, fifoBuffer, count * bytes) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "FIFO burst read failed");
+        count = 0;
+    }
+    const int64_t burstUs = esp_timer_get_time() - burstStart;
+
+    for (int axis = 0; axes != NULL && axis < axisCount; axis++)
+    {
+        int16_t *out = axes[axis];
+        if (out == NULL)
+        {
+            continue;
+        }
+        const uint8_t *word = &fifoBuffer[2 * axis];
+        for (uint16_t i = 0; i < count; i++, word += bytes)
+        {
+            out[i] = (int16_t)(word[0] | (word[1] << 8));
+        }
+    }
+
+    /* Leave the read mode so the sensor writes to the FIFO again */
+    if (readRegisters(QMI_REG_FIFO_CTRL, &fifoCtrl, 1) == ESP_OK)
+    {
+        writeRegister(QMI_REG_FIFO_CTRL, fifoCtrl & ~QMI_FIFO_CTRL_RD_MODE);
+    }
+
+    ESP_LOGD(TAG, "Drained %u samples: burst %" PRId64 " us, whole read %" PRId64 " us",
+             count, burstUs, esp_timer_get_time() - start);
+    return count;
+}
+
+ImuSensor *create_imu_sensor()
+{
+#if USE_SIMULATED_IMU
+    static SimulatedImu imu(simulated_imu_default_config());
+#else
+    static Qmi8658Imu imu;
+#endif
+    return &imu;
+}
@@ -0,0 +1,106 @@
+#include <math.h>
+#include <string.h>
+
+#include "resampler.h"
+
+/* Kernel cutoff relative to the Nyquist frequency of the slower rate */
+#define RESAMPLER_CUTOFF 0.9
+
+float Resampler::kernel[RESAMPLER_PHASES + 1][RESAMPLER_TAPS];
+bool Resampler::kernelReady = false;
+
+Resampler::Resampler()
+    : step(1.0)
+{
+    if (!kernelReady)
+    {
+        for (int phase = 0; phase <= RESAMPLER_PHASES; phase++)
+        {
+            double fraction = (double)phase / RESAMPLER_PHASES;
+            double sum = 0;
+            for (int tap = 0; tap < RESAMPLER_TAPS; tap++)
+            {
+                /* Distance from the interpolated point to this tap, in samples */
+                double distance = tap - RESAMPLER_DELAY - fraction;
+                double x = M_PI * RESAMPLER_CUTOFF * distance;
+                double sinc = (distance == 0) ? 1.0 : sin(x) / x;
+                /* Blackman window spanning the taps */
+                double w = 2 * M_PI * (distance + RESAMPLER_TAPS / 2.0) / RESAMPLER_TAPS;
+                double window = 0.42 - 0.5 * cos(w) + 0.08 * cos(2 * w);
+                kernel[phase][tap] = (float)(sinc * window);
+                sum += kernel[phase][tap];
+            }
+            /* Unity gain at DC for every phase */
+            for (int tap = 0; tap < RESAMPLER_TAPS; tap++)
+            {
+                kernel[phase][tap] /= sum;
+            }
+        }
+        kernelReady = true;
+    }
+    reset();
+}
+
+void Resampler::reset()
+{
+    position = RESAMPLER_DELAY;
+    consumed = 0;
+    memset(history, 0, sizeof(history));
+}
+
+void Resampler::setRates(float inputHz, float outputHz)
+{
+    step = (double)inputHz / outputHz;
+}
+
+float Resampler::sample(const float *input, uint64_t index) const
+{
+    if (index >= consumed)
+    {
+        return input[index - consumed];
+    }
+    return history[index % RESAMPLER_TAPS];
+}
+
+size_t Resampler::process(const float *input, size_t count, float *output, size_t capacity)
+{
+    size_t written = 0;
+    uint64_t available = consumed + count;
+
+    while (written < capacity)
+    {
+        uint64_t base = (uint64_t)position;
+        /* Rightmost tap must be available */
+        if (base + RESAMPLER_TAPS - RESAMPLER_DELAY > available)
+        {
+            break;
+        }
+        double fraction = (position - base) * RESAMPLER_PHASES;
+        int phase = (int)fraction;
+        float weight = (float)(fraction - phase);
+        const float *low = kernel[phase];
+        const float *high = kernel[phase + 1];
+        uint64_t first = base - RESAMPLER_DELAY;
+        float y = 0;
+        for (int tap = 0; tap < RESAMPLER_TAPS; tap++)
+        {
+            float h = low[tap] + weight * (high[tap] - low[tap]);
+            y += h * sample(input, first + tap);
+        }
+        output[written++] = y;
+        position += step;
+    }
+
+    /* Keep the last samples as history for the next block */
+    for (size_t i = (count > RESAMPLER_TAPS) ? count - RESAMPLER_TAPS : 0; i < count; i++)
+    {
+        history[(consumed + i) % RESAMPLER_TAPS] = input[i];
+    }
+    consumed = available;
+    if (written == capacity)
+    {
+        /* Output full, drop what is left of the input */
+        position = available + RESAMPLER_DELAY;
+    }
+    return written;
+}
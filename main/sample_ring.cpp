@@ -0,0 +1,53 @@
+#include <algorithm>
+
+#include "sample_ring.h"
+
+SampleRing::SampleRing(int16_t *buffer, uint32_t capacity)
+    : buffer(buffer), capacity(capacity), written(0), start(0), frozen(false), broken(false)
+{
+}
+
+void SampleRing::restart()
+{
+    /* A frozen stretch stays readable until the release */
+    if (frozen)
+    {
+        broken = true;
+        return;
+    }
+    start = written;
+}
+
+void SampleRing::push(const int16_t *samples, uint32_t count)
+{
+    if (frozen)
+    {
+        broken = true;
+        return;
+    }
+    if (broken)
+    {
+        broken = false;
+        restart();
+    }
+    for (uint32_t i = 0; i < count; i++)
+    {
+        buffer[(written + i) % capacity] = samples[i];
+    }
+    written += count;
+    start = std::max(start, written > capacity ? written - capacity : 0);
+}
+
+uint32_t SampleRing::copy(uint64_t from, int16_t *output, uint32_t count) const
+{
+    if (from < start || from >= written)
+    {
+        return 0;
+    }
+    count = (uint32_t)std::min<uint64_t>(count, written - from);
+    for (uint32_t i = 0; i < count; i++)
+    {
+        output[i] = buffer[(from + i) % capacity];
+    }
+    return count;
+}
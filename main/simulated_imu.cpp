@@ -0,0 +1,335 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+#include "simulated_imu.h"
+
+#define TAG "SIMULATED_IMU"
+
+#define GENERATE_TASK_STACK_SIZE 4096
+/* Above the acquisition tasks, it stands in for the sensor and its interrupt */
+#define GENERATE_TASK_PRIORITY 5
+/* Bytes of a sample in the QMI8658 FIFO, accelerometer only and with the gyroscope */
+#define FIFO_SAMPLE_BYTES 6
+#define FIFO_6AXIS_SAMPLE_BYTES 12
+/* Impacts older than this many decay times are below the 16 bit resolution */
+#define IMPULSE_TAIL_DECAYS 12.0
+/* Standard deviation of the bump of the damaged tooth in the gear mesh, in shaft turns */
+#define GEAR_TOOTH_WIDTH_TURNS 0.03
+
+SimulatedImuConfig simulated_imu_default_config()
+{
+    SimulatedImuConfig config;
+
+    memset(&config, 0, sizeof(config));
+    /* 1x and 2x of a four pole motor at 1475 rpm */
+    config.tones[0] = {24.58f, 0.2f, 0.0f};
+    config.tones[1] = {49.17f, 0.05f, 1.0f};
+    config.toneCount = 2;
+    config.noiseRmsG = 0.005f;
+    /* Rocking on the mounts at the shaft frequency */
+    config.gyroTones[0] = {24.58f, 0.5f, 0.0f};
+    config.gyroToneCount = 1;
+    config.gyroNoiseRmsDps = 0.05f;
+    config.odrErrorPpm = -2000.0f;
+    config.noiseSeed = 1;
+    config.realTime = true;
+    return config;
+}
+
+SimulatedImu::SimulatedImu(const SimulatedImuConfig &config)
+    : config(config),
+      rangeG(2.0f),
+      rangeDps(0.0f),
+      odrHz(1000),
+      watermark(SIMULATED_IMU_FIFO_SIZE),
+      callback(NULL),
+      generateHandle(NULL),
+      noiseState(config.noiseSeed != 0 ? config.noiseSeed : 1),
+      fifoHead(0),
+      fifoCount(0),
+      interruptRaised(false),
+      generated(0),
+      dropped(0)
+{
+    portMUX_INITIALIZE(&fifoLock);
+}
+
+bool SimulatedImu::begin()
+{
+    ESP_LOGI(TAG, "%d tones, noise %.4f g, impulses %.1f Hz, ODR error %.0f ppm, %s",
+             config.toneCount, config.noiseRmsG, config.impulseRateHz, config.odrErrorPpm,
+             config.realTime ? "real time" : "free running");
+    return config.toneCount <= SIMULATED_IMU_MAX_TONES && config.gyroToneCount <= SIMULATED_IMU_MAX_TONES;
+}
+
+bool SimulatedImu::configAccelerometer(AccelRange range, uint16_t odrHz)
+{
+    if (odrHz == 0 || odrHz > 8000)
+    {
+        return false;
+    }
+    rangeG = imu_range_g(range);
+    this->odrHz = odrHz;
+    return true;
+}
+
+bool SimulatedImu::configGyroscope(GyroRange range)
+{
+    rangeDps = imu_range_dps(range);
+    return true;
+}
+
+bool SimulatedImu::configFifo(uint16_t watermark)
+{
+    if (watermark == 0 || watermark > SIMULATED_IMU_FIFO_SIZE)
+    {
+        return false;
+    }
+    this->watermark = watermark;
+    return true;
+}
+
+void SimulatedImu::setWatermarkCallback(WatermarkCallback callback)
+{
+    this->callback = callback;
+}
+
+bool SimulatedImu::enable()
+{
+    if (generateHandle != NULL)
+    {
+        return true;
+    }
+    return xTaskCreatePinnedToCore(vTaskGenerate, "SimImuTask", GENERATE_TASK_STACK_SIZE, this,
+                                   GENERATE_TASK_PRIORITY, &generateHandle, 0) == pdPASS;
+}
+
+uint16_t SimulatedImu::readFifo(int16_t *const *axes, uint16_t count)
+{
+    uint16_t read = 0;
+
+    portENTER_CRITICAL(&fifoLock);
+    count = std::min(count, fifoCount);
+    portEXIT_CRITICAL(&fifoLock);
+
+    /* The samples leave the FIFO only once they went over the bus, new ones
+     * keep coming meanwhile */
+    const uint32_t drainUs = (uint32_t)drainTimeUs(count);
+    vTaskDelay(drainUs / (portTICK_PERIOD_MS * 1000));
+    esp_rom_delay_us(drainUs % (portTICK_PERIOD_MS * 1000));
+
+    portENTER_CRITICAL(&fifoLock);
+    while (read < count)
+    {
+        const int16_t *counts = fifo[fifoHead];
+        for (int axis = 0; axes != NULL && axis < AXES; axis++)
+        {
+            if (axes[axis] != NULL)
+            {
+                axes[axis][read] = counts[axis];
+            }
+        }
+        read++;
+        fifoHead = (fifoHead + 1) % SIMULATED_IMU_FIFO_SIZE;
+        fifoCount--;
+    }
+    interruptRaised = false;
+    portEXIT_CRITICAL(&fifoLock);
+    return read;
+}
+
+float SimulatedImu::drainTimeUs(uint16_t samples) const
+{
+    return imu_drain_time_us(config.bus, config.busClockHz, samples,
+                             rangeDps > 0 ? FIFO_6AXIS_SAMPLE_BYTES : FIFO_SAMPLE_BYTES);
+}
+
+/* Nominal rate of the sensor clock, the 6 axis rates with the gyroscope on */
+double SimulatedImu::sampleRateHz() const
+{
+    return rangeDps > 0 ? imu_6axis_odr_hz(odrHz) : odrHz;
+}
+
+void SimulatedImu::vTaskGenerate(void *pvParameters)
+{
+    static_cast<SimulatedImu *>(pvParameters)->run();
+}
+
+void SimulatedImu::run()
+{
+    const double samplePeriodUs = 1e6 / (sampleRateHz() * (1.0 + config.odrErrorPpm * 1e-6));
+    const int64_t start = esp_timer_get_time();
+
+    while (true)
+    {
+        uint64_t due;
+
+        if (config.realTime)
+        {
+            due = (uint64_t)((esp_timer_get_time() - start) / samplePeriodUs);
+        }
+        else
+        {
+            portENTER_CRITICAL(&fifoLock);
+            due = generated + (fifoCount < watermark ? watermark : 0);
+            portEXIT_CRITICAL(&fifoLock);
+        }
+
+        while (generated < due)
+        {
+            int16_t counts[AXES];
+            bool raise = false;
+
+            sample(generated, counts);
+            portENTER_CRITICAL(&fifoLock);
+            if (fifoCount < SIMULATED_IMU_FIFO_SIZE)
+            {
+                memcpy(fifo[(fifoHead + fifoCount) % SIMULATED_IMU_FIFO_SIZE], counts, sizeof(counts));
+                fifoCount++;
+            }
+            else
+            {
+                dropped++;
+            }
+            /* A read clears the interrupt, it comes back on the next sample if
+             * the FIFO is still at the watermark */
+            if (!interruptRaised && fifoCount >= watermark)
+            {
+                interruptRaised = true;
+                raise = true;
+            }
+            portEXIT_CRITICAL(&fifoLock);
+            generated++;
+
+            if (raise && callback != NULL)
+            {
+                callback();
+            }
+        }
+        vTaskDelay(1);
+    }
+}
+
+void SimulatedImu::sample(uint64_t index, int16_t *counts)
+{
+    /* Time of the sample on the true clock, the sensor clock runs off by odrErrorPpm */
+    const double t = index / (sampleRateHz() * (1.0 + config.odrErrorPpm * 1e-6));
+    double z = 1.0;
+    double rocking = 0.0;
+    /* Shaft turns in units of the nominal speed, the integral of 1 + v sin(2 pi t / P) */
+    double turns = t;
+    if (config.speedVariation != 0 && config.speedPeriodS > 0)
+    {
+        turns += config.speedVariation * config.speedPeriodS / (2.0 * M_PI) *
+                 (1.0 - cos(2.0 * M_PI * fmod(t / config.speedPeriodS, 1.0)));
+    }
+
+    for (int i = 0; i < config.toneCount; i++)
+    {
+        const SimulatedTone &tone = config.tones[i];
+        double cycles = fmod(tone.frequencyHz * turns, 1.0);
+        z += tone.amplitude * sin(2.0 * M_PI * cycles + tone.phaseRad);
+    }
+
+    if (config.gearMeshHz > 0 && config.gearShaftHz > 0)
+    {
+        /* Shaft angle from the damaged tooth, -0.5 to 0.5 turns */
+        double angle = fmod(config.gearShaftHz * turns, 1.0);
+        angle -= angle > 0.5 ? 1.0 : 0.0;
+        const double bump = exp(-0.5 * angle * angle / (GEAR_TOOTH_WIDTH_TURNS * GEAR_TOOTH_WIDTH_TURNS));
+        z += config.gearAmplitudeG * (1.0 + config.gearModulationDepth * bump) *
+             sin(2.0 * M_PI * fmod(config.gearMeshHz * turns, 1.0));
+    }
+
+    if (config.impulseRateHz > 0 && config.impulseDecayS > 0)
+    {
+        const double first = ceil(config.impulseOnsetS * config.impulseRateHz);
+        /* Sum the ringing of every impact that has not died out yet */
+        for (double k = floor(t * config.impulseRateHz); k >= first; k--)
+        {
+            double age = t - k / config.impulseRateHz;
+            if (age > IMPULSE_TAIL_DECAYS * config.impulseDecayS)
+            {
+                break;
+            }
+            double amplitude = config.impulseAmplitudeG;
+            if (config.impulseModulationHz > 0)
+            {
+                double hit = k / config.impulseRateHz;
+                amplitude *= 1.0 + config.impulseModulationDepth *
+                                       cos(2.0 * M_PI * fmod(config.impulseModulationHz * hit, 1.0));
+            }
+            z += amplitude * exp(-age / config.impulseDecayS) *
+                 sin(2.0 * M_PI * fmod(config.impulseResonanceHz * age, 1.0));
+        }
+    }
+
+    if (config.baselineDriftG != 0 && config.baselineDriftPeriodS > 0)
+    {
+        z += config.baselineDriftG * sin(2.0 * M_PI * fmod(t / config.baselineDriftPeriodS, 1.0));
+    }
+
+    double x = 0.0;
+    if (config.lateralEndS <= 0 || t < config.lateralEndS)
+    {
+        const SimulatedTone &tone = config.lateralTone;
+        x = tone.amplitude * sin(2.0 * M_PI * fmod(tone.frequencyHz * turns, 1.0) + tone.phaseRad);
+    }
+
+    counts[ACCEL_X] = quantize((float)x + noise(config.noiseRmsG), rangeG);
+    counts[ACCEL_Y] = quantize(noise(config.noiseRmsG), rangeG);
+    counts[ACCEL_Z] = quantize((float)z + noise(config.noiseRmsG), rangeG);
+
+    if (rangeDps <= 0)
+    {
+        counts[GYRO_X] = counts[GYRO_Y] = counts[GYRO_Z] = 0;
+        return;
+    }
+    for (int i = 0; i < config.gyroToneCount; i++)
+    {
+        const SimulatedTone &tone = config.gyroTones[i];
+        rocking += tone.amplitude * sin(2.0 * M_PI * fmod(tone.frequencyHz * turns, 1.0) + tone.phaseRad);
+    }
+    counts[GYRO_X] = quantize((float)rocking + noise(config.gyroNoiseRmsDps), rangeDps);
+    counts[GYRO_Y] = quantize(noise(config.gyroNoiseRmsDps), rangeDps);
+    counts[GYRO_Z] = quantize(noise(config.gyroNoiseRmsDps), rangeDps);
+}
+
+float SimulatedImu::noise(float rms)
+{
+    if (rms <= 0)
+    {
+        return 0.0f;
+    }
+
+    /* Box-Muller on a xorshift32, reproducible for a given seed */
+    float u[2];
+    for (int i = 0; i < 2; i++)
+    {
+        noiseState ^= noiseState << 13;
+        noiseState ^= noiseState >> 17;
+        noiseState ^= noiseState << 5;
+        u[i] = (noiseState >> 8) * (1.0f / 16777216.0f);
+    }
+    return rms * sqrtf(-2.0f * logf(u[0] + 1e-12f)) * cosf(2.0f * (float)M_PI * u[1]);
+}
+
+int16_t SimulatedImu::quantize(float value, float fullScale)
+{
+    float counts = roundf(value / fullScale * 32768.0f);
+
+    if (counts > 32767.0f)
+    {
+        counts = 32767.0f;
+    }
+    else if (counts < -32768.0f)
+    {
+        counts = -32768.0f;
+    }
+    return (int16_t)counts;
+}
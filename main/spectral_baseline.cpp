@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "spectral_baseline.h"
+
+/* Bin 1 holds the leakage of the removed mean */
+#define BASELINE_FIRST_BIN 2
+
+uint16_t spectral_band_edge(uint16_t bins, uint8_t band)
+{
+    if (bins <= BASELINE_FIRST_BIN + BASELINE_BANDS)
+    {
+        return std::min<uint16_t>(bins, BASELINE_FIRST_BIN + band);
+    }
+    const float ratio = (float)bins / BASELINE_FIRST_BIN;
+    const uint16_t edge = (uint16_t)lroundf(BASELINE_FIRST_BIN * powf(ratio, (float)band / BASELINE_BANDS));
+    /* The lowest bands would be narrower than a bin */
+    return std::min<uint16_t>(bins, std::max<uint16_t>(edge, BASELINE_FIRST_BIN + band));
+}
+
+template <typename T>
+void spectral_band_levels(const T *magnitude, uint16_t bins, float amplitudeScale, float *levels)
+{
+    uint16_t low = spectral_band_edge(bins, 0);
+
+    for (uint8_t band = 0; band < BASELINE_BANDS; band++)
+    {
+        const uint16_t high = spectral_band_edge(bins, band + 1);
+        float power = 0;
+        for (uint16_t i = low; i < high; i++)
+        {
+            const float amplitude = magnitude[i] * amplitudeScale;
+            power += amplitude * amplitude;
+        }
+        levels[band] = power > 0 ? std::max(BASELINE_FLOOR_DB, 10 * log10f(power)) : BASELINE_FLOOR_DB;
+        low = high;
+    }
+}
+
+template void spectral_band_levels<float>(const float *, uint16_t, float, float *);
+template void spectral_band_levels<int16_t>(const int16_t *, uint16_t, float, float *);
+
+SpectralBaseline::SpectralBaseline(uint16_t bins, float sampleRateHz, float alpha, uint16_t minWindows,
+                                   float threshold)
+    : alpha(alpha), minWindows(minWindows > 0 ? minWindows : 1), threshold(threshold)
+{
+    memset(&state, 0, sizeof(state));
+    state.version = BASELINE_MODEL_VERSION;
+    state.bins = bins;
+    state.sampleRateHz = sampleRateHz;
+    reset();
+}
+
+void SpectralBaseline::reset()
+{
+    state.mode = BASELINE_LEARNING;
+    state.windows = 0;
+    std::fill(state.mean, state.mean + BASELINE_BANDS, 0.0f);
+    std::fill(state.variance, state.variance + BASELINE_BANDS, 0.0f);
+}
+
+void SpectralBaseline::learn()
+{
+    state.mode = BASELINE_LEARNING;
+}
+
+void SpectralBaseline::freeze()
+{
+    state.mode = BASELINE_FROZEN;
+}
+
+bool SpectralBaseline::restore(const BaselineModel &model)
+{
+    if (model.version != BASELINE_MODEL_VERSION || model.bins != state.bins ||
+        model.sampleRateHz != state.sampleRateHz || model.mode > BASELINE_FROZEN)
+    {
+        return false;
+    }
+    state = model;
+    return true;
+}
+
+float SpectralBaseline::update(const float *levels, float *z)
+{
+    float score = -1.0f;
+
+    if (state.windows >= minWindows)
+    {
+        float sum = 0;
+        for (int band = 0; band < BASELINE_BANDS; band++)
+        {
+            const float deviation = std::max(sqrtf(state.variance[band]), BASELINE_MIN_DEVIATION_DB);
+            const float bandZ = (levels[band] - state.mean[band]) / deviation;
+            sum += bandZ * bandZ;
+            if (z != NULL)
+            {
+                z[band] = bandZ;
+            }
+        }
+        score = sqrtf(sum / BASELINE_BANDS);
+    }
+    else if (z != NULL)
+    {
+        std::fill(z, z + BASELINE_BANDS, 0.0f);
+    }
+
+    if (state.mode == BASELINE_LEARNING && score <= threshold)
+    {
+        /* West's weighted update, the plain mean and variance while 1/n is above alpha */
+        const float weight = std::max(1.0f / (state.windows + 1), alpha);
+        for (int band = 0; band < BASELINE_BANDS; band++)
+        {
+            const float difference = levels[band] - state.mean[band];
+            state.mean[band] += weight * difference;
+            state.variance[band] = (1 - weight) * (state.variance[band] + weight * difference * difference);
+        }
+        state.windows++;
+    }
+    return score;
+}
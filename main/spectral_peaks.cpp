@@ -0,0 +1,115 @@
+#include <algorithm>
+#include <math.h>
+
+#include "spectral_peaks.h"
+
+float spectral_peak_offset(float left, float centre, float right)
+{
+    if (left <= 0 || centre <= 0 || right <= 0)
+    {
+        return 0.0f;
+    }
+    const float a = logf(left);
+    const float b = logf(centre);
+    const float c = logf(right);
+    const float curvature = a - 2 * b + c;
+    return curvature < 0 ? std::min(0.5f, std::max(-0.5f, 0.5f * (a - c) / curvature)) : 0.0f;
+}
+
+template <typename T>
+uint8_t find_spectral_peaks(const T *magnitude, uint16_t bins, float binWidth, float amplitudeScale,
+                            float minRatio, SpectralPeak *peaks, uint8_t capacity)
+{
+    uint16_t heap[SPECTRAL_PEAKS_MAX];
+    uint8_t size = 0;
+    /* Min heap on the magnitude, its top is the weakest peak kept */
+    auto weaker = [magnitude](uint16_t a, uint16_t b) { return magnitude[a] > magnitude[b]; };
+
+    capacity = std::min<uint8_t>(capacity, SPECTRAL_PEAKS_MAX);
+    if (capacity == 0)
+    {
+        return 0;
+    }
+
+    /* Bin 1 holds the leakage of the removed mean */
+    for (uint16_t i = 2; i + 1 < bins; i++)
+    {
+        if (magnitude[i] <= magnitude[i - 1] || magnitude[i] < magnitude[i + 1])
+        {
+            continue;
+        }
+        if (size < capacity)
+        {
+            heap[size++] = i;
+            std::push_heap(heap, heap + size, weaker);
+        }
+        else if (magnitude[i] > magnitude[heap[0]])
+        {
+            std::pop_heap(heap, heap + size, weaker);
+            heap[size - 1] = i;
+            std::push_heap(heap, heap + size, weaker);
+        }
+    }
+    /* Sorting a heap by its order leaves the strongest first */
+    std::sort_heap(heap, heap + size, weaker);
+
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < size; i++)
+    {
+        const uint16_t bin = heap[i];
+        if (magnitude[bin] < minRatio * magnitude[heap[0]])
+        {
+            break;
+        }
+        const float left = magnitude[bin - 1];
+        const float centre = magnitude[bin];
+        const float right = magnitude[bin + 1];
+        const float offset = spectral_peak_offset(left, centre, right);
+        /* Top of the log parabola */
+        const float top = left > 0 && right > 0 && centre > 0
+                              ? expf(logf(centre) - 0.25f * (logf(left) - logf(right)) * offset)
+                              : centre;
+
+        SpectralPeak &peak = peaks[count];
+        peak.hz = (bin + offset) * binWidth;
+        peak.amplitude = top * amplitudeScale;
+        peak.family = count;
+        peak.harmonic = 1;
+        count++;
+    }
+
+    /* Harmonic families, from the lowest frequency up */
+    uint8_t byFrequency[SPECTRAL_PEAKS_MAX];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        byFrequency[i] = i;
+    }
+    std::sort(byFrequency, byFrequency + count,
+              [peaks](uint8_t a, uint8_t b) { return peaks[a].hz < peaks[b].hz; });
+    for (uint8_t i = 0; i < count; i++)
+    {
+        const SpectralPeak &fundamental = peaks[byFrequency[i]];
+        if (fundamental.harmonic != 1)
+        {
+            continue;
+        }
+        for (uint8_t j = i + 1; j < count; j++)
+        {
+            SpectralPeak &peak = peaks[byFrequency[j]];
+            const float ratio = peak.hz / fundamental.hz;
+            const long n = lroundf(ratio);
+            if (peak.harmonic != 1 || n < 2 || n > UINT8_MAX ||
+                fabsf(peak.hz - n * fundamental.hz) > HARMONIC_TOLERANCE_BINS * binWidth)
+            {
+                continue;
+            }
+            peak.family = byFrequency[i];
+            peak.harmonic = (uint8_t)n;
+        }
+    }
+    return count;
+}
+
+template uint8_t find_spectral_peaks<float>(const float *, uint16_t, float, float, float, SpectralPeak *, uint8_t);
+template uint8_t find_spectral_peaks<int16_t>(const int16_t *, uint16_t, float, float, float, SpectralPeak *,
+                                              uint8_t);
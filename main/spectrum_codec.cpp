@@ -0,0 +1,518 @@
+#include <algorithm>
+#include <math.h>
+#include <new>
+#include <string.h>
+
+#include "spectrum_codec.h"
+
+#define SPECTRUM_FLAG_KEYFRAME 0x01
+/* Version, flags and sequence, then for a keyframe step, range and channels, and id, count and reference of each */
+#define HEADER_BYTES 4
+#define KEYFRAME_BYTES 9
+#define CHANNEL_BYTES 7
+/* Codes are steps above the floor, they fit an int16 with a wide margin */
+#define CODE_MAX 32767
+/* Rice parameters 0 to 7, 3 bits per channel */
+#define RICE_PARAMETER_BITS 3
+#define RICE_PARAMETERS (1 << RICE_PARAMETER_BITS)
+/* A Rice quotient of this many ones is followed by the value in 16 bits, a
+ * difference of codes fits them once zigzagged */
+#define RICE_ESCAPE 16
+#define RICE_ESCAPE_BITS 16
+
+/* Most significant bit first */
+class BitWriter
+{
+public:
+    BitWriter(uint8_t *out, size_t capacity) : overflow(false), out(out), capacity(capacity), bits(0) {}
+
+    void put(uint32_t value, int count)
+    {
+        for (int i = count - 1; i >= 0 && !overflow; i--)
+        {
+            const size_t byte = bits / 8;
+            if (byte >= capacity)
+            {
+                overflow = true;
+                return;
+            }
+            if (bits % 8 == 0)
+            {
+                out[byte] = 0;
+            }
+            out[byte] |= ((value >> i) & 1) << (7 - bits % 8);
+            bits++;
+        }
+    }
+    size_t bytes() const { return (bits + 7) / 8; }
+
+    bool overflow;
+
+private:
+    uint8_t *out;
+    size_t capacity;
+    size_t bits;
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t *data, size_t size) : failed(false), data(data), size(size), bits(0) {}
+
+    /* 0 once the data ran out */
+    uint32_t get(int count)
+    {
+        uint32_t value = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (bits / 8 >= size)
+            {
+                failed = true;
+                return 0;
+            }
+            value = (value << 1) | ((data[bits / 8] >> (7 - bits % 8)) & 1);
+            bits++;
+        }
+        return value;
+    }
+
+    bool failed;
+
+private:
+    const uint8_t *data;
+    size_t size;
+    size_t bits;
+};
+
+static void putUint16(uint8_t *out, uint16_t value)
+{
+    out[0] = value & 0xFF;
+    out[1] = value >> 8;
+}
+
+static uint16_t getUint16(const uint8_t *data)
+{
+    return data[0] | data[1] << 8;
+}
+
+static void putFloat(uint8_t *out, float value)
+{
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    putUint16(out, bits & 0xFFFF);
+    putUint16(out + 2, bits >> 16);
+}
+
+static float getFloat(const uint8_t *data)
+{
+    const uint32_t bits = getUint16(data) | (uint32_t)getUint16(data + 2) << 16;
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static uint32_t zigzag(int32_t value)
+{
+    return value >= 0 ? 2 * (uint32_t)value : 2 * (uint32_t)(-value) - 1;
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return value % 2 == 0 ? (int32_t)(value / 2) : -(int32_t)((value + 1) / 2);
+}
+
+static void putExpGolomb(BitWriter &writer, uint32_t value)
+{
+    const int length = 32 - __builtin_clz(value + 1);
+    writer.put(0, length - 1);
+    writer.put(value + 1, length);
+}
+
+static uint32_t getExpGolomb(BitReader &reader)
+{
+    int zeros = 0;
+    while (!reader.failed && reader.get(1) == 0)
+    {
+        if (++zeros > 16)
+        {
+            reader.failed = true;
+            return 0;
+        }
+    }
+    return ((1u << zeros) | reader.get(zeros)) - 1;
+}
+
+static uint32_t riceBits(uint32_t value, int parameter)
+{
+    const uint32_t quotient = value >> parameter;
+    return quotient < RICE_ESCAPE ? quotient + 1 + parameter : RICE_ESCAPE + RICE_ESCAPE_BITS;
+}
+
+static void putRice(BitWriter &writer, uint32_t value, int parameter)
+{
+    const uint32_t quotient = value >> parameter;
+    if (quotient < RICE_ESCAPE)
+    {
+        writer.put(0xFFFF, quotient);
+        writer.put(0, 1);
+        writer.put(value, parameter);
+    }
+    else
+    {
+        writer.put(0xFFFF, RICE_ESCAPE);
+        writer.put(value, RICE_ESCAPE_BITS);
+    }
+}
+
+static uint32_t getRice(BitReader &reader, int parameter)
+{
+    uint32_t quotient = 0;
+    while (quotient < RICE_ESCAPE && reader.get(1) == 1)
+    {
+        quotient++;
+    }
+    if (quotient == RICE_ESCAPE)
+    {
+        return reader.get(RICE_ESCAPE_BITS);
+    }
+    return (quotient << parameter) | reader.get(parameter);
+}
+
+/* Runs of zeros between the other differences, a last run when the channel ends in zeros */
+static void putChannel(BitWriter &writer, const int32_t *differences, uint16_t count)
+{
+    uint32_t bits[RICE_PARAMETERS] = {};
+    for (uint16_t i = 0; i < count; i++)
+    {
+        for (int parameter = 0; parameter < RICE_PARAMETERS && differences[i] != 0; parameter++)
+        {
+            bits[parameter] += riceBits(zigzag(differences[i]) - 1, parameter);
+        }
+    }
+    const int parameter = std::min_element(bits, bits + RICE_PARAMETERS) - bits;
+
+    uint32_t run = 0;
+    writer.put(parameter, RICE_PARAMETER_BITS);
+    for (uint16_t i = 0; i < count; i++)
+    {
+        if (differences[i] == 0)
+        {
+            run++;
+            continue;
+        }
+        putExpGolomb(writer, run);
+        putRice(writer, zigzag(differences[i]) - 1, parameter);
+        run = 0;
+    }
+    if (run > 0)
+    {
+        putExpGolomb(writer, run);
+    }
+}
+
+/* Differences from the value below in a keyframe, from the code held in a delta */
+static bool getChannel(BitReader &reader, int16_t *codes, uint16_t count, bool keyframe)
+{
+    const int parameter = reader.get(RICE_PARAMETER_BITS);
+    int32_t previous = 0;
+    uint32_t i = 0;
+
+    while (i < count && !reader.failed)
+    {
+        const uint32_t run = getExpGolomb(reader);
+        if (run > count - i)
+        {
+            return false;
+        }
+        for (uint32_t end = i + run; i < end; i++)
+        {
+            codes[i] = keyframe ? previous : codes[i];
+        }
+        if (i == count)
+        {
+            break;
+        }
+        const int32_t code = (keyframe ? previous : codes[i]) + unzigzag(getRice(reader, parameter) + 1);
+        if (code < 0 || code > CODE_MAX)
+        {
+            return false;
+        }
+        codes[i++] = code;
+        previous = code;
+    }
+    return !reader.failed;
+}
+
+static int16_t quantize(float value, float reference, float stepDb, float rangeDb)
+{
+    if (!(value > 0) || !(reference > 0))
+    {
+        return 0;
+    }
+    const float steps = (20 * log10f(value / reference) + rangeDb) / stepDb;
+    return (int16_t)lroundf(std::min(std::max(steps, 0.0f), (float)CODE_MAX));
+}
+
+static float dequantize(int16_t code, float reference, float stepDb, float rangeDb)
+{
+    return code > 0 ? reference * powf(10.0f, (code * stepDb - rangeDb) / 20) : 0.0f;
+}
+
+const char *spectrum_channel_name(uint8_t id)
+{
+    switch (id)
+    {
+    case SPECTRUM_CHANNEL_FFT:
+        return "FFT";
+    case SPECTRUM_CHANNEL_ORDER:
+        return "order";
+    case SPECTRUM_CHANNEL_ENVELOPE:
+        return "envelope";
+    default:
+        return NULL;
+    }
+}
+
+SpectrumEncoder::SpectrumEncoder(uint8_t channels, const uint8_t *ids, const uint16_t *counts, float stepDb,
+                                 float rangeDb, uint8_t deadband, uint16_t keyframeInterval)
+    : channels(std::min<uint8_t>(channels, SPECTRUM_CODEC_CHANNELS_MAX)), stepDb(stepDb), rangeDb(rangeDb),
+      deadband(deadband), keyframeInterval(keyframeInterval), codes(NULL), scratch(NULL), keyframeDue(true),
+      lastKeyframe(false), sinceKeyframe(0), seq(UINT16_MAX)
+{
+    size_t total = 0;
+    uint16_t largest = 0;
+
+    for (uint8_t c = 0; c < this->channels; c++)
+    {
+        this->ids[c] = ids[c];
+        this->counts[c] = counts[c];
+        reference[c] = 0;
+        total += counts[c];
+        largest = std::max(largest, counts[c]);
+    }
+    codes = new (std::nothrow) int16_t[total];
+    scratch = new (std::nothrow) int32_t[largest];
+}
+
+SpectrumEncoder::~SpectrumEncoder()
+{
+    delete[] codes;
+    delete[] scratch;
+}
+
+size_t SpectrumEncoder::encode(const float *const *values, uint8_t *out, size_t capacity)
+{
+    bool key = keyframeDue || sinceKeyframe >= keyframeInterval;
+    size_t position = HEADER_BYTES;
+
+    if (!ready() || capacity < (size_t)(HEADER_BYTES + KEYFRAME_BYTES + CHANNEL_BYTES * channels))
+    {
+        return 0;
+    }
+    /* A channel that was all 0 at the keyframe has no level to code against */
+    for (uint8_t c = 0; c < channels && !key; c++)
+    {
+        key = reference[c] <= 0 && std::any_of(values[c], values[c] + counts[c], [](float v) { return v > 0; });
+    }
+
+    const uint16_t next = seq + 1;
+    out[0] = SPECTRUM_CODEC_VERSION;
+    out[1] = key ? SPECTRUM_FLAG_KEYFRAME : 0;
+    putUint16(out + 2, next);
+    if (key)
+    {
+        putFloat(out + position, stepDb);
+        putFloat(out + position + 4, rangeDb);
+        out[position + 8] = channels;
+        position += KEYFRAME_BYTES;
+        for (uint8_t c = 0; c < channels; c++)
+        {
+            reference[c] = 0;
+            for (uint16_t i = 0; i < counts[c]; i++)
+            {
+                reference[c] = std::isfinite(values[c][i]) ? std::max(reference[c], values[c][i]) : reference[c];
+            }
+            out[position] = ids[c];
+            putUint16(out + position + 1, counts[c]);
+            putFloat(out + position + 3, reference[c]);
+            position += CHANNEL_BYTES;
+        }
+    }
+
+    BitWriter writer(out + position, capacity - position);
+    int16_t *held = codes;
+    for (uint8_t c = 0; c < channels; c++)
+    {
+        int16_t previous = 0;
+        for (uint16_t i = 0; i < counts[c]; i++)
+        {
+            const int16_t code = quantize(values[c][i], reference[c], stepDb, rangeDb);
+            if (key)
+            {
+                scratch[i] = code - previous;
+                held[i] = previous = code;
+            }
+            else
+            {
+                /* Against what the decoder holds, so the error never builds up past the dead band */
+                scratch[i] = abs(code - held[i]) > deadband ? code - held[i] : 0;
+                held[i] += scratch[i];
+            }
+        }
+        putChannel(writer, scratch, counts[c]);
+        held += counts[c];
+    }
+    if (writer.overflow)
+    {
+        /* The codes moved on without the decoder */
+        keyframeDue = true;
+        return 0;
+    }
+
+    seq = next;
+    lastKeyframe = key;
+    keyframeDue = false;
+    sinceKeyframe = key ? 1 : sinceKeyframe + 1;
+    return position + writer.bytes();
+}
+
+SpectrumDecoder::SpectrumDecoder()
+    : channelCount(0), stepDb(0), rangeDb(0), synced(false), lastKeyframe(false), seq(0)
+{
+    for (int c = 0; c < SPECTRUM_CODEC_CHANNELS_MAX; c++)
+    {
+        ids[c] = 0;
+        counts[c] = 0;
+        reference[c] = 0;
+        codes[c] = NULL;
+        decoded[c] = NULL;
+    }
+}
+
+SpectrumDecoder::~SpectrumDecoder()
+{
+    release();
+}
+
+void SpectrumDecoder::release()
+{
+    for (int c = 0; c < SPECTRUM_CODEC_CHANNELS_MAX; c++)
+    {
+        delete[] codes[c];
+        delete[] decoded[c];
+        codes[c] = NULL;
+        decoded[c] = NULL;
+    }
+    channelCount = 0;
+}
+
+bool SpectrumDecoder::layout(uint8_t count, const uint8_t *newIds, const uint16_t *newCounts)
+{
+    bool same = count == channelCount;
+    for (uint8_t c = 0; c < count && same; c++)
+    {
+        same = newIds[c] == ids[c] && newCounts[c] == counts[c];
+    }
+    if (same)
+    {
+        return true;
+    }
+
+    release();
+    for (uint8_t c = 0; c < count; c++)
+    {
+        ids[c] = newIds[c];
+        counts[c] = newCounts[c];
+        codes[c] = new (std::nothrow) int16_t[counts[c]];
+        decoded[c] = new (std::nothrow) float[counts[c]];
+        if (codes[c] == NULL || decoded[c] == NULL)
+        {
+            release();
+            return false;
+        }
+    }
+    channelCount = count;
+    return true;
+}
+
+SpectrumCodecStatus SpectrumDecoder::decode(const uint8_t *data, size_t size)
+{
+    if (data == NULL || size < HEADER_BYTES || data[0] != SPECTRUM_CODEC_VERSION)
+    {
+        synced = false;
+        return SPECTRUM_INVALID;
+    }
+    const bool key = data[1] & SPECTRUM_FLAG_KEYFRAME;
+    const uint16_t sequence = getUint16(data + 2);
+    size_t position = HEADER_BYTES;
+
+    if (key)
+    {
+        uint8_t keyIds[SPECTRUM_CODEC_CHANNELS_MAX];
+        uint16_t keyCounts[SPECTRUM_CODEC_CHANNELS_MAX];
+        float keyReference[SPECTRUM_CODEC_CHANNELS_MAX];
+
+        synced = false;
+        if (size < position + KEYFRAME_BYTES)
+        {
+            return SPECTRUM_INVALID;
+        }
+        const float keyStep = getFloat(data + position);
+        const float keyRange = getFloat(data + position + 4);
+        const uint8_t keyChannels = data[position + 8];
+        position += KEYFRAME_BYTES;
+        if (!(keyStep > 0) || !std::isfinite(keyStep) || !(keyRange >= 0) || !std::isfinite(keyRange) ||
+            keyChannels == 0 || keyChannels > SPECTRUM_CODEC_CHANNELS_MAX ||
+            size < position + CHANNEL_BYTES * keyChannels)
+        {
+            return SPECTRUM_INVALID;
+        }
+        for (uint8_t c = 0; c < keyChannels; c++, position += CHANNEL_BYTES)
+        {
+            keyIds[c] = data[position];
+            keyCounts[c] = getUint16(data + position + 1);
+            keyReference[c] = getFloat(data + position + 3);
+            if (keyCounts[c] == 0 || !(keyReference[c] >= 0) || !std::isfinite(keyReference[c]))
+            {
+                return SPECTRUM_INVALID;
+            }
+        }
+        if (!layout(keyChannels, keyIds, keyCounts))
+        {
+            return SPECTRUM_INVALID;
+        }
+        stepDb = keyStep;
+        rangeDb = keyRange;
+        memcpy(reference, keyReference, sizeof(float) * keyChannels);
+    }
+    else if (synced && sequence == seq)
+    {
+        return SPECTRUM_DUPLICATE;
+    }
+    else if (!synced || sequence != (uint16_t)(seq + 1))
+    {
+        synced = false;
+        return SPECTRUM_NEED_KEYFRAME;
+    }
+
+    BitReader reader(data + position, size - position);
+    for (uint8_t c = 0; c < channelCount; c++)
+    {
+        if (!getChannel(reader, codes[c], counts[c], key))
+        {
+            synced = false;
+            return SPECTRUM_INVALID;
+        }
+    }
+    for (uint8_t c = 0; c < channelCount; c++)
+    {
+        for (uint16_t i = 0; i < counts[c]; i++)
+        {
+            decoded[c][i] = dequantize(codes[c][i], reference[c], stepDb, rangeDb);
+        }
+    }
+    seq = sequence;
+    lastKeyframe = key;
+    synced = true;
+    return SPECTRUM_DECODED;
+}
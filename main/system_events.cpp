@@ -0,0 +1,102 @@
+#include <inttypes.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/task.h"
+
+#include "system_events.h"
+
+#define TAG "SYSTEM_EVENTS"
+
+/* setupQMI8658() is the deepest: the stored baseline and alarm bands on its
+ * stack over the NVS reads, the octave band table, the CRC of the mapped
+ * fault model and float logs. vTaskInit() logs the stack left unused */
+#define INIT_TASK_STACK_SIZE 6144
+
+EventGroupHandle_t g_system_events = NULL;
+
+static int64_t s_boot_milestones_us[BOOT_MILESTONE_COUNT];
+
+static const char *s_boot_milestone_names[BOOT_MILESTONE_COUNT] = {
+    "sensor ready",
+    "first sample",
+    "Wi-Fi connected",
+    "time synchronized",
+    "first publish",
+};
+
+typedef struct
+{
+    const char *name;
+    esp_err_t (*init)();
+    EventBits_t ready_bit;
+} init_task_params_t;
+
+esp_err_t init_system_events()
+{
+    g_system_events = xEventGroupCreate();
+    if (g_system_events == NULL)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    for (int i = 0; i < BOOT_MILESTONE_COUNT; i++)
+    {
+        s_boot_milestones_us[i] = -1;
+    }
+    return ESP_OK;
+}
+
+static void vTaskInit(void *pvParameters)
+{
+    init_task_params_t *params = (init_task_params_t *)pvParameters;
+    int64_t start = esp_timer_get_time();
+
+    esp_err_t err = params->init();
+    ESP_LOGI(TAG, "%s init left %u of %d bytes of stack unused", params->name,
+             (unsigned)uxTaskGetStackHighWaterMark(NULL), INIT_TASK_STACK_SIZE);
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "%s initialized in %" PRId64 " ms", params->name, (esp_timer_get_time() - start) / 1000);
+        xEventGroupSetBits(g_system_events, params->ready_bit);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "%s failed to initialize (%s)", params->name, esp_err_to_name(err));
+    }
+
+    delete params;
+    vTaskDelete(NULL);
+}
+
+esp_err_t start_init_task(const char *name, esp_err_t (*init)(), EventBits_t ready_bit, BaseType_t core)
+{
+    init_task_params_t *params = new init_task_params_t{name, init, ready_bit};
+
+    if (xTaskCreatePinnedToCore(vTaskInit, name, INIT_TASK_STACK_SIZE, params, 1, NULL, core) != pdPASS)
+    {
+        ESP_LOGE(TAG, "Failed to create %s init task", name);
+        delete params;
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void mark_boot_milestone(boot_milestone_t milestone)
+{
+    if (s_boot_milestones_us[milestone] >= 0)
+    {
+        return;
+    }
+    s_boot_milestones_us[milestone] = esp_timer_get_time();
+    ESP_LOGI(TAG, "Boot to %s: %" PRId64 " ms", s_boot_milestone_names[milestone],
+             s_boot_milestones_us[milestone] / 1000);
+}
+
+int32_t get_boot_milestone_ms(boot_milestone_t milestone)
+{
+    if (s_boot_milestones_us[milestone] < 0)
+    {
+        return -1;
+    }
+    return (int32_t)(s_boot_milestones_us[milestone] / 1000);
+}
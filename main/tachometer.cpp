@@ -0,0 +1,58 @@
+#include "Arduino.h"
+
+#include "esp_attr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "tachometer.h"
+
+#define TAG "TACHOMETER"
+
+static portMUX_TYPE pulseLock = portMUX_INITIALIZER_UNLOCKED;
+/* Ring of the pulse timestamps, pulseCount is the total since begin */
+static int64_t pulseAt[TACHOMETER_PULSES];
+static uint32_t pulseCount = 0;
+static uint8_t pulsesPerRev = 1;
+
+static void IRAM_ATTR tachometer_isr()
+{
+    const int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL_ISR(&pulseLock);
+    pulseAt[pulseCount % TACHOMETER_PULSES] = now;
+    pulseCount++;
+    portEXIT_CRITICAL_ISR(&pulseLock);
+}
+
+bool tachometer_begin(int pin, uint8_t pulsesPerRevolution)
+{
+    if (pin < 0 || pulsesPerRevolution == 0 || pulsesPerRevolution >= TACHOMETER_PULSES)
+    {
+        ESP_LOGE(TAG, "Invalid tachometer pin %d or %u pulses per revolution", pin, pulsesPerRevolution);
+        return false;
+    }
+    pulsesPerRev = pulsesPerRevolution;
+    pinMode(pin, INPUT);
+    attachInterrupt(pin, tachometer_isr, RISING);
+    return true;
+}
+
+float tachometer_hz(int64_t atUs)
+{
+    int64_t last;
+    int64_t first;
+
+    portENTER_CRITICAL(&pulseLock);
+    const uint32_t count = pulseCount;
+    last = pulseAt[(count - 1) % TACHOMETER_PULSES];
+    first = pulseAt[(count - 1 - pulsesPerRev) % TACHOMETER_PULSES];
+    portEXIT_CRITICAL(&pulseLock);
+
+    /* A revolution of pulses, spanning the whole rotor when there are several */
+    if (count <= pulsesPerRev || atUs - last > TACHOMETER_TIMEOUT_US || last <= first)
+    {
+        return 0.0f;
+    }
+    return 1e6f / (float)(last - first);
+}
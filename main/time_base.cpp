@@ -0,0 +1,98 @@
+#include <inttypes.h>
+#include <time.h>
+#include <stdio.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+#include "time_base.h"
+
+#define TAG "TIME_BASE"
+
+/* Shorter intervals are dominated by the SNTP round trip jitter */
+#define MIN_DRIFT_INTERVAL_US (10 * 60 * 1000000LL)
+/* Anything above this is a clock step, not drift */
+#define MAX_DRIFT_PPM 500.0
+
+static portMUX_TYPE s_lock = portMUX_INITIALIZER_UNLOCKED;
+static bool s_synchronized = false;
+static int64_t s_sync_monotonic_us = 0;
+static int64_t s_sync_utc_us = 0;
+static double s_drift_ppm = 0;
+
+void time_base_synchronized(const struct timeval *tv)
+{
+    int64_t monotonic_us = esp_timer_get_time();
+    int64_t utc_us = (int64_t)tv->tv_sec * 1000000LL + tv->tv_usec;
+
+    portENTER_CRITICAL(&s_lock);
+    if (s_synchronized && (monotonic_us - s_sync_monotonic_us) >= MIN_DRIFT_INTERVAL_US)
+    {
+        double elapsed = (double)(monotonic_us - s_sync_monotonic_us);
+        double drift_ppm = ((double)(utc_us - s_sync_utc_us) - elapsed) / elapsed * 1e6;
+        if (drift_ppm > -MAX_DRIFT_PPM && drift_ppm < MAX_DRIFT_PPM)
+        {
+            s_drift_ppm = drift_ppm;
+        }
+    }
+    s_sync_monotonic_us = monotonic_us;
+    s_sync_utc_us = utc_us;
+    s_synchronized = true;
+    portEXIT_CRITICAL(&s_lock);
+
+    ESP_LOGI(TAG, "Monotonic %" PRId64 " us is UTC %" PRId64 " us, CPU clock drift %.1f ppm", monotonic_us, utc_us,
+             s_drift_ppm);
+}
+
+bool time_base_is_synchronized()
+{
+    return s_synchronized;
+}
+
+bool time_base_to_utc(int64_t monotonic_us, int64_t *utc_us)
+{
+    portENTER_CRITICAL(&s_lock);
+    bool synchronized = s_synchronized;
+    int64_t sync_monotonic_us = s_sync_monotonic_us;
+    int64_t sync_utc_us = s_sync_utc_us;
+    double drift_ppm = s_drift_ppm;
+    portEXIT_CRITICAL(&s_lock);
+
+    int64_t elapsed = monotonic_us - sync_monotonic_us;
+    *utc_us = sync_utc_us + elapsed + (int64_t)(elapsed * drift_ppm * 1e-6);
+    return synchronized;
+}
+
+float time_base_cpu_drift_ppm()
+{
+    return (float)s_drift_ppm;
+}
+
+size_t time_base_format_utc(int64_t utc_us, char *out, size_t len)
+{
+    time_t seconds = (time_t)(utc_us / 1000000LL);
+    int32_t micros = (int32_t)(utc_us % 1000000LL);
+    struct tm tm;
+
+    if (micros < 0)
+    {
+        seconds -= 1;
+        micros += 1000000;
+    }
+    if (gmtime_r(&seconds, &tm) == NULL)
+    {
+        return 0;
+    }
+    size_t written = strftime(out, len, "%Y-%m-%dT%H:%M:%S", &tm);
+    if (written == 0)
+    {
+        return 0;
+    }
+    int tail = snprintf(out + written, len - written, ".%06dZ", (int)micros);
+    if (tail < 0 || (size_t)tail >= len - written)
+    {
+        return 0;
+    }
+    return written + tail;
+}
@@ -0,0 +1,81 @@
+#include <math.h>
+#include <string.h>
+
+#include "time_features.h"
+
+void TimeFeatures::reset()
+{
+    n = 0;
+    mean = m2 = m3 = m4 = 0;
+    min = INT16_MAX;
+    max = INT16_MIN;
+}
+
+void TimeFeatures::addBlock(const int16_t *counts, uint16_t samples)
+{
+    if (samples == 0)
+    {
+        return;
+    }
+
+    int32_t sum = 0;
+    int16_t lo = min;
+    int16_t hi = max;
+    for (uint16_t i = 0; i < samples; i++)
+    {
+        sum += counts[i];
+        lo = counts[i] < lo ? counts[i] : lo;
+        hi = counts[i] > hi ? counts[i] : hi;
+    }
+    min = lo;
+    max = hi;
+
+    /* A block spans a few counts around its own mean, float holds its sums */
+    const float blockMean = (float)sum / samples;
+    float s2 = 0;
+    float s3 = 0;
+    float s4 = 0;
+    for (uint16_t i = 0; i < samples; i++)
+    {
+        float d = counts[i] - blockMean;
+        float d2 = d * d;
+        s2 += d2;
+        s3 += d2 * d;
+        s4 += d2 * d2;
+    }
+
+    /* Merge the block moments into the window, the 3rd and 4th first since they use the old 2nd and 3rd */
+    const double na = n;
+    const double nb = samples;
+    const double total = na + nb;
+    const double delta = blockMean - mean;
+    const double delta2 = delta * delta;
+
+    m4 += s4 + delta2 * delta2 * na * nb * (na * na - na * nb + nb * nb) / (total * total * total) +
+          6 * delta2 * (na * na * s2 + nb * nb * m2) / (total * total) + 4 * delta * (na * s3 - nb * m3) / total;
+    m3 += s3 + delta2 * delta * na * nb * (na - nb) / (total * total) + 3 * delta * (na * s2 - nb * m2) / total;
+    m2 += s2 + delta2 * na * nb / total;
+    mean += delta * nb / total;
+    n += samples;
+}
+
+AxisFeatures TimeFeatures::result(float scale) const
+{
+    AxisFeatures features;
+
+    memset(&features, 0, sizeof(features));
+    if (n < 2 || m2 <= 0)
+    {
+        return features;
+    }
+
+    const double rms = sqrt(m2 / n);
+    const double peak = fmax(max - mean, mean - min);
+    features.rms = (float)(rms * scale);
+    features.peak = (float)(peak * scale);
+    features.peakToPeak = (float)((max - min) * (double)scale);
+    features.crestFactor = (float)(peak / rms);
+    features.kurtosis = (float)(n * m4 / (m2 * m2));
+    features.skewness = (float)(sqrt((double)n) * m3 / (m2 * sqrt(m2)));
+    return features;
+}
@@ -11,18 +11,20 @@
 
 #include "wifi_setup.h"
 #include "device_configuration.h"
-
-#define NR_OF_IP_ADDRESSES_TO_WAIT_FOR 1
+#include "system_events.h"
+#include "time_base.h"
 
 static const char *tag = "IOT_SETUP";
 
-static bool g_timeInitialized = false;
+static bool s_wifi_started = false;
+static bool s_sntp_started = false;
 
-static xSemaphoreHandle s_semph_get_ip_addrs;
 static esp_ip4_addr_t s_ip_addr;
 
 static bool s_is_connected_to_internet = false;
 
+static void initialize_time();
+
 /**
  * @brief Checks the netif description if it contains specified prefix.
  * All netifs created withing common connect component are prefixed with the module TAG,
@@ -53,7 +55,9 @@ static void on_got_ip(void *arg,
              esp_netif_get_desc(event->esp_netif), IP2STR(&event->ip_info.ip));
     memcpy(&s_ip_addr, &event->ip_info.ip, sizeof(s_ip_addr));
     s_is_connected_to_internet = true;
-    xSemaphoreGive(s_semph_get_ip_addrs);
+    mark_boot_milestone(BOOT_MILESTONE_WIFI_CONNECTED);
+    xEventGroupSetBits(g_system_events, SYSTEM_EVENT_WIFI_CONNECTED);
+    initialize_time();
 }
 /*-----------------------------------------------------------*/
 
@@ -64,6 +68,7 @@ static void on_wifi_disconnect(void *arg,
 {
     ESP_LOGI(tag, "Wi-Fi disconnected, trying to reconnect...");
     s_is_connected_to_internet = false;
+    xEventGroupClearBits(g_system_events, SYSTEM_EVENT_WIFI_CONNECTED);
     esp_err_t err = esp_wifi_connect();
 
     if (err == ESP_ERR_WIFI_NOT_STARTED)
@@ -162,16 +167,14 @@ static void stop(void)
 esp_err_t connect()
 {
     esp_err_t err;
-    if (s_semph_get_ip_addrs != NULL)
+    if (s_wifi_started)
     {
         return ESP_ERR_INVALID_STATE;
     }
 
     esp_netif_t *esp_netif = wifi_start();
     (void)esp_netif;
-
-    /* create semaphore if at least one interface is active */
-    s_semph_get_ip_addrs = xSemaphoreCreateCounting(NR_OF_IP_ADDRESSES_TO_WAIT_FOR, 0);
+    s_wifi_started = true;
 
     err = esp_register_shutdown_handler(&stop);
     if (err != ESP_OK)
@@ -179,54 +182,36 @@ esp_err_t connect()
         return err;
     }
 
-    ESP_LOGI(tag, "Waiting for IP(s)");
-
-    for (int i = 0; i < NR_OF_IP_ADDRESSES_TO_WAIT_FOR; ++i)
-    {
-        xSemaphoreTake(s_semph_get_ip_addrs, portMAX_DELAY);
-    }
-
-    /* iterate over active interfaces, and print out IPs of "our" netifs */
-    esp_netif_t *netif = NULL;
-    esp_netif_ip_info_t ip;
-
-    for (int i = 0; i < esp_netif_get_nr_of_ifs(); ++i)
-    {
-        netif = esp_netif_next(netif);
-
-        if (is_our_netif(tag, netif))
-        {
-            err = esp_netif_get_ip_info(netif, &ip);
-            if (err != ESP_OK)
-            {
-                ESP_LOGE(tag, "Failed to get IP information");
-                return err;
-            }
-        }
-    }
+    /* Don't wait for the IP here, on_got_ip signals SYSTEM_EVENT_WIFI_CONNECTED */
     return ESP_OK;
 }
 
 static void time_sync_notification_cb(struct timeval *tv)
 {
     ESP_LOGI(tag, "Notification of a time synchronization event");
-    g_timeInitialized = true;
+    time_base_synchronized(tv);
+    mark_boot_milestone(BOOT_MILESTONE_TIME_SYNCED);
+    xEventGroupSetBits(g_system_events, SYSTEM_EVENT_TIME_SYNCED);
 }
 
+/**
+ * @brief Start SNTP once the first IP is available. Doesn't wait for the
+ * synchronization, time_sync_notification_cb signals SYSTEM_EVENT_TIME_SYNCED.
+ */
 static void initialize_time()
 {
+    if (s_sntp_started)
+    {
+        return;
+    }
+    s_sntp_started = true;
+
     sntp_setoperatingmode(SNTP_OPMODE_POLL);
     sntp_setservername(0, SNTP_SERVER_FQDN);
     sntp_set_time_sync_notification_cb(time_sync_notification_cb);
     sntp_init();
 
     ESP_LOGI(tag, "Waiting for time synchronization with SNTP server");
-
-    while (!g_timeInitialized)
-    {
-        vTaskDelay(pdMS_TO_TICKS(1000));
-    }
-    ESP_LOGI(tag, "Time synchronized");
 }
 
 uint64_t ullGetUnixTime(void)
@@ -248,13 +233,5 @@ bool xAzureSample_IsConnectedToInternet()
 
 esp_err_t init_wifi()
 {
-    esp_err_t err = connect();
-    if (err != ESP_OK)
-    {
-        return err;
-    }
-
-    initialize_time();
-
-    return ESP_OK;
+    return connect();
 }
\ No newline at end of file
@@ -0,0 +1,250 @@
+/**
+ * @file backoff_sim.c
+ * @brief Host simulation of a fleet of devices reconnecting to the IoT Hub
+ * after an access point reboot.
+ *
+ * Runs the same backoff_algorithm.c and backoff_dither.c that ship in the
+ * firmware against a hub that only accepts a limited number of TLS handshakes
+ * per second, once with the old configuration (rand() / RAND_MAX jitter, five
+ * attempts then assert and reboot) and once with the current one, and prints
+ * how the connection attempts are spread over time.
+ *
+ * Build and run from the repository root:
+ *
+ *     cc -O2 -Icomponents/sample-azure-iot tools/backoff_sim/backoff_sim.c \
+ *        components/sample-azure-iot/backoff_algorithm.c \
+ *        components/sample-azure-iot/backoff_dither.c -o backoff_sim
+ *     ./backoff_sim [devices] [hub handshakes per second]
+ *
+ * It is also built by the host project in host/.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "backoff_algorithm.h"
+#include "backoff_dither.h"
+
+#define SIM_DURATION_MS        ( 300 * 1000U )
+#define SIM_HISTOGRAM_BUCKET_MS ( 5 * 1000U )
+#define SIM_MAX_DEVICES        ( 5000U )
+
+/* Time for the access point to come back and a device to associate. */
+#define SIM_WIFI_ASSOCIATION_SPREAD_MS ( 3 * 1000U )
+/* Time a refused TLS handshake takes to fail. */
+#define SIM_FAILED_ATTEMPT_MS  ( 1000U )
+/* Time for a device to reboot after configASSERT and get Wi-Fi back. */
+#define SIM_REBOOT_MS          ( 8 * 1000U )
+
+typedef struct SimPolicy
+{
+    const char * pcName;
+    uint16_t usBackoffBaseMs;
+    uint16_t usMaxBackoffMs;
+    uint32_t ulMaxAttempts;
+    uint32_t ulDitherWindowMs;
+    bool xLegacyRandom;
+} SimPolicy_t;
+
+typedef struct SimDevice
+{
+    char cDeviceId[ 32 ];
+    BackoffAlgorithmContext_t xBackoff;
+    uint32_t ulNextAttemptMs;
+    bool xConnected;
+} SimDevice_t;
+
+static SimDevice_t xDevices[ SIM_MAX_DEVICES ];
+static uint32_t ulAttemptsPerBucket[ SIM_DURATION_MS / SIM_HISTOGRAM_BUCKET_MS ];
+
+/*-----------------------------------------------------------*/
+
+/* xorshift32, stands in for the hardware RNG of each device. */
+static uint32_t prvRandom( void )
+{
+    static uint32_t ulState = 0x12345678U;
+
+    ulState ^= ulState << 13;
+    ulState ^= ulState >> 17;
+    ulState ^= ulState << 5;
+    return ulState;
+}
+/*-----------------------------------------------------------*/
+
+static uint32_t prvPolicyRandom( const SimPolicy_t * pxPolicy )
+{
+    if( pxPolicy->xLegacyRandom )
+    {
+        /* The old configRAND32(): an integer division that is 0 almost always. */
+        return ( uint32_t ) ( rand() / RAND_MAX );
+    }
+
+    return prvRandom();
+}
+/*-----------------------------------------------------------*/
+
+static void prvStartCycle( const SimPolicy_t * pxPolicy,
+                           SimDevice_t * pxDevice,
+                           uint32_t ulNowMs )
+{
+    BackoffAlgorithm_InitializeParams( &pxDevice->xBackoff,
+                                       pxPolicy->usBackoffBaseMs,
+                                       pxPolicy->usMaxBackoffMs,
+                                       pxPolicy->ulMaxAttempts );
+    pxDevice->ulNextAttemptMs = ulNowMs +
+                                BackoffDither_GetStartupDelay( pxDevice->cDeviceId,
+                                                               pxPolicy->ulDitherWindowMs,
+                                                               prvPolicyRandom( pxPolicy ) );
+}
+/*-----------------------------------------------------------*/
+
+static void prvRunPolicy( const SimPolicy_t * pxPolicy,
+                          uint32_t ulDeviceCount,
+                          uint32_t ulHubRatePerSecond )
+{
+    uint32_t ulConnected = 0;
+    uint32_t ulAttempts = 0;
+    uint32_t ulReboots = 0;
+    uint32_t ulPeakPerSecond = 0;
+    uint32_t ulThisSecond = 0;
+    uint32_t ulLastConnectedMs = 0;
+    /* Token bucket in thousandths of a handshake, refilled every millisecond. */
+    uint32_t ulTokens = ulHubRatePerSecond * 1000U;
+    uint32_t ulBucketCount = SIM_DURATION_MS / SIM_HISTOGRAM_BUCKET_MS;
+    uint32_t ulMaxBucket = 1;
+
+    srand( 1 );
+
+    for( uint32_t i = 0; i < ulBucketCount; i++ )
+    {
+        ulAttemptsPerBucket[ i ] = 0;
+    }
+
+    for( uint32_t i = 0; i < ulDeviceCount; i++ )
+    {
+        snprintf( xDevices[ i ].cDeviceId, sizeof( xDevices[ i ].cDeviceId ), "vibration-sensor-%04u", ( unsigned ) i );
+        xDevices[ i ].xConnected = false;
+        prvStartCycle( pxPolicy, &xDevices[ i ], prvRandom() % SIM_WIFI_ASSOCIATION_SPREAD_MS );
+    }
+
+    for( uint32_t ulNowMs = 0; ulNowMs < SIM_DURATION_MS; ulNowMs++ )
+    {
+        if( ( ulNowMs % 1000U ) == 0U )
+        {
+            ulPeakPerSecond = ( ulThisSecond > ulPeakPerSecond ) ? ulThisSecond : ulPeakPerSecond;
+            ulThisSecond = 0;
+        }
+
+        ulTokens += ulHubRatePerSecond;
+
+        if( ulTokens > ulHubRatePerSecond * 1000U )
+        {
+            ulTokens = ulHubRatePerSecond * 1000U;
+        }
+
+        for( uint32_t i = 0; i < ulDeviceCount; i++ )
+        {
+            SimDevice_t * pxDevice = &xDevices[ i ];
+            uint16_t usBackoffMs = 0;
+
+            if( pxDevice->xConnected || ( pxDevice->ulNextAttemptMs != ulNowMs ) )
+            {
+                continue;
+            }
+
+            ulAttempts++;
+            ulThisSecond++;
+            ulAttemptsPerBucket[ ulNowMs / SIM_HISTOGRAM_BUCKET_MS ]++;
+
+            if( ulTokens >= 1000U )
+            {
+                ulTokens -= 1000U;
+                pxDevice->xConnected = true;
+                ulConnected++;
+                ulLastConnectedMs = ulNowMs;
+            }
+            else if( BackoffAlgorithm_GetNextBackoff( &pxDevice->xBackoff,
+                                                      prvPolicyRandom( pxPolicy ),
+                                                      &usBackoffMs ) == BackoffAlgorithmSuccess )
+            {
+                pxDevice->ulNextAttemptMs = ulNowMs + SIM_FAILED_ATTEMPT_MS + usBackoffMs;
+            }
+            else
+            {
+                /* Retries exhausted: the old firmware asserted and rebooted. */
+                ulReboots++;
+                prvStartCycle( pxPolicy, pxDevice, ulNowMs + SIM_FAILED_ATTEMPT_MS + SIM_REBOOT_MS );
+            }
+        }
+    }
+
+    for( uint32_t i = 0; i < ulBucketCount; i++ )
+    {
+        ulMaxBucket = ( ulAttemptsPerBucket[ i ] > ulMaxBucket ) ? ulAttemptsPerBucket[ i ] : ulMaxBucket;
+    }
+
+    printf( "\n== %s ==\n", pxPolicy->pcName );
+    printf( "connected %u/%u, last at %.1f s, attempts %u, reboots %u, peak %u attempts/s\n",
+            ( unsigned ) ulConnected, ( unsigned ) ulDeviceCount,
+            ulLastConnectedMs / 1000.0, ( unsigned ) ulAttempts,
+            ( unsigned ) ulReboots, ( unsigned ) ulPeakPerSecond );
+
+    for( uint32_t i = 0; i < ulBucketCount; i++ )
+    {
+        uint32_t ulBar = ( ulAttemptsPerBucket[ i ] * 50U + ulMaxBucket - 1U ) / ulMaxBucket;
+
+        if( ( ulAttemptsPerBucket[ i ] == 0U ) && ( i * SIM_HISTOGRAM_BUCKET_MS > ulLastConnectedMs ) )
+        {
+            break;
+        }
+
+        printf( "%4u-%4us %5u |", ( unsigned ) ( i * SIM_HISTOGRAM_BUCKET_MS / 1000U ),
+                ( unsigned ) ( ( i + 1U ) * SIM_HISTOGRAM_BUCKET_MS / 1000U ),
+                ( unsigned ) ulAttemptsPerBucket[ i ] );
+
+        for( uint32_t j = 0; j < ulBar; j++ )
+        {
+            putchar( '#' );
+        }
+
+        putchar( '\n' );
+    }
+}
+/*-----------------------------------------------------------*/
+
+int main( int argc,
+          char ** argv )
+{
+    uint32_t ulDeviceCount = ( argc > 1 ) ? ( uint32_t ) strtoul( argv[ 1 ], NULL, 10 ) : 500U;
+    uint32_t ulHubRatePerSecond = ( argc > 2 ) ? ( uint32_t ) strtoul( argv[ 2 ], NULL, 10 ) : 25U;
+
+    /* Mirrors the values in main/iot_setup.cpp before and after the fix. */
+    const SimPolicy_t xLegacy =
+    {
+        "legacy: rand() / RAND_MAX jitter, 5 attempts, no dither",
+        500U, 5000U, 5U, 0U, true
+    };
+    const SimPolicy_t xCurrent =
+    {
+        "current: hardware RNG full jitter, retry forever, 30 s device ID dither",
+        500U, 60000U, BACKOFF_ALGORITHM_RETRY_FOREVER, 30000U, false
+    };
+
+    if( ( ulDeviceCount == 0U ) || ( ulDeviceCount > SIM_MAX_DEVICES ) || ( ulHubRatePerSecond == 0U ) )
+    {
+        fprintf( stderr, "usage: %s [devices <= %u] [hub handshakes per second > 0]\n",
+                 argv[ 0 ], ( unsigned ) SIM_MAX_DEVICES );
+        return 1;
+    }
+
+    printf( "%u devices, hub accepts %u handshakes/s, access point back at t=0\n",
+            ( unsigned ) ulDeviceCount, ( unsigned ) ulHubRatePerSecond );
+
+    prvRunPolicy( &xLegacy, ulDeviceCount, ulHubRatePerSecond );
+    prvRunPolicy( &xCurrent, ulDeviceCount, ulHubRatePerSecond );
+
+    return 0;
+}
+/*-----------------------------------------------------------*/
@@ -0,0 +1,246 @@
+#!/usr/bin/env python3
+"""Pack a quantized fault classifier into the blob main/fault_classifier.cpp runs.
+
+The model is described in JSON, as exported from training:
+
+    {
+      "modelId": 3,
+      "labels": ["normal", "imbalance", ...],
+      "inputZeroPoint": -1,
+      "offset": [...], "gain": [...],            # q = round((x - offset) * gain) + inputZeroPoint
+      "layers": [{
+        "activation": "relu" | "none",
+        "inputZeroPoint": -1, "outputZeroPoint": -128,
+        "scale": 0.0042,                         # input scale * weight scale / output scale,
+                                                 # or "multiplier" and "shift" as TensorFlow Lite has them
+        "outputScale": 0.1,
+        "bias": [...],                           # int32, in input scale * weight scale
+        "weights": [[...], ...]                  # int8, [outputs][inputs]
+      }, ...]
+    }
+
+    fault_model.py MODEL.json MODEL.bin [--golden GOLDEN.csv [--vectors N]]
+    fault_model.py --demo MODEL.json
+
+--golden runs the model over random feature vectors with the same integer
+arithmetic as the firmware (TensorFlow Lite's) and writes a CSV of the
+features, the int8 logits and the probabilities, which host/classifier_check
+compares the C++ stage against. A CSV in the same layout from the
+interpreter of the training framework works as well.
+"""
+
+import argparse
+import json
+import math
+import random
+import struct
+import sys
+import zlib
+
+MAGIC = 0x4C444D46
+VERSION = 1
+CLASSES_MAX = 8
+LABEL_LENGTH = 16
+LAYERS_MAX = 8
+# Features of a spectrum window, FAULT_MODEL_INPUTS in QMI8658_setup.h: the
+# 16 log band levels of the baseline in dB, velocity in mm/s and displacement in um
+INPUTS = 18
+ACTIVATIONS = {"none": 0, "relu": 1}
+INT32_MIN = -(1 << 31)
+INT32_MAX = (1 << 31) - 1
+
+
+def f32(value):
+    return struct.unpack("<f", struct.pack("<f", value))[0]
+
+
+def quantize_multiplier(scale):
+    """TensorFlow Lite's QuantizeMultiplier: scale = multiplier * 2^(shift - 31)."""
+    if scale == 0:
+        return 0, 0
+    fraction, shift = math.frexp(scale)
+    multiplier = round(fraction * (1 << 31))
+    if multiplier == 1 << 31:
+        multiplier //= 2
+        shift += 1
+    return multiplier, shift
+
+
+def clamp(value, low, high):
+    return min(max(value, low), high)
+
+
+def requantize(accumulator, multiplier, shift):
+    left = max(shift, 0)
+    right = max(-shift, 0)
+    value = clamp(accumulator * (1 << left), INT32_MIN, INT32_MAX)
+    if value == INT32_MIN and multiplier == INT32_MIN:
+        high = INT32_MAX
+    else:
+        product = value * multiplier
+        total = product + ((1 << 30) if product >= 0 else 1 - (1 << 30))
+        # C division truncates towards zero
+        high = abs(total) // (1 << 31) * (1 if total >= 0 else -1)
+    mask = (1 << right) - 1
+    threshold = (mask >> 1) + (1 if high < 0 else 0)
+    return (high >> right) + (1 if (high & mask) > threshold else 0)
+
+
+def round_away(value):
+    return int(math.floor(abs(value) + 0.5)) * (1 if value >= 0 else -1)
+
+
+def layer_multiplier(layer):
+    if "multiplier" in layer:
+        return layer["multiplier"], layer["shift"]
+    return quantize_multiplier(layer["scale"])
+
+
+def run(model, features):
+    """Integer inference as FaultClassifier::classify() does it, returns the logits and probabilities."""
+    values = []
+    for x, offset, gain in zip(features, model["offset"], model["gain"]):
+        scaled = f32(f32(f32(x) - f32(offset)) * f32(gain))
+        scaled = clamp(scaled, -256.0, 256.0) if math.isfinite(scaled) else 0.0
+        values.append(clamp(round_away(scaled) + model["inputZeroPoint"], -128, 127))
+
+    for layer in model["layers"]:
+        multiplier, shift = layer_multiplier(layer)
+        low = max(layer["outputZeroPoint"], -128) if layer["activation"] == "relu" else -128
+        outputs = []
+        for bias, row in zip(layer["bias"], layer["weights"]):
+            accumulator = bias + sum((v - layer["inputZeroPoint"]) * w for v, w in zip(values, row))
+            value = requantize(accumulator, multiplier, shift) + layer["outputZeroPoint"]
+            outputs.append(clamp(value, low, 127))
+        values = outputs
+
+    last = model["layers"][-1]
+    real = [(v - last["outputZeroPoint"]) * f32(last["outputScale"]) for v in values]
+    largest = max(real)
+    exponentials = [math.exp(r - largest) for r in real]
+    total = sum(exponentials)
+    return values, [e / total for e in exponentials]
+
+
+def check(model):
+    labels = model["labels"]
+    layers = model["layers"]
+    if not 0 < len(labels) <= CLASSES_MAX or not 0 < len(layers) <= LAYERS_MAX:
+        sys.exit("1 to %d labels and 1 to %d layers" % (CLASSES_MAX, LAYERS_MAX))
+    if any(len(label.encode()) >= LABEL_LENGTH for label in labels):
+        sys.exit("labels are at most %d bytes" % (LABEL_LENGTH - 1))
+    width = len(model["offset"])
+    if len(model["gain"]) != width:
+        sys.exit("offset and gain differ in length")
+    for index, layer in enumerate(layers):
+        if any(len(row) != width for row in layer["weights"]) or len(layer["bias"]) != len(layer["weights"]):
+            sys.exit("layer %d does not take %d inputs" % (index, width))
+        width = len(layer["weights"])
+    if width != len(labels):
+        sys.exit("the last layer has %d outputs for %d labels" % (width, len(labels)))
+
+
+def pack(model):
+    check(model)
+    inputs = len(model["offset"])
+    body = struct.pack("<%df" % inputs, *model["offset"]) + struct.pack("<%df" % inputs, *model["gain"])
+    for layer in model["layers"]:
+        multiplier, shift = layer_multiplier(layer)
+        outputs = len(layer["weights"])
+        weights = bytes(w & 0xFF for row in layer["weights"] for w in row)
+        weights += bytes(-len(weights) % 4)
+        body += struct.pack("<HHB3xiiiif", inputs, outputs, ACTIVATIONS[layer["activation"]],
+                            layer["inputZeroPoint"], layer["outputZeroPoint"], multiplier, shift,
+                            layer["outputScale"])
+        body += struct.pack("<%di" % outputs, *layer["bias"]) + weights
+        inputs = outputs
+
+    labels = b"".join(label.encode().ljust(LABEL_LENGTH, b"\0") for label in model["labels"])
+    labels = labels.ljust(CLASSES_MAX * LABEL_LENGTH, b"\0")
+    # Everything after the crc field
+    tail = struct.pack("<IBBHi", model["modelId"], len(model["labels"]), len(model["layers"]), 0,
+                       model["inputZeroPoint"]) + labels + body
+    size = 16 + len(tail)
+    return struct.pack("<IHHII", MAGIC, VERSION, len(model["offset"]), size, zlib.crc32(tail)) + tail
+
+
+def demo_model():
+    """A model of the right shape with seeded weights, to exercise the stage, not to classify."""
+    generator = random.Random(47)
+    sizes = [INPUTS, 16, 12, 5]
+    input_scale = 1 / 16
+    model = {
+        "modelId": 1,
+        "labels": ["normal", "imbalance", "misalignment", "looseness", "bearing"],
+        "inputZeroPoint": -1,
+        # Bands about -60 dB +-15 dB, velocity 2 +-2 mm/s, displacement 10 +-10 um, to z scores
+        "offset": [-60.0] * 16 + [2.0, 10.0],
+        "gain": [1 / (15 * input_scale)] * 16 + [1 / (2 * input_scale), 1 / (10 * input_scale)],
+        "layers": [],
+    }
+    zero_point = model["inputZeroPoint"]
+    for index in range(len(sizes) - 1):
+        last = index == len(sizes) - 2
+        weight_scale = 1 / (64 * math.sqrt(sizes[index]))
+        output_scale = 0.1 if last else 0.05
+        output_zero_point = 0 if last else -128
+        model["layers"].append({
+            "activation": "none" if last else "relu",
+            "inputZeroPoint": zero_point,
+            "outputZeroPoint": output_zero_point,
+            "scale": input_scale * weight_scale / output_scale,
+            "outputScale": output_scale,
+            "bias": [generator.randint(-2000, 2000) for _ in range(sizes[index + 1])],
+            "weights": [[generator.randint(-127, 127) for _ in range(sizes[index])]
+                        for _ in range(sizes[index + 1])],
+        })
+        input_scale = output_scale
+        zero_point = output_zero_point
+    return model
+
+
+def golden(model, path, vectors):
+    generator = random.Random(470)
+    inputs = len(model["offset"])
+    with open(path, "w") as out:
+        out.write("# %d features, %d int8 logits, %d probabilities of fault model %d\n" %
+                  (inputs, len(model["labels"]), len(model["labels"]), model["modelId"]))
+        for index in range(vectors):
+            # Spread over a few steps of 16 input counts, the standard deviation of the demo model
+            features = [f32(offset + generator.gauss(0, 1.5) * 16 / gain)
+                        for offset, gain in zip(model["offset"], model["gain"])]
+            if index == 0:
+                # Saturated and missing inputs
+                features[0] = 1e9
+                features[1] = float("nan")
+            logits, probabilities = run(model, features)
+            out.write(",".join(["%.9g" % f for f in features] + ["%d" % l for l in logits] +
+                               ["%.7f" % p for p in probabilities]) + "\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("model", help="model JSON")
+    parser.add_argument("blob", nargs="?", help="blob to write")
+    parser.add_argument("--demo", action="store_true", help="write a demo model JSON instead of reading it")
+    parser.add_argument("--golden", help="CSV of golden outputs to write")
+    parser.add_argument("--vectors", type=int, default=64, help="feature vectors of the golden CSV")
+    args = parser.parse_args()
+
+    if args.demo:
+        with open(args.model, "w") as out:
+            json.dump(demo_model(), out, indent=1)
+            out.write("\n")
+    with open(args.model) as source:
+        model = json.load(source)
+    if args.blob:
+        blob = pack(model)
+        with open(args.blob, "wb") as out:
+            out.write(blob)
+        print("%s: model %d, %d bytes" % (args.blob, model["modelId"], len(blob)))
+    if args.golden:
+        golden(model, args.golden, args.vectors)
+
+
+if __name__ == "__main__":
+    main()